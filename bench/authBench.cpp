@@ -0,0 +1,179 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   authBench.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/23 16:05:12 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/23 16:05:12 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+SASL password checks. One key derivation at the default iteration count is
+what a login costs without the cache; the reconnect storm is every account
+logging in kLoginsPerAccount times, as after a netsplit, with and without
+the cache. check() is what the event loop itself spends per login.
+
+The checks at the start verify PBKDF2-HMAC-SHA256 against RFC 7914's test
+vector and that wrong passwords and unknown accounts are refused.
+*/
+
+#include "benchUtils.hpp"
+#include "server/auth/authenticator.hpp"
+#include "server/auth/sha256.hpp"
+#include "utils/server_utils.hpp"
+#include <poll.h>
+#include <vector>
+#include <fstream>
+
+static const size_t kAccounts = 100;
+static const size_t kLoginsPerAccount = 5;
+static const unsigned int kStormIterations = 1000;
+static const size_t kThreads = 2;
+
+static bool check(bool condition, const char* what) {
+    if (!condition) {
+        std::printf("FAIL: %s\n", what);
+    }
+    return condition;
+}
+
+static std::string toHex(const std::string& bytes) {
+    std::string hex;
+    char digits[3];
+    for (size_t i = 0; i < bytes.length(); ++i) {
+        std::snprintf(digits, sizeof(digits), "%02x", static_cast<unsigned char>(bytes[i]));
+        hex += digits;
+    }
+    return hex;
+}
+
+static std::string passwordOf(size_t i) {
+    return "correct horse " + to_string(i);
+}
+
+// Waits for count answers; returns how many were accepted, or -1 on a timeout
+static long collect(Authenticator& authenticator, size_t count) {
+    long accepted = 0;
+    std::vector<Authenticator::Result> results;
+    while (results.size() < count) {
+        pollfd wake = { authenticator.getWakeFd(), POLLIN, 0 };
+        if (poll(&wake, 1, 30000) != 1) {
+            return -1;
+        }
+        authenticator.takeResults(results);
+    }
+    for (size_t i = 0; i < results.size(); ++i) {
+        accepted += results[i].accepted ? 1 : 0;
+    }
+    return accepted;
+}
+
+static bool checkVerdicts(const std::string& path) {
+    bool ok = check(toHex(Sha256::pbkdf2("passwd", "salt", 1, 64)).compare(0, 32, "55ac046e56e3089fec1691c22544b605") == 0,
+                    "PBKDF2-HMAC-SHA256 test vector");
+    Authenticator authenticator(path, kThreads, 16);
+    ok &= check(authenticator.check(1, 1, "user0", passwordOf(0)) == Authenticator::PENDING, "first login is checked");
+    ok &= check(authenticator.check(2, 2, "user0", "wrong") == Authenticator::PENDING, "wrong password is checked");
+    ok &= check(authenticator.check(3, 3, "nobody", "x") == Authenticator::PENDING, "unknown account is checked");
+    std::vector<Authenticator::Result> results;
+    while (results.size() < 3) {
+        pollfd wake = { authenticator.getWakeFd(), POLLIN, 0 };
+        poll(&wake, 1, 30000);
+        authenticator.takeResults(results);
+    }
+    for (size_t i = 0; i < results.size(); ++i) {
+        ok &= check(results[i].accepted == (results[i].fd == 1), "verdict of a checked login");
+    }
+    ok &= check(authenticator.check(4, 4, "user0", passwordOf(0)) == Authenticator::ACCEPTED, "second login is cached");
+    ok &= check(authenticator.check(5, 5, "user0", "wrong") == Authenticator::PENDING, "cache does not accept a wrong password");
+    authenticator.waitIdle();
+    return ok;
+}
+
+static bool storm(const std::string& path, size_t cacheEntries) {
+    Authenticator authenticator(path, kThreads, cacheEntries);
+    long long start = benchNowNs();
+    size_t pending = 0;
+    size_t immediate = 0;
+    long accepted = 0;
+    for (size_t round = 0; round < kLoginsPerAccount; ++round) {
+        for (size_t i = 0; i < kAccounts; ++i) {
+            Authenticator::Outcome outcome = authenticator.check(static_cast<int>(i), round * kAccounts + i + 1,
+                                                                 "user" + to_string(i), passwordOf(i));
+            if (outcome == Authenticator::PENDING) {
+                ++pending;
+            } else if (outcome == Authenticator::ACCEPTED) {
+                ++immediate;
+            }
+        }
+        // Each round waits for the previous one, as clients reconnect after their answer
+        long collected = collect(authenticator, pending);
+        if (collected < 0) {
+            return check(false, "storm timed out");
+        }
+        accepted += collected;
+        pending = 0;
+    }
+    long long elapsed = benchNowNs() - start;
+    std::printf("%-48s %12.2f ms %6lu derivations %6lu cached\n",
+                cacheEntries ? "reconnect storm, cache on" : "reconnect storm, cache off", elapsed / 1e6,
+                static_cast<unsigned long>(kAccounts * kLoginsPerAccount - immediate),
+                static_cast<unsigned long>(immediate));
+    return check(accepted + static_cast<long>(immediate) == static_cast<long>(kAccounts * kLoginsPerAccount),
+                 "every storm login accepted");
+}
+
+struct CachedCheck {
+    Authenticator& authenticator;
+    bool ok;
+    explicit CachedCheck(Authenticator& authenticator) : authenticator(authenticator), ok(true) {}
+    void operator()() { ok &= authenticator.check(1, 1, "user0", passwordOf(0)) == Authenticator::ACCEPTED; }
+};
+
+int main() {
+    NullBuffer nullBuffer;
+    std::streambuf* original = std::cout.rdbuf(&nullBuffer);
+    char path[] = "/tmp/authBench.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        std::cout.rdbuf(original);
+        std::printf("FAIL: cannot create the accounts file\n");
+        return 1;
+    }
+    close(fd);
+    {
+        std::ofstream file(path);
+        for (size_t i = 0; i < kAccounts; ++i) {
+            file << AccountStore::makeEntry("user" + to_string(i), passwordOf(i), kStormIterations) << "\n";
+        }
+    }
+
+    std::printf("authBench (%lu accounts, %lu threads, storms at %u iterations)\n",
+                static_cast<unsigned long>(kAccounts), static_cast<unsigned long>(kThreads), kStormIterations);
+    bool ok = checkVerdicts(path);
+    if (ok) {
+        AccountStore::Account account;
+        account.iterations = AccountStore::kDefaultIterations;
+        account.salt = AccountStore::randomBytes(AccountStore::kSaltSize);
+        account.key = std::string(AccountStore::kKeySize, '\0');
+        long long start = benchNowNs();
+        AccountStore::verify(account, "password");
+        std::printf("%-48s %12.2f ms\n", "key derivation, default iterations", (benchNowNs() - start) / 1e6);
+        ok = storm(path, 4096) && storm(path, 0);
+    }
+    if (ok) {
+        Authenticator authenticator(path, kThreads, 16);
+        authenticator.check(1, 1, "user0", passwordOf(0));
+        ok = collect(authenticator, 1) == 1;
+        CachedCheck cached(authenticator);
+        BenchStats stats = benchRun(cached, 20000);
+        benchReport("check(), cached login", stats);
+        ok &= check(cached.ok, "cached check verdicts");
+    }
+    unlink(path);
+    std::cout.rdbuf(original);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   benchUtils.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/08 10:02:31 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/08 10:02:31 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef BENCHUTILS_HPP
+#define BENCHUTILS_HPP
+
+/*
+Shared helpers for the programs in bench/. Each benchmark is a single
+translation unit, so this header also replaces the global operator new to
+count heap allocations: include it from exactly one file per executable.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <ctime>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <iostream>
+#include <streambuf>
+
+static unsigned long g_allocations = 0;
+
+void* operator new(std::size_t size) throw(std::bad_alloc) {
+    ++g_allocations;
+    void* ptr = std::malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) throw() {
+    std::free(ptr);
+}
+
+static inline long long benchNowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<long long>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+struct BenchStats {
+    double nsPerOp;
+    double allocsPerOp;
+};
+
+// Runs op() iterations times and reports the average cost per call
+template <typename Op>
+static BenchStats benchRun(Op& op, unsigned long iterations) {
+    for (unsigned long i = 0; i < iterations / 10 + 1; ++i) {
+        op();
+    }
+    unsigned long allocsBefore = g_allocations;
+    long long start = benchNowNs();
+    for (unsigned long i = 0; i < iterations; ++i) {
+        op();
+    }
+    long long elapsed = benchNowNs() - start;
+    BenchStats stats;
+    stats.nsPerOp = static_cast<double>(elapsed) / iterations;
+    stats.allocsPerOp = static_cast<double>(g_allocations - allocsBefore) / iterations;
+    return stats;
+}
+
+static inline void benchReport(const std::string& name, const BenchStats& stats) {
+    std::printf("%-48s %12.1f ns/op %10.2f allocs/op\n", name.c_str(), stats.nsPerOp, stats.allocsPerOp);
+}
+
+// Socket stand-in for a client connection: the server end is returned in
+// serverFd, the test keeps peerFd to read what the server sent.
+static inline bool benchSocketPair(int& serverFd, int& peerFd) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        return false;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    serverFd = fds[0];
+    peerFd = fds[1];
+    return true;
+}
+
+static inline void benchDrain(int fd) {
+    char buffer[65536];
+    while (read(fd, buffer, sizeof(buffer)) > 0) {
+    }
+}
+
+// Swallows std::cout so log lines do not dominate the measurements
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) { return n; }
+};
+
+#endif // BENCHUTILS_HPP
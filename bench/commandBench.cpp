@@ -0,0 +1,161 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   commandBench.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/15 09:41:07 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/15 09:41:07 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+Cost of the command path without the network: CommandParser::parse over a
+corpus of client lines, executeCommand dispatch for a verb matched first
+(PING), one in the middle of the chain (WHO) and one that falls through to
+421, and reply construction in sendReply compared with sending the same
+bytes already formatted.
+*/
+
+#include "benchUtils.hpp"
+#include "server/server.hpp"
+#include "server/command/commandParser.hpp"
+#include "server/command/commandExecutor.hpp"
+
+static const unsigned long kIterations = 200000;
+
+static const char* const kCorpus[] = {
+    "PASS secret",
+    "NICK alice",
+    "USER alice 0 * :Alice Liddell",
+    "CAP LS 302",
+    "JOIN #bench",
+    "JOIN #ops,#dev key1,key2",
+    "PRIVMSG #bench :hello everybody, how is the build going today?",
+    "PRIVMSG bob :did you see the last benchmark numbers?",
+    ":alice!alice@127.0.0.1 PRIVMSG #bench :relayed line with a prefix",
+    "NOTICE #bench :the server restarts in five minutes",
+    "MODE #bench +itk secret",
+    "MODE #bench +o bob",
+    "TOPIC #bench :Weekly performance review",
+    "KICK #bench bob :flooding",
+    "INVITE carol #bench",
+    "WHO #bench",
+    "PING ft_irc.com",
+    "CHATHISTORY LATEST #bench * 50",
+};
+static const size_t kCorpusSize = sizeof(kCorpus) / sizeof(kCorpus[0]);
+
+struct ParseOp {
+    std::vector<std::string> lines;
+    size_t next;
+    void operator()() {
+        Command cmd = CommandParser::parse(lines[next]);
+        (void)cmd;
+        next = (next + 1) % lines.size();
+    }
+};
+
+struct DispatchOp {
+    CommandExecutor* executor;
+    Command cmd;
+    int clientFd;
+    int peerFd;
+    unsigned long calls;
+    void operator()() {
+        executor->executeCommand(clientFd, cmd);
+        if (++calls % 64 == 0) {
+            benchDrain(peerFd);
+        }
+    }
+};
+
+struct SendOp {
+    Server* server;
+    std::string reply;
+    int clientFd;
+    int peerFd;
+    unsigned long calls;
+    void operator()() {
+        server->sendToClient(clientFd, reply);
+        if (++calls % 64 == 0) {
+            benchDrain(peerFd);
+        }
+    }
+};
+
+static int registerClient(Server& server, const std::string& nick, int& peerFd) {
+    int serverFd;
+    if (!benchSocketPair(serverFd, peerFd)) {
+        std::perror("socketpair");
+        std::exit(1);
+    }
+    server.addClient(serverFd, "127.0.0.1");
+    server.processLine(serverFd, "PASS bench");
+    server.processLine(serverFd, "NICK " + nick);
+    server.processLine(serverFd, "USER " + nick + " 0 * :" + nick);
+    server.processLine(serverFd, "JOIN #bench");
+    benchDrain(peerFd);
+    return serverFd;
+}
+
+static DispatchOp makeDispatch(CommandExecutor& executor, const std::string& line, int clientFd, int peerFd) {
+    DispatchOp op;
+    op.executor = &executor;
+    op.cmd = CommandParser::parse(line);
+    op.clientFd = clientFd;
+    op.peerFd = peerFd;
+    op.calls = 0;
+    return op;
+}
+
+int main() {
+    NullBuffer nullBuffer;
+    std::streambuf* original = std::cout.rdbuf(&nullBuffer);
+    Logger::setLogLevel(Logger::ERROR);
+
+    Server server(0, "bench");
+    int alicePeer;
+    int alice = registerClient(server, "alice", alicePeer);
+    CommandExecutor executor(server);
+
+    ParseOp parse;
+    parse.lines.assign(kCorpus, kCorpus + kCorpusSize);
+    parse.next = 0;
+    ParseOp parseMessage;
+    parseMessage.lines.push_back(kCorpus[6]);
+    parseMessage.next = 0;
+
+    DispatchOp ping = makeDispatch(executor, "PING ft_irc.com", alice, alicePeer);
+    DispatchOp who = makeDispatch(executor, "WHO #bench", alice, alicePeer);
+    DispatchOp unknown = makeDispatch(executor, "FOOBAR", alice, alicePeer);
+
+    // PING replies ":ft_irc.com PONG ft_irc.com"; sendToClient gets the finished line
+    SendOp send;
+    send.server = &server;
+    send.reply = ":ft_irc.com PONG ft_irc.com\r\n";
+    send.clientFd = alice;
+    send.peerFd = alicePeer;
+    send.calls = 0;
+
+    BenchStats stats[6];
+    stats[0] = benchRun(parse, kIterations);
+    stats[1] = benchRun(parseMessage, kIterations);
+    stats[2] = benchRun(ping, kIterations);
+    stats[3] = benchRun(who, kIterations);
+    stats[4] = benchRun(unknown, kIterations);
+    stats[5] = benchRun(send, kIterations);
+    std::cout.rdbuf(original);
+
+    std::printf("commandBench\n");
+    benchReport("parse corpus (" + to_string(kCorpusSize) + " lines, mean)", stats[0]);
+    benchReport("parse PRIVMSG #channel", stats[1]);
+    benchReport("executeCommand PING (sendReply)", stats[2]);
+    benchReport("executeCommand WHO #bench, 1 member", stats[3]);
+    benchReport("executeCommand unknown verb (421)", stats[4]);
+    benchReport("sendToClient preformatted PONG", stats[5]);
+    std::printf("sendReply formatting and dispatch over a raw send: %.1f ns, %.2f allocs\n",
+                stats[2].nsPerOp - stats[5].nsPerOp, stats[2].allocsPerOp - stats[5].allocsPerOp);
+    return 0;
+}
@@ -0,0 +1,162 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   fanoutBench.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/24 20:31:52 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/24 20:31:52 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+A PRIVMSG to a channel of kMembers users, each on a socket pair, with 0
+(inline), 1, 2 and 4 fan-out workers. Reported per broadcast: how long the
+event loop was busy with it, and the time until the last member could read
+the line, which this thread checks by reading every member's socket.
+
+Then, with a backlog of kBacklog broadcasts queued on the workers, a member
+leaves the channel and QUITs, so the QUIT reaches nobody: the loop must not
+wait for the backlog, which still points at the member, and the member's
+fd must be closed once the workers are done with it.
+*/
+
+#include "benchUtils.hpp"
+#include "server/server.hpp"
+#include <cerrno>
+
+static const size_t kMembers = 4000;
+static const size_t kBroadcasts = 50;
+static const size_t kBacklog = 20;
+static const size_t kThreads[] = { 0, 1, 2, 4 };
+static const size_t kThreadCounts = sizeof(kThreads) / sizeof(kThreads[0]);
+
+static Client* addUser(Server& server, int fd, const std::string& nick) {
+    Client* client = server.addClient(fd, "127.0.0.1");
+    client->setPassword(true);
+    server.setNickname(client, nick);
+    client->setUsername(nick);
+    client->setRealname(nick);
+    client->setUser(true);
+    return client;
+}
+
+// Reads every peer until each got lines lines; returns false on timeout
+static bool awaitLines(Server& server, const std::vector<int>& peers, size_t lines) {
+    std::vector<size_t> received(peers.size(), 0);
+    size_t done = 0;
+    char buffer[4096];
+    long long start = benchNowNs();
+    while (done < peers.size()) {
+        if (benchNowNs() - start > 10000000000LL) {
+            return false;
+        }
+        for (size_t i = 0; i < peers.size(); ++i) {
+            if (received[i] >= lines) {
+                continue;
+            }
+            ssize_t count;
+            while ((count = read(peers[i], buffer, sizeof(buffer))) > 0) {
+                for (ssize_t j = 0; j < count; ++j) {
+                    received[i] += buffer[j] == '\n';
+                }
+            }
+            done += received[i] >= lines;
+        }
+        server.runOnce(0);
+    }
+    return true;
+}
+
+static bool measure(size_t threads) {
+    ServerConfig config;
+    config.parseOption("--fanout-threads=" + to_string(threads));
+    config.parseOption("--fanout-threshold=1");
+    Server server(0, "bench", config);
+    Channel* channel = server.createChannel("#big");
+    std::vector<int> peers;
+    std::vector<Client*> members;
+    for (size_t i = 0; i < kMembers + 1; ++i) {
+        int serverFd;
+        int peerFd;
+        if (!benchSocketPair(serverFd, peerFd)) {
+            std::perror("socketpair");
+            std::exit(1);
+        }
+        Client* client = addUser(server, serverFd, "user" + to_string(i));
+        channel->addMemberUnchecked(client);
+        client->addChannel("#big");
+        peers.push_back(peerFd);
+        members.push_back(client);
+    }
+    int senderFd = members[0]->getFd();
+    std::vector<int> receivers(peers.begin() + 1, peers.end());
+
+    long long loopNs = 0;
+    long long lastNs = 0;
+    for (size_t i = 0; i < kBroadcasts; ++i) {
+        long long start = benchNowNs();
+        server.processLine(senderFd, "PRIVMSG #big :announcement");
+        loopNs += benchNowNs() - start;
+        if (!awaitLines(server, receivers, 1)) {
+            std::printf("FAIL: %lu workers: a member never got the broadcast\n", static_cast<unsigned long>(threads));
+            return false;
+        }
+        lastNs += benchNowNs() - start;
+    }
+
+    bool ok = true;
+    double quitUs = 0;
+    if (threads > 0) {
+        for (size_t i = 0; i < kBacklog; ++i) {
+            server.processLine(senderFd, "PRIVMSG #big :backlog");
+        }
+        int leaving = members[kMembers]->getFd();
+        server.processLine(leaving, "PART #big");
+        long long start = benchNowNs();
+        server.processLine(leaving, "QUIT :bye");
+        quitUs = (benchNowNs() - start) / 1e3;
+        receivers.pop_back();
+        start = benchNowNs();
+        while (fcntl(leaving, F_GETFD) != -1 && benchNowNs() - start < 10000000000LL) {
+            server.runOnce(10);
+            for (size_t i = 0; i < receivers.size(); ++i) {
+                benchDrain(receivers[i]);
+            }
+        }
+        if (fcntl(leaving, F_GETFD) != -1 || errno != EBADF) {
+            std::printf("FAIL: %lu workers: the fd of the member that quit was never closed\n",
+                        static_cast<unsigned long>(threads));
+            ok = false;
+        }
+    }
+    std::printf("%lu workers %14.1f us loop busy %14.1f us to last member %12.1f us QUIT with %lu queued\n",
+                static_cast<unsigned long>(threads), loopNs / 1e3 / kBroadcasts, lastNs / 1e3 / kBroadcasts, quitUs,
+                static_cast<unsigned long>(threads ? kBacklog : 0));
+    // The server does not close its clients' sockets when it is destroyed
+    for (size_t i = 0; i < kMembers; ++i) {
+        close(members[i]->getFd());
+    }
+    for (size_t i = 0; i < peers.size(); ++i) {
+        close(peers[i]);
+    }
+    return ok;
+}
+
+int main() {
+    NullBuffer nullBuffer;
+    std::streambuf* original = std::cout.rdbuf(&nullBuffer);
+    Logger::setLogLevel(Logger::ERROR);
+
+    std::printf("fanoutBench (PRIVMSG to %lu members, %ld cores online)\n", static_cast<unsigned long>(kMembers),
+                sysconf(_SC_NPROCESSORS_ONLN));
+    std::fflush(stdout);
+    bool ok = true;
+    for (size_t i = 0; i < kThreadCounts; ++i) {
+        ok &= measure(kThreads[i]);
+        std::fflush(stdout);
+    }
+    std::cout.rdbuf(original);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,94 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   idleBench.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/17 09:12:35 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/17 09:12:35 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+Resident memory per idle connection at 1k, 10k and 100k registered clients.
+Each client has been through one long line delivered in two reads, as an
+active bouncer would, before going idle. Every size runs in its own forked
+process so the allocator starts clean.
+
+The file descriptor limit does not allow 100k socket pairs, so clients get
+placeholder descriptors and their replies fail to send; registration state
+is set directly because NICK checks nicknames with a linear scan.
+*/
+
+#include "benchUtils.hpp"
+#include "server/server.hpp"
+#include <sys/wait.h>
+
+static const int kFirstFakeFd = 1000000;
+static const size_t kSizes[] = { 1000, 10000, 100000 };
+
+static long residentBytes() {
+    long pages = 0;
+    long resident = 0;
+    FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (!statm) {
+        return 0;
+    }
+    if (std::fscanf(statm, "%ld %ld", &pages, &resident) != 2) {
+        resident = 0;
+    }
+    std::fclose(statm);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static void measure(size_t count) {
+    NullBuffer nullBuffer;
+    std::cout.rdbuf(&nullBuffer);
+    Logger::setLogLevel(Logger::ERROR);
+
+    Server server(0, "bench");
+    std::string head = "PING :" + std::string(200, 'a');
+    std::string tail = std::string(200, 'b') + "\r\n";
+    long before = residentBytes();
+    for (size_t i = 0; i < count; ++i) {
+        int fd = kFirstFakeFd + static_cast<int>(i);
+        Client* client = server.addClient(fd, "127.0.0.1");
+        std::string nick = "idle" + to_string(i);
+        client->setPassword(true);
+        server.setNickname(client, nick);
+        client->setUsername(nick);
+        client->setRealname("Idle bouncer " + nick);
+        client->setUser(true);
+        server.handleInput(fd, head.data(), head.length());
+        server.handleInput(fd, tail.data(), tail.length());
+    }
+    long after = residentBytes();
+    if (InputBuffer::getBorrowedBlocks() != 0) {
+        std::printf("FAIL: idle clients still hold %lu receive blocks\n", static_cast<unsigned long>(InputBuffer::getBorrowedBlocks()));
+        std::fflush(stdout);
+        _exit(1);
+    }
+
+    std::printf("%-8lu idle clients %12.1f MiB RSS %10.1f bytes/connection\n", static_cast<unsigned long>(count),
+                (after - before) / (1024.0 * 1024.0), static_cast<double>(after - before) / count);
+}
+
+int main() {
+    std::printf("idleBench (sizeof Client %lu)\n", static_cast<unsigned long>(sizeof(Client)));
+    std::fflush(stdout);
+    for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            measure(kSizes[i]);
+            std::fflush(stdout);
+            _exit(0);
+        }
+        int status = 0;
+        if (pid == -1 || waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            std::printf("FAIL: measurement for %lu clients did not complete\n", static_cast<unsigned long>(kSizes[i]));
+            return 1;
+        }
+    }
+    return 0;
+}
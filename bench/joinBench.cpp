@@ -0,0 +1,145 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   joinBench.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/24 17:02:51 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/24 17:02:51 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+A client autojoining kChannels channels of kResidents users each and leaving
+them again: as one JOIN and one PART per channel, and as one JOIN and one
+PART listing every channel. The client's socket is a SOCK_SEQPACKET pair, so
+each record it reads is one write() of the server. Reported: the cost of a
+join and part cycle and the writes it took.
+
+Both forms must send the client the same bytes, and the listed form must
+take one write per command.
+*/
+
+#include "benchUtils.hpp"
+#include "server/server.hpp"
+
+static const size_t kChannels = 30;
+static const size_t kResidents = 20;
+static const unsigned long kIterations = 500;
+
+struct AutojoinOp {
+    Server* server;
+    int clientFd;
+    int peerFd;
+    std::vector<std::string> lines;
+    const std::vector<int>* residents;
+    unsigned long calls;
+    unsigned long writes;
+    unsigned long bytes;
+    std::string firstCycle;     // What the client read in the first cycle
+    void operator()() {
+        for (size_t i = 0; i < lines.size(); ++i) {
+            server->processLine(clientFd, lines[i]);
+        }
+        char buffer[65536];
+        ssize_t count;
+        while ((count = recv(peerFd, buffer, sizeof(buffer), 0)) > 0) {
+            if (calls == 0) {
+                firstCycle.append(buffer, count);
+            }
+            ++writes;
+            bytes += count;
+        }
+        if (++calls % 16 == 0) {
+            for (size_t i = 0; i < residents->size(); ++i) {
+                benchDrain((*residents)[i]);
+            }
+        }
+    }
+};
+
+static std::string channelName(size_t i) {
+    return "#auto" + to_string(i);
+}
+
+static Client* addUser(Server& server, const std::string& nick, int serverFd) {
+    Client* client = server.addClient(serverFd, "127.0.0.1");
+    client->setPassword(true);
+    server.setNickname(client, nick);
+    client->setUsername(nick);
+    client->setRealname(nick);
+    client->setUser(true);
+    return client;
+}
+
+static bool measure(const std::string& label, AutojoinOp& op, unsigned long expectedWrites) {
+    BenchStats stats = benchRun(op, kIterations);
+    double writes = static_cast<double>(op.writes) / op.calls;
+    std::printf("%-48s %12.1f ns/cycle %8.1f writes/cycle %8.2f allocs/cycle\n", label.c_str(), stats.nsPerOp, writes,
+                stats.allocsPerOp);
+    if (expectedWrites && op.writes != expectedWrites * op.calls) {
+        std::printf("FAIL: %s took %.1f writes per cycle instead of %lu\n", label.c_str(), writes, expectedWrites);
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    NullBuffer nullBuffer;
+    std::streambuf* original = std::cout.rdbuf(&nullBuffer);
+    Logger::setLogLevel(Logger::ERROR);
+
+    Server server(0, "bench");
+    std::vector<int> residents;
+    for (size_t i = 0; i < kChannels * kResidents; ++i) {
+        int serverFd;
+        int peerFd;
+        if (!benchSocketPair(serverFd, peerFd)) {
+            std::perror("socketpair");
+            return 1;
+        }
+        residents.push_back(peerFd);
+        Client* resident = addUser(server, "resident" + to_string(i), serverFd);
+        std::string name = channelName(i / kResidents);
+        Channel* channel = server.getChannel(name);
+        if (!channel) {
+            channel = server.createChannel(name);
+        }
+        channel->addMemberUnchecked(resident);
+        resident->addChannel(name);
+    }
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == -1) {
+        std::perror("socketpair");
+        return 1;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    Client* client = addUser(server, "autojoin", fds[0]);
+
+    AutojoinOp perChannel = { &server, client->getFd(), fds[1], std::vector<std::string>(), &residents, 0, 0, 0, "" };
+    std::string list;
+    for (size_t i = 0; i < kChannels; ++i) {
+        perChannel.lines.push_back("JOIN " + channelName(i));
+        list += (i ? "," : "") + channelName(i);
+    }
+    for (size_t i = 0; i < kChannels; ++i) {
+        perChannel.lines.push_back("PART " + channelName(i));
+    }
+    std::vector<std::string> listLines;
+    listLines.push_back("JOIN " + list);
+    listLines.push_back("PART " + list);
+    AutojoinOp listed = { &server, client->getFd(), fds[1], listLines, &residents, 0, 0, 0, "" };
+
+    std::printf("joinBench (%lu channels with %lu users, join and part cycles)\n", static_cast<unsigned long>(kChannels),
+                static_cast<unsigned long>(kResidents));
+    bool ok = measure("one JOIN and one PART per channel", perChannel, 0);
+    ok &= measure("one JOIN and one PART, " + to_string(kChannels) + " channels each", listed, 2);
+    if (perChannel.firstCycle != listed.firstCycle || perChannel.bytes / perChannel.calls != listed.bytes / listed.calls) {
+        std::printf("FAIL: the listed JOIN and PART sent different replies\n");
+        ok = false;
+    }
+    std::cout.rdbuf(original);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   limiterBench.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/22 14:40:08 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/22 14:40:08 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+Cost of the connection limits on the accept path. The trie already holds
+one connection from each of N addresses spread over many /24 networks; an
+operation admits and releases one more address, as a short-lived client
+does. The flood cases are one address connecting over and over after its
+limit is reached, which is the case the limits exist for.
+
+Once the arena has grown to fit, none of this may allocate. The checks at
+the start cover the verdicts and that released addresses give their nodes
+back.
+*/
+
+#include "benchUtils.hpp"
+#include "server/limits/connectionLimiter.hpp"
+
+static const size_t kSizes[] = { 1000, 100000 };
+static const unsigned long kIterations = 1000000;
+
+// Spreads i over the 10.0.0.0/8 range, 200 addresses per /24
+static unsigned int addressOf(size_t i) {
+    return (10u << 24) | (static_cast<unsigned int>(i / 200) << 8) | static_cast<unsigned int>(i % 200 + 1);
+}
+
+static unsigned int parse(const char* text) {
+    unsigned int prefix = 0;
+    unsigned int length = 0;
+    ConnectionLimiter::parseNetwork(text, prefix, length);
+    return prefix;
+}
+
+static bool check(bool condition, const char* what) {
+    if (!condition) {
+        std::printf("FAIL: %s\n", what);
+    }
+    return condition;
+}
+
+static bool checkVerdicts() {
+    bool ok = true;
+    time_t now = 1000;
+    unsigned int prefix;
+    unsigned int length;
+    ok &= check(ConnectionLimiter::parseNetwork("192.168.0.0/16", prefix, length) && length == 16, "parse a network");
+    ok &= check(!ConnectionLimiter::parseNetwork("192.168.0.1/16", prefix, length), "reject host bits past the prefix");
+    ok &= check(!ConnectionLimiter::parseNetwork("192.168.0.0/33", prefix, length), "reject a prefix over 32");
+
+    ConnectionLimiter limiter(2, 3, 24, 0);
+    size_t baseline = limiter.getNodeCount();
+    unsigned int a = parse("192.0.2.1");
+    unsigned int b = parse("192.0.2.2");
+    unsigned int other = parse("198.51.100.7");
+    ok &= check(limiter.admit(a, now) == ConnectionLimiter::ADMITTED, "first connection admitted");
+    ok &= check(limiter.admit(a, now) == ConnectionLimiter::ADMITTED, "second connection admitted");
+    ok &= check(limiter.admit(a, now) == ConnectionLimiter::TOO_MANY_FROM_ADDRESS, "third connection refused");
+    ok &= check(limiter.admit(b, now) == ConnectionLimiter::ADMITTED, "neighbour admitted");
+    ok &= check(limiter.admit(b, now) == ConnectionLimiter::TOO_MANY_FROM_NETWORK, "fourth in the /24 refused");
+    ok &= check(limiter.admit(other, now) == ConnectionLimiter::ADMITTED, "other network admitted");
+    limiter.release(a, now);
+    ok &= check(limiter.admit(b, now) == ConnectionLimiter::ADMITTED, "admitted again after a release");
+    limiter.release(a, now);
+    limiter.release(b, now);
+    limiter.release(b, now);
+    limiter.release(other, now);
+    ok &= check(limiter.getNodeCount() == baseline, "released addresses give their nodes back");
+
+    ConnectionLimiter rate(0, 0, 24, 3);
+    for (int i = 0; i < 3; ++i) {
+        rate.release(a, now);   // Nothing counted: must not underflow
+        ok &= check(rate.admit(a, now) == ConnectionLimiter::ADMITTED, "connects within the rate admitted");
+        rate.release(a, now);
+    }
+    ok &= check(rate.admit(a, now) == ConnectionLimiter::TOO_FAST, "connect over the rate refused");
+    ok &= check(rate.admit(a, now + ConnectionLimiter::kRateWindowSeconds) == ConnectionLimiter::ADMITTED,
+                "admitted once the window has passed");
+
+    ConnectionLimiter exempt(1, 0, 24, 0);
+    exempt.addExemption(parse("192.0.2.0"), 24);
+    size_t exemptBaseline = exempt.getNodeCount();
+    ok &= check(exempt.admit(a, now) == ConnectionLimiter::ADMITTED
+                && exempt.admit(a, now) == ConnectionLimiter::ADMITTED, "exempt network not limited");
+    ok &= check(exempt.getNodeCount() == exemptBaseline, "exempt connections not counted");
+    ok &= check(exempt.admit(other, now) == ConnectionLimiter::ADMITTED
+                && exempt.admit(other, now) == ConnectionLimiter::TOO_MANY_FROM_ADDRESS, "others still limited");
+    return ok;
+}
+
+struct AdmitRelease {
+    ConnectionLimiter& limiter;
+    size_t count;
+    size_t next;
+    bool ok;
+    AdmitRelease(ConnectionLimiter& limiter, size_t count) : limiter(limiter), count(count), next(0), ok(true) {}
+    void operator()() {
+        unsigned int address = addressOf(count + next % count);
+        ok &= limiter.admit(address, 1000) == ConnectionLimiter::ADMITTED;
+        limiter.release(address, 1000);
+        ++next;
+    }
+};
+
+struct Flood {
+    ConnectionLimiter& limiter;
+    unsigned int address;
+    ConnectionLimiter::Verdict expected;
+    bool ok;
+    Flood(ConnectionLimiter& limiter, unsigned int address, ConnectionLimiter::Verdict expected)
+        : limiter(limiter), address(address), expected(expected), ok(true) {}
+    void operator()() { ok &= limiter.admit(address, 1000) == expected; }
+};
+
+static bool measure(size_t count) {
+    char name[96];
+    ConnectionLimiter limiter(4, 1000, 24, 0);
+    for (size_t i = 0; i < count; ++i) {
+        limiter.admit(addressOf(i), 1000);
+    }
+    AdmitRelease cycle(limiter, count);
+    BenchStats stats = benchRun(cycle, kIterations);
+    std::snprintf(name, sizeof(name), "admit+release, %lu addresses", static_cast<unsigned long>(count));
+    benchReport(name, stats);
+    bool ok = check(cycle.ok, "admit+release verdicts") && check(stats.allocsPerOp == 0, "admit+release allocates");
+
+    unsigned int flooder = addressOf(0);
+    for (int i = 0; i < 3; ++i) {
+        limiter.admit(flooder, 1000);
+    }
+    Flood flood(limiter, flooder, ConnectionLimiter::TOO_MANY_FROM_ADDRESS);
+    stats = benchRun(flood, kIterations);
+    std::snprintf(name, sizeof(name), "flood over address limit, %lu addresses", static_cast<unsigned long>(count));
+    benchReport(name, stats);
+    ok &= check(flood.ok, "flood verdicts") && check(stats.allocsPerOp == 0, "refusing a connection allocates");
+    std::printf("%-48s %12lu nodes %12lu capacity\n", "", static_cast<unsigned long>(limiter.getNodeCount()),
+                static_cast<unsigned long>(limiter.getCapacity()));
+    return ok;
+}
+
+static bool measureRate() {
+    ConnectionLimiter limiter(0, 0, 24, 10);
+    unsigned int flooder = addressOf(0);
+    for (int i = 0; i < 10; ++i) {
+        limiter.admit(flooder, 1000);
+    }
+    Flood flood(limiter, flooder, ConnectionLimiter::TOO_FAST);
+    BenchStats stats = benchRun(flood, kIterations);
+    benchReport("flood over connect rate", stats);
+    return check(flood.ok, "rate flood verdicts") && check(stats.allocsPerOp == 0, "rate refusal allocates");
+}
+
+int main() {
+    std::printf("limiterBench\n");
+    bool ok = checkVerdicts();
+    for (size_t i = 0; ok && i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+        ok = measure(kSizes[i]);
+    }
+    ok = ok && measureRate();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   linkBench.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/19 14:37:08 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/19 14:37:08 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+Cost of the burst a server sends when a link comes up, with and without
+compression. A forked process runs server A holding 1k or 10k users spread
+over 100 channels with topics and modes; this process starts server B linked
+to A and runs its loop until every user, membership and topic arrived.
+Reported: wall time, bytes on the wire and as plain text, and CPU time of
+both processes during the burst.
+
+A's users are never written to. They share one socket, duplicated once per
+user, so they are valid descriptors that poll() never reports.
+*/
+
+#include "benchUtils.hpp"
+#include "server/server.hpp"
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <signal.h>
+
+static const size_t kSizes[] = { 1000, 10000 };
+static const size_t kChannels = 100;
+static const int kFirstPort = 16660;
+
+static double processCpuMs(pid_t pid) {
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(pid));
+    FILE* stat = std::fopen(path, "r");
+    if (!stat) {
+        return 0;
+    }
+    unsigned long user = 0;
+    unsigned long system = 0;
+    // Fields 14 and 15; the command name in field 2 has no spaces here
+    if (std::fscanf(stat, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &user, &system) != 2) {
+        user = system = 0;
+    }
+    std::fclose(stat);
+    return (user + system) * 1000.0 / sysconf(_SC_CLK_TCK);
+}
+
+static double selfCpuMs() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0
+           + usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+}
+
+static ServerConfig configFor(const std::string& name, bool compression) {
+    ServerConfig config;
+    config.parseOption("--server-name=" + name);
+    config.parseOption("--link-password=bench");
+    config.parseOption(compression ? "--link-compression=on" : "--link-compression=off");
+    return config;
+}
+
+// Server A: populated, then serving the link until killed
+static void runPopulated(int port, size_t users, bool compression, int readyFd) {
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    Server server(port, "bench", configFor("a.bench", compression));
+    int quiet[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, quiet) == -1) {
+        _exit(1);
+    }
+    for (size_t i = 0; i < users; ++i) {
+        int fd = dup(quiet[0]);
+        if (fd == -1) {
+            std::fprintf(stderr, "linkBench: out of descriptors at %lu users\n", static_cast<unsigned long>(i));
+            _exit(1);
+        }
+        Client* client = server.addClient(fd, "10.0.0." + to_string(i % 250));
+        std::string nick = "user" + to_string(i);
+        client->setPassword(true);
+        server.setNickname(client, nick);
+        client->setUsername("u" + to_string(i));
+        client->setRealname("Benchmark user " + nick);
+        client->setUser(true);
+
+        std::string name = "#channel" + to_string(i % kChannels);
+        Channel* channel = server.getChannel(name);
+        if (!channel) {
+            channel = server.createChannel(name);
+            channel->addOperator(client);
+            channel->setTopic("Topic of " + name + ", set for the link benchmark");
+            channel->setTopicRestricted(true);
+        }
+        channel->addMemberUnchecked(client);
+        client->addChannel(name);
+    }
+    char ready = 1;
+    if (write(readyFd, &ready, 1) != 1) {
+        _exit(1);
+    }
+    close(readyFd);
+    server.run();
+}
+
+static size_t countMemberships(Server& server) {
+    size_t members = 0;
+    const std::map<std::string, Channel*>& channels = server.getChannels();
+    for (std::map<std::string, Channel*>::const_iterator it = channels.begin(); it != channels.end(); ++it) {
+        if (!it->second->getTopic().empty()) {
+            members += it->second->getMembers().size();
+        }
+    }
+    return members;
+}
+
+static bool measure(size_t users, bool compression, int port) {
+    int ready[2];
+    if (pipe(ready) == -1) {
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(ready[0]);
+        runPopulated(port, users, compression, ready[1]);
+        _exit(0);
+    }
+    close(ready[1]);
+    char byte = 0;
+    bool started = pid != -1 && read(ready[0], &byte, 1) == 1;
+    close(ready[0]);
+    if (!started) {
+        return false;
+    }
+
+    double childBefore = processCpuMs(pid);
+    double selfBefore = selfCpuMs();
+    long long start = benchNowNs();
+    bool complete = false;
+    {
+        ServerConfig config = configFor("b.bench", compression);
+        config.parseOption("--link=127.0.0.1:" + to_string(port));
+        Server server(kFirstPort - 1, "bench", config);
+        Metrics& metrics = server.getMetrics();
+        while (benchNowNs() - start < 60000000000LL) {
+            server.runOnce(100);
+            if (server.getClients().size() >= users + 1 && server.getChannels().size() == kChannels
+                && countMemberships(server) == users) {
+                complete = true;
+                break;
+            }
+        }
+        long long elapsed = benchNowNs() - start;
+        unsigned long wire = metrics.bytesIn.get();
+        unsigned long plain = compression ? metrics.linkPlainIn.get() : wire;
+        std::printf("%-6lu users, compression %-3s %9.1f ms %10lu B wire %10lu B plain (%4.2fx) cpu A %7.1f ms B %7.1f ms\n",
+                    static_cast<unsigned long>(users), compression ? "on" : "off", elapsed / 1e6, wire, plain,
+                    wire ? static_cast<double>(plain) / wire : 0.0,
+                    processCpuMs(pid) - childBefore, selfCpuMs() - selfBefore);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return complete;
+}
+
+int main() {
+    NullBuffer nullBuffer;
+    std::streambuf* original = std::cout.rdbuf(&nullBuffer);
+    Logger::setLogLevel(Logger::ERROR);
+
+    std::printf("linkBench (%lu channels)\n", static_cast<unsigned long>(kChannels));
+    std::fflush(stdout);
+    int port = kFirstPort;
+    for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+        for (int compression = 0; compression < 2; ++compression) {
+            if (!measure(kSizes[i], compression == 1, port++)) {
+                std::cout.rdbuf(original);
+                std::printf("FAIL: the burst of %lu users did not complete\n", static_cast<unsigned long>(kSizes[i]));
+                return 1;
+            }
+            std::fflush(stdout);
+        }
+    }
+    std::cout.rdbuf(original);
+    return 0;
+}
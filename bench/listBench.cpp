@@ -0,0 +1,143 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   listBench.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/24 20:14:39 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/24 20:14:39 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+LIST on a server of kChannels channels of 1 to kMaxMembers members, one in
+ten with a topic, read by a client that takes kReadBytes per turn of the
+event loop through socket buffers of that size. The server runs through runOnce(), so the list streams as the
+client's queue drains. Reported: total time, the longest turn, the bytes
+sent, which a LIST built up front would have queued at once, and the most
+that ever waited in the client's queue.
+
+Each LIST must send the lines its filter asks for, and the queue must never
+hold more than one batch of replies.
+*/
+
+#include "benchUtils.hpp"
+#include "server/server.hpp"
+
+static const size_t kChannels = 100000;
+static const size_t kMaxMembers = 20;
+static const size_t kReadBytes = 4096;
+static const size_t kQueueBound = 16384 + 512;     // One batch of _continueListing and the line that crossed it
+
+static std::string channelName(size_t i) {
+    return "#chan" + to_string(i);
+}
+
+static bool measure(Server& server, Client* client, int peerFd, const std::string& line, size_t expected) {
+    server.processLine(client->getFd(), line);
+    size_t lines = 0;
+    size_t bytes = 0;
+    size_t peakQueued = 0;
+    size_t turns = 0;
+    long long longestTurn = 0;
+    bool ended = false;
+    std::string tail;
+    char buffer[kReadBytes];
+    long long start = benchNowNs();
+    while (!ended && benchNowNs() - start < 60000000000LL) {
+        ssize_t count = read(peerFd, buffer, sizeof(buffer));
+        for (ssize_t i = 0; i < count; ++i) {
+            lines += buffer[i] == '\n';
+        }
+        if (count > 0) {
+            bytes += count;
+            std::string seen = tail + std::string(buffer, count);   // " 323 " may straddle two reads
+            ended = seen.find(" 323 ") != std::string::npos;
+            tail = seen.substr(seen.length() - std::min(seen.length(), static_cast<size_t>(4)));
+        }
+        peakQueued = std::max(peakQueued, client->getOutbound().getPendingBytes());
+        long long turnStart = benchNowNs();
+        server.runOnce(0);
+        longestTurn = std::max(longestTurn, benchNowNs() - turnStart);
+        ++turns;
+    }
+    long long elapsed = benchNowNs() - start;
+    std::printf("%-24s %9.1f ms %8lu lines %10lu bytes %8lu turns %8.1f us longest %7lu queued max\n", line.c_str(),
+                elapsed / 1e6, static_cast<unsigned long>(lines), static_cast<unsigned long>(bytes),
+                static_cast<unsigned long>(turns), longestTurn / 1e3, static_cast<unsigned long>(peakQueued));
+    bool ok = true;
+    if (lines != expected + 2) {
+        std::printf("FAIL: %s sent %lu lines instead of %lu\n", line.c_str(), static_cast<unsigned long>(lines),
+                    static_cast<unsigned long>(expected + 2));
+        ok = false;
+    }
+    if (peakQueued > kQueueBound) {
+        std::printf("FAIL: %s queued %lu bytes\n", line.c_str(), static_cast<unsigned long>(peakQueued));
+        ok = false;
+    }
+    return ok;
+}
+
+int main() {
+    NullBuffer nullBuffer;
+    std::streambuf* original = std::cout.rdbuf(&nullBuffer);
+    Logger::setLogLevel(Logger::ERROR);
+
+    Server server(0, "bench");
+    std::vector<Client*> members;       // Only ever members: not users of the server
+    for (size_t i = 0; i < kMaxMembers; ++i) {
+        members.push_back(new Client(100000 + static_cast<int>(i)));
+    }
+    size_t large = 0;
+    size_t prefixed = 0;
+    size_t topics = 0;
+    size_t combined = 0;
+    long long buildStart = benchNowNs();
+    for (size_t i = 0; i < kChannels; ++i) {
+        Channel* channel = server.createChannel(channelName(i));
+        size_t count = i % kMaxMembers + 1;
+        for (size_t j = 0; j < count; ++j) {
+            channel->addMemberUnchecked(members[j]);
+        }
+        if (i % 10 == 0) {
+            channel->setTopic("Topic of " + channelName(i));
+            ++topics;
+        }
+        large += count > 15;
+        prefixed += to_string(i)[0] == '1';
+        combined += count > 10 && i % 10 == 0 && to_string(i)[0] == '1';
+    }
+    long long buildNs = benchNowNs() - buildStart;
+
+    int serverFd;
+    int peerFd;
+    if (!benchSocketPair(serverFd, peerFd)) {
+        std::perror("socketpair");
+        return 1;
+    }
+    // Small socket buffers, so the client's queue fills and has to drain
+    int bufferBytes = kReadBytes;
+    setsockopt(serverFd, SOL_SOCKET, SO_SNDBUF, &bufferBytes, sizeof(bufferBytes));
+    setsockopt(peerFd, SOL_SOCKET, SO_RCVBUF, &bufferBytes, sizeof(bufferBytes));
+    Client* client = server.addClient(serverFd, "127.0.0.1");
+    client->setPassword(true);
+    server.setNickname(client, "lister");
+    client->setUsername("lister");
+    client->setRealname("lister");
+    client->setUser(true);
+
+    std::cout.rdbuf(original);
+    std::printf("listBench (%lu channels of 1 to %lu members, read %lu bytes per turn)\n",
+                static_cast<unsigned long>(kChannels), static_cast<unsigned long>(kMaxMembers),
+                static_cast<unsigned long>(kReadBytes));
+    std::printf("%-24s %9.1f ms, %.0f ns per member added\n", "building the index", buildNs / 1e6,
+                static_cast<double>(buildNs) / (kChannels * (kMaxMembers + 1) / 2));
+    bool ok = measure(server, client, peerFd, "LIST", kChannels);
+    ok &= measure(server, client, peerFd, "LIST >15", large);
+    ok &= measure(server, client, peerFd, "LIST #chan1*", prefixed);
+    ok &= measure(server, client, peerFd, "LIST T<60", topics);
+    ok &= measure(server, client, peerFd, "LIST >10,T<60,#chan1*", combined);
+    close(peerFd);
+    return ok ? 0 : 1;
+}
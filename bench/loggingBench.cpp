@@ -0,0 +1,121 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   loggingBench.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/08 10:14:50 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/08 10:14:50 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+Cost of logging on the parse and execute path at each log level, and of
+DEBUG logging into a --log-binary file instead of text.
+With DEBUG disabled the lazy LOG_* macros must not build a single string,
+so the INFO run has to show exactly as many allocations as the ERROR run.
+*/
+
+#include "benchUtils.hpp"
+#include "server/server.hpp"
+#include "server/command/commandParser.hpp"
+
+static const unsigned long kIterations = 20000;
+
+struct ParseOp {
+    std::string line;
+    void operator()() {
+        Command cmd = CommandParser::parse(line);
+        (void)cmd;
+    }
+};
+
+struct ExecuteOp {
+    Server* server;
+    int senderFd;
+    int readerPeerFd;
+    unsigned long calls;
+    void operator()() {
+        server->processLine(senderFd, "PRIVMSG #bench :hello from the logging benchmark");
+        if (++calls % 64 == 0) {
+            benchDrain(readerPeerFd);
+        }
+    }
+};
+
+static int registerClient(Server& server, const std::string& nick, int& peerFd) {
+    int serverFd;
+    if (!benchSocketPair(serverFd, peerFd)) {
+        std::perror("socketpair");
+        std::exit(1);
+    }
+    server.addClient(serverFd, "127.0.0.1");
+    server.processLine(serverFd, "PASS bench");
+    server.processLine(serverFd, "NICK " + nick);
+    server.processLine(serverFd, "USER " + nick + " 0 * :" + nick);
+    server.processLine(serverFd, "JOIN #bench");
+    benchDrain(peerFd);
+    return serverFd;
+}
+
+int main() {
+    NullBuffer nullBuffer;
+    std::streambuf* original = std::cout.rdbuf(&nullBuffer);
+
+    Server server(0, "bench");
+    int alicePeer;
+    int bobPeer;
+    int alice = registerClient(server, "alice", alicePeer);
+    registerClient(server, "bob", bobPeer);
+
+    ParseOp parse;
+    parse.line = ":alice!alice@127.0.0.1 PRIVMSG #bench :hello from the logging benchmark";
+    ExecuteOp execute;
+    execute.server = &server;
+    execute.senderFd = alice;
+    execute.readerPeerFd = bobPeer;
+    execute.calls = 0;
+
+    const Logger::LogLevel levels[] = { Logger::DEBUG, Logger::INFO, Logger::ERROR };
+    const char* names[] = { "debug", "info", "error" };
+    BenchStats parseStats[3];
+    BenchStats executeStats[3];
+    for (int i = 0; i < 3; ++i) {
+        Logger::setLogLevel(levels[i]);
+        parseStats[i] = benchRun(parse, kIterations);
+        executeStats[i] = benchRun(execute, kIterations);
+    }
+
+    // Same DEBUG run with records going to a binary log instead of text
+    char binaryPath[] = "/tmp/loggingBench.XXXXXX";
+    int binaryFd = mkstemp(binaryPath);
+    BenchStats binaryStats = { 0.0, 0.0 };
+    if (binaryFd != -1 && Logger::openBinary(binaryPath)) {
+        Logger::setLogLevel(Logger::DEBUG);
+        benchRun(parse, kIterations);
+        binaryStats = benchRun(execute, kIterations);
+        Logger::closeBinary();
+    }
+    if (binaryFd != -1) {
+        close(binaryFd);
+        unlink(binaryPath);
+    }
+    std::cout.rdbuf(original);
+
+    std::printf("loggingBench (LOG_MIN_LEVEL=%d)\n", LOG_MIN_LEVEL);
+    for (int i = 0; i < 3; ++i) {
+        benchReport(std::string("parse   level=") + names[i], parseStats[i]);
+        benchReport(std::string("execute level=") + names[i], executeStats[i]);
+    }
+    benchReport("execute level=debug binary log", binaryStats);
+
+    double parseLogging = parseStats[1].allocsPerOp - parseStats[2].allocsPerOp;
+    double executeLogging = executeStats[1].allocsPerOp - executeStats[2].allocsPerOp;
+    std::printf("logging allocs/op with debug disabled: parse %.2f, execute %.2f\n", parseLogging, executeLogging);
+    if (parseLogging > 0.0 || executeLogging > 0.0) {
+        std::printf("FAIL: disabled log statements still allocate\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,191 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   mailboxBench.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/20 11:06:53 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/20 11:06:53 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+Throughput of Mailbox with 1, 2 and 4 producer threads and a consumer that
+sleeps in poll() on the wake fd, as the event loop does, next to the mutex,
+vector and pipe hand-off it replaced. Both hold 1024 values; producers that
+outrun the consumer find them full and retry (the last column).
+
+It doubles as a stress test: every value carries its producer and sequence
+number, and the consumer checks that each producer's values arrive once and
+in order. A poll() that times out while values are queued is a lost wakeup.
+*/
+
+#include "benchUtils.hpp"
+#include "utils/mailbox.hpp"
+#include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+#include <vector>
+
+static const unsigned long kValuesPerProducer = 500000;
+static const size_t kCapacity = 1024;
+static const int kMaxProducers = 4;
+
+struct Handoff {
+    virtual ~Handoff() {}
+    virtual bool push(unsigned long value) = 0;
+    virtual int wakeFd() = 0;
+    virtual void clearWakeup() = 0;
+    virtual size_t popBatch(unsigned long* out, size_t max) = 0;
+};
+
+struct MailboxHandoff : Handoff {
+    Mailbox<unsigned long> mailbox;
+    MailboxHandoff() : mailbox(kCapacity) {}
+    bool push(unsigned long value) { return mailbox.push(value); }
+    int wakeFd() { return mailbox.getWakeFd(); }
+    void clearWakeup() { mailbox.clearWakeup(); }
+    size_t popBatch(unsigned long* out, size_t max) { return mailbox.popBatch(out, max); }
+};
+
+// The fan-out pool's former hand-off: a locked vector and one pipe write per push
+struct MutexHandoff : Handoff {
+    std::vector<unsigned long> values;
+    pthread_mutex_t mutex;
+    int pipeFds[2];
+    MutexHandoff() {
+        pthread_mutex_init(&mutex, NULL);
+        if (pipe(pipeFds) == 0) {
+            fcntl(pipeFds[0], F_SETFL, O_NONBLOCK);
+            fcntl(pipeFds[1], F_SETFL, O_NONBLOCK);
+        }
+    }
+    ~MutexHandoff() {
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        pthread_mutex_destroy(&mutex);
+    }
+    bool push(unsigned long value) {
+        pthread_mutex_lock(&mutex);
+        bool accepted = values.size() < kCapacity;
+        if (accepted) {
+            values.push_back(value);
+        }
+        pthread_mutex_unlock(&mutex);
+        if (accepted) {
+            char byte = 1;
+            ssize_t ignored = write(pipeFds[1], &byte, 1);
+            (void)ignored;
+        }
+        return accepted;
+    }
+    int wakeFd() { return pipeFds[0]; }
+    void clearWakeup() {
+        char drain[256];
+        while (read(pipeFds[0], drain, sizeof(drain)) > 0) {
+        }
+    }
+    size_t popBatch(unsigned long* out, size_t max) {
+        pthread_mutex_lock(&mutex);
+        size_t count = values.size() < max ? values.size() : max;
+        std::copy(values.begin(), values.begin() + count, out);
+        values.erase(values.begin(), values.begin() + count);
+        pthread_mutex_unlock(&mutex);
+        return count;
+    }
+};
+
+struct Producer {
+    Handoff* handoff;
+    unsigned long id;
+    unsigned long retries;
+};
+
+static void* produce(void* arg) {
+    Producer* producer = static_cast<Producer*>(arg);
+    for (unsigned long i = 0; i < kValuesPerProducer; ++i) {
+        while (!producer->handoff->push(producer->id << 32 | i)) {
+            ++producer->retries;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+// Returns false if a value was lost, duplicated or reordered, or a wakeup was missed
+static bool run(const char* name, Handoff& handoff, int producers) {
+    Producer state[kMaxProducers];
+    pthread_t threads[kMaxProducers];
+    unsigned long expected[kMaxProducers] = { 0 };
+    unsigned long total = kValuesPerProducer * producers;
+    unsigned long received = 0;
+    unsigned long wakeups = 0;
+    bool valid = true;
+
+    long long start = benchNowNs();
+    for (int i = 0; i < producers; ++i) {
+        state[i].handoff = &handoff;
+        state[i].id = i;
+        state[i].retries = 0;
+        pthread_create(&threads[i], NULL, produce, &state[i]);
+    }
+    unsigned long batch[256];
+    while (received < total && valid) {
+        pollfd wake = { handoff.wakeFd(), POLLIN, 0 };
+        if (poll(&wake, 1, 1000) == 0) {
+            // Nothing for a second: legitimate only if nothing is queued either
+            if (handoff.popBatch(batch, 1) > 0) {
+                std::printf("FAIL: %s, lost wakeup\n", name);
+                valid = false;
+            }
+            continue;
+        }
+        ++wakeups;
+        handoff.clearWakeup();
+        size_t count;
+        while ((count = handoff.popBatch(batch, sizeof(batch) / sizeof(batch[0]))) > 0) {
+            for (size_t i = 0; i < count; ++i) {
+                unsigned long id = batch[i] >> 32;
+                unsigned long sequence = batch[i] & 0xffffffffUL;
+                if (id >= static_cast<unsigned long>(producers) || sequence != expected[id]) {
+                    valid = false;
+                } else {
+                    ++expected[id];
+                }
+            }
+            received += count;
+        }
+    }
+    for (int i = 0; i < producers; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    long long elapsed = benchNowNs() - start;
+    unsigned long retries = 0;
+    for (int i = 0; i < producers; ++i) {
+        retries += state[i].retries;
+    }
+    if (!valid) {
+        std::printf("FAIL: %s with %d producers delivered values out of order\n", name, producers);
+        return false;
+    }
+    char label[64];
+    std::snprintf(label, sizeof(label), "%s, %d producer%s", name, producers, producers > 1 ? "s" : "");
+    std::printf("%-32s %8.1f ns/value %8.2f M values/s %8.3f wakeups/value %6.2f full/value\n", label,
+                static_cast<double>(elapsed) / total, total * 1e3 / elapsed,
+                static_cast<double>(wakeups) / total, static_cast<double>(retries) / total);
+    return true;
+}
+
+int main() {
+    std::printf("mailboxBench (%lu values per producer, capacity %lu)\n", kValuesPerProducer,
+                static_cast<unsigned long>(kCapacity));
+    for (int producers = 1; producers <= kMaxProducers; producers *= 2) {
+        MailboxHandoff mailbox;
+        MutexHandoff locked;
+        if (!run("mailbox", mailbox, producers) || !run("mutex + pipe", locked, producers)) {
+            return 1;
+        }
+    }
+    return 0;
+}
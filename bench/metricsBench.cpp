@@ -0,0 +1,95 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   metricsBench.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/11 15:02:19 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/11 15:02:19 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+Cost of one metrics sample: counter add, histogram record, the command lookup
+and the full per-command record done around executeCommand (two clock reads
+included), plus a trace span with tracing off and on. None of them may
+allocate once the trace ring of the thread exists.
+*/
+
+#include "benchUtils.hpp"
+#include "server/metrics/metrics.hpp"
+#include "trace/tracer.hpp"
+
+static const unsigned long kIterations = 2000000;
+
+struct CounterOp {
+    MetricCounter* counter;
+    void operator()() { counter->add(); }
+};
+
+struct HistogramOp {
+    LatencyHistogram* histogram;
+    unsigned long value;
+    void operator()() { histogram->record((value = value * 1103515245 + 12345) % 100000); }
+};
+
+struct LookupOp {
+    std::string command;
+    int sink;
+    void operator()() { sink += Metrics::commandIndex(command); }
+};
+
+struct CommandOp {
+    Metrics* metrics;
+    std::string command;
+    void operator()() {
+        unsigned long start = Metrics::nowNs();
+        metrics->recordCommand(Metrics::commandIndex(command), 64, Metrics::nowNs() - start);
+    }
+};
+
+struct SpanOp {
+    void operator()() { TraceSpan span("bench", NULL, 1); }
+};
+
+int main() {
+    Metrics metrics;
+    CounterOp counter;
+    counter.counter = &metrics.bytesIn;
+    HistogramOp histogram;
+    histogram.histogram = &metrics.fanoutRecipients;
+    histogram.value = 0;
+    LookupOp lookup;
+    lookup.command = "PRIVMSG";
+    lookup.sink = 0;
+    CommandOp command;
+    command.metrics = &metrics;
+    command.command = "PRIVMSG";
+
+    SpanOp span;
+
+    BenchStats stats[6];
+    stats[0] = benchRun(counter, kIterations);
+    stats[1] = benchRun(histogram, kIterations);
+    stats[2] = benchRun(lookup, kIterations);
+    stats[3] = benchRun(command, kIterations);
+    stats[4] = benchRun(span, kIterations);
+    Tracer::enable(4096);
+    stats[5] = benchRun(span, kIterations);
+
+    std::printf("metricsBench\n");
+    benchReport("counter add", stats[0]);
+    benchReport("histogram record", stats[1]);
+    benchReport("command index lookup", stats[2]);
+    benchReport("command sample (lookup + 2 clock reads)", stats[3]);
+    benchReport("trace span, tracing off", stats[4]);
+    benchReport("trace span, tracing on", stats[5]);
+    for (int i = 0; i < 6; ++i) {
+        if (stats[i].allocsPerOp > 0.0) {
+            std::printf("FAIL: recording a metric allocates\n");
+            return 1;
+        }
+    }
+    return lookup.sink == -1;
+}
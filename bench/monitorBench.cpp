@@ -0,0 +1,155 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   monitorBench.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/24 18:20:16 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/24 18:20:16 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+Watching kFriends nicknames on servers of 1k to 100k users: a client polling
+them with one WHO each, against MONITOR, where the server pushes 731 and 730
+to kWatchers watchers each time one of them changes nick. Reported: the
+cost of a poll round and of a presence change, which must not grow with the
+user count, and the lines each sent.
+*/
+
+#include "benchUtils.hpp"
+#include "server/server.hpp"
+
+static const size_t kSizes[] = { 1000, 10000, 100000 };
+static const size_t kSizeCount = sizeof(kSizes) / sizeof(kSizes[0]);
+static const size_t kFriends = 10;
+static const size_t kWatchers = 10;
+static const unsigned long kIterations = 5000;
+static const int kFirstFakeFd = 100000;    // Never opened: these users are only looked up
+
+static size_t drainLines(int fd) {
+    char buffer[65536];
+    size_t lines = 0;
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < count; ++i) {
+            lines += buffer[i] == '\n';
+        }
+    }
+    return lines;
+}
+
+struct PollOp {
+    Server* server;
+    int clientFd;
+    int peerFd;
+    std::vector<std::string> lines;
+    size_t received;
+    void operator()() {
+        for (size_t i = 0; i < lines.size(); ++i) {
+            server->processLine(clientFd, lines[i]);
+        }
+        received += drainLines(peerFd);
+    }
+};
+
+struct PresenceOp {
+    Server* server;
+    Client* user;
+    const std::vector<int>* watchers;
+    unsigned long calls;
+    size_t received;
+    void operator()() {
+        server->setNickname(user, (calls++ % 2) ? "friend0" : "away0");
+        for (size_t i = 0; i < watchers->size(); ++i) {
+            received += drainLines((*watchers)[i]);
+        }
+    }
+};
+
+static Client* addUser(Server& server, int fd, const std::string& nick) {
+    Client* client = server.addClient(fd, "127.0.0.1");
+    client->setPassword(true);
+    server.setNickname(client, nick);
+    client->setUsername(nick);
+    client->setRealname(nick);
+    client->setUser(true);
+    return client;
+}
+
+static Client* addSocketUser(Server& server, const std::string& nick, std::vector<int>& peers) {
+    int serverFd;
+    int peerFd;
+    if (!benchSocketPair(serverFd, peerFd)) {
+        std::perror("socketpair");
+        std::exit(1);
+    }
+    peers.push_back(peerFd);
+    return addUser(server, serverFd, nick);
+}
+
+int main() {
+    NullBuffer nullBuffer;
+    std::streambuf* original = std::cout.rdbuf(&nullBuffer);
+    Logger::setLogLevel(Logger::ERROR);
+
+    std::printf("monitorBench (%lu friends watched, %lu watchers)\n", static_cast<unsigned long>(kFriends),
+                static_cast<unsigned long>(kWatchers));
+    bool ok = true;
+    for (size_t s = 0; s < kSizeCount; ++s) {
+        size_t size = kSizes[s];
+        Server server(0, "bench");
+        for (size_t i = 0; i < size; ++i) {
+            addUser(server, kFirstFakeFd + static_cast<int>(i), "user" + to_string(i));
+        }
+        std::vector<int> peers;
+        Client* pollster = addSocketUser(server, "pollster", peers);
+        Client* target = NULL;
+        PollOp poll = { &server, pollster->getFd(), peers[0], std::vector<std::string>(), 0 };
+        for (size_t i = 0; i < kFriends; ++i) {
+            Client* user = addSocketUser(server, "friend" + to_string(i), peers);
+            target = target ? target : user;
+            poll.lines.push_back("WHO friend" + to_string(i));
+        }
+        std::vector<int> watcherPeers;
+        for (size_t i = 0; i < kWatchers; ++i) {
+            Client* watcher = addSocketUser(server, "watcher" + to_string(i), watcherPeers);
+            for (size_t j = 0; j < kFriends; ++j) {
+                server.monitor(watcher, "Friend" + to_string(j));
+            }
+        }
+        PresenceOp presence = { &server, target, &watcherPeers, 0, 0 };
+
+        BenchStats stats = benchRun(poll, kIterations);
+        unsigned long calls = kIterations + kIterations / 10 + 1;
+        std::cout.rdbuf(original);
+        std::printf("%-48s %12.1f ns/op %8.1f lines/op\n", ("WHO poll of every friend, " + to_string(size) + " users").c_str(),
+                    stats.nsPerOp, static_cast<double>(poll.received) / calls);
+        if (poll.received != calls * kFriends * 2) {
+            std::printf("FAIL: %lu WHO lines instead of %lu\n", static_cast<unsigned long>(poll.received),
+                        calls * kFriends * 2);
+            ok = false;
+        }
+        std::cout.rdbuf(&nullBuffer);
+
+        stats = benchRun(presence, kIterations);
+        std::cout.rdbuf(original);
+        std::printf("%-48s %12.1f ns/op %8.1f lines/op\n", ("MONITOR presence change, " + to_string(size) + " users").c_str(),
+                    stats.nsPerOp, static_cast<double>(presence.received) / calls);
+        if (presence.received != calls * kWatchers) {
+            std::printf("FAIL: %lu presence lines instead of %lu\n", static_cast<unsigned long>(presence.received),
+                        calls * kWatchers);
+            ok = false;
+        }
+        std::cout.rdbuf(&nullBuffer);
+        for (size_t i = 0; i < peers.size(); ++i) {
+            close(peers[i]);
+        }
+        for (size_t i = 0; i < watcherPeers.size(); ++i) {
+            close(watcherPeers[i]);
+        }
+    }
+    std::cout.rdbuf(original);
+    return ok ? 0 : 1;
+}
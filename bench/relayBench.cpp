@@ -0,0 +1,126 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   relayBench.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/24 15:40:08 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/24 15:40:08 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+A relay bot sending one line to kChannels channels whose kUsers members each
+sit in three of them: once per channel, as one PRIVMSG with all channels as
+targets, and as that PRIVMSG from a +B bot, which reaches every user once.
+Reported: the cost per relayed line and the lines written to the users.
+*/
+
+#include "benchUtils.hpp"
+#include "server/server.hpp"
+
+static const size_t kChannels = 8;
+static const size_t kUsers = 200;
+static const unsigned long kIterations = 2000;
+
+struct RelayOp {
+    Server* server;
+    int botFd;
+    std::vector<std::string> lines;
+    const std::vector<int>* peers;
+    unsigned long calls;
+    void operator()() {
+        for (size_t i = 0; i < lines.size(); ++i) {
+            server->processLine(botFd, lines[i]);
+        }
+        if (++calls % 16 == 0) {
+            for (size_t i = 0; i < peers->size(); ++i) {
+                benchDrain((*peers)[i]);
+            }
+        }
+    }
+};
+
+static std::string channelName(size_t i) {
+    return "#relay" + to_string(i);
+}
+
+static Client* addUser(Server& server, const std::string& nick, std::vector<int>& peers) {
+    int serverFd;
+    int peerFd;
+    if (!benchSocketPair(serverFd, peerFd)) {
+        std::perror("socketpair");
+        std::exit(1);
+    }
+    peers.push_back(peerFd);
+    Client* client = server.addClient(serverFd, "127.0.0.1");
+    client->setPassword(true);
+    server.setNickname(client, nick);
+    client->setUsername(nick);
+    client->setRealname(nick);
+    client->setUser(true);
+    return client;
+}
+
+static void join(Server& server, Client* client, const std::string& name) {
+    Channel* channel = server.getChannel(name);
+    if (!channel) {
+        channel = server.createChannel(name);
+    }
+    channel->addMemberUnchecked(client);
+    client->addChannel(name);
+}
+
+static bool measure(Server& server, const std::string& label, RelayOp& op, size_t expectedLines) {
+    Metrics& metrics = server.getMetrics();
+    size_t lineLength = (":relaybot!relaybot@127.0.0.1 PRIVMSG " + channelName(0) + " :relayed line\r\n").length();
+    unsigned long before = metrics.bytesOut.get();
+    BenchStats stats = benchRun(op, kIterations);
+    double lines = static_cast<double>(metrics.bytesOut.get() - before) / lineLength / (kIterations + kIterations / 10 + 1);
+    std::printf("%-48s %12.1f ns/relay %8.1f lines/relay %8.2f allocs/relay\n", label.c_str(), stats.nsPerOp, lines,
+                stats.allocsPerOp);
+    if (lines < expectedLines - 0.5 || lines > expectedLines + 0.5) {
+        std::printf("FAIL: %s wrote %.1f lines per relay instead of %lu\n", label.c_str(), lines,
+                    static_cast<unsigned long>(expectedLines));
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    NullBuffer nullBuffer;
+    std::streambuf* original = std::cout.rdbuf(&nullBuffer);
+    Logger::setLogLevel(Logger::ERROR);
+
+    Server server(0, "bench");
+    std::vector<int> peers;
+    Client* bot = addUser(server, "relaybot", peers);
+    for (size_t i = 0; i < kChannels; ++i) {
+        join(server, bot, channelName(i));
+    }
+    for (size_t i = 0; i < kUsers; ++i) {
+        Client* user = addUser(server, "user" + to_string(i), peers);
+        join(server, user, channelName(i % kChannels));
+        join(server, user, channelName((i + 1) % kChannels));
+        join(server, user, channelName((i + 3) % kChannels));
+    }
+
+    RelayOp perChannel = { &server, bot->getFd(), std::vector<std::string>(), &peers, 0 };
+    std::string targets;
+    for (size_t i = 0; i < kChannels; ++i) {
+        perChannel.lines.push_back("PRIVMSG " + channelName(i) + " :relayed line");
+        targets += (i ? "," : "") + channelName(i);
+    }
+    RelayOp multiTarget = { &server, bot->getFd(), std::vector<std::string>(1, "PRIVMSG " + targets + " :relayed line"),
+                            &peers, 0 };
+
+    std::printf("relayBench (%lu channels, %lu users in 3 channels each)\n", static_cast<unsigned long>(kChannels),
+                static_cast<unsigned long>(kUsers));
+    bool ok = measure(server, "one PRIVMSG per channel", perChannel, kUsers * 3);
+    ok &= measure(server, "one PRIVMSG, " + to_string(kChannels) + " targets", multiTarget, kUsers * 3);
+    bot->setBot(true);
+    ok &= measure(server, "one PRIVMSG, " + to_string(kChannels) + " targets, bot +B", multiTarget, kUsers);
+    std::cout.rdbuf(original);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   snapshotBench.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/20 17:48:03 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/20 17:48:03 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+Time to save and restore the channel snapshot at 1k, 10k and 100k channels,
+each with a topic, modes and two operators, and the size of the file. The
+restore runs in a fresh server, as at startup, and must bring back every
+channel with its state.
+*/
+
+#include "benchUtils.hpp"
+#include "server/server.hpp"
+#include <sys/stat.h>
+
+static const int kFirstFakeFd = 1000000;
+static const size_t kSizes[] = { 1000, 10000, 100000 };
+static const size_t kOperators = 1000;
+
+static bool measure(size_t count, const std::string& path) {
+    Server source(0, "bench");
+    std::vector<Client*> operators;
+    for (size_t i = 0; i < kOperators; ++i) {
+        Client* client = source.addClient(kFirstFakeFd + static_cast<int>(i), "127.0.0.1");
+        source.setNickname(client, "op" + to_string(i));
+        operators.push_back(client);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        Channel* channel = source.createChannel("#channel" + to_string(i));
+        channel->setTopic("Topic of channel " + to_string(i) + ", kept across restarts");
+        channel->setTopicRestricted(true);
+        if (i % 4 == 0) {
+            channel->setKey("key" + to_string(i));
+            channel->setUserLimit(50);
+        }
+        channel->addOperator(operators[i % kOperators]);
+        channel->addOperator(operators[(i + 1) % kOperators]);
+    }
+
+    long long start = benchNowNs();
+    std::string error;
+    if (!ChannelSnapshot::save(path, source.getChannels(), error)) {
+        std::printf("FAIL: save: %s\n", error.c_str());
+        return false;
+    }
+    long long saved = benchNowNs() - start;
+    struct stat info;
+    stat(path.c_str(), &info);
+
+    Server restarted(0, "bench");
+    start = benchNowNs();
+    long restored = ChannelSnapshot::load(path, restarted, error);
+    long long loaded = benchNowNs() - start;
+    unlink(path.c_str());
+
+    Channel* sample = restarted.getChannel("#channel" + to_string(count - 4));
+    if (restored != static_cast<long>(count) || !sample || sample->getKey() != "key" + to_string(count - 4)
+        || sample->getUserLimit() != 50 || !sample->isTopicRestricted() || sample->getRestoredOperators().size() != 2) {
+        std::printf("FAIL: restored %ld of %lu channels (%s)\n", restored, static_cast<unsigned long>(count), error.c_str());
+        return false;
+    }
+    std::printf("%-7lu channels %10.2f ms save %10.2f ms load %10.1f KiB (%5.1f bytes/channel)\n",
+                static_cast<unsigned long>(count), saved / 1e6, loaded / 1e6, info.st_size / 1024.0,
+                static_cast<double>(info.st_size) / count);
+    return true;
+}
+
+int main() {
+    NullBuffer nullBuffer;
+    std::streambuf* original = std::cout.rdbuf(&nullBuffer);
+    Logger::setLogLevel(Logger::ERROR);
+
+    std::string path = "/tmp/ircserv-snapshotBench." + to_string(getpid());
+    std::printf("snapshotBench\n");
+    for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+        if (!measure(kSizes[i], path)) {
+            std::cout.rdbuf(original);
+            return 1;
+        }
+    }
+    std::cout.rdbuf(original);
+    return 0;
+}
@@ -0,0 +1,110 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   stateBench.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/15 10:26:52 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/15 10:26:52 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+How the server state scales: Channel::addMember/removeMember, isMember for
+the last member and for a non-member at growing member counts, and
+Server::getClientByNickname at growing user counts. Clients here are never
+written to, so they get placeholder descriptors instead of sockets.
+*/
+
+#include "benchUtils.hpp"
+#include "server/server.hpp"
+
+static const int kFirstFakeFd = 1000000;
+static const size_t kSizes[] = { 10, 100, 1000, 10000 };
+static const size_t kSizeCount = sizeof(kSizes) / sizeof(kSizes[0]);
+
+static unsigned long iterationsFor(size_t size) {
+    return size >= 10000 ? 2000 : 200000 / size;
+}
+
+struct JoinPartOp {
+    Channel* channel;
+    Client* client;
+    void operator()() {
+        channel->addMember(client, "");
+        channel->removeMember(client);
+    }
+};
+
+struct IsMemberOp {
+    Channel* channel;
+    Client* client;
+    int hits;
+    void operator()() { hits += channel->isMember(client) ? 1 : 0; }
+};
+
+struct NickLookupOp {
+    Server* server;
+    std::string nickname;
+    int hits;
+    void operator()() { hits += server->getClientByNickname(nickname) ? 1 : 0; }
+};
+
+int main() {
+    NullBuffer nullBuffer;
+    std::streambuf* original = std::cout.rdbuf(&nullBuffer);
+    Logger::setLogLevel(Logger::ERROR);
+
+    std::vector<Client*> clients;
+    for (size_t i = 0; i <= kSizes[kSizeCount - 1]; ++i) {
+        Client* client = new Client(kFirstFakeFd + static_cast<int>(i));
+        client->setNickname("user" + to_string(i));
+        clients.push_back(client);
+    }
+    Client* outsider = clients.back();
+
+    std::printf("stateBench\n");
+    for (size_t s = 0; s < kSizeCount; ++s) {
+        size_t size = kSizes[s];
+        Channel channel("#bench");
+        for (size_t i = 0; i < size; ++i) {
+            channel.addMember(clients[i], "");
+        }
+        JoinPartOp joinPart = { &channel, outsider };
+        IsMemberOp lastMember = { &channel, clients[size - 1], 0 };
+        IsMemberOp nonMember = { &channel, outsider, 0 };
+        BenchStats stats[3];
+        stats[0] = benchRun(joinPart, iterationsFor(size));
+        stats[1] = benchRun(lastMember, iterationsFor(size));
+        stats[2] = benchRun(nonMember, iterationsFor(size));
+        std::cout.rdbuf(original);
+        benchReport("channel addMember+removeMember, " + to_string(size) + " members", stats[0]);
+        benchReport("channel isMember last, " + to_string(size) + " members", stats[1]);
+        benchReport("channel isMember miss, " + to_string(size) + " members", stats[2]);
+        std::cout.rdbuf(&nullBuffer);
+    }
+
+    for (size_t s = 0; s < kSizeCount; ++s) {
+        size_t size = kSizes[s];
+        Server server(0, "bench");
+        for (size_t i = 0; i < size; ++i) {
+            server.setNickname(server.addClient(kFirstFakeFd + static_cast<int>(i), "127.0.0.1"), "user" + to_string(i));
+        }
+        NickLookupOp found = { &server, "user" + to_string(size / 2), 0 };
+        NickLookupOp missing = { &server, "nobody", 0 };
+        BenchStats stats[2];
+        stats[0] = benchRun(found, iterationsFor(size));
+        stats[1] = benchRun(missing, iterationsFor(size));
+        std::cout.rdbuf(original);
+        benchReport("getClientByNickname hit, " + to_string(size) + " users", stats[0]);
+        benchReport("getClientByNickname miss, " + to_string(size) + " users", stats[1]);
+        std::cout.rdbuf(&nullBuffer);
+    }
+    std::cout.rdbuf(original);
+
+    for (size_t i = 0; i < clients.size(); ++i) {
+        delete clients[i];
+    }
+    return 0;
+}
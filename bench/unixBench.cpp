@@ -0,0 +1,211 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   unixBench.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/24 10:12:37 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/24 10:12:37 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+A bot streaming PRIVMSG to one user, over TCP loopback and over the Unix
+socket. A forked process runs the server with --unix-socket and our uid in
+--unix-trusted; this process registers a sender and a receiver on the same
+transport and times kMessages lines from the first write until the
+receiver read the last one. Reported: wall time, messages per second and
+CPU time of the server.
+
+The Unix socket pair registers without PASS, which checks that the server
+read our uid with SO_PEERCRED.
+*/
+
+#include "benchUtils.hpp"
+#include "server/server.hpp"
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <poll.h>
+
+static const size_t kMessages = 100000;
+static const size_t kTextBytes = 64;
+static const int kPort = 16690;
+
+static double processCpuMs(pid_t pid) {
+    char path[64];
+    std::snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(pid));
+    FILE* stat = std::fopen(path, "r");
+    if (!stat) {
+        return 0;
+    }
+    unsigned long user = 0;
+    unsigned long system = 0;
+    if (std::fscanf(stat, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &user, &system) != 2) {
+        user = system = 0;
+    }
+    std::fclose(stat);
+    return (user + system) * 1000.0 / sysconf(_SC_CLK_TCK);
+}
+
+static int connectTo(const std::string& unixPath) {
+    int fd;
+    if (unixPath.empty()) {
+        struct sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(kPort);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd != -1 && connect(fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        struct sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, unixPath.c_str(), sizeof(address.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd != -1 && connect(fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    return fd;
+}
+
+// Sends the registration and blocks until the welcome arrives
+static bool registerAs(int fd, const std::string& nick, bool sendPass) {
+    std::string lines = (sendPass ? "PASS bench\r\n" : "") + std::string("NICK ") + nick + "\r\nUSER " + nick
+                        + " 0 * :Bench " + nick + "\r\n";
+    if (write(fd, lines.data(), lines.length()) != static_cast<ssize_t>(lines.length())) {
+        return false;
+    }
+    std::string received;
+    char buffer[4096];
+    while (received.find(" 001 ") == std::string::npos) {
+        pollfd readable = { fd, POLLIN, 0 };
+        if (poll(&readable, 1, 5000) != 1) {
+            return false;
+        }
+        ssize_t count = read(fd, buffer, sizeof(buffer));
+        if (count <= 0) {
+            return false;
+        }
+        received.append(buffer, count);
+    }
+    // The rest of the welcome is read with the stream and not counted
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return true;
+}
+
+static bool measure(const char* name, const std::string& unixPath, pid_t server) {
+    int sender = connectTo(unixPath);
+    int receiver = connectTo(unixPath);
+    bool sendPass = unixPath.empty();
+    std::string suffix = sendPass ? "t" : "u";
+    if (sender == -1 || receiver == -1 || !registerAs(receiver, "recv" + suffix, sendPass)
+        || !registerAs(sender, "send" + suffix, sendPass)) {
+        std::printf("FAIL: %s: could not register\n", name);
+        return false;
+    }
+
+    std::string line = "PRIVMSG recv" + suffix + " :" + std::string(kTextBytes, 'x') + "\r\n";
+    std::string batch;
+    for (size_t i = 0; i < 256; ++i) {
+        batch += line;
+    }
+    size_t batchLines = 256;
+    size_t sentLines = 0;
+    size_t offset = 0;              // Into batch, while a write left part of it unsent
+    size_t received = 0;
+    char buffer[65536];
+    double cpuBefore = processCpuMs(server);
+    long long start = benchNowNs();
+    while (received < kMessages) {
+        if (benchNowNs() - start > 60000000000LL) {
+            std::printf("FAIL: %s: %lu of %lu messages arrived\n", name, static_cast<unsigned long>(received),
+                        static_cast<unsigned long>(kMessages));
+            return false;
+        }
+        short senderEvents = sentLines < kMessages ? POLLOUT : 0;
+        pollfd fds[2] = { { receiver, POLLIN, 0 }, { sender, senderEvents, 0 } };
+        poll(fds, 2, 1000);
+        if (fds[0].revents & POLLIN) {
+            ssize_t count = read(receiver, buffer, sizeof(buffer));
+            for (ssize_t i = 0; i < count; ++i) {
+                if (buffer[i] == '\n') {
+                    ++received;
+                }
+            }
+        }
+        if ((fds[1].revents & POLLOUT) && sentLines < kMessages) {
+            ssize_t count = write(sender, batch.data() + offset, batch.length() - offset);
+            if (count > 0) {
+                offset += count;
+                if (offset == batch.length()) {
+                    offset = 0;
+                    sentLines += batchLines;
+                }
+            }
+        }
+    }
+    long long elapsed = benchNowNs() - start;
+    std::printf("%-24s %9.1f ms %12.0f msg/s   server cpu %8.1f ms\n", name, elapsed / 1e6,
+                kMessages / (elapsed / 1e9), processCpuMs(server) - cpuBefore);
+    close(sender);
+    close(receiver);
+    return true;
+}
+
+int main() {
+    char directory[] = "/tmp/unixBench.XXXXXX";
+    if (!mkdtemp(directory)) {
+        std::printf("FAIL: cannot create a directory for the socket\n");
+        return 1;
+    }
+    std::string path = std::string(directory) + "/ircserv.sock";
+    int ready[2];
+    if (pipe(ready) == -1) {
+        return 1;
+    }
+    std::fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(ready[0]);
+        NullBuffer nullBuffer;
+        std::cout.rdbuf(&nullBuffer);
+        Logger::setLogLevel(Logger::ERROR);
+        ServerConfig config;
+        config.parseOption("--unix-socket=" + path);
+        config.parseOption("--unix-trusted=" + to_string(getuid()));
+        Server server(kPort, "bench", config);
+        char byte = 1;
+        if (write(ready[1], &byte, 1) != 1) {
+            _exit(1);
+        }
+        close(ready[1]);
+        server.run();
+        _exit(0);
+    }
+    close(ready[1]);
+    char byte = 0;
+    bool started = pid != -1 && read(ready[0], &byte, 1) == 1;
+    close(ready[0]);
+
+    std::printf("unixBench (%lu PRIVMSG with %lu byte texts, one sender, one receiver)\n",
+                static_cast<unsigned long>(kMessages), static_cast<unsigned long>(kTextBytes));
+    bool ok = started && measure("TCP loopback", "", pid) && measure("Unix socket", path, pid);
+    if (!started) {
+        std::printf("FAIL: the server did not start\n");
+    }
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+    unlink(path.c_str());
+    rmdir(directory);
+    return ok ? 0 : 1;
+}
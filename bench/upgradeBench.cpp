@@ -0,0 +1,159 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   upgradeBench.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/21 15:12:36 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/21 15:12:36 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+How long UPGRADE keeps the clients waiting, apart from starting the new
+binary: encoding the state, passing it and the descriptors over a socket
+pair, and rebuilding the clients and channels on the other side. Both
+servers live in this process; a thread plays the old one's sending side.
+
+Clients sit on duplicates of one socket, each in 5 of 100 channels and with
+a partial input line and some unsent output that must come through intact.
+*/
+
+#include "benchUtils.hpp"
+#include "server/server.hpp"
+#include <pthread.h>
+#include <sys/resource.h>
+
+static const size_t kSizes[] = { 1000, 5000 };
+static const size_t kChannels = 100;
+static const size_t kChannelsPerClient = 5;
+
+struct Sender {
+    int channel;
+    const std::string* state;
+    const std::vector<int>* fds;
+    bool ok;
+};
+
+static void* sendHandoff(void* arg) {
+    Sender* sender = static_cast<Sender*>(arg);
+    std::string error;
+    sender->ok = LiveUpgrade::sendState(sender->channel, *sender->state, *sender->fds, error);
+    return NULL;
+}
+
+static void closeClients(Server& server) {
+    const std::map<int, Client*>& clients = server.getClients();
+    for (std::map<int, Client*>::const_iterator it = clients.begin(); it != clients.end(); ++it) {
+        close(it->first);
+    }
+}
+
+static bool measure(size_t count) {
+    int quiet[2];
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, quiet) == -1 || socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
+        return false;
+    }
+    Server source(0, "bench");
+    for (size_t i = 0; i < count; ++i) {
+        Client* client = source.addClient(dup(quiet[0]), "10.0.0." + to_string(i % 250));
+        std::string nick = "user" + to_string(i);
+        client->setPassword(true);
+        source.setNickname(client, nick);
+        client->setUsername("u" + to_string(i));
+        client->setRealname("Benchmark user " + nick);
+        client->setUser(true);
+        client->getInput().assign("PRIVMSG #channel0 :half a li");
+        SharedMessage* pending = SharedMessage::create(":server NOTICE " + nick + " :queued before the upgrade\r\n");
+        client->getOutbound().push(pending);
+        pending->release();
+        for (size_t j = 0; j < kChannelsPerClient; ++j) {
+            std::string name = "#channel" + to_string((i + j * 7) % kChannels);
+            Channel* channel = source.getChannel(name);
+            if (!channel) {
+                channel = source.createChannel(name);
+                channel->addOperator(client);
+                channel->setTopic("Topic of " + name);
+            }
+            channel->addMemberUnchecked(client);
+            client->addChannel(name);
+        }
+    }
+
+    long long start = benchNowNs();
+    std::vector<int> fds;
+    std::string state = LiveUpgrade::encode(source, quiet[1], -1, -1, fds);
+    long long encoded = benchNowNs() - start;
+
+    Sender sender = { pair[0], &state, &fds, false };
+    pthread_t thread;
+    start = benchNowNs();
+    pthread_create(&thread, NULL, sendHandoff, &sender);
+    std::string received;
+    std::vector<int> receivedFds;
+    std::string error;
+    bool ok = LiveUpgrade::receiveState(pair[1], received, receivedFds, error);
+    pthread_join(thread, NULL);
+    long long transferred = benchNowNs() - start;
+
+    Server target(0, "bench");
+    int listener = -1;
+    int metrics = -1;
+    int unixListener = -1;
+    start = benchNowNs();
+    ok = ok && sender.ok && LiveUpgrade::restore(received, receivedFds, target, listener, metrics, unixListener, error);
+    long long restored = benchNowNs() - start;
+
+    Client* sample = target.getClientByNickname("user" + to_string(count - 1));
+    Channel* channel = target.getChannel("#channel0");
+    std::string input;
+    std::string output;
+    if (sample) {
+        sample->getInput().copyTo(input);
+        sample->getOutbound().copyPending(output);
+    }
+    bool valid = ok && target.getClients().size() == count && target.getChannels().size() == kChannels
+                 && channel && channel->getMembers().size() == source.getChannel("#channel0")->getMembers().size()
+                 && sample && sample->getChannels().size() == kChannelsPerClient
+                 && input == "PRIVMSG #channel0 :half a li" && output.find("queued before the upgrade") != std::string::npos;
+    if (valid) {
+        std::printf("%-6lu clients %8.2f ms encode %8.2f ms transfer %8.2f ms restore %9.1f KiB state\n",
+                    static_cast<unsigned long>(count), encoded / 1e6, transferred / 1e6, restored / 1e6,
+                    state.length() / 1024.0);
+    } else {
+        std::printf("FAIL: handing over %lu clients (%s)\n", static_cast<unsigned long>(count), error.c_str());
+    }
+    closeClients(source);
+    closeClients(target);
+    if (listener != -1) {
+        close(listener);
+    }
+    close(quiet[0]);
+    close(quiet[1]);
+    close(pair[0]);
+    close(pair[1]);
+    return valid;
+}
+
+int main() {
+    NullBuffer nullBuffer;
+    std::streambuf* original = std::cout.rdbuf(&nullBuffer);
+    Logger::setLogLevel(Logger::ERROR);
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    std::printf("upgradeBench (%lu channels, %lu per client)\n", static_cast<unsigned long>(kChannels),
+                static_cast<unsigned long>(kChannelsPerClient));
+    for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+        if (!measure(kSizes[i])) {
+            std::cout.rdbuf(original);
+            return 1;
+        }
+    }
+    std::cout.rdbuf(original);
+    return 0;
+}
@@ -0,0 +1,129 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   whoBench.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/24 19:31:07 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/24 19:31:07 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+WHO on a channel of kMembers users, as plain WHO and as WHOX asking for
+nickname and account only, the fields a client tracking logins needs.
+Then WHO mask searches on servers of 1k to 100k users: a nickname prefix
+and a host prefix, served from the indexes, and a mask starting with a
+wildcard, which looks at every user. Reported: time and bytes per WHO.
+*/
+
+#include "benchUtils.hpp"
+#include "server/server.hpp"
+
+static const size_t kMembers = 1000;
+static const size_t kSizes[] = { 1000, 10000, 100000 };
+static const size_t kSizeCount = sizeof(kSizes) / sizeof(kSizes[0]);
+static const int kFirstFakeFd = 100000;    // Never opened: these users are only listed
+
+struct WhoOp {
+    Server* server;
+    int clientFd;
+    int peerFd;
+    std::string line;
+    size_t bytes;
+    size_t lines;
+    void operator()() {
+        server->processLine(clientFd, line);
+        char buffer[65536];
+        ssize_t count;
+        while ((count = read(peerFd, buffer, sizeof(buffer))) > 0) {
+            bytes += count;
+            for (ssize_t i = 0; i < count; ++i) {
+                lines += buffer[i] == '\n';
+            }
+        }
+    }
+};
+
+static Client* addUser(Server& server, int fd, size_t i) {
+    std::string nick = "user" + to_string(i);
+    Client* client = server.addClient(fd, "10." + to_string(i / 65536) + "." + to_string(i / 256 % 256) + "."
+                                              + to_string(i % 256));
+    client->setPassword(true);
+    server.setNickname(client, nick);
+    client->setUsername(nick);
+    client->setRealname("Benchmark user " + nick);
+    client->setUser(true);
+    if (i % 2) {
+        client->setAccount(nick);
+    }
+    return client;
+}
+
+static bool measure(Server& server, int clientFd, int peerFd, const std::string& label, const std::string& line,
+                    size_t expectedLines, unsigned long iterations) {
+    WhoOp op = { &server, clientFd, peerFd, line, 0, 0 };
+    BenchStats stats = benchRun(op, iterations);
+    unsigned long calls = iterations + iterations / 10 + 1;
+    std::printf("%-48s %12.1f ns/op %10.0f bytes/op %8.1f lines/op\n", label.c_str(), stats.nsPerOp,
+                static_cast<double>(op.bytes) / calls, static_cast<double>(op.lines) / calls);
+    if (op.lines != expectedLines * calls) {
+        std::printf("FAIL: %s sent %.1f lines instead of %lu\n", label.c_str(), static_cast<double>(op.lines) / calls,
+                    static_cast<unsigned long>(expectedLines));
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    NullBuffer nullBuffer;
+    std::streambuf* original = std::cout.rdbuf(&nullBuffer);
+    Logger::setLogLevel(Logger::ERROR);
+
+    std::printf("whoBench (channel of %lu, mask searches among 1k to 100k users)\n",
+                static_cast<unsigned long>(kMembers));
+    bool ok = true;
+    for (size_t s = 0; s < kSizeCount; ++s) {
+        size_t size = kSizes[s];
+        ServerConfig config;
+        config.parseOption("--who-limit=0");
+        Server server(0, "bench", config);
+        Channel* channel = server.createChannel("#big");
+        for (size_t i = 0; i < size; ++i) {
+            Client* client = addUser(server, kFirstFakeFd + static_cast<int>(i), i);
+            if (i < kMembers) {
+                channel->addMemberUnchecked(client);
+                client->addChannel("#big");
+            }
+        }
+        int serverFd;
+        int peerFd;
+        if (!benchSocketPair(serverFd, peerFd)) {
+            std::perror("socketpair");
+            return 1;
+        }
+        Client* requester = addUser(server, serverFd, size);
+        server.setNickname(requester, "requester");
+
+        std::cout.rdbuf(original);
+        if (s == 0) {
+            ok &= measure(server, serverFd, peerFd, "WHO #big", "WHO #big", kMembers + 1, 200);
+            ok &= measure(server, serverFd, peerFd, "WHO #big %na (WHOX)", "WHO #big %na", kMembers + 1, 200);
+        }
+        size_t prefixed = 0;
+        for (size_t i = 0; i < size; ++i) {
+            prefixed += to_string(i).compare(0, 3, "100") == 0;
+        }
+        ok &= measure(server, serverFd, peerFd, "WHO user100* %n, " + to_string(size) + " users", "WHO user100* %n",
+                      prefixed + 1, 2000);
+        ok &= measure(server, serverFd, peerFd, "WHO 10.0.1.* %n, " + to_string(size) + " users", "WHO 10.0.1.* %n",
+                      256 + 1, 2000);
+        ok &= measure(server, serverFd, peerFd, "WHO *ser100* %n, " + to_string(size) + " users", "WHO *ser100* %n",
+                      prefixed + 1, size > 10000 ? 20 : 200);
+        std::cout.rdbuf(&nullBuffer);
+        close(peerFd);
+    }
+    std::cout.rdbuf(original);
+    return ok ? 0 : 1;
+}
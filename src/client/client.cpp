@@ -10,7 +10,23 @@ Client::Client(int fd)
       _channels(),
       _isPasswordSet(false),
       _isUserSet(false),
-      _buffer("")
+      _isOperator(false),
+      _operFailures(0),
+      _linkState(LINK_NONE),
+      _linkAuthorized(false),
+      _linkCompressionOffered(false),
+      _countedAddress(0),
+      _capabilities(0),
+      _capNegotiating(false),
+      _account(),
+      _peerUid(-1),
+      _isBot(false),
+      _monitored(),
+      _hops(0),
+      _serverName(),
+      _link(NULL),
+      _input(),
+      _outbound()
 {
 }
 
@@ -65,6 +81,14 @@ bool Client::isUserSet() const {
     return _isUserSet;
 }
 
+bool Client::isOperator() const {
+    return _isOperator;
+}
+
+unsigned int Client::getOperFailures() const {
+    return _operFailures;
+}
+
 void Client::setRealname(const std::string& realname) {
     _realname = realname;
 }
@@ -89,15 +113,144 @@ void Client::setUser(bool isSet) {
     _isUserSet = isSet;
 }
 
+void Client::setOperator(bool isOperator) {
+    _isOperator = isOperator;
+}
+
+void Client::setOperFailures(unsigned int failures) {
+    _operFailures = failures;
+}
+
+Client::LinkState Client::getLinkState() const {
+    return _linkState;
+}
+
+bool Client::isLinkAuthorized() const {
+    return _linkAuthorized;
+}
+
+bool Client::isLinkCompressionOffered() const {
+    return _linkCompressionOffered;
+}
+
+unsigned int Client::getCountedAddress() const {
+    return _countedAddress;
+}
+
+bool Client::hasCapability(Capability capability) const {
+    return (_capabilities & capability) != 0;
+}
+
+unsigned int Client::getCapabilities() const {
+    return _capabilities;
+}
+
+bool Client::isCapNegotiating() const {
+    return _capNegotiating;
+}
+
+std::string Client::getAccount() const {
+    return _account;
+}
+
+long Client::getPeerUid() const {
+    return _peerUid;
+}
+
+bool Client::isBot() const {
+    return _isBot;
+}
+
+const std::set<std::string>& Client::getMonitored() const {
+    return _monitored;
+}
+
+int Client::getHops() const {
+    return _hops;
+}
+
+std::string Client::getServerName() const {
+    return _serverName;
+}
+
+Client* Client::getLink() const {
+    return _link;
+}
+
+bool Client::isRemote() const {
+    return _link != NULL;
+}
+
+// PASS (or SASL), NICK and USER all done and no CAP negotiation left open:
+// the user is known to the rest of the network
+bool Client::isRegistered() const {
+    return _isPasswordSet && !_nickname.empty() && _isUserSet && !_capNegotiating;
+}
+
+void Client::setLinkState(LinkState state) {
+    _linkState = state;
+}
+
+void Client::setLinkAuthorized(bool authorized) {
+    _linkAuthorized = authorized;
+}
+
+void Client::setLinkCompressionOffered(bool offered) {
+    _linkCompressionOffered = offered;
+}
+
+void Client::setCountedAddress(unsigned int address) {
+    _countedAddress = address;
+}
+
+void Client::setCapabilities(unsigned int capabilities) {
+    _capabilities = capabilities;
+}
+
+void Client::setCapNegotiating(bool negotiating) {
+    _capNegotiating = negotiating;
+}
+
+void Client::setAccount(const std::string& account) {
+    _account = account;
+}
+
+void Client::setPeerUid(long uid) {
+    _peerUid = uid;
+}
+
+void Client::setBot(bool isBot) {
+    _isBot = isBot;
+}
+
+bool Client::addMonitored(const std::string& nickname) {
+    return _monitored.insert(nickname).second;
+}
+
+bool Client::removeMonitored(const std::string& nickname) {
+    return _monitored.erase(nickname) > 0;
+}
+
+// Turns this record into a user of another server, reached through link
+void Client::setRemote(Client* link, const std::string& serverName, int hops) {
+    _link = link;
+    _serverName = serverName;
+    _hops = hops;
+}
+
+void Client::setServerName(const std::string& serverName) {
+    _serverName = serverName;
+}
+
 std::string Client::getFullClientIdentifier() const {
     return _nickname + "!" + _username + "@" + _hostname;
 }
 
-void Client::appendToBuffer(const std::string& data) {
-        _buffer += data;
-    }
+InputBuffer& Client::getInput() {
+    return _input;
+}
 
-std::string& Client::getBuffer() {
-    return _buffer;
+OutboundQueue& Client::getOutbound() {
+    return _outbound;
 }
 
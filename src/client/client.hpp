@@ -4,8 +4,27 @@
 #include <string>
 #include <vector>
 #include <set>
+#include "outboundQueue.hpp"
+#include "inputBuffer.hpp"
 
 class Client {
+public:
+    // Server-to-server state of a connection; users stay LINK_NONE
+    enum LinkState {
+        LINK_NONE,
+        LINK_CONNECTING,    // We connected out and sent PASS/SERVER, waiting for theirs
+        LINK_ESTABLISHED
+    };
+
+    // IRCv3 capabilities a client can enable with CAP REQ
+    enum Capability {
+        CAP_SASL = 1,
+        CAP_BATCH = 2,
+        CAP_SERVER_TIME = 4,
+        CAP_MESSAGE_TAGS = 8,
+        CAP_CHATHISTORY = 16
+    };
+
 private:
     int _fd;                             // Socket file descriptor
     std::string _nickname;               // Client's nickname
@@ -15,7 +34,23 @@ private:
     std::vector<std::string> _channels;  // Channels the client has joined
     bool _isPasswordSet;                 // Whether password is set
     bool _isUserSet;                     // Whether client has successfully sent the USER command during the IRC registration process.
-    std::string _buffer;
+    bool _isOperator;                    // Whether client has authenticated with OPER
+    unsigned int _operFailures;          // OPER attempts with a wrong password on this connection
+    LinkState _linkState;                // Whether this connection is another server
+    bool _linkAuthorized;                // A server-form PASS with the link password was received
+    bool _linkCompressionOffered;        // That PASS carried the Z flag
+    unsigned int _countedAddress;        // Address the connection limits counted us under (0 = not counted)
+    unsigned int _capabilities;          // Capability bits enabled with CAP REQ
+    bool _capNegotiating;                // CAP LS or REQ before registration: no welcome until CAP END
+    std::string _account;                // Account logged in to with SASL, empty if none
+    long _peerUid;                       // Unix socket peers: uid from SO_PEERCRED (-1 = TCP)
+    bool _isBot;                         // User mode +B: marked as a bot (IRCv3 bot mode)
+    std::set<std::string> _monitored;    // Casefolded nicknames on the MONITOR list
+    int _hops;                           // Servers between us and this user or server (local = 0)
+    std::string _serverName;             // Links: the peer's name. Remote users: the server they are on
+    Client* _link;                       // Remote users: the link they are reached through (NULL if local)
+    InputBuffer _input;                  // Partial line between reads, empty (no memory) when idle
+    OutboundQueue _outbound;             // Bytes waiting for the socket to become writable
 
 public:
     Client(int fd);
@@ -30,6 +65,24 @@ public:
     std::vector<std::string> getChannels() const;
     bool isPasswordSet() const;
     bool isUserSet() const;
+    bool isOperator() const;
+    unsigned int getOperFailures() const;
+    LinkState getLinkState() const;
+    bool isLinkAuthorized() const;
+    bool isLinkCompressionOffered() const;
+    unsigned int getCountedAddress() const;
+    bool hasCapability(Capability capability) const;
+    unsigned int getCapabilities() const;
+    bool isCapNegotiating() const;
+    std::string getAccount() const;
+    long getPeerUid() const;
+    bool isBot() const;
+    const std::set<std::string>& getMonitored() const;
+    int getHops() const;
+    std::string getServerName() const;
+    Client* getLink() const;
+    bool isRemote() const;
+    bool isRegistered() const;
 
     // Setters
     void setNickname(const std::string& nickname);
@@ -40,12 +93,28 @@ public:
     void removeChannel(const std::string& channel);
     void setPassword(bool isSet);
     void setUser(bool isSet);
+    void setOperator(bool isOperator);
+    void setOperFailures(unsigned int failures);
+    void setLinkState(LinkState state);
+    void setLinkAuthorized(bool authorized);
+    void setLinkCompressionOffered(bool offered);
+    void setCountedAddress(unsigned int address);
+    void setCapabilities(unsigned int capabilities);
+    void setCapNegotiating(bool negotiating);
+    void setAccount(const std::string& account);
+    void setPeerUid(long uid);
+    void setBot(bool isBot);
+    // Both return whether the list changed; Server keeps its reverse index in step
+    bool addMonitored(const std::string& nickname);
+    bool removeMonitored(const std::string& nickname);
+    void setRemote(Client* link, const std::string& serverName, int hops);
+    void setServerName(const std::string& serverName);
 
     
     bool isInChannel(const std::string& channel) const;
     std::string getFullClientIdentifier() const;
-    void appendToBuffer(const std::string& data);
-    std::string& getBuffer();
+    InputBuffer& getInput();
+    OutboundQueue& getOutbound();
 };
 
 #endif // CLIENT_HPP
@@ -0,0 +1,87 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   inputBuffer.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/17 10:04:26 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/17 10:04:26 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "inputBuffer.hpp"
+#include <cstring>
+
+// Blocks beyond this many idle ones go back to the allocator
+static const size_t kMaxPooledBlocks = 1024;
+
+std::vector<char*> InputBuffer::_freeBlocks;
+size_t InputBuffer::_borrowedBlocks = 0;
+
+InputBuffer::InputBuffer() : _block(NULL), _length(0) {}
+
+InputBuffer::~InputBuffer() {
+    _release();
+}
+
+bool InputBuffer::empty() const {
+    return _length == 0;
+}
+
+size_t InputBuffer::size() const {
+    return _length;
+}
+
+void InputBuffer::moveTo(std::string& out) {
+    if (_block) {
+        out.append(_block, _length);
+        _release();
+    }
+}
+
+void InputBuffer::copyTo(std::string& out) const {
+    if (_block) {
+        out.append(_block, _length);
+    }
+}
+
+void InputBuffer::assign(const std::string& data) {
+    if (data.empty()) {
+        _release();
+        return;
+    }
+    if (!_block) {
+        if (_freeBlocks.empty()) {
+            _block = new char[kBlockSize];
+        } else {
+            _block = _freeBlocks.back();
+            _freeBlocks.pop_back();
+        }
+        ++_borrowedBlocks;
+    }
+    _length = static_cast<unsigned short>(data.length() < kBlockSize ? data.length() : kBlockSize);
+    std::memcpy(_block, data.data(), _length);
+}
+
+void InputBuffer::_release() {
+    if (!_block) {
+        return;
+    }
+    if (_freeBlocks.size() < kMaxPooledBlocks) {
+        _freeBlocks.push_back(_block);
+    } else {
+        delete[] _block;
+    }
+    _block = NULL;
+    _length = 0;
+    --_borrowedBlocks;
+}
+
+size_t InputBuffer::getBorrowedBlocks() {
+    return _borrowedBlocks;
+}
+
+size_t InputBuffer::getPooledBlocks() {
+    return _freeBlocks.size();
+}
@@ -0,0 +1,56 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   inputBuffer.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/17 10:04:18 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/17 10:04:18 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef INPUTBUFFER_HPP
+#define INPUTBUFFER_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// The incomplete line a client left after its last read. Idle clients hold
+// no memory: a fixed block is borrowed from a shared free list only while a
+// partial line is pending and handed back once it completes. Event loop only.
+class InputBuffer {
+public:
+    static const size_t kBlockSize = 512;   // Longest line the server accepts, \r\n included
+
+    InputBuffer();
+    ~InputBuffer();
+
+    bool empty() const;
+    size_t size() const;
+
+    // Appends the pending bytes to out and returns the block to the pool
+    void moveTo(std::string& out);
+    // Appends the pending bytes to out and keeps them
+    void copyTo(std::string& out) const;
+    // Keeps the first kBlockSize bytes of data, borrowing a block if there are any
+    void assign(const std::string& data);
+
+    static size_t getBorrowedBlocks();
+    static size_t getPooledBlocks();
+
+private:
+    char* _block;
+    unsigned short _length;
+
+    static std::vector<char*> _freeBlocks;
+    static size_t _borrowedBlocks;
+
+    void _release();
+
+    InputBuffer(const InputBuffer& other);
+    InputBuffer& operator=(const InputBuffer& other);
+};
+
+#endif // INPUTBUFFER_HPP
@@ -0,0 +1,207 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   outboundQueue.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/02 18:12:44 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/02 18:12:44 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "outboundQueue.hpp"
+#include <sys/socket.h>
+#include <cerrno>
+
+SharedMessage::SharedMessage(const std::string& data) : _data(data), _refs(1) {}
+
+SharedMessage::~SharedMessage() {}
+
+SharedMessage* SharedMessage::create(const std::string& data) {
+    return new SharedMessage(data);
+}
+
+void SharedMessage::retain() {
+    __sync_add_and_fetch(&_refs, 1);
+}
+
+void SharedMessage::release() {
+    if (__sync_sub_and_fetch(&_refs, 1) == 0) {
+        delete this;
+    }
+}
+
+const std::string& SharedMessage::getData() const {
+    return _data;
+}
+
+
+OutboundQueue::OutboundQueue()
+    : _head(NULL), _tail(NULL), _offset(0), _pendingBytes(0), _limit(0), _overflowed(false) {
+    pthread_mutex_init(&_mutex, NULL);
+}
+
+OutboundQueue::~OutboundQueue() {
+    clear();
+    pthread_mutex_destroy(&_mutex);
+}
+
+void OutboundQueue::pushLocked(SharedMessage* msg, size_t offset) {
+    Node* node = new Node;
+    node->msg = msg;
+    node->next = NULL;
+    if (_tail) {
+        _tail->next = node;
+    } else {
+        _head = node;
+        _offset = offset;
+    }
+    _tail = node;
+    _pendingBytes += msg->getData().length() - offset;
+}
+
+// Marks the queue overflowed if bytes more would not fit
+bool OutboundQueue::fitsLocked(size_t bytes) {
+    if (!_overflowed && _limit && _pendingBytes + bytes > _limit) {
+        _overflowed = true;
+    }
+    return !_overflowed;
+}
+
+void OutboundQueue::popLocked() {
+    Node* node = _head;
+    _head = node->next;
+    if (!_head) {
+        _tail = NULL;
+    }
+    _offset = 0;
+    node->msg->release();
+    delete node;
+}
+
+long OutboundQueue::flushLocked(int fd) {
+    while (_head) {
+        const std::string& data = _head->msg->getData();
+        ssize_t sent = send(fd, data.c_str() + _offset, data.length() - _offset, MSG_NOSIGNAL);
+        if (sent == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        _offset += sent;
+        _pendingBytes -= sent;
+        if (_offset == data.length()) {
+            popLocked();
+        }
+    }
+    return static_cast<long>(_pendingBytes);
+}
+
+long OutboundQueue::write(int fd, const std::string& data) {
+    pthread_mutex_lock(&_mutex);
+    long result = 0;
+    if (_overflowed) {
+        result = kOverflow;
+    } else if (!_head) {
+        // Fast path: nothing queued, so try the socket before copying anything
+        size_t offset = 0;
+        while (offset < data.length()) {
+            ssize_t sent = send(fd, data.c_str() + offset, data.length() - offset, MSG_NOSIGNAL);
+            if (sent == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    result = -1;
+                }
+                break;
+            }
+            offset += sent;
+        }
+        if (result != -1 && offset < data.length()) {
+            if (fitsLocked(data.length() - offset)) {
+                pushLocked(SharedMessage::create(data), offset);
+                result = static_cast<long>(_pendingBytes);
+            } else {
+                result = kOverflow;
+            }
+        }
+    } else if (fitsLocked(data.length())) {
+        pushLocked(SharedMessage::create(data), 0);
+        result = flushLocked(fd);
+    } else {
+        result = kOverflow;
+    }
+    pthread_mutex_unlock(&_mutex);
+    return result;
+}
+
+long OutboundQueue::push(SharedMessage* msg) {
+    pthread_mutex_lock(&_mutex);
+    long pending = kOverflow;
+    if (fitsLocked(msg->getData().length())) {
+        msg->retain();
+        pushLocked(msg, 0);
+        pending = static_cast<long>(_pendingBytes);
+    }
+    pthread_mutex_unlock(&_mutex);
+    return pending;
+}
+
+void OutboundQueue::setLimit(size_t bytes) {
+    pthread_mutex_lock(&_mutex);
+    _limit = bytes;
+    pthread_mutex_unlock(&_mutex);
+}
+
+bool OutboundQueue::isOverflowed() const {
+    pthread_mutex_lock(&_mutex);
+    bool overflowed = _overflowed;
+    pthread_mutex_unlock(&_mutex);
+    return overflowed;
+}
+
+long OutboundQueue::flush(int fd) {
+    pthread_mutex_lock(&_mutex);
+    long pending = flushLocked(fd);
+    pthread_mutex_unlock(&_mutex);
+    return pending;
+}
+
+bool OutboundQueue::empty() const {
+    pthread_mutex_lock(&_mutex);
+    bool isEmpty = (_head == NULL);
+    pthread_mutex_unlock(&_mutex);
+    return isEmpty;
+}
+
+size_t OutboundQueue::getPendingBytes() const {
+    pthread_mutex_lock(&_mutex);
+    size_t pending = _pendingBytes;
+    pthread_mutex_unlock(&_mutex);
+    return pending;
+}
+
+void OutboundQueue::copyPending(std::string& out) const {
+    pthread_mutex_lock(&_mutex);
+    out.reserve(out.length() + _pendingBytes);
+    for (Node* node = _head; node; node = node->next) {
+        const std::string& data = node->msg->getData();
+        out.append(data, node == _head ? _offset : 0, std::string::npos);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+void OutboundQueue::clear() {
+    pthread_mutex_lock(&_mutex);
+    while (_head) {
+        popLocked();
+    }
+    _pendingBytes = 0;
+    pthread_mutex_unlock(&_mutex);
+}
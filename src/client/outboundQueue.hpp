@@ -0,0 +1,89 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   outboundQueue.hpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/02 18:12:40 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/02 18:12:40 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef OUTBOUNDQUEUE_HPP
+#define OUTBOUNDQUEUE_HPP
+
+#include <string>
+#include <cstddef>
+#include <pthread.h>
+
+// Immutable message body shared by every recipient of a broadcast.
+// The last release() frees it, whichever thread that happens on.
+class SharedMessage {
+private:
+    std::string _data;
+    int _refs;
+
+    SharedMessage(const std::string& data);
+    ~SharedMessage();
+    SharedMessage(const SharedMessage& other);
+    SharedMessage& operator=(const SharedMessage& other);
+
+public:
+    static SharedMessage* create(const std::string& data);
+
+    void retain();
+    void release();
+    const std::string& getData() const;
+};
+
+// Per-client queue of bytes not yet accepted by the socket.
+// Every method takes the queue mutex, so the event loop and the fan-out
+// workers may push and flush the same client concurrently.
+class OutboundQueue {
+private:
+    struct Node {
+        SharedMessage* msg;
+        Node* next;
+    };
+
+    Node* _head;
+    Node* _tail;
+    size_t _offset;        // Bytes of _head->msg already sent
+    size_t _pendingBytes;
+    size_t _limit;         // Most bytes the queue may hold, 0 for no limit
+    bool _overflowed;      // Data was refused: the client is to be dropped
+    mutable pthread_mutex_t _mutex;
+
+    OutboundQueue(const OutboundQueue& other);
+    OutboundQueue& operator=(const OutboundQueue& other);
+
+    void pushLocked(SharedMessage* msg, size_t offset);
+    bool fitsLocked(size_t bytes);
+    void popLocked();
+    long flushLocked(int fd);
+
+public:
+    static const long kOverflow = -2;
+
+    OutboundQueue();
+    ~OutboundQueue();
+
+    void setLimit(size_t bytes);
+    bool isOverflowed() const;
+
+    // All three return the bytes still queued afterwards, or -1 on a socket error.
+    // write() and push() return kOverflow instead of queueing past the limit; the
+    // queue then refuses everything after it too, and keeps only what it had.
+    long write(int fd, const std::string& data);
+    long push(SharedMessage* msg);
+    long flush(int fd);
+
+    bool empty() const;
+    size_t getPendingBytes() const;
+    // Appends the bytes not yet sent, in order, to out
+    void copyPending(std::string& out) const;
+    void clear();
+};
+
+#endif // OUTBOUNDQUEUE_HPP
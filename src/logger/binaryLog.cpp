@@ -0,0 +1,232 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   binaryLog.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/09 16:05:18 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/09 16:05:18 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "binaryLog.hpp"
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace BinaryLogFormat;
+
+static const size_t kWindowSize = 4 * 1024 * 1024;   // Multiple of the page size
+
+// One mapped slice of the file. tail only grows; a writer whose reservation
+// runs past the end leaves the rest of the window zeroed and maps the next.
+struct Window {
+    char* data;
+    size_t base;
+    size_t tail;
+    Window* previous;
+};
+
+static int fileFd = -1;
+static Window* current = NULL;
+static unsigned long dropped = 0;
+static pthread_mutex_t growMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t nowNs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+static Window* mapWindow(size_t base, size_t tail, Window* previous) {
+    if (ftruncate(fileFd, base + kWindowSize) == -1) {
+        return NULL;
+    }
+    void* data = mmap(NULL, kWindowSize, PROT_READ | PROT_WRITE, MAP_SHARED, fileFd, base);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    Window* window = new Window;
+    window->data = static_cast<char*>(data);
+    window->base = base;
+    window->tail = tail;
+    window->previous = previous;
+    return window;
+}
+
+static void unmapAll(Window* window) {
+    while (window) {
+        Window* previous = window->previous;
+        munmap(window->data, kWindowSize);
+        delete window;
+        window = previous;
+    }
+}
+
+// Called by the writer that overflowed `full`; the first one maps the next window
+static void grow(Window* full) {
+    pthread_mutex_lock(&growMutex);
+    if (__atomic_load_n(&current, __ATOMIC_ACQUIRE) == full) {
+        Window* next = mapWindow(full->base + kWindowSize, 0, full);
+        // On failure the log stays attached to the full window and records are dropped
+        if (next) {
+            __atomic_store_n(&current, next, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&growMutex);
+}
+
+char* BinaryLog::_reserve(size_t size) {
+    if (size > kWindowSize) {
+        return NULL;
+    }
+    while (true) {
+        Window* window = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+        if (!window) {
+            return NULL;
+        }
+        size_t offset = __atomic_fetch_add(&window->tail, size, __ATOMIC_RELAXED);
+        if (offset + size <= kWindowSize) {
+            return window->data + offset;
+        }
+        grow(window);
+        if (__atomic_load_n(&current, __ATOMIC_ACQUIRE) == window) {
+            __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+    }
+}
+
+bool BinaryLog::open(const std::string& path) {
+    if (fileFd != -1) {
+        return false;
+    }
+    fileFd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fileFd == -1) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fileFd, &info) == -1) {
+        ::close(fileFd);
+        fileFd = -1;
+        return false;
+    }
+    // Keep appending after whatever an earlier run left behind
+    size_t size = static_cast<size_t>(info.st_size);
+    size_t base = size - size % kWindowSize;
+    Window* window = mapWindow(base, size - base, NULL);
+    if (!window) {
+        ::close(fileFd);
+        fileFd = -1;
+        return false;
+    }
+    dropped = 0;
+    __atomic_store_n(&current, window, __ATOMIC_RELEASE);
+
+    char* out = _reserve(sizeof(Header) + sizeof(Session));
+    if (out) {
+        Header header;
+        header.type = RECORD_SESSION;
+        header.extra = 0;
+        header.formatId = 0;
+        header.length = sizeof(Header) + sizeof(Session);
+        Session session;
+        std::memcpy(session.magic, kMagic, sizeof(kMagic));
+        session.monotonicNs = nowNs(CLOCK_MONOTONIC);
+        session.realtimeNs = nowNs(CLOCK_REALTIME);
+        session.pid = static_cast<uint32_t>(getpid());
+        session.reserved = 0;
+        std::memcpy(out + sizeof(Header), &session, sizeof(session));
+        std::memcpy(out, &header, sizeof(header));
+    }
+    return true;
+}
+
+void BinaryLog::close() {
+    Window* window = __atomic_exchange_n(&current, static_cast<Window*>(NULL), __ATOMIC_ACQ_REL);
+    if (!window) {
+        return;
+    }
+    // Trim the unused part of the last window so the next run appends right after
+    size_t used = window->tail < kWindowSize ? window->tail : kWindowSize;
+    size_t end = window->base + used;
+    unmapAll(window);
+    if (ftruncate(fileFd, end) == -1) {
+        // The zeroed tail stays; readers skip it
+    }
+    ::close(fileFd);
+    fileFd = -1;
+}
+
+bool BinaryLog::isOpen() {
+    return __atomic_load_n(&current, __ATOMIC_ACQUIRE) != NULL;
+}
+
+unsigned long BinaryLog::getDroppedCount() {
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+void BinaryLog::writeFormat(unsigned short formatId, Logger::LogLevel level, const char* format) {
+    size_t textLength = std::strlen(format);
+    Header header;
+    header.type = RECORD_FORMAT;
+    header.extra = static_cast<uint8_t>(level);
+    header.formatId = formatId;
+    header.length = static_cast<uint32_t>(sizeof(Header) + textLength);
+    char* out = _reserve(header.length);
+    if (!out) {
+        return;
+    }
+    std::memcpy(out + sizeof(Header), format, textLength);
+    std::memcpy(out, &header, sizeof(header));
+}
+
+void BinaryLog::writeEvent(unsigned short formatId, const LogArgs& args) {
+    size_t length = sizeof(Header) + sizeof(uint64_t);
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i].type == LogArgs::INTEGER) {
+            length += 1 + sizeof(int64_t);
+        } else {
+            size_t bytes = args[i].length < kMaxStringArg ? args[i].length : kMaxStringArg;
+            length += 1 + sizeof(uint32_t) + bytes;
+        }
+    }
+    char* out = _reserve(length);
+    if (!out) {
+        return;
+    }
+
+    char* cursor = out + sizeof(Header);
+    uint64_t timestamp = nowNs(CLOCK_MONOTONIC);
+    std::memcpy(cursor, &timestamp, sizeof(timestamp));
+    cursor += sizeof(timestamp);
+    for (size_t i = 0; i < args.size(); ++i) {
+        const LogArgs::Arg& arg = args[i];
+        if (arg.type == LogArgs::INTEGER) {
+            *cursor++ = ARG_INTEGER;
+            int64_t value = arg.value;
+            std::memcpy(cursor, &value, sizeof(value));
+            cursor += sizeof(value);
+        } else {
+            *cursor++ = ARG_STRING;
+            uint32_t bytes = static_cast<uint32_t>(arg.length < kMaxStringArg ? arg.length : kMaxStringArg);
+            std::memcpy(cursor, &bytes, sizeof(bytes));
+            cursor += sizeof(bytes);
+            std::memcpy(cursor, arg.data, bytes);
+            cursor += bytes;
+        }
+    }
+
+    // The header goes last so a torn record never looks complete
+    Header header;
+    header.type = RECORD_EVENT;
+    header.extra = static_cast<uint8_t>(args.size());
+    header.formatId = formatId;
+    header.length = static_cast<uint32_t>(length);
+    std::memcpy(out, &header, sizeof(header));
+}
@@ -0,0 +1,81 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   binaryLog.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/09 16:05:12 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/09 16:05:12 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef BINARYLOG_HPP
+#define BINARYLOG_HPP
+
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+#include "logger.hpp"
+
+/*
+On-disk layout, shared with tools/logdump.cpp. The file is a sequence of
+records in host byte order, each starting with a BinaryLogHeader whose length
+covers the whole record. Runs of zero bytes between records are padding left
+at the end of a mapping window (or by a crash) and are skipped by readers.
+
+Every server run starts with a SESSION record, followed by one FORMAT record
+per template known so far; format IDs are only meaningful within a session.
+*/
+namespace BinaryLogFormat {
+    enum RecordType {
+        RECORD_SESSION = 1,
+        RECORD_FORMAT = 2,
+        RECORD_EVENT = 3
+    };
+
+    enum ArgType {
+        ARG_INTEGER = 1,   // int64_t
+        ARG_STRING = 2     // uint32_t length, then the bytes
+    };
+
+    struct Header {
+        uint8_t type;
+        uint8_t extra;       // FORMAT: log level, EVENT: argument count
+        uint16_t formatId;
+        uint32_t length;     // Header included
+    };
+
+    struct Session {
+        char magic[8];
+        uint64_t monotonicNs;   // Clock used by EVENT records
+        uint64_t realtimeNs;    // Wall clock at the same instant
+        uint32_t pid;
+        uint32_t reserved;
+    };
+
+    // FORMAT: Header, then the template text (length - sizeof(Header) bytes)
+    // EVENT: Header, uint64_t monotonicNs, then extra arguments
+
+    static const char kMagic[8] = { 'I', 'R', 'C', 'B', 'L', 'O', 'G', '1' };
+    static const size_t kMaxStringArg = 4096;   // Longer string arguments are truncated
+}
+
+// Append-only writer for the format above. The file is extended and mapped
+// in fixed windows; writers reserve space with an atomic add, so records can
+// come from any thread. open() and close() must not race with writers.
+class BinaryLog {
+public:
+    static bool open(const std::string& path);
+    static void close();
+    static bool isOpen();
+
+    static void writeFormat(unsigned short formatId, Logger::LogLevel level, const char* format);
+    static void writeEvent(unsigned short formatId, const LogArgs& args);
+    static unsigned long getDroppedCount();
+
+private:
+    static char* _reserve(size_t size);
+};
+
+#endif // BINARYLOG_HPP
@@ -6,32 +6,465 @@
 /*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/09/07 20:40:36 by rdolzi            #+#    #+#             */
-/*   Updated: 2024/09/07 20:40:37 by rdolzi           ###   ########.fr       */
+/*   Updated: 2024/10/06 11:20:05 by rdolzi           ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #include "logger.hpp"
+#include "binaryLog.hpp"
+#include "../trace/tracer.hpp"
 #include <iostream>
 #include <ctime>
-#include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
 
 Logger::LogLevel Logger::currentLevel = Logger::INFO;
-std::ofstream Logger::logFile;
+int Logger::logFd = -1;
+
+static const size_t kRecordSize = 1024;   // Longer records are truncated in async mode
+static const size_t kBatchSize = 64;
+static const size_t kCacheLine = 64;
+
+struct LogSlot {
+    size_t sequence;
+    size_t length;
+    char data[kRecordSize];
+};
+
+// Bounded multi-producer ring (Vyukov style): a slot is free for position p
+// when its sequence is p, and holds a record when its sequence is p + 1.
+// The writer parks on writerWake once the ring is empty, and producers only
+// take the mutex to wake it or, under BLOCK, to wait on spaceFree.
+struct AsyncLog {
+    LogSlot* slots;
+    size_t mask;
+    Logger::OverflowPolicy policy;
+    bool running;
+    pthread_t writer;
+    pthread_mutex_t mutex;
+    pthread_cond_t writerWake;
+    pthread_cond_t spaceFree;
+    bool writerParked;           // Set by the writer before it waits, cleared by whoever wakes it
+    unsigned int blockedProducers;
+    char pad0[kCacheLine];
+    size_t enqueuePos;
+    char pad1[kCacheLine];
+    unsigned long dropped;
+    char pad2[kCacheLine];
+};
+
+static AsyncLog asyncLog;
+static bool asyncEnabled = false;
+
+// LOG_EVENT templates. IDs 0..3 are reserved for plain LOG_* messages, one
+// per level, so that binary mode also captures sites without a template.
+static const size_t kMaxFormats = 1024;
+static const size_t kPlainFormats = 4;
+static const char* formatTexts[kMaxFormats] = { "{}", "{}", "{}", "{}" };
+static Logger::LogLevel formatLevels[kMaxFormats] = { Logger::DEBUG, Logger::INFO, Logger::WARNING, Logger::ERROR };
+static size_t formatCount = kPlainFormats;
+static pthread_mutex_t formatMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char* levelName(Logger::LogLevel level) {
+    switch (level) {
+        case Logger::DEBUG: return "DEBUG";
+        case Logger::INFO: return "INFO";
+        case Logger::WARNING: return "WARNING";
+        case Logger::ERROR: return "ERROR";
+    }
+    return "";
+}
+
+// strftime runs at most once per second per thread
+static size_t formatTimestamp(char* out) {
+    static __thread time_t cachedSecond = -1;
+    static __thread char cached[32];
+    static __thread size_t cachedLength = 0;
+
+    std::time_t now = std::time(0);
+    if (now != cachedSecond) {
+        std::tm localTime;
+        localtime_r(&now, &localTime);
+        cachedLength = std::strftime(cached, sizeof(cached), "%Y-%m-%d %H:%M:%S", &localTime);
+        cachedSecond = now;
+    }
+    std::memcpy(out, cached, cachedLength);
+    return cachedLength;
+}
+
+static void writeAll(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t written = writev(fd, iov, count);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        while (count > 0 && static_cast<size_t>(written) >= iov->iov_len) {
+            written -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+            iov->iov_len -= written;
+        }
+    }
+}
+
+static void writeBatch(int logFd, struct iovec* iov, int count) {
+    struct iovec copy[kBatchSize];
+    if (logFd != -1) {
+        std::memcpy(copy, iov, sizeof(struct iovec) * count);
+    }
+    writeAll(STDOUT_FILENO, iov, count);
+    if (logFd != -1) {
+        writeAll(logFd, copy, count);
+    }
+}
+
+static void wakeWriter() {
+    pthread_mutex_lock(&asyncLog.mutex);
+    if (asyncLog.writerParked) {
+        __atomic_store_n(&asyncLog.writerParked, false, __ATOMIC_RELAXED);
+        pthread_cond_signal(&asyncLog.writerWake);
+    }
+    pthread_mutex_unlock(&asyncLog.mutex);
+}
+
+// BLOCK policy: sleeps until the writer frees the slot for pos, or stops
+static void waitForSpace(size_t pos) {
+    LogSlot* slot = &asyncLog.slots[pos & asyncLog.mask];
+    pthread_mutex_lock(&asyncLog.mutex);
+    __atomic_add_fetch(&asyncLog.blockedProducers, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (asyncLog.writerParked) {
+        __atomic_store_n(&asyncLog.writerParked, false, __ATOMIC_RELAXED);
+        pthread_cond_signal(&asyncLog.writerWake);
+    }
+    while (static_cast<long>(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - pos) < 0
+           && __atomic_load_n(&asyncLog.running, __ATOMIC_ACQUIRE)) {
+        pthread_cond_wait(&asyncLog.spaceFree, &asyncLog.mutex);
+    }
+    __atomic_sub_fetch(&asyncLog.blockedProducers, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&asyncLog.mutex);
+}
+
+static bool enqueueRecord(Logger::LogLevel level, const std::string& message) {
+    size_t pos = __atomic_load_n(&asyncLog.enqueuePos, __ATOMIC_RELAXED);
+    LogSlot* slot;
+    while (true) {
+        slot = &asyncLog.slots[pos & asyncLog.mask];
+        size_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        long diff = static_cast<long>(sequence) - static_cast<long>(pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&asyncLog.enqueuePos, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            if (asyncLog.policy == Logger::DROP) {
+                __atomic_add_fetch(&asyncLog.dropped, 1, __ATOMIC_RELAXED);
+                return false;
+            }
+            waitForSpace(pos);
+            pos = __atomic_load_n(&asyncLog.enqueuePos, __ATOMIC_RELAXED);
+        } else {
+            pos = __atomic_load_n(&asyncLog.enqueuePos, __ATOMIC_RELAXED);
+        }
+    }
+
+    // "<timestamp> [<LEVEL>] <message>\n", truncated to the slot size
+    char* out = slot->data;
+    size_t len = formatTimestamp(out);
+    const char* name = levelName(level);
+    out[len++] = ' ';
+    out[len++] = '[';
+    size_t nameLen = std::strlen(name);
+    std::memcpy(out + len, name, nameLen);
+    len += nameLen;
+    out[len++] = ']';
+    out[len++] = ' ';
+    size_t room = kRecordSize - len - 1;
+    size_t copied = message.length() < room ? message.length() : room;
+    std::memcpy(out + len, message.data(), copied);
+    len += copied;
+    out[len++] = '\n';
+    slot->length = len;
+
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+    // Pairs with the fence in parkWriter(): either the writer sees this
+    // record before it sleeps, or we see it parked and wake it
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&asyncLog.writerParked, __ATOMIC_RELAXED)) {
+        wakeWriter();
+    }
+    return true;
+}
+
+// Drains every ready record, kBatchSize at a time. Returns how many were written.
+static size_t drainRing(size_t& dequeuePos, int logFd) {
+    size_t total = 0;
+    while (true) {
+        struct iovec iov[kBatchSize];
+        size_t positions[kBatchSize];
+        int count = 0;
+        while (count < static_cast<int>(kBatchSize)) {
+            LogSlot& slot = asyncLog.slots[dequeuePos & asyncLog.mask];
+            if (__atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE) != dequeuePos + 1) {
+                break;
+            }
+            iov[count].iov_base = slot.data;
+            iov[count].iov_len = slot.length;
+            positions[count] = dequeuePos;
+            ++count;
+            ++dequeuePos;
+        }
+        if (count == 0) {
+            return total;
+        }
+        {
+            TraceSpan span("log write", NULL, count);
+            writeBatch(logFd, iov, count);
+        }
+        for (int i = 0; i < count; ++i) {
+            LogSlot& slot = asyncLog.slots[positions[i] & asyncLog.mask];
+            __atomic_store_n(&slot.sequence, positions[i] + asyncLog.mask + 1, __ATOMIC_RELEASE);
+        }
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&asyncLog.blockedProducers, __ATOMIC_RELAXED) > 0) {
+            pthread_mutex_lock(&asyncLog.mutex);
+            pthread_cond_broadcast(&asyncLog.spaceFree);
+            pthread_mutex_unlock(&asyncLog.mutex);
+        }
+        total += count;
+    }
+}
+
+static void reportDropped(unsigned long& reported, int logFd) {
+    unsigned long dropped = __atomic_load_n(&asyncLog.dropped, __ATOMIC_RELAXED);
+    if (dropped == reported) {
+        return;
+    }
+    char line[kRecordSize];
+    size_t len = formatTimestamp(line);
+    int extra = snprintf(line + len, sizeof(line) - len, " [WARNING] Logger dropped %lu records (ring full)\n",
+                         dropped - reported);
+    struct iovec iov;
+    iov.iov_base = line;
+    iov.iov_len = len + extra;
+    writeBatch(logFd, &iov, 1);
+    reported = dropped;
+}
+
+// Sleeps until a producer publishes the record at dequeuePos or stopAsync()
+// runs. The record is checked again after writerParked is set, so one
+// published in between is never left waiting.
+static void parkWriter(size_t dequeuePos) {
+    LogSlot* slot = &asyncLog.slots[dequeuePos & asyncLog.mask];
+    pthread_mutex_lock(&asyncLog.mutex);
+    __atomic_store_n(&asyncLog.writerParked, true, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) == dequeuePos + 1
+        || !__atomic_load_n(&asyncLog.running, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&asyncLog.writerParked, false, __ATOMIC_RELAXED);
+    }
+    while (asyncLog.writerParked) {
+        pthread_cond_wait(&asyncLog.writerWake, &asyncLog.mutex);
+    }
+    pthread_mutex_unlock(&asyncLog.mutex);
+}
+
+static void* writerMain(void* arg) {
+    int logFd = *static_cast<int*>(arg);
+    Tracer::setThreadName("log writer");
+    size_t dequeuePos = 0;
+    unsigned long reported = 0;
+
+    while (__atomic_load_n(&asyncLog.running, __ATOMIC_ACQUIRE)) {
+        drainRing(dequeuePos, logFd);
+        reportDropped(reported, logFd);
+        parkWriter(dequeuePos);
+    }
+    drainRing(dequeuePos, logFd);
+    reportDropped(reported, logFd);
+    return NULL;
+}
 
 void Logger::setLogLevel(LogLevel level) {
     currentLevel = level;
 }
 
 void Logger::setLogFile(const std::string& filename) {
-    if (logFile.is_open()) {
-        logFile.close();
+    if (logFd != -1) {
+        close(logFd);
     }
-    logFile.open(filename.c_str(), std::ios::app);
-    if (!logFile.is_open()) {
+    logFd = open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (logFd == -1) {
         std::cerr << "Failed to open log file: " << filename << std::endl;
     }
 }
 
+bool Logger::startAsync(size_t capacity, OverflowPolicy policy) {
+    if (asyncEnabled || capacity == 0) {
+        return false;
+    }
+    size_t rounded = 1;
+    while (rounded < capacity) {
+        rounded <<= 1;
+    }
+
+    asyncLog.slots = new LogSlot[rounded];
+    for (size_t i = 0; i < rounded; ++i) {
+        asyncLog.slots[i].sequence = i;
+        asyncLog.slots[i].length = 0;
+    }
+    asyncLog.mask = rounded - 1;
+    asyncLog.policy = policy;
+    asyncLog.enqueuePos = 0;
+    asyncLog.dropped = 0;
+    asyncLog.running = true;
+    asyncLog.writerParked = false;
+    asyncLog.blockedProducers = 0;
+    pthread_mutex_init(&asyncLog.mutex, NULL);
+    pthread_cond_init(&asyncLog.writerWake, NULL);
+    pthread_cond_init(&asyncLog.spaceFree, NULL);
+
+    if (pthread_create(&asyncLog.writer, NULL, &writerMain, &logFd) != 0) {
+        pthread_cond_destroy(&asyncLog.spaceFree);
+        pthread_cond_destroy(&asyncLog.writerWake);
+        pthread_mutex_destroy(&asyncLog.mutex);
+        delete[] asyncLog.slots;
+        asyncLog.slots = NULL;
+        return false;
+    }
+    std::cout.flush();
+    __atomic_store_n(&asyncEnabled, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+void Logger::stopAsync() {
+    if (!asyncEnabled) {
+        return;
+    }
+    __atomic_store_n(&asyncEnabled, false, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&asyncLog.mutex);
+    __atomic_store_n(&asyncLog.running, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&asyncLog.writerParked, false, __ATOMIC_RELAXED);
+    pthread_cond_signal(&asyncLog.writerWake);
+    pthread_cond_broadcast(&asyncLog.spaceFree);
+    pthread_mutex_unlock(&asyncLog.mutex);
+    pthread_join(asyncLog.writer, NULL);
+    pthread_cond_destroy(&asyncLog.spaceFree);
+    pthread_cond_destroy(&asyncLog.writerWake);
+    pthread_mutex_destroy(&asyncLog.mutex);
+    delete[] asyncLog.slots;
+    asyncLog.slots = NULL;
+}
+
+unsigned long Logger::getDroppedCount() {
+    return asyncEnabled ? __atomic_load_n(&asyncLog.dropped, __ATOMIC_RELAXED) : 0;
+}
+
+bool Logger::openBinary(const std::string& path) {
+    pthread_mutex_lock(&formatMutex);
+    bool opened = BinaryLog::open(path);
+    if (opened) {
+        for (size_t id = 0; id < formatCount; ++id) {
+            BinaryLog::writeFormat(static_cast<unsigned short>(id), formatLevels[id], formatTexts[id]);
+        }
+    }
+    pthread_mutex_unlock(&formatMutex);
+    return opened;
+}
+
+void Logger::closeBinary() {
+    BinaryLog::close();
+}
+
+unsigned short Logger::defineFormat(LogLevel level, const char* format) {
+    pthread_mutex_lock(&formatMutex);
+    size_t id = level;
+    if (formatCount < kMaxFormats) {
+        id = formatCount++;
+        formatTexts[id] = format;
+        formatLevels[id] = level;
+        if (BinaryLog::isOpen()) {
+            BinaryLog::writeFormat(static_cast<unsigned short>(id), level, format);
+        }
+    }
+    pthread_mutex_unlock(&formatMutex);
+    return static_cast<unsigned short>(id);
+}
+
+void Logger::event(unsigned short formatId, const LogArgs& args) {
+    LogLevel level = formatLevels[formatId];
+    if (level < currentLevel) return;
+
+    if (BinaryLog::isOpen()) {
+        TraceSpan span("log", levelName(level));
+        BinaryLog::writeEvent(formatId, args);
+        return;
+    }
+    log(level, render(formatTexts[formatId], args));
+}
+
+std::string Logger::render(const char* format, const LogArgs& args) {
+    std::string out;
+    size_t next = 0;
+    for (const char* p = format; *p; ++p) {
+        if (p[0] == '{' && p[1] == '}') {
+            if (next < args.size()) {
+                const LogArgs::Arg& arg = args[next];
+                if (arg.type == LogArgs::INTEGER) {
+                    char number[32];
+                    int length = snprintf(number, sizeof(number), "%lld", arg.value);
+                    out.append(number, length);
+                } else {
+                    out.append(arg.data, arg.length);
+                }
+            }
+            ++next;
+            ++p;
+        } else {
+            out += *p;
+        }
+    }
+    return out;
+}
+
+LogArgs& LogArgs::operator<<(const char* value) {
+    return _string(value, value ? std::strlen(value) : 0);
+}
+
+LogArgs& LogArgs::_integer(long long value) {
+    if (_count < kMaxArgs) {
+        _args[_count].type = INTEGER;
+        _args[_count].value = value;
+        _args[_count].data = NULL;
+        _args[_count].length = 0;
+        ++_count;
+    }
+    return *this;
+}
+
+LogArgs& LogArgs::_string(const char* data, size_t length) {
+    if (_count < kMaxArgs) {
+        _args[_count].type = STRING;
+        _args[_count].value = 0;
+        _args[_count].data = data;
+        _args[_count].length = length;
+        ++_count;
+    }
+    return *this;
+}
+
 void Logger::debug(const std::string& message) {
     log(DEBUG, message);
 }
@@ -50,27 +483,32 @@ void Logger::error(const std::string& message) {
 
 void Logger::log(LogLevel level, const std::string& message) {
     if (level < currentLevel) return;
+    TraceSpan span("log", levelName(level));
 
-    std::string levelStr;
-    switch (level) {
-        case DEBUG: levelStr = "DEBUG"; break;
-        case INFO: levelStr = "INFO"; break;
-        case WARNING: levelStr = "WARNING"; break;
-        case ERROR: levelStr = "ERROR"; break;
+    if (BinaryLog::isOpen()) {
+        LogArgs args;
+        args << message;
+        BinaryLog::writeEvent(static_cast<unsigned short>(level), args);
+        return;
+    }
+
+    if (__atomic_load_n(&asyncEnabled, __ATOMIC_ACQUIRE)) {
+        enqueueRecord(level, message);
+        return;
     }
 
-    std::string logMessage = getTimestamp() + " [" + levelStr + "] " + message;
+    std::string logMessage = getTimestamp() + " [" + levelName(level) + "] " + message;
 
     std::cout << logMessage << std::endl;
-    if (logFile.is_open()) {
-        logFile << logMessage << std::endl;
+    if (logFd != -1) {
+        logMessage += '\n';
+        ssize_t ignored = write(logFd, logMessage.c_str(), logMessage.length());
+        (void)ignored;
     }
 }
 
 std::string Logger::getTimestamp() {
-    std::time_t now = std::time(0);
-    std::tm* localTime = std::localtime(&now);
-    char buffer[80];
-    std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", localTime);
-    return std::string(buffer);
-}
\ No newline at end of file
+    char buffer[32];
+    size_t len = formatTimestamp(buffer);
+    return std::string(buffer, len);
+}
@@ -6,7 +6,7 @@
 /*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2024/09/07 20:40:39 by rdolzi            #+#    #+#             */
-/*   Updated: 2024/09/07 20:40:39 by rdolzi           ###   ########.fr       */
+/*   Updated: 2024/10/06 11:20:02 by rdolzi           ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -14,7 +14,45 @@
 #define LOGGER_HPP
 
 #include <string>
-#include <fstream>
+#include <cstddef>
+
+// Arguments of a LOG_EVENT call site, collected with operator<<. Strings are
+// referenced, not copied, so a LogArgs must not outlive the statement.
+class LogArgs {
+public:
+    enum Type {
+        INTEGER,
+        STRING
+    };
+
+    struct Arg {
+        Type type;
+        long long value;
+        const char* data;
+        size_t length;
+    };
+
+    static const size_t kMaxArgs = 6;   // Extra arguments are ignored
+
+    LogArgs() : _count(0) {}
+
+    LogArgs& operator<<(int value) { return _integer(value); }
+    LogArgs& operator<<(unsigned int value) { return _integer(value); }
+    LogArgs& operator<<(long value) { return _integer(value); }
+    LogArgs& operator<<(unsigned long value) { return _integer(static_cast<long long>(value)); }
+    LogArgs& operator<<(const std::string& value) { return _string(value.data(), value.length()); }
+    LogArgs& operator<<(const char* value);
+
+    size_t size() const { return _count; }
+    const Arg& operator[](size_t index) const { return _args[index]; }
+
+private:
+    Arg _args[kMaxArgs];
+    size_t _count;
+
+    LogArgs& _integer(long long value);
+    LogArgs& _string(const char* data, size_t length);
+};
 
 class Logger {
 public:
@@ -25,9 +63,32 @@ public:
         ERROR
     };
 
+    // What a producer does when the async ring is full
+    enum OverflowPolicy {
+        DROP,   // Discard the record and count it
+        BLOCK   // Wait for the writer thread to free a slot
+    };
+
     static void setLogLevel(LogLevel level);
     static void setLogFile(const std::string& filename);
 
+    // Async mode: log calls only copy the formatted record into a bounded
+    // lock-free ring; a background thread writes batches with writev().
+    static bool startAsync(size_t capacity, OverflowPolicy policy);
+    static void stopAsync();
+    static unsigned long getDroppedCount();
+
+    // Binary mode: every record is appended to a memory-mapped file as a
+    // format ID plus raw arguments; ircserv-logdump renders it offline.
+    static bool openBinary(const std::string& path);
+    static void closeBinary();
+
+    static bool isEnabled(LogLevel level) { return level >= currentLevel; }
+
+    // Registers a "{}"-placeholder template once per LOG_EVENT call site
+    static unsigned short defineFormat(LogLevel level, const char* format);
+    static void event(unsigned short formatId, const LogArgs& args);
+
     static void debug(const std::string& message);
     static void info(const std::string& message);
     static void warning(const std::string& message);
@@ -35,10 +96,60 @@ public:
 
 private:
     static LogLevel currentLevel;
-    static std::ofstream logFile;
+    static int logFd;
 
     static void log(LogLevel level, const std::string& message);
     static std::string getTimestamp();
+    static std::string render(const char* format, const LogArgs& args);
 };
 
-#endif // LOGGER_HPP
\ No newline at end of file
+/*
+Prefer these macros to the functions above: the message expression is only
+evaluated when its level is enabled, so a disabled LOG_DEBUG costs a single
+comparison and no string building. Sites below LOG_MIN_LEVEL (set at build
+time, e.g. make LOG_MIN_LEVEL=1) are compiled out altogether.
+*/
+#ifndef LOG_MIN_LEVEL
+# define LOG_MIN_LEVEL 0
+#endif
+
+#define LOG_ENABLED(level) ((level) >= LOG_MIN_LEVEL && Logger::isEnabled(level))
+
+#define LOG_DISCARD(message) do { if (0) { (void)(message); } } while (0)
+
+#if LOG_MIN_LEVEL <= 0
+# define LOG_DEBUG(message) do { if (Logger::isEnabled(Logger::DEBUG)) Logger::debug(message); } while (0)
+#else
+# define LOG_DEBUG(message) LOG_DISCARD(message)
+#endif
+
+#if LOG_MIN_LEVEL <= 1
+# define LOG_INFO(message) do { if (Logger::isEnabled(Logger::INFO)) Logger::info(message); } while (0)
+#else
+# define LOG_INFO(message) LOG_DISCARD(message)
+#endif
+
+#if LOG_MIN_LEVEL <= 2
+# define LOG_WARNING(message) do { if (Logger::isEnabled(Logger::WARNING)) Logger::warning(message); } while (0)
+#else
+# define LOG_WARNING(message) LOG_DISCARD(message)
+#endif
+
+#define LOG_ERROR(message) do { if (Logger::isEnabled(Logger::ERROR)) Logger::error(message); } while (0)
+
+/*
+Templated variant for hot call sites: the format is registered once and only
+the arguments travel with each record, e.g.
+    LOG_EVENT(Logger::DEBUG, "Received command from client {}: {}", << fd << line);
+In text mode the template is rendered as usual; in binary mode nothing is
+formatted at all.
+*/
+#define LOG_EVENT(level, format, args) \
+    do { \
+        if (LOG_ENABLED(level)) { \
+            static const unsigned short logEventFormat = Logger::defineFormat(level, format); \
+            Logger::event(logEventFormat, LogArgs() args); \
+        } \
+    } while (0)
+
+#endif // LOGGER_HPP
@@ -15,13 +15,46 @@
 #include <cstdlib>
 #include <stdexcept>
 #include "logger/logger.hpp"
+#include "trace/tracer.hpp"
+
+// UPGRADE starts the binary now at the path we were started from, with our
+// arguments; the path is resolved here, before a new build replaces the file
+static std::vector<std::string> upgradeCommand(int argc, char* argv[]) {
+    std::vector<std::string> command;
+    char path[4096];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    command.push_back(length > 0 ? std::string(path, length) : std::string(argv[0]));
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]).compare(0, 13, "--upgrade-fd=") != 0) {
+            command.push_back(argv[i]);
+        }
+    }
+    return command;
+}
 
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <port> <password>" << std::endl;
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <port> <password> [options]" << std::endl;
+        std::cerr << ServerConfig::usage();
         return 1;
     }
+
+    ServerConfig config;
+    for (int i = 3; i < argc; ++i) {
+        if (!config.parseOption(argv[i])) {
+            std::cerr << "Invalid option: " << argv[i] << std::endl;
+            std::cerr << ServerConfig::usage();
+            return 1;
+        }
+    }
     Logger::setLogLevel(Logger::DEBUG); 
+    if (config.logLevel == "info") {
+        Logger::setLogLevel(Logger::INFO);
+    } else if (config.logLevel == "warning") {
+        Logger::setLogLevel(Logger::WARNING);
+    } else if (config.logLevel == "error") {
+        Logger::setLogLevel(Logger::ERROR);
+    }
     int port;
     try {
         port = std::atoi(argv[1]);
@@ -36,14 +69,35 @@ int main(int argc, char* argv[]) {
 
     std::string password = argv[2];
 
+    if (!config.logFile.empty()) {
+        Logger::setLogFile(config.logFile);
+    }
+    if (!config.logBinary.empty() && !Logger::openBinary(config.logBinary)) {
+        std::cerr << "Failed to open binary log: " << config.logBinary << std::endl;
+        return 1;
+    }
+    if (config.traceSpans > 0) {
+        Tracer::enable(config.traceSpans);
+        Tracer::installSignalHandler();
+    }
+    if (config.logAsyncCapacity > 0) {
+        Logger::startAsync(config.logAsyncCapacity, config.logBlockOnOverflow ? Logger::BLOCK : Logger::DROP);
+    }
+
+    Server::installShutdownHandler();
     try {
-        Server server(port, password);
+        Server server(port, password, config);
+        server.setUpgradeCommand(upgradeCommand(argc, argv));
         server.run();
     } catch (const std::exception& e) {
+        Logger::stopAsync();
+        Logger::closeBinary();
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
 
+    Logger::stopAsync();
+    Logger::closeBinary();
     return 0;
 }
 
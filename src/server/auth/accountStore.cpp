@@ -0,0 +1,170 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   accountStore.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/23 10:12:07 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/23 10:12:07 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "accountStore.hpp"
+#include "sha256.hpp"
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char* const kScheme = "pbkdf2-sha256";
+
+static std::string toHex(const std::string& bytes) {
+    static const char kDigits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(bytes.length() * 2);
+    for (size_t i = 0; i < bytes.length(); ++i) {
+        unsigned char byte = static_cast<unsigned char>(bytes[i]);
+        hex += kDigits[byte >> 4];
+        hex += kDigits[byte & 0xf];
+    }
+    return hex;
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static bool fromHex(const std::string& hex, std::string& bytes) {
+    if (hex.empty() || hex.length() % 2 != 0) {
+        return false;
+    }
+    bytes.clear();
+    for (size_t i = 0; i < hex.length(); i += 2) {
+        int high = hexValue(hex[i]);
+        int low = hexValue(hex[i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        bytes += static_cast<char>(high << 4 | low);
+    }
+    return true;
+}
+
+static std::string field(const std::string& line, size_t& pos) {
+    size_t colon = line.find(':', pos);
+    std::string value = line.substr(pos, colon == std::string::npos ? std::string::npos : colon - pos);
+    pos = colon == std::string::npos ? line.length() + 1 : colon + 1;
+    return value;
+}
+
+AccountStore::AccountStore() : _accounts() {}
+
+bool AccountStore::load(const std::string& path, std::string& error) {
+    std::ifstream file(path.c_str());
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::map<std::string, Account> accounts;
+    std::string line;
+    for (int number = 1; std::getline(file, line); ++number) {
+        if (!line.empty() && line[line.length() - 1] == '\r') {
+            line.erase(line.length() - 1);
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::ostringstream where;
+        where << path << ":" << number << ": ";
+        size_t pos = 0;
+        Account account;
+        account.name = field(line, pos);
+        std::string scheme = field(line, pos);
+        std::string iterations = field(line, pos);
+        std::string salt = field(line, pos);
+        std::string key = field(line, pos);
+        char* end = NULL;
+        long parsedIterations = std::strtol(iterations.c_str(), &end, 10);
+        if (pos <= line.length() || !isValidName(account.name) || scheme != kScheme || iterations.empty()
+            || *end != '\0' || parsedIterations < 1 || parsedIterations > 100000000
+            || !fromHex(salt, account.salt) || !fromHex(key, account.key) || account.key.length() != kKeySize) {
+            error = where.str() + "expected <name>:" + kScheme + ":<iterations>:<salt>:<key>";
+            return false;
+        }
+        if (accounts.count(account.name)) {
+            error = where.str() + "account " + account.name + " listed twice";
+            return false;
+        }
+        account.iterations = static_cast<unsigned int>(parsedIterations);
+        accounts[account.name] = account;
+    }
+    _accounts.swap(accounts);
+    return true;
+}
+
+const AccountStore::Account* AccountStore::find(const std::string& name) const {
+    std::map<std::string, Account>::const_iterator it = _accounts.find(name);
+    return it == _accounts.end() ? NULL : &it->second;
+}
+
+size_t AccountStore::size() const {
+    return _accounts.size();
+}
+
+bool AccountStore::verify(const Account& account, const std::string& password) {
+    return Sha256::equals(Sha256::pbkdf2(password, account.salt, account.iterations, kKeySize), account.key);
+}
+
+std::string AccountStore::makeEntry(const std::string& name, const std::string& password, unsigned int iterations) {
+    std::string salt = randomBytes(kSaltSize);
+    std::ostringstream entry;
+    entry << name << ":" << kScheme << ":" << iterations << ":" << toHex(salt) << ":"
+          << toHex(Sha256::pbkdf2(password, salt, iterations, kKeySize));
+    return entry.str();
+}
+
+std::string AccountStore::randomBytes(size_t count) {
+    std::string bytes(count, '\0');
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    size_t filled = 0;
+    while (fd != -1 && filled < count) {
+        ssize_t got = read(fd, &bytes[filled], count - filled);
+        if (got <= 0) {
+            break;
+        }
+        filled += static_cast<size_t>(got);
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+    if (filled < count) {
+        throw std::runtime_error("Failed to read /dev/urandom");
+    }
+    return bytes;
+}
+
+// Printable, no spaces or ':' (the file's separator), short enough for a numeric
+bool AccountStore::isValidName(const std::string& name) {
+    if (name.empty() || name.length() > 64) {
+        return false;
+    }
+    for (size_t i = 0; i < name.length(); ++i) {
+        unsigned char c = static_cast<unsigned char>(name[i]);
+        if (c <= ' ' || c >= 0x7f || c == ':') {
+            return false;
+        }
+    }
+    return true;
+}
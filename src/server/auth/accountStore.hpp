@@ -0,0 +1,61 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   accountStore.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/23 10:12:07 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/23 10:12:07 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef ACCOUNTSTORE_HPP
+#define ACCOUNTSTORE_HPP
+
+#include <string>
+#include <map>
+#include <cstddef>
+
+/*
+The accounts SASL logs in to, read once from --accounts-file. One account
+per line, as printed by ircserv-passwd:
+
+    <name>:pbkdf2-sha256:<iterations>:<salt, hex>:<derived key, hex>
+
+Blank lines and lines starting with '#' are skipped. Only the salted,
+derived key is stored; checking a password runs the whole key derivation,
+which is slow on purpose and belongs on the Authenticator's threads.
+*/
+class AccountStore {
+public:
+    struct Account {
+        std::string name;
+        unsigned int iterations;
+        std::string salt;
+        std::string key;
+    };
+
+    static const unsigned int kDefaultIterations = 100000;
+    static const size_t kSaltSize = 16;
+    static const size_t kKeySize = 32;
+
+    AccountStore();
+
+    // False with error naming the line if the file cannot be used
+    bool load(const std::string& path, std::string& error);
+    const Account* find(const std::string& name) const;
+    size_t size() const;
+
+    // Runs the key derivation: seconds of CPU for large iteration counts
+    static bool verify(const Account& account, const std::string& password);
+    // A line for the accounts file, with a fresh random salt
+    static std::string makeEntry(const std::string& name, const std::string& password, unsigned int iterations);
+    static std::string randomBytes(size_t count);
+    static bool isValidName(const std::string& name);
+
+private:
+    std::map<std::string, Account> _accounts;
+};
+
+#endif // ACCOUNTSTORE_HPP
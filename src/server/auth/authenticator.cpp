@@ -0,0 +1,229 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   authenticator.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/23 11:26:40 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/23 11:26:40 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "authenticator.hpp"
+#include "sha256.hpp"
+#include "../metrics/metrics.hpp"
+#include "../../trace/tracer.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+// Overwrites a password before its memory goes back to the allocator
+static void wipe(std::string& secret) {
+    std::fill(secret.begin(), secret.end(), '\0');
+    secret.clear();
+}
+
+Authenticator::Authenticator(const std::string& accountsFile, size_t threadCount, size_t cacheEntries)
+    : _accounts(),
+      _dummy(),
+      _cacheKey(AccountStore::randomBytes(Sha256::kDigestSize)),
+      _cache(),
+      _recent(),
+      _cacheLimit(cacheEntries),
+      _threads(),
+      _jobs(),
+      _results(kMaxPending),
+      _outstanding(0),
+      _running(0),
+      _stopping(false)
+{
+    std::string error;
+    if (!_accounts.load(accountsFile, error)) {
+        throw std::runtime_error("Failed to load accounts: " + error);
+    }
+    // Costs what an account made with the default iteration count costs
+    _dummy.iterations = AccountStore::kDefaultIterations;
+    _dummy.salt = AccountStore::randomBytes(AccountStore::kSaltSize);
+    _dummy.key = AccountStore::randomBytes(AccountStore::kKeySize);
+
+    pthread_mutex_init(&_mutex, NULL);
+    pthread_cond_init(&_jobReady, NULL);
+    pthread_cond_init(&_idle, NULL);
+    for (size_t i = 0; i < threadCount; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, &Authenticator::workerMain, this) != 0) {
+            break;
+        }
+        _threads.push_back(thread);
+    }
+    if (_threads.empty()) {
+        pthread_cond_destroy(&_idle);
+        pthread_cond_destroy(&_jobReady);
+        pthread_mutex_destroy(&_mutex);
+        throw std::runtime_error("Failed to start authentication threads");
+    }
+}
+
+Authenticator::~Authenticator() {
+    pthread_mutex_lock(&_mutex);
+    _stopping = true;
+    pthread_cond_broadcast(&_jobReady);
+    pthread_mutex_unlock(&_mutex);
+    for (size_t i = 0; i < _threads.size(); ++i) {
+        pthread_join(_threads[i], NULL);
+    }
+    for (std::deque<Job*>::iterator it = _jobs.begin(); it != _jobs.end(); ++it) {
+        wipe((*it)->password);
+        delete *it;
+    }
+    Result* batch[64];
+    size_t count;
+    while ((count = _results.popBatch(batch, sizeof(batch) / sizeof(batch[0]))) > 0) {
+        for (size_t i = 0; i < count; ++i) {
+            delete batch[i];
+        }
+    }
+    pthread_cond_destroy(&_idle);
+    pthread_cond_destroy(&_jobReady);
+    pthread_mutex_destroy(&_mutex);
+}
+
+void* Authenticator::workerMain(void* arg) {
+    static_cast<Authenticator*>(arg)->workerLoop();
+    return NULL;
+}
+
+void Authenticator::workerLoop() {
+    Tracer::setThreadName("auth worker");
+    pthread_mutex_lock(&_mutex);
+    while (true) {
+        while (_jobs.empty() && !_stopping) {
+            pthread_cond_wait(&_jobReady, &_mutex);
+        }
+        if (_stopping) {
+            break;
+        }
+        Job* job = _jobs.front();
+        _jobs.pop_front();
+        ++_running;
+        pthread_mutex_unlock(&_mutex);
+
+        Result* result = new Result;
+        {
+            TraceSpan span("auth verify", NULL, job->fd);
+            result->accepted = AccountStore::verify(*job->account, job->password) && job->account != &_dummy;
+        }
+        result->fd = job->fd;
+        result->ticket = job->ticket;
+        result->account = job->name;
+        result->startNs = job->startNs;
+        result->proof = job->proof;
+        wipe(job->password);
+        delete job;
+        // Never full: check() keeps fewer than kMaxPending outstanding
+        _results.push(result);
+
+        pthread_mutex_lock(&_mutex);
+        if (--_running == 0 && _jobs.empty()) {
+            pthread_cond_broadcast(&_idle);
+        }
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+Authenticator::Outcome Authenticator::check(int fd, unsigned long ticket, const std::string& account,
+                                            const std::string& password) {
+    std::string proof = _proof(account, password);
+    std::map<std::string, CacheEntry>::iterator cached = _cache.find(account);
+    if (cached != _cache.end() && Sha256::equals(cached->second.proof, proof)) {
+        _recent.splice(_recent.begin(), _recent, cached->second.recent);
+        return ACCEPTED;
+    }
+    if (_outstanding >= kMaxPending) {
+        return BUSY;
+    }
+    const AccountStore::Account* record = _accounts.find(account);
+    Job* job = new Job;
+    job->fd = fd;
+    job->ticket = ticket;
+    job->account = record ? record : &_dummy;
+    job->name = account;
+    job->password = password;
+    job->startNs = Metrics::nowNs();
+    job->proof = proof;
+    ++_outstanding;
+    pthread_mutex_lock(&_mutex);
+    _jobs.push_back(job);
+    pthread_cond_signal(&_jobReady);
+    pthread_mutex_unlock(&_mutex);
+    return PENDING;
+}
+
+void Authenticator::takeResults(std::vector<Result>& out) {
+    _results.clearWakeup();
+    Result* batch[64];
+    size_t count;
+    while ((count = _results.popBatch(batch, sizeof(batch) / sizeof(batch[0]))) > 0) {
+        for (size_t i = 0; i < count; ++i) {
+            --_outstanding;
+            if (batch[i]->accepted) {
+                _remember(batch[i]->account, batch[i]->proof);
+            }
+            out.push_back(*batch[i]);
+            delete batch[i];
+        }
+    }
+}
+
+void Authenticator::waitIdle() {
+    pthread_mutex_lock(&_mutex);
+    while (!_jobs.empty() || _running > 0) {
+        pthread_cond_wait(&_idle, &_mutex);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+int Authenticator::getWakeFd() const {
+    return _results.getWakeFd();
+}
+
+bool Authenticator::hasAccount(const std::string& account) const {
+    return _accounts.find(account) != NULL;
+}
+
+size_t Authenticator::getAccountCount() const {
+    return _accounts.size();
+}
+
+size_t Authenticator::getThreadCount() const {
+    return _threads.size();
+}
+
+size_t Authenticator::getCacheSize() const {
+    return _cache.size();
+}
+
+std::string Authenticator::_proof(const std::string& account, const std::string& password) const {
+    return Sha256::hmac(_cacheKey, account + '\0' + password);
+}
+
+void Authenticator::_remember(const std::string& account, const std::string& proof) {
+    if (_cacheLimit == 0) {
+        return;
+    }
+    std::map<std::string, CacheEntry>::iterator it = _cache.find(account);
+    if (it != _cache.end()) {
+        it->second.proof = proof;
+        _recent.splice(_recent.begin(), _recent, it->second.recent);
+        return;
+    }
+    if (_cache.size() >= _cacheLimit) {
+        _cache.erase(_recent.back());
+        _recent.pop_back();
+    }
+    _recent.push_front(account);
+    CacheEntry entry;
+    entry.proof = proof;
+    entry.recent = _recent.begin();
+    _cache[account] = entry;
+}
@@ -0,0 +1,119 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   authenticator.hpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/23 11:26:40 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/23 11:26:40 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef AUTHENTICATOR_HPP
+#define AUTHENTICATOR_HPP
+
+#include "accountStore.hpp"
+#include "../../utils/mailbox.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <map>
+#include <pthread.h>
+
+/*
+Checks SASL PLAIN passwords against the AccountStore without blocking the
+event loop. check() answers at once when it can: from the cache of recent
+successful logins, or with a refusal when too many checks are queued.
+Otherwise the key derivation runs on a worker thread and the outcome comes
+back through a Mailbox whose wake fd the loop polls, tagged with the fd and
+ticket the caller passed so a reply for a connection that has gone since is
+recognised and dropped.
+
+The cache keeps, per account, an HMAC of the password under a key drawn at
+startup, and forgets the least recently used account when full. A hit costs
+one HMAC instead of the full derivation, so a reconnect storm after a
+netsplit does not queue thousands of derivations. Failed logins are never
+cached. An unknown account is checked against a dummy record, so the time a
+refusal takes does not tell whether the account exists.
+
+check(), takeResults() and the cache belong to the event loop.
+*/
+class Authenticator {
+public:
+    enum Outcome {
+        ACCEPTED,           // From the cache
+        BUSY,               // Too many checks queued: refused without checking
+        PENDING             // The outcome comes out of takeResults()
+    };
+
+    struct Result {
+        int fd;
+        unsigned long ticket;
+        std::string account;
+        bool accepted;
+        unsigned long startNs;      // When check() queued it
+        std::string proof;          // What the cache keeps if accepted
+    };
+
+    static const size_t kMaxPending = 1024;
+
+    // Throws std::runtime_error if the accounts file cannot be used
+    Authenticator(const std::string& accountsFile, size_t threadCount, size_t cacheEntries);
+    ~Authenticator();
+
+    Outcome check(int fd, unsigned long ticket, const std::string& account, const std::string& password);
+    // Appends the checks finished since the last call, and caches successes
+    void takeResults(std::vector<Result>& out);
+    // Blocks until every queued check has finished (UPGRADE)
+    void waitIdle();
+
+    int getWakeFd() const;
+    bool hasAccount(const std::string& account) const;
+    size_t getAccountCount() const;
+    size_t getThreadCount() const;
+    size_t getCacheSize() const;
+
+private:
+    struct Job {
+        int fd;
+        unsigned long ticket;
+        const AccountStore::Account* account;   // The dummy record for unknown accounts
+        std::string name;
+        std::string password;
+        unsigned long startNs;
+        std::string proof;
+    };
+
+    struct CacheEntry {
+        std::string proof;
+        std::list<std::string>::iterator recent;
+    };
+
+    AccountStore _accounts;
+    AccountStore::Account _dummy;
+    std::string _cacheKey;
+    std::map<std::string, CacheEntry> _cache;
+    std::list<std::string> _recent;            // Cached accounts, most recently used first
+    size_t _cacheLimit;
+    std::vector<pthread_t> _threads;
+    std::deque<Job*> _jobs;
+    Mailbox<Result*> _results;
+    size_t _outstanding;                       // Queued or finished but not yet taken; event loop only
+    size_t _running;                           // Taken by a worker, under _mutex
+    bool _stopping;
+    pthread_mutex_t _mutex;
+    pthread_cond_t _jobReady;
+    pthread_cond_t _idle;
+
+    static void* workerMain(void* arg);
+    void workerLoop();
+    std::string _proof(const std::string& account, const std::string& password) const;
+    void _remember(const std::string& account, const std::string& proof);
+
+    Authenticator(const Authenticator& other);
+    Authenticator& operator=(const Authenticator& other);
+};
+
+#endif // AUTHENTICATOR_HPP
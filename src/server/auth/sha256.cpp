@@ -0,0 +1,215 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   sha256.cpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/23 09:04:51 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/23 09:04:51 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "sha256.hpp"
+#include <cstring>
+
+static const unsigned int kRoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline unsigned int rotateRight(unsigned int value, int bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+Sha256::Sha256() {
+    reset();
+}
+
+void Sha256::reset() {
+    static const unsigned int kInitial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    std::memcpy(_state, kInitial, sizeof(_state));
+    _blockLength = 0;
+    _totalLength = 0;
+}
+
+void Sha256::update(const void* data, size_t length) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    _totalLength += length;
+    if (_blockLength > 0) {
+        size_t take = kBlockSize - _blockLength < length ? kBlockSize - _blockLength : length;
+        std::memcpy(_block + _blockLength, bytes, take);
+        _blockLength += take;
+        bytes += take;
+        length -= take;
+        if (_blockLength < kBlockSize) {
+            return;
+        }
+        _compress(_block);
+        _blockLength = 0;
+    }
+    for (; length >= kBlockSize; bytes += kBlockSize, length -= kBlockSize) {
+        _compress(bytes);
+    }
+    std::memcpy(_block, bytes, length);
+    _blockLength = length;
+}
+
+void Sha256::finish(unsigned char* digest) {
+    unsigned long long bits = _totalLength * 8;
+    _block[_blockLength++] = 0x80;
+    if (_blockLength > kBlockSize - 8) {
+        std::memset(_block + _blockLength, 0, kBlockSize - _blockLength);
+        _compress(_block);
+        _blockLength = 0;
+    }
+    std::memset(_block + _blockLength, 0, kBlockSize - 8 - _blockLength);
+    for (int i = 0; i < 8; ++i) {
+        _block[kBlockSize - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+    _compress(_block);
+    for (int i = 0; i < 8; ++i) {
+        digest[4 * i] = static_cast<unsigned char>(_state[i] >> 24);
+        digest[4 * i + 1] = static_cast<unsigned char>(_state[i] >> 16);
+        digest[4 * i + 2] = static_cast<unsigned char>(_state[i] >> 8);
+        digest[4 * i + 3] = static_cast<unsigned char>(_state[i]);
+    }
+}
+
+void Sha256::_compress(const unsigned char* block) {
+    unsigned int w[64];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = (static_cast<unsigned int>(block[4 * i]) << 24) | (static_cast<unsigned int>(block[4 * i + 1]) << 16)
+               | (static_cast<unsigned int>(block[4 * i + 2]) << 8) | block[4 * i + 3];
+    }
+    for (int i = 16; i < 64; ++i) {
+        unsigned int s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        unsigned int s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    unsigned int a = _state[0], b = _state[1], c = _state[2], d = _state[3];
+    unsigned int e = _state[4], f = _state[5], g = _state[6], h = _state[7];
+    for (int i = 0; i < 64; ++i) {
+        unsigned int s1 = rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25);
+        unsigned int choice = (e & f) ^ (~e & g);
+        unsigned int t1 = h + s1 + choice + kRoundConstants[i] + w[i];
+        unsigned int s0 = rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22);
+        unsigned int majority = (a & b) ^ (a & c) ^ (b & c);
+        unsigned int t2 = s0 + majority;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    _state[0] += a;
+    _state[1] += b;
+    _state[2] += c;
+    _state[3] += d;
+    _state[4] += e;
+    _state[5] += f;
+    _state[6] += g;
+    _state[7] += h;
+}
+
+std::string Sha256::digest(const std::string& data) {
+    Sha256 hash;
+    unsigned char out[kDigestSize];
+    hash.update(data);
+    hash.finish(out);
+    return std::string(reinterpret_cast<char*>(out), kDigestSize);
+}
+
+// Inner and outer hashes with the padded key already absorbed
+static void keyHmac(const std::string& key, Sha256& inner, Sha256& outer) {
+    unsigned char block[Sha256::kBlockSize];
+    std::memset(block, 0, sizeof(block));
+    if (key.length() > Sha256::kBlockSize) {
+        std::string hashed = Sha256::digest(key);
+        std::memcpy(block, hashed.data(), hashed.length());
+    } else {
+        std::memcpy(block, key.data(), key.length());
+    }
+    unsigned char pad[Sha256::kBlockSize];
+    for (size_t i = 0; i < sizeof(block); ++i) {
+        pad[i] = block[i] ^ 0x36;
+    }
+    inner.update(pad, sizeof(pad));
+    for (size_t i = 0; i < sizeof(block); ++i) {
+        pad[i] = block[i] ^ 0x5c;
+    }
+    outer.update(pad, sizeof(pad));
+}
+
+// Finishes an HMAC whose keyed states were copied and fed the message
+static void finishHmac(Sha256& inner, Sha256& outer, unsigned char* out) {
+    inner.finish(out);
+    outer.update(out, Sha256::kDigestSize);
+    outer.finish(out);
+}
+
+std::string Sha256::hmac(const std::string& key, const std::string& message) {
+    Sha256 inner;
+    Sha256 outer;
+    keyHmac(key, inner, outer);
+    inner.update(message);
+    unsigned char out[kDigestSize];
+    finishHmac(inner, outer, out);
+    return std::string(reinterpret_cast<char*>(out), kDigestSize);
+}
+
+std::string Sha256::pbkdf2(const std::string& password, const std::string& salt, unsigned int iterations,
+                           size_t length) {
+    Sha256 keyedInner;
+    Sha256 keyedOuter;
+    keyHmac(password, keyedInner, keyedOuter);
+    std::string result;
+    for (unsigned int blockIndex = 1; result.length() < length; ++blockIndex) {
+        unsigned char counter[4] = {
+            static_cast<unsigned char>(blockIndex >> 24), static_cast<unsigned char>(blockIndex >> 16),
+            static_cast<unsigned char>(blockIndex >> 8), static_cast<unsigned char>(blockIndex)
+        };
+        Sha256 inner = keyedInner;
+        Sha256 outer = keyedOuter;
+        inner.update(salt);
+        inner.update(counter, sizeof(counter));
+        unsigned char u[kDigestSize];
+        unsigned char t[kDigestSize];
+        finishHmac(inner, outer, u);
+        std::memcpy(t, u, sizeof(t));
+        for (unsigned int i = 1; i < iterations; ++i) {
+            inner = keyedInner;
+            outer = keyedOuter;
+            inner.update(u, sizeof(u));
+            finishHmac(inner, outer, u);
+            for (size_t j = 0; j < kDigestSize; ++j) {
+                t[j] ^= u[j];
+            }
+        }
+        size_t take = length - result.length() < kDigestSize ? length - result.length() : kDigestSize;
+        result.append(reinterpret_cast<char*>(t), take);
+    }
+    return result;
+}
+
+bool Sha256::equals(const std::string& a, const std::string& b) {
+    if (a.length() != b.length()) {
+        return false;
+    }
+    unsigned char difference = 0;
+    for (size_t i = 0; i < a.length(); ++i) {
+        difference |= static_cast<unsigned char>(a[i] ^ b[i]);
+    }
+    return difference == 0;
+}
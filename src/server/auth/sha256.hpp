@@ -0,0 +1,59 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   sha256.hpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/23 09:04:51 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/23 09:04:51 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef SHA256_HPP
+#define SHA256_HPP
+
+#include <string>
+#include <cstddef>
+
+/*
+SHA-256 (FIPS 180-4), HMAC-SHA256 (RFC 2104) and PBKDF2-HMAC-SHA256
+(RFC 8018), enough to check the account file without a crypto library.
+Digests are returned as 32 raw bytes in a std::string.
+
+PBKDF2 keys the HMAC once: the inner and outer states after the padded key
+block are computed up front and copied for every iteration, so each of the
+iterations costs two compressions instead of four.
+*/
+class Sha256 {
+public:
+    static const size_t kDigestSize = 32;
+    static const size_t kBlockSize = 64;
+
+    Sha256();
+
+    void update(const void* data, size_t length);
+    void update(const std::string& data) { update(data.data(), data.length()); }
+    // Writes the digest and leaves the object unusable until reset()
+    void finish(unsigned char* digest);
+    void reset();
+
+    static std::string digest(const std::string& data);
+    static std::string hmac(const std::string& key, const std::string& message);
+    static std::string pbkdf2(const std::string& password, const std::string& salt,
+                              unsigned int iterations, size_t length);
+
+    // Compares without an early exit, so the time does not reveal where two
+    // digests first differ
+    static bool equals(const std::string& a, const std::string& b);
+
+private:
+    unsigned int _state[8];
+    unsigned char _block[kBlockSize];
+    size_t _blockLength;
+    unsigned long long _totalLength;
+
+    void _compress(const unsigned char* block);
+};
+
+#endif // SHA256_HPP
@@ -0,0 +1,109 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   trafficCapture.cpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/16 09:58:20 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/16 09:58:20 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "trafficCapture.hpp"
+#include "../metrics/metrics.hpp"
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const size_t kFlushThreshold = 64 * 1024;
+
+TrafficCapture::TrafficCapture() : _fd(-1), _startNs(0), _nextConnection(1) {}
+
+TrafficCapture::~TrafficCapture() {
+    if (_fd != -1) {
+        flush();
+        ::close(_fd);
+    }
+}
+
+bool TrafficCapture::open(const std::string& path) {
+    _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (_fd == -1) {
+        return false;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    CaptureFormat::FileHeader header;
+    std::memcpy(header.magic, CaptureFormat::kMagic, sizeof(header.magic));
+    header.realtimeNs = static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + now.tv_nsec;
+    _buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    _startNs = Metrics::nowNs();
+    return true;
+}
+
+void TrafficCapture::_append(CaptureFormat::RecordType type, uint32_t connection, const char* payload, size_t length) {
+    CaptureFormat::Header header;
+    header.offsetNs = Metrics::nowNs() - _startNs;
+    header.connection = connection;
+    header.length = static_cast<uint16_t>(length);
+    header.type = static_cast<uint8_t>(type);
+    header.reserved = 0;
+    _buffer.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (length > 0) {
+        _buffer.append(payload, length);
+    }
+    if (_buffer.size() >= kFlushThreshold) {
+        flush();
+    }
+}
+
+void TrafficCapture::connectionOpened(int fd, const std::string& address) {
+    if (_fd == -1) {
+        return;
+    }
+    uint32_t connection = _nextConnection++;
+    _connections[fd] = connection;
+    size_t length = address.length() < CaptureFormat::kMaxPayload ? address.length() : CaptureFormat::kMaxPayload;
+    _append(CaptureFormat::RECORD_OPEN, connection, address.data(), length);
+}
+
+void TrafficCapture::received(int fd, const char* data, size_t length) {
+    std::map<int, uint32_t>::iterator it = _connections.find(fd);
+    if (_fd == -1 || it == _connections.end()) {
+        return;
+    }
+    while (length > 0) {
+        size_t chunk = length < CaptureFormat::kMaxPayload ? length : CaptureFormat::kMaxPayload;
+        _append(CaptureFormat::RECORD_DATA, it->second, data, chunk);
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+void TrafficCapture::connectionClosed(int fd) {
+    std::map<int, uint32_t>::iterator it = _connections.find(fd);
+    if (_fd == -1 || it == _connections.end()) {
+        return;
+    }
+    _append(CaptureFormat::RECORD_CLOSE, it->second, NULL, 0);
+    _connections.erase(it);
+}
+
+// A failed write drops the buffered records rather than growing without bound
+void TrafficCapture::flush() {
+    size_t written = 0;
+    while (_fd != -1 && written < _buffer.size()) {
+        ssize_t result = write(_fd, _buffer.data() + written, _buffer.size() - written);
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            break;
+        }
+        written += static_cast<size_t>(result);
+    }
+    _buffer.clear();
+}
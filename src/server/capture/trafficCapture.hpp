@@ -0,0 +1,83 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   trafficCapture.hpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/16 09:58:13 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/16 09:58:13 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef TRAFFICCAPTURE_HPP
+#define TRAFFICCAPTURE_HPP
+
+#include <string>
+#include <map>
+#include <cstddef>
+#include <stdint.h>
+
+/*
+On-disk layout, shared with tools/ircreplay.cpp. A FileHeader, then records
+in host byte order: a Header followed by length bytes of payload.
+
+    OPEN    a connection was accepted; payload is the client address
+    DATA    bytes received from the connection, exactly as recv() returned them
+    CLOSE   the server removed the connection; no payload
+
+Connections are numbered from 1 in accept order, so a reused descriptor gets
+a new number. Offsets are nanoseconds since the capture started.
+*/
+namespace CaptureFormat {
+    enum RecordType {
+        RECORD_OPEN = 1,
+        RECORD_DATA = 2,
+        RECORD_CLOSE = 3
+    };
+
+    struct FileHeader {
+        char magic[8];
+        uint64_t realtimeNs;    // Wall clock when the capture started
+    };
+
+    struct Header {
+        uint64_t offsetNs;
+        uint32_t connection;
+        uint16_t length;        // Payload bytes
+        uint8_t type;
+        uint8_t reserved;
+    };
+
+    static const char kMagic[8] = { 'I', 'R', 'C', 'C', 'A', 'P', 'T', '1' };
+    static const size_t kMaxPayload = 65535;
+}
+
+// Records the inbound side of every client connection, for ircreplay.
+// Used from the event loop only; records are buffered and written at the end
+// of each loop iteration.
+class TrafficCapture {
+public:
+    TrafficCapture();
+    ~TrafficCapture();
+
+    bool open(const std::string& path);
+    void connectionOpened(int fd, const std::string& address);
+    void received(int fd, const char* data, size_t length);
+    void connectionClosed(int fd);
+    void flush();
+
+private:
+    int _fd;
+    std::string _buffer;
+    unsigned long _startNs;
+    uint32_t _nextConnection;
+    std::map<int, uint32_t> _connections;   // Live descriptor -> connection number
+
+    void _append(CaptureFormat::RecordType type, uint32_t connection, const char* payload, size_t length);
+
+    TrafficCapture(const TrafficCapture&);
+    TrafficCapture& operator=(const TrafficCapture&);
+};
+
+#endif // TRAFFICCAPTURE_HPP
@@ -11,62 +11,96 @@
 /* ************************************************************************** */
 
 #include "channel.hpp"
+#include "channelIndex.hpp"
 #include "../../utils/server_utils.hpp"
 #include <algorithm>
 
 
-Channel::Channel() : _inviteOnly(false), _userLimit(-1) {}
+Channel::Channel() : _topicTime(0), _inviteOnly(false), _userLimit(-1), _index(NULL) {}
 
 
-Channel::Channel(const std::string& name) : _name(name), _inviteOnly(false), _topicRestricted(false), _userLimit(-1) {}
+Channel::Channel(const std::string& name)
+    : _name(name), _topicTime(0), _inviteOnly(false), _topicRestricted(false), _userLimit(-1), _index(NULL) {}
 
 
+// Copies are not indexed
 Channel::Channel(const Channel& other)
-    : _name(other._name), _topic(other._topic), _members(other._members),
+    : _name(other._name), _topic(other._topic), _topicTime(other._topicTime), _members(other._members),
       _operators(other._operators), _key(other._key), _inviteOnly(other._inviteOnly),
       _topicRestricted(other._topicRestricted),
-      _userLimit(other._userLimit) {}
+      _userLimit(other._userLimit), _restoredOperators(other._restoredOperators), _index(NULL) {}
 
-Channel::~Channel() {}
+Channel::~Channel() {
+    if (_index) {
+        _index->remove(this);
+    }
+}
 
+// Keeps the index of the channel assigned to, refiled under the new name and count
 Channel& Channel::operator=(const Channel& other) {
     if (this != &other) {
+        if (_index) {
+            _index->remove(this);
+        }
         _name = other._name;
         _topic = other._topic;
+        _topicTime = other._topicTime;
         _members = other._members;
         _operators = other._operators;
         _key = other._key;
         _inviteOnly = other._inviteOnly;
         _topicRestricted = other._topicRestricted;
         _userLimit = other._userLimit;
+        _restoredOperators = other._restoredOperators;
+        if (_index) {
+            _index->add(this);
+        }
     }
     return *this;
 }
 
 std::string Channel::getName() const { return _name; }
 std::string Channel::getTopic() const { return _topic; }
+time_t Channel::getTopicTime() const { return _topicTime; }
 std::vector<Client*> Channel::getMembers() const { return _members; }
+size_t Channel::getMemberCount() const { return _members.size(); }
 std::vector<Client*> Channel::getOperators() const { return _operators; }
+std::vector<Client*> Channel::getInvitedClients() const { return _invitedClients; }
 std::string Channel::getKey() const { return _key; }
 bool Channel::isInviteOnly() const { return _inviteOnly; }
+int Channel::getUserLimit() const { return _userLimit; }
 
-void Channel::setTopic(const std::string& topic) { _topic = topic; }
+void Channel::setTopic(const std::string& topic, time_t setAt) {
+    _topic = topic;
+    _topicTime = topic.empty() ? 0 : setAt ? setAt : std::time(NULL);
+}
 void Channel::setKey(const std::string& key) {
-    std::string newKey;
-    if (key[0] == ':')
-        newKey = key.substr(1);
+    std::string newKey = key;
+    if (!newKey.empty() && newKey[0] == ':')
+        newKey = newKey.substr(1);
     _key = newKey; 
 }
 void Channel::setInviteOnly(bool inviteOnly) { _inviteOnly = inviteOnly; }
 void Channel::setUserLimit(int limit) { _userLimit = limit; }
 
 void Channel::removeMember(Client* client) {
+    size_t before = _members.size();
     _members.erase(std::remove(_members.begin(), _members.end(), client), _members.end());
     removeOperator(client);
+    _resized(before);
 }
 
+void Channel::_resized(size_t before) {
+    if (_index && _members.size() != before) {
+        _index->resized(this, before);
+    }
+}
+
+// Once: a channel's creator is made operator on creation and again on joining
 void Channel::addOperator(Client* client) {
-    _operators.push_back(client);
+    if (!isOperator(client)) {
+        _operators.push_back(client);
+    }
 }
 
 void Channel::removeOperator(Client* client) {
@@ -86,12 +120,12 @@ bool Channel::isInvited(Client* client) const {
 }
 
 bool Channel::checkKey(const std::string& key) const {
-    Logger::info("KEY: "+ key + "_KEY: " + _key);
+    LOG_DEBUG("KEY: "+ key + "_KEY: " + _key);
     return _key.empty() || key == _key;
 }
 
 bool Channel::isFull() const {
-    Logger::info("_members.size(): "+ to_string(_members.size()));
+    LOG_DEBUG("_members.size(): "+ to_string(_members.size()));
     return _userLimit > 0 && _members.size() >= static_cast<size_t>(_userLimit);
 }
 
@@ -116,32 +150,42 @@ void Channel::inviteClient(Client* client) {
 int Channel::addMember(Client* client, const std::string& key) {
     if (isFull()) {
         
-        Logger::info("FAIL addMember: Channel is full, cannot add " + client->getNickname());
+        LOG_INFO("FAIL addMember: Channel is full, cannot add " + client->getNickname());
         return 1;
     }
 
     if (!checkKey(key)) {
-        Logger::info("FAIL addMember: Invalid key provided for channel " + _name + " by " + client->getNickname());
-        Logger::info("Provided key: '" + key + "', Expected key: '" + _key + "'");
+        LOG_INFO("FAIL addMember: Invalid key provided for channel " + _name + " by " + client->getNickname());
+        LOG_INFO("Provided key: '" + key + "', Expected key: '" + _key + "'");
         return 2;
     }
 
     if (_inviteOnly && !isInvited(client)) {
-        Logger::info("FAIL addMember: Channel is invite-only, client " + client->getNickname() + " is not invited");
+        LOG_INFO("FAIL addMember: Channel is invite-only, client " + client->getNickname() + " is not invited");
         return 3;
     }
 
     if (!isMember(client)) {
         _members.push_back(client);
-        Logger::info("SUCCESS addMember: Added client " + client->getNickname() + " to channel " + _name);
+        _resized(_members.size() - 1);
+        LOG_INFO("SUCCESS addMember: Added client " + client->getNickname() + " to channel " + _name);
         _invitedClients.erase(std::remove(_invitedClients.begin(), _invitedClients.end(), client), _invitedClients.end());
         return 0;
     }
 
-    Logger::info("FAIL addMember: Client " + client->getNickname() + " is already a member of the channel " + _name);
+    LOG_INFO("FAIL addMember: Client " + client->getNickname() + " is already a member of the channel " + _name);
     return 4;
 }
 
+// For members whose server already checked key, limit and invites (server links)
+void Channel::addMemberUnchecked(Client* client) {
+    if (!isMember(client)) {
+        _members.push_back(client);
+        _resized(_members.size() - 1);
+        _invitedClients.erase(std::remove(_invitedClients.begin(), _invitedClients.end(), client), _invitedClients.end());
+    }
+}
+
 void Channel::setTopicRestricted(bool restricted) {
     _topicRestricted = restricted;
 }
@@ -162,3 +206,64 @@ bool Channel::isTopicRestricted() const {
     return _topicRestricted;
 }
 
+void Channel::setRestoredOperators(const std::vector<std::string>& identities) {
+    _restoredOperators = identities;
+}
+
+bool Channel::hasRestoredOperators() const {
+    return !_restoredOperators.empty();
+}
+
+const std::vector<std::string>& Channel::getRestoredOperators() const {
+    return _restoredOperators;
+}
+
+std::string Channel::restoredIdentity(const Client* client) {
+    if (!client->getAccount().empty()) {
+        return "$a:" + client->getAccount();
+    }
+    return client->getFullClientIdentifier();
+}
+
+// An account match wins over a nick!user@host one, which is casefolded like nicknames
+size_t Channel::_findRestoredOperator(const Client* client, RestoredMatch& match) const {
+    std::string account = client->getAccount().empty() ? "" : "$a:" + client->getAccount();
+    std::string mask = casefold(client->getFullClientIdentifier());
+    size_t found = static_cast<size_t>(-1);
+    match = RESTORED_NONE;
+    for (size_t i = 0; i < _restoredOperators.size(); ++i) {
+        if (!account.empty() && _restoredOperators[i] == account) {
+            match = RESTORED_BY_ACCOUNT;
+            return i;
+        }
+        if (match == RESTORED_NONE && casefold(_restoredOperators[i]) == mask) {
+            match = RESTORED_BY_HOST;
+            found = i;
+        }
+    }
+    return found;
+}
+
+Channel::RestoredMatch Channel::matchRestoredOperator(const Client* client) const {
+    RestoredMatch match;
+    _findRestoredOperator(client, match);
+    return match;
+}
+
+void Channel::takeRestoredOperator(const Client* client) {
+    RestoredMatch match;
+    size_t index = _findRestoredOperator(client, match);
+    if (match != RESTORED_NONE) {
+        _restoredOperators.erase(_restoredOperators.begin() + index);
+    }
+}
+
+void Channel::setIndex(ChannelIndex* index) {
+    if (_index) {
+        _index->remove(this);
+    }
+    _index = index;
+    if (_index) {
+        _index->add(this);
+    }
+}
@@ -15,13 +15,25 @@
 
 #include <string>
 #include <vector>
+#include <ctime>
 #include "../../client/client.hpp"
 #include "../../logger/logger.hpp"
 
+class ChannelIndex;
+
 class Channel {
+public:
+    // How a joining client matched a former operator of a restored channel
+    enum RestoredMatch {
+        RESTORED_NONE,
+        RESTORED_BY_HOST,       // Same nick!user@host; the user name is only claimed
+        RESTORED_BY_ACCOUNT     // Logged in to the operator's SASL account
+    };
+
 private:
     std::string _name;
     std::string _topic;
+    time_t _topicTime;          // When the topic was set, 0 if there is none
     std::vector<Client*> _members;
     std::vector<Client*> _operators;
     std::string _key;
@@ -29,6 +41,11 @@ private:
     bool _inviteOnly;
     bool _topicRestricted;
     int _userLimit;
+    std::vector<std::string> _restoredOperators;  // Identities of operators named in a snapshot, not back yet
+    ChannelIndex* _index;       // Told of every change of the member count; NULL if not indexed
+
+    void _resized(size_t before);
+    size_t _findRestoredOperator(const Client* client, RestoredMatch& match) const;
 
 public:
     Channel();
@@ -40,20 +57,26 @@ public:
     // Getters
     std::string getName() const;
     std::string getTopic() const;
+    time_t getTopicTime() const;
     std::vector<Client*> getMembers() const;
+    size_t getMemberCount() const;
     std::vector<Client*> getOperators() const;
+    std::vector<Client*> getInvitedClients() const;
     std::string getKey() const;
     bool isInviteOnly() const;
+    int getUserLimit() const;
 
 
     // Setters
-    void setTopic(const std::string& topic);
+    // The time defaults to now; snapshots and UPGRADE pass the one they kept
+    void setTopic(const std::string& topic, time_t setAt = 0);
     void setKey(const std::string& key);
     void setInviteOnly(bool inviteOnly);
     void setUserLimit(int limit);
 
     // Member functions
     int addMember(Client* client, const std::string& key);
+    void addMemberUnchecked(Client* client);
     void removeMember(Client* client);
     void addOperator(Client* client);
     void removeOperator(Client* client);
@@ -68,6 +91,20 @@ public:
     void removeKey();
     void removeUserLimit();
     bool isTopicRestricted() const;
+
+    // Channels restored from a snapshot keep operator status for these
+    // identities until they rejoin, instead of giving it to the first joiner
+    void setRestoredOperators(const std::vector<std::string>& identities);
+    bool hasRestoredOperators() const;
+    const std::vector<std::string>& getRestoredOperators() const;
+    // "$a:<account>" for users logged in with SASL, nick!user@host otherwise
+    static std::string restoredIdentity(const Client* client);
+    RestoredMatch matchRestoredOperator(const Client* client) const;
+    // Forgets the identity matchRestoredOperator() found for client
+    void takeRestoredOperator(const Client* client);
+
+    // Files the channel in the index LIST walks (see ChannelIndex)
+    void setIndex(ChannelIndex* index);
 };
 
 #endif // CHANNEL_HPP
\ No newline at end of file
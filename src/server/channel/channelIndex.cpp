@@ -0,0 +1,134 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   channelIndex.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/24 19:52:14 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/24 19:52:14 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "channelIndex.hpp"
+#include "channel.hpp"
+#include "../../utils/server_utils.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+static const size_t kNoLimit = static_cast<size_t>(-1);
+
+static long parseCount(const std::string& text) {
+    char* end = NULL;
+    long value = std::strtol(text.c_str(), &end, 10);
+    return (text.empty() || *end || value < 0) ? 0 : value;
+}
+
+// Larger counts first, then names in byte order
+bool ChannelIndex::Order::operator()(const Position& a, const Position& b) const {
+    if (a.first != b.first) {
+        return a.first > b.first;
+    }
+    return a.second < b.second;
+}
+
+ChannelIndex::Filter::Filter() : minUsers(0), maxUsers(kNoLimit), topicNewerThan(-1), topicOlderThan(-1) {}
+
+void ChannelIndex::Filter::add(const std::string& condition) {
+    if (condition.empty()) {
+        return;
+    }
+    if (condition[0] == '>') {
+        minUsers = std::max(minUsers, static_cast<size_t>(parseCount(condition.substr(1))) + 1);
+    } else if (condition[0] == '<') {
+        size_t below = parseCount(condition.substr(1));
+        if (below == 0) {
+            minUsers = std::max(minUsers, static_cast<size_t>(1));   // Fewer than 0: nothing
+        }
+        maxUsers = std::min(maxUsers, below ? below - 1 : 0);
+    } else if (condition.length() > 1 && (condition[0] == 'T' || condition[0] == 't')
+               && (condition[1] == '<' || condition[1] == '>')) {
+        long minutes = parseCount(condition.substr(2));
+        if (condition[1] == '<') {
+            topicNewerThan = topicNewerThan < 0 ? minutes : std::min(topicNewerThan, minutes);
+        } else {
+            topicOlderThan = std::max(topicOlderThan, minutes);
+        }
+    } else {
+        masks.push_back(condition);
+    }
+}
+
+// Channels without a topic meet neither topic condition
+bool ChannelIndex::Filter::matches(const Channel& channel, time_t now) const {
+    size_t members = channel.getMemberCount();
+    if (members < minUsers || members > maxUsers) {
+        return false;
+    }
+    if (topicNewerThan >= 0 || topicOlderThan >= 0) {
+        time_t setAt = channel.getTopicTime();
+        if (setAt == 0 || (topicNewerThan >= 0 && now - setAt >= topicNewerThan * 60)
+            || (topicOlderThan >= 0 && now - setAt <= topicOlderThan * 60)) {
+            return false;
+        }
+    }
+    if (masks.empty()) {
+        return true;
+    }
+    std::string name = channel.getName();
+    for (std::vector<std::string>::const_iterator it = masks.begin(); it != masks.end(); ++it) {
+        if (matchMask(*it, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+ChannelIndex::Position ChannelIndex::Filter::first() const {
+    return Position(maxUsers, "");
+}
+
+ChannelIndex::ChannelIndex() : _entries() {}
+
+void ChannelIndex::add(Channel* channel) {
+    _entries[Position(channel->getMemberCount(), channel->getName())] = channel;
+}
+
+void ChannelIndex::remove(Channel* channel) {
+    Entries::iterator it = _entries.find(Position(channel->getMemberCount(), channel->getName()));
+    if (it != _entries.end() && it->second == channel) {
+        _entries.erase(it);
+    }
+}
+
+void ChannelIndex::resized(Channel* channel, size_t before) {
+    Entries::iterator it = _entries.find(Position(before, channel->getName()));
+    if (it != _entries.end() && it->second == channel) {
+        _entries.erase(it);
+    }
+    add(channel);
+}
+
+ChannelIndex::const_iterator ChannelIndex::begin() const {
+    return _entries.begin();
+}
+
+ChannelIndex::const_iterator ChannelIndex::end() const {
+    return _entries.end();
+}
+
+ChannelIndex::const_iterator ChannelIndex::lowerBound(const Position& position) const {
+    return _entries.lower_bound(position);
+}
+
+// Position(n, "") sorts before every channel of n members
+ChannelIndex::const_iterator ChannelIndex::stop(const Filter& filter) const {
+    if (filter.minUsers == 0) {
+        return _entries.end();
+    }
+    return _entries.lower_bound(Position(filter.minUsers - 1, ""));
+}
+
+size_t ChannelIndex::size() const {
+    return _entries.size();
+}
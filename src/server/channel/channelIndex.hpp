@@ -0,0 +1,86 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   channelIndex.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/24 19:52:14 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/24 19:52:14 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CHANNELINDEX_HPP
+#define CHANNELINDEX_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstddef>
+#include <ctime>
+
+class Channel;
+
+/*
+Channels ordered by member count, largest first, then by name: the order
+LIST answers in. A channel is filed under the count it has; Channel calls
+resized() on every join and part, so the key never goes stale.
+
+LIST remembers where it stopped as a Position, not as an iterator, since
+channels come and go while a long list is sent: lowerBound() resumes at
+the first channel not before it. A channel whose count changes meanwhile
+may be listed twice or not at all.
+
+The count conditions of LIST are a range of this order: `>n` ends it
+before the channels of n members, `<n` starts it at those of n - 1.
+*/
+class ChannelIndex {
+public:
+    typedef std::pair<size_t, std::string> Position;    // Member count and name
+
+    struct Order {
+        bool operator()(const Position& a, const Position& b) const;
+    };
+
+    typedef std::map<Position, Channel*, Order> Entries;
+    typedef Entries::const_iterator const_iterator;
+
+    // The conditions of one LIST (ELIST U, M and T), all of which a channel must meet.
+    // No N: "!mask" would be taken for a safe channel name.
+    struct Filter {
+        size_t minUsers;                    // Inclusive
+        size_t maxUsers;                    // Inclusive
+        std::vector<std::string> masks;     // One must match the name, if there are any
+        long topicNewerThan;                // Minutes; a topic set less long ago, -1 if not asked
+        long topicOlderThan;                // Minutes; a topic set longer ago, -1 if not asked
+
+        Filter();
+        // ">n", "<n", "T<n", "T>n" or a mask; a number that is not one counts as 0
+        void add(const std::string& condition);
+        bool matches(const Channel& channel, time_t now) const;
+        // Where the walk over the index starts
+        Position first() const;
+    };
+
+    ChannelIndex();
+
+    void add(Channel* channel);
+    void remove(Channel* channel);
+    // The channel had before members until now
+    void resized(Channel* channel, size_t before);
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator lowerBound(const Position& position) const;
+    // The first channel with fewer members than filter asks for
+    const_iterator stop(const Filter& filter) const;
+    size_t size() const;
+
+private:
+    Entries _entries;
+
+    ChannelIndex(const ChannelIndex& other);
+    ChannelIndex& operator=(const ChannelIndex& other);
+};
+
+#endif // CHANNELINDEX_HPP
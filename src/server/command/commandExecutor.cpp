@@ -11,9 +11,14 @@
 /* ************************************************************************** */
 
 #include "commandExecutor.hpp"
+#include "../../utils/base64.hpp"
+#include "../auth/sha256.hpp"
+#include <cstdio>
+#include <sstream>
+#include <pwd.h>
 
 
-CommandExecutor::CommandExecutor(Server& server) : _server(server) {}
+CommandExecutor::CommandExecutor(Server& server) : _server(server), _batchCounter(0) {}
 
 CommandExecutor::~CommandExecutor() {}
 
@@ -23,7 +28,7 @@ void CommandExecutor::executeCommand(int clientFd, const Command& cmd) {
     Client* client = _server.getClientByFd(clientFd);
 
     if (!client) {
-        Logger::error("Client not found for fd: " + to_string(clientFd));
+        LOG_ERROR("Client not found for fd: " + to_string(clientFd));
         return;
     }
 
@@ -40,7 +45,12 @@ void CommandExecutor::executeCommand(int clientFd, const Command& cmd) {
     }
 
     if (command == "CAP") {
-        executeCap(clientFd);
+        executeCap(clientFd, cmd);
+        return;
+    }
+
+    if (command == "AUTHENTICATE" && _server.getAuthenticator()) {
+        executeAuthenticate(clientFd, cmd);
         return;
     }
 
@@ -49,8 +59,20 @@ void CommandExecutor::executeCommand(int clientFd, const Command& cmd) {
         return;
     }
 
-    // Check if PASS has been received before allowing other commands
-    if (!client->isPasswordSet()) {
+    if (command == "SERVER") {
+        executeServer(clientFd, cmd);
+        return;
+    }
+
+    if (command == "QUIT") {
+        executeQuit(clientFd, cmd);
+        return;
+    }
+
+    // Check if PASS has been received before allowing other commands. During
+    // CAP negotiation NICK and USER may come first: SASL can stand in for PASS.
+    bool negotiating = client->isCapNegotiating() && (command == "NICK" || command == "USER");
+    if (!client->isPasswordSet() && !negotiating) {
         sendReply(clientFd, " * :Password required", true);
         return;
     }
@@ -77,12 +99,28 @@ void CommandExecutor::executeCommand(int clientFd, const Command& cmd) {
         executeTopic(clientFd, cmd);
     } else if (command == "WHO") {
         executeWho(clientFd, cmd);
+    } else if (command == "LIST") {
+        executeList(clientFd, cmd);
+    } else if (command == "MONITOR" && _server.getConfig().monitorLimit > 0) {
+        executeMonitor(clientFd, cmd);
     } else if (command == "INVITE") {
         executeInvite(clientFd, cmd);
     } else if (command == "KICK") {
         executeKick(clientFd, cmd);
-    }else {
-        Logger::warning("Unimplemented command: " + command);
+    } else if (command == "CHATHISTORY" && _server.getHistory()) {
+        executeChatHistory(clientFd, cmd);
+    } else if (command == "OPER") {
+        executeOper(clientFd, cmd);
+    } else if (command == "STATS") {
+        executeStats(clientFd, cmd);
+    } else if (command == "TRACEDUMP") {
+        executeTraceDump(clientFd);
+    } else if (command == "UPGRADE") {
+        executeUpgrade(clientFd);
+    } else if (command == "PART") {
+        executePart(clientFd, cmd);
+    } else {
+        LOG_WARNING("Unimplemented command: " + command);
         sendReply(clientFd, "421 * " + command + " :Unknown command", true);
     }
 }
@@ -91,31 +129,47 @@ void CommandExecutor::executeCommand(int clientFd, const Command& cmd) {
 void CommandExecutor::executePass(int clientFd, const Command& cmd) {
     Client* client = _server.getClientByFd(clientFd);
     
-    Logger::debug("Executing PASS command. Client password set: " + 
+    LOG_DEBUG("Executing PASS command. Client password set: " + 
                   std::string(client->isPasswordSet() ? "true" : "false"));
 
     if (client->isPasswordSet()) {
         sendReply(clientFd, "462 * :Unauthorized command (already registered)", true);
-        Logger::debug("Sent [462] 'already registered' reply");
+        LOG_DEBUG("Sent [462] 'already registered' reply");
         return;
     }
 
     if (cmd.getParameters().empty()) {
         sendReply(clientFd, "461 PASS :Wrong number of parameters", true);
-        Logger::debug("Sent [461] 'Wrong number of parameters' reply");
+        LOG_DEBUG("Sent [461] 'Wrong number of parameters' reply");
         return;
     }
 
     std::string password = cmd.getParameters()[0];
     if (password[0] == ':')
         password = password.substr(1);
+
+    // Server form (PASS <password> <version> <flags>): the connection is about to send SERVER
+    if (cmd.getParameters().size() >= 2) {
+        if (_server.getLinkExecutor()->acceptPassword(client, cmd.getParameters())) {
+            LOG_DEBUG("Client " + to_string(clientFd) + " sent the link password.");
+        } else {
+            sendReply(clientFd, "464 * :Password incorrect", true);
+        }
+        return;
+    }
+
     if (password == _server.getPassword()) {
         client->setPassword(true);
         //sendReply(clientFd, ":Password accepted");
-        Logger::debug("Client "+ to_string(clientFd)  + " set password correctly.");
+        LOG_DEBUG("Client "+ to_string(clientFd)  + " set password correctly.");
+        // NICK and USER may have come first, during CAP negotiation
+        if (isRegistered(client)) {
+            sendWelcome(clientFd, client);
+            _server.introduceUser(client);
+        }
     } else {
         sendReply(clientFd, "464 * :Password incorrect", true);
-        Logger::debug("Sent [464] 'password incorrect' reply");
+        LOG_DEBUG("Sent [464] 'password incorrect' reply");
     }
 }
 
@@ -125,16 +179,16 @@ void CommandExecutor::executeNick(int clientFd, const Command& cmd) {
 
     // Ensure client is valid
     if (!client) {
-        Logger::error("Client not found for fd: " + to_string(clientFd));
+        LOG_ERROR("Client not found for fd: " + to_string(clientFd));
         return;
     }
 
-    Logger::debug("Executing NICK command. Current nickname: " + client->getNickname());
+    LOG_DEBUG("Executing NICK command. Current nickname: " + client->getNickname());
 
     // Check if a nickname was provided
     if (cmd.getParameters().size() != 1) {
         sendReply(clientFd, "431 * :No nickname given", true);
-        Logger::debug("Sent [431] 'no nickname given' reply");
+        LOG_DEBUG("Sent [431] 'no nickname given' reply");
         return;
     }
 
@@ -143,33 +197,41 @@ void CommandExecutor::executeNick(int clientFd, const Command& cmd) {
     // Check if the provided nickname is valid
     if (!isValidNickname(newNick)) {
         sendReply(clientFd, "432 " + newNick + " :Erroneous nickname", true);
-        Logger::debug("Sent [432] 'erroneous nickname' reply");
+        LOG_DEBUG("Sent [432] 'erroneous nickname' reply");
         return;
     }
 
-    // Check if the nickname is already taken
-    if (_server.isNicknameTaken(newNick)) {
+    // Check if the nickname is already taken; changing the case of one's own is allowed
+    Client* holder = _server.getClientByNickname(newNick);
+    if (holder && holder != client) {
         sendReply(clientFd, "433 " + newNick + " :Nickname is already in use", true);
-        Logger::debug("Sent [433] 'nickname in use' reply");
+        LOG_DEBUG("Sent [433] 'nickname in use' reply");
+        return;
+    }
+    if (newNick == client->getNickname()) {
         return;
     }
 
     std::string oldNick = client->getNickname();
     std::string oldClientIdentifier = client->getFullClientIdentifier();
-    client->setNickname(newNick);
+    _server.setNickname(client, newNick);
 
     // Handle first-time nickname set (registration complete)
     if (oldNick.empty() && isRegistered(client)) {
-        Logger::debug("Nickname set for the first time: " + newNick);
-        sendReply(clientFd, "001 " + newNick + " :Welcome to the Internet Relay Network " + client->getFullClientIdentifier(), true);
-        Logger::debug("[001] Registration complete, sent welcome message");
+        LOG_DEBUG("Nickname set for the first time: " + newNick);
+        sendWelcome(clientFd, client);
+        _server.introduceUser(client);
+        LOG_DEBUG("[001] Registration complete, sent welcome message");
     } else if (!oldNick.empty()) { 
         // Broadcast the nickname change to others
-        std::string newClientIdentifier = client->getFullClientIdentifier();
-        _server.broadcast(":" + oldClientIdentifier + " NICK " + newNick + "\r\n", clientFd);
-        Logger::debug("Nickname changed from " + oldNick + " to " + newNick + ". Broadcasting to other clients.");
+        std::string nickMessage = ":" + oldClientIdentifier + " NICK " + newNick + "\r\n";
+        _server.broadcast(nickMessage, clientFd);
+        if (isRegistered(client)) {
+            _server.propagate(nickMessage, NULL);
+        }
+        LOG_DEBUG("Nickname changed from " + oldNick + " to " + newNick + ". Broadcasting to other clients.");
     } else {
-        Logger::debug("Nickname set but client is not yet fully registered: " + newNick);
+        LOG_DEBUG("Nickname set but client is not yet fully registered: " + newNick);
     }
 }
 
@@ -177,24 +239,24 @@ void CommandExecutor::executeNick(int clientFd, const Command& cmd) {
 
 void CommandExecutor::executeUser(int clientFd, const Command& cmd) {
     Client* client = _server.getClientByFd(clientFd);
-    Logger::debug("Executing USER command. Is user set: " + std::string(client->isUserSet() ? "true" : "false"));
+    LOG_DEBUG("Executing USER command. Is user set: " + std::string(client->isUserSet() ? "true" : "false"));
 
     if (client->isUserSet()) {
         sendReply(clientFd, "462 :Unauthorized command (already registered)", true);
-        Logger::debug("Sent [462] 'already registered' reply");
+        LOG_DEBUG("Sent [462] 'already registered' reply");
         return;
     }
 
     if (cmd.getParameters().size() < 4) {
         sendReply(clientFd, "461 USER :Wrong number of parameters", true);
-        Logger::debug("Sent [461] 'Wrong number of parameters' reply");
+        LOG_DEBUG("Sent [461] 'Wrong number of parameters' reply");
         return;
     }
 
 
     if (cmd.getParameters().size() > 4 || cmd.getParameters()[3][0] != ':') {
         sendReply(clientFd, "461 USER :Wrong syntax", true);
-        Logger::debug("Sent [461] 'wrong syntax' reply");
+        LOG_DEBUG("Sent [461] 'wrong syntax' reply");
         return;
     }
 
@@ -205,48 +267,70 @@ void CommandExecutor::executeUser(int clientFd, const Command& cmd) {
     client->setRealname(realname);
     client->setUser(true);
 
-    Logger::debug("User info set - Username: " + username + ", Realname: " + realname);
+    LOG_DEBUG("User info set - Username: " + username + ", Realname: " + realname);
 
     if (isRegistered(client)) {
-        sendReply(clientFd, "001 " + client->getNickname() + " :Welcome to the Internet Relay Network " + client->getFullClientIdentifier(), true);
-        Logger::debug("Registration complete, sent welcome message");
+        sendWelcome(clientFd, client);
+        _server.introduceUser(client);
+        LOG_DEBUG("Registration complete, sent welcome message");
     }
 }
 
+// Splits a comma-separated list parameter, without the ':' of a trailing parameter
+static std::vector<std::string> splitList(const std::string& parameter) {
+    std::vector<std::string> items;
+    std::stringstream list(!parameter.empty() && parameter[0] == ':' ? parameter.substr(1) : parameter);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        items.push_back(item);
+    }
+    return items;
+}
+
+// JOIN <channel>{,<channel>} [<key>{,<key>}] | JOIN 0
+// Keys pair with channels by position. The replies for the whole list reach
+// the client in one write.
 void CommandExecutor::executeJoin(int clientFd, const Command& cmd) {
     if (cmd.getParameters().empty()) {
         sendReply(clientFd, "461 JOIN :Wrong number of parameters", true);
         return;
     }
 
-    std::string channelName = cmd.getParameters()[0];
-    std::string key;
+    Client* client = _server.getClientByFd(clientFd);
+
+    if (!client) {
+        LOG_ERROR("Client not found for fd: " + to_string(clientFd));
+        return;
+    }
+
+    std::vector<std::string> channels = splitList(cmd.getParameters()[0]);
+    std::vector<std::string> keys;
     if (cmd.getParameters().size() > 1) {
-    // Start concatenating the parameters from the second one
-        for (size_t i = 1; i < cmd.getParameters().size(); ++i) {
-            if (i > 1) {
-                key += " "; // Add a space between parts if there are multiple
-            }
-            key += cmd.getParameters()[i];
+        keys = splitList(cmd.getParameters()[1]);
     }
 
-    // Check if the key starts with a colon and remove it
-    if (!key.empty() && key[0] == ':') {
-        key = key.substr(1);
+    _server.cork(clientFd);
+    if (channels.size() == 1 && channels[0] == "0") {
+        // Leave every channel, as a PART of each
+        std::vector<std::string> joined = client->getChannels();
+        for (std::vector<std::string>::iterator it = joined.begin(); it != joined.end(); ++it) {
+            partChannel(client, *it, "");
+        }
+    } else {
+        for (size_t i = 0; i < channels.size(); ++i) {
+            joinChannel(client, channels[i], i < keys.size() ? keys[i] : "");
+        }
     }
+    _server.uncork();
 }
 
-    Client* client = _server.getClientByFd(clientFd);
-
-    if (!client) {
-        Logger::error("Client not found for fd: " + to_string(clientFd));
-        return;
-    }
+void CommandExecutor::joinChannel(Client* client, const std::string& channelName, const std::string& key) {
+    int clientFd = client->getFd();
 
     // Check if the channel name is valid
     if (!isValidChannelName(channelName)) {
         sendReply(clientFd, "403 " + channelName + " :No such channel", true);
-        Logger::debug("Sent [403] 'No such channel' reply");
+        LOG_DEBUG("Sent [403] 'No such channel' reply");
         return;
     }
 
@@ -254,122 +338,162 @@ void CommandExecutor::executeJoin(int clientFd, const Command& cmd) {
     Channel* channel = _server.getOrCreateChannel(channelName, clientFd);
     if (!channel) {
         sendReply(clientFd, "403 " + channelName + " :No such channel", true);
-        Logger::debug("Sent [403] 'No such channel' reply");
+        LOG_DEBUG("Sent [403] 'No such channel' reply");
         return;
     }
-
-    if (channel->getMembers().empty()) {
-        channel->addOperator(client);
-        Logger::info("Client " + client->getNickname() + " is now the channel operator for " + channelName);
+    if (channel->isMember(client)) {
+        return;     // Already there: nothing to announce
     }
 
-    int res = channel->addMember(client, key);
+    // A former operator of a restored channel gets the status back. Only the
+    // SASL account gets it past +i, +k and +l: a user name is only claimed.
+    Channel::RestoredMatch restored = channel->matchRestoredOperator(client);
+    bool founder = channel->getMembers().empty() && !channel->hasRestoredOperators();
+
+    int res = 0;
+    if (restored == Channel::RESTORED_BY_ACCOUNT) {
+        channel->addMemberUnchecked(client);
+    } else {
+        res = channel->addMember(client, key);
+    }
     // Add the client as a member of the channel
     if (res == 1) {
-        sendReply(client->getFd(), " :Can't join, channel is full", true);
-        Logger::error("Failed to add member to channel after all checks passed");
+        sendReply(clientFd, "471 " + client->getNickname() + " " + channelName + " :Cannot join channel (+l)", true);
         return;
     } else if (res == 2) {
-        sendReply(client->getFd(), " :Can't join, wrong channel key", true);
-        Logger::error("Failed to add member to channel after all checks passed");
+        sendReply(clientFd, "475 " + client->getNickname() + " " + channelName + " :Cannot join channel (+k)", true);
         return;
-    } if (res == 3 ) {
-        sendReply(clientFd, channelName + " :Can't join channel, channel is invite only", true);
-        Logger::error("Failed to add member to channel after all checks passed");
+    } else if (res == 3) {
+        sendReply(clientFd, "473 " + client->getNickname() + " " + channelName + " :Cannot join channel (+i)", true);
         return;
-    } if (res == 4 ) {
-        sendReply(clientFd, channelName + " :Can't join channel", true);
-        Logger::error("Failed to add member to channel after all checks passed");
+    } else if (res == 4) {
         return;
-    } 
+    }
+    if (restored != Channel::RESTORED_NONE) {
+        channel->takeRestoredOperator(client);
+    }
+    if (restored != Channel::RESTORED_NONE || founder) {
+        channel->addOperator(client);
+        LOG_INFO("Client " + client->getNickname() + " is now the channel operator for " + channelName);
+    }
+
+    client->addChannel(channel->getName());
 
     // Broadcast the join message to all members of the channel
     std::string joinMessage = ":" + client->getFullClientIdentifier() + " JOIN :" + channelName + "\r\n";
-    _server.broadcastToChannel(channelName, joinMessage);
+    _server.broadcastToChannel(channelName, joinMessage, NULL, true);
+    _server.propagate(joinMessage, NULL);
 
-    // Send the channel topic after joining
+    // Topic, then the names list (331 or 332, 353, 366)
+    std::string prefix = ":" + _server.getServerName() + " ";
+    std::string replies;
     std::string topic = channel->getTopic();
     if (topic.empty()) {
-        sendReply(clientFd, "331 " + client->getNickname() + " " + channelName + " :No topic is set", true);
+        replies = prefix + "331 " + client->getNickname() + " " + channelName + " :No topic is set\r\n";
     } else {
-        sendReply(clientFd, "332 " + client->getNickname() + " " + channelName + " :" + topic, true);
+        replies = prefix + "332 " + client->getNickname() + " " + channelName + " :" + topic + "\r\n";
     }
-
-    // Send names list (numeric 353 and 366)
-    std::string namesList = channel->getNames();
-    sendReply(clientFd, "353 " + client->getNickname() + " = " + channelName + " :" + namesList, true);
-    sendReply(clientFd, "366 " + client->getNickname() + " " + channelName + " :End of /NAMES list", true);
+    replies += prefix + "353 " + client->getNickname() + " = " + channelName + " :" + channel->getNames() + "\r\n";
+    replies += prefix + "366 " + client->getNickname() + " " + channelName + " :End of /NAMES list\r\n";
+    _server.sendToClient(clientFd, replies);
 }
 
 void CommandExecutor::executePrivmsg(int clientFd, const Command& cmd) {
-    // Check if the PRIVMSG command has at least two parameters: the target and the message
-    if (cmd.getParameters().size() < 2) {
-        sendReply(clientFd, "411 :No recipient given (PRIVMSG)", true);
-        return;
-    }
+    deliverMessage(clientFd, cmd, false);
+}
 
-    std::string target = cmd.getParameters()[0];
-    std::string message = cmd.getParameters()[1];
+/*
+PRIVMSG and NOTICE to a comma-separated list of at most kMaxTargets channels
+and nicknames (TARGMAX). The sender's prefix and the text are formatted
+once; each target's line only adds its name. A target listed twice is served
+once. A sender with user mode +B (a relay bot) also reaches a user who shares
+several of the channels only once, through the first of them. NOTICE never
+answers with an error.
+*/
+void CommandExecutor::deliverMessage(int clientFd, const Command& cmd, bool notice) {
+    const std::string verb = notice ? "NOTICE" : "PRIVMSG";
     Client* sender = _server.getClientByFd(clientFd);
-
-    // Check if the sender exists (shouldn't be null)
     if (!sender) {
-        Logger::error("Client not found for fd: " + to_string(clientFd));
+        LOG_ERROR("Client not found for fd: " + to_string(clientFd));
+        return;
+    }
+    if (cmd.getParameters().size() < 2) {
+        if (!notice) {
+            sendReply(clientFd, "411 :No recipient given (PRIVMSG)", true);
+        }
         return;
     }
 
-    // Check if the message starts with ':'
-    if (message[0] != ':') {
+    std::string text = cmd.getParameters()[1];
+    if (!text.empty() && text[0] == ':') {
+        text = text.substr(1);
+    } else if (!notice) {
         sendReply(clientFd, "461 PRIVMSG :Message must start with ':'", true);  // Error code 461: Not enough parameters
-        Logger::debug("PRIVMSG message missing ':'");
+        LOG_DEBUG("PRIVMSG message missing ':'");
         return;
     }
 
-    // Remove the leading ':' from the message
-    message = message.substr(1);
-
-    // Check if the target is a channel
-    if (isChannelSyntaxOk(target)) {
-        // Validate the channel name
-        if (!isValidChannelName(target)) {
-            sendReply(clientFd, "403 :No such channel", true);
-            Logger::debug("Sent [403] 'No such channel' reply");
-            return;
+    std::vector<std::string> targets;
+    std::stringstream names(cmd.getParameters()[0]);
+    std::string name;
+    while (std::getline(names, name, ',')) {
+        if (!name.empty()) {
+            targets.push_back(name);
         }
-
-        Channel* channel = _server.getChannel(target);
-
-        // Check if the channel exists and the sender is a member of the channel
-        if (!channel || !channel->isMember(sender)) {
-            sendReply(clientFd, "404 " + target + " :Cannot send to channel", true);
-            Logger::debug("Client is not a member of the channel. Sent [404] ':Cannot send to channel'");
-            return;
+    }
+    if (targets.size() > kMaxTargets) {
+        if (!notice) {
+            sendReply(clientFd, "407 " + cmd.getParameters()[0] + " :Too many recipients, at most "
+                                    + to_string(kMaxTargets), true);
         }
+        return;
+    }
 
-        Logger::info("Client is sending a message to the channel...");
-
-        // Construct the channel message in the proper IRC format
-        std::string channelMessage = ":" + sender->getFullClientIdentifier() + " PRIVMSG " + target + " :" + message + "\r\n";
-        _server.broadcastToChannel(target, channelMessage, sender);
-
-    } else {
-        // Handle private messages to a specific user
-        Client* recipient = _server.getClientByNickname(target);
-
-        // Check if the recipient exists
-        if (!recipient) {
-            Logger::error("Recipient client not found for nickname: " + target);
-            sendReply(clientFd, "401 " + target + " :No such nick/channel", true);
-            return;
+    std::string senderPrefix = sender->getFullClientIdentifier();
+    std::string head = ":" + senderPrefix + " " + verb + " ";
+    std::string tail = " :" + text + "\r\n";
+    std::set<Channel*> channelsDone;
+    std::set<Client*> delivered;
+    std::set<Client*>* overlap = sender->isBot() ? &delivered : NULL;
+    for (std::vector<std::string>::const_iterator target = targets.begin(); target != targets.end(); ++target) {
+        std::string line = head + *target + tail;
+        if (isChannelSyntaxOk(*target)) {
+            if (!isValidChannelName(*target)) {
+                if (!notice) {
+                    sendReply(clientFd, "403 " + *target + " :No such channel", true);
+                }
+                continue;
+            }
+            Channel* channel = _server.getChannel(*target);
+            if (!channel || !channel->isMember(sender)) {
+                if (!notice) {
+                    sendReply(clientFd, "404 " + *target + " :Cannot send to channel", true);
+                }
+                continue;
+            }
+            if (!channelsDone.insert(channel).second) {
+                continue;
+            }
+            _server.broadcastToChannel(*target, line, sender, false, overlap);
+            if (_server.getHistory()) {
+                _server.getHistory()->record(*target, notice ? HistoryStore::NOTICE : HistoryStore::PRIVMSG,
+                                             senderPrefix, text);
+            }
+        } else {
+            Client* recipient = _server.getClientByNickname(*target);
+            if (!recipient) {
+                if (!notice) {
+                    sendReply(clientFd, "401 " + *target + " :No such nick/channel", true);
+                }
+                continue;
+            }
+            // Listed twice, or already reached through a channel by a bot's relay
+            if (!delivered.insert(recipient).second) {
+                continue;
+            }
+            _server.sendToClient(recipient->getFd(), line);
+            LOG_EVENT(Logger::DEBUG, "{} sent to recipient: {}", << verb << recipient->getNickname());
         }
-
-        Logger::info("Target: " + target + " | Recipient: " + recipient->getNickname());
-
-        // Construct the private message in the proper IRC format
-        std::string privateMessage = ":" + sender->getFullClientIdentifier() + " PRIVMSG " + target + " :" + message + "\r\n";
-        sendReply(recipient->getFd(), privateMessage, false);
-
-        Logger::info("Message sent to recipient: " + recipient->getNickname());
     }
 }
 
@@ -400,7 +524,7 @@ bool CommandExecutor::isValidNickname(const std::string& nickname) const {
 }
 
 bool CommandExecutor::isRegistered(const Client* client) const {
-    return client->isPasswordSet() && (client->getNickname() != "") && client->isUserSet();
+    return client->isRegistered();
 }
 
 void CommandExecutor::sendReply(int clientFd, const std::string& reply, bool includeServerName) const {
@@ -412,13 +536,68 @@ void CommandExecutor::sendReply(int clientFd, const std::string& reply, bool inc
         formattedReply += "\r\n";  // Just append the reply without server name
     }
     
-    Logger::debug("Sending reply to client " + to_string(clientFd) + ": " + formattedReply);
+    LOG_EVENT(Logger::DEBUG, "Sending reply to client {}: {}", << clientFd << formattedReply);
     _server.sendToClient(clientFd, formattedReply);  // Send reply only to the specified client
 }
 
 
 
+// RPL_WELCOME (001) followed by RPL_ISUPPORT (005)
+void CommandExecutor::sendWelcome(int clientFd, const Client* client) const {
+    sendReply(clientFd, "001 " + client->getNickname() + " :Welcome to the Internet Relay Network " + client->getFullClientIdentifier(), true);
+
+    std::string tokens;
+    std::vector<std::string> supported = getISupportTokens();
+    for (std::vector<std::string>::const_iterator it = supported.begin(); it != supported.end(); ++it) {
+        tokens += " " + *it;
+    }
+    sendReply(clientFd, "005 " + client->getNickname() + tokens + " :are supported by this server", true);
+}
+
+std::vector<std::string> CommandExecutor::getISupportTokens() const {
+    std::vector<std::string> tokens;
+    tokens.push_back("CHANTYPES=#&+!");
+    tokens.push_back("PREFIX=(o)@");
+    tokens.push_back("CHANMODES=,k,l,it");
+    tokens.push_back("MODES=3");
+    tokens.push_back("NICKLEN=9");
+    tokens.push_back("CHANNELLEN=50");
+    tokens.push_back("TARGMAX=PRIVMSG:" + to_string(kMaxTargets) + ",NOTICE:" + to_string(kMaxTargets));
+    tokens.push_back("BOT=B");
+    tokens.push_back("CASEMAPPING=ascii");
+    tokens.push_back("WHOX");
+    tokens.push_back("ELIST=MTU");
+    if (_server.getConfig().monitorLimit > 0) {
+        tokens.push_back("MONITOR=" + to_string(_server.getConfig().monitorLimit));
+    }
+    if (_server.getHistory()) {
+        tokens.push_back("CHATHISTORY=" + to_string(_server.getHistory()->getMaxLines()));
+    }
+    return tokens;
+}
+
+
+void CommandExecutor::sendListReply(int clientFd, const std::string& head, const std::vector<std::string>& items) const {
+    std::string prefix = ":" + _server.getServerName() + " " + head;
+    std::string line = prefix;
+    for (std::vector<std::string>::const_iterator it = items.begin(); it != items.end(); ++it) {
+        if (line.length() > prefix.length() && line.length() + 1 + it->length() + 2 > 512) {
+            _server.sendToClient(clientFd, line + "\r\n");
+            line = prefix;
+        }
+        line += (line.length() > prefix.length() ? "," : "") + *it;
+    }
+    if (line.length() > prefix.length()) {
+        _server.sendToClient(clientFd, line + "\r\n");
+    }
+}
+
+
 void CommandExecutor::executeMode(int clientFd, const Command& cmd) {
+    if (!cmd.getParameters().empty() && !isChannelSyntaxOk(cmd.getParameters()[0])) {
+        executeUserMode(clientFd, cmd);
+        return;
+    }
     if (cmd.getParameters().size() == 1) {
         sendReply(clientFd, "368 MODE "+cmd.getParameters()[0], true);
         return;
@@ -438,7 +617,7 @@ void CommandExecutor::executeMode(int clientFd, const Command& cmd) {
 
     std::vector<std::string> args;
      for (size_t i = 0; i < cmd.getParameters().size(); ++i) {
-        Logger::info("Parameter " + to_string(i) + ": '" + cmd.getParameters()[i] + "'");
+        LOG_DEBUG("Parameter " + to_string(i) + ": '" + cmd.getParameters()[i] + "'");
         args.push_back(cmd.getParameters()[i]);
     }
     // Check if the channel name is valid
@@ -449,6 +628,43 @@ void CommandExecutor::executeMode(int clientFd, const Command& cmd) {
     handleChannelMode(clientFd, channel, modestring, args);
 }
 
+// User modes: only +B, which marks a bot (IRCv3 bot mode)
+void CommandExecutor::executeUserMode(int clientFd, const Command& cmd) {
+    Client* client = _server.getClientByFd(clientFd);
+    const std::string& nick = client->getNickname();
+    if (casefold(cmd.getParameters()[0]) != casefold(nick)) {
+        sendReply(clientFd, "502 " + nick + " :Cant change mode for other users", true);
+        return;
+    }
+    if (cmd.getParameters().size() == 1) {
+        sendReply(clientFd, "221 " + nick + (client->isBot() ? " +B" : " +"), true);
+        return;
+    }
+    std::string modestring = cmd.getParameters()[1];
+    if (!modestring.empty() && modestring[0] == ':') {
+        modestring = modestring.substr(1);
+    }
+    bool adding = true;
+    bool unknown = false;
+    bool bot = client->isBot();
+    for (size_t i = 0; i < modestring.length(); ++i) {
+        if (modestring[i] == '+' || modestring[i] == '-') {
+            adding = modestring[i] == '+';
+        } else if (modestring[i] == 'B') {
+            bot = adding;
+        } else {
+            unknown = true;
+        }
+    }
+    if (unknown) {
+        sendReply(clientFd, "501 " + nick + " :Unknown MODE flag", true);
+    }
+    if (bot != client->isBot()) {
+        client->setBot(bot);
+        _server.sendToClient(clientFd, ":" + nick + " MODE " + nick + " :" + (bot ? "+B" : "-B") + "\r\n");
+    }
+}
+
 void CommandExecutor::handleChannelMode(int clientFd, const std::string& channelName, const std::string& modestring, const std::vector<std::string>& args) {
     // 1. Validate the channel
     Channel* channel = _server.getChannel(channelName);
@@ -460,7 +676,7 @@ void CommandExecutor::handleChannelMode(int clientFd, const std::string& channel
     Client* client = _server.getClientByFd(clientFd);
 
     if (!client) {
-        Logger::error("Client not found in handleChannelMode for fd: " + to_string(clientFd));
+        LOG_ERROR("Client not found in handleChannelMode for fd: " + to_string(clientFd));
         return;
     }
 
@@ -503,10 +719,10 @@ void CommandExecutor::handleChannelMode(int clientFd, const std::string& channel
                     argIndex++;
                     break;
                 case 'k': // Channel key (password)
-                    if (adding && argIndex < args.size()) {
+                    if (adding && argIndex + 1 < args.size()) {
                         channel->setKey(args[argIndex + 1]);
                         modeChanges += mode;
-                        modeArgs += " " + args[argIndex];
+                        modeArgs += " " + args[argIndex + 1];
                         argIndex++;
                         paramModeCount++;
                     } else if (!adding) {
@@ -520,10 +736,10 @@ void CommandExecutor::handleChannelMode(int clientFd, const std::string& channel
                     if (args.size() == 3) {
                         Client* targetClient = _server.getClientByNickname(args[2]);
                         if (!targetClient) {
-                            Logger::error("Client not found in handleChannelMode for fd: " + to_string(clientFd));
+                            LOG_ERROR("Client not found in handleChannelMode for fd: " + to_string(clientFd));
                             return;
                         }
-                        Logger::info("targetClient: "+ targetClient->getNickname());
+                        LOG_DEBUG("targetClient: "+ targetClient->getNickname());
                         if (targetClient) {
                             if (adding) {
                                 channel->addOperator(targetClient);
@@ -531,27 +747,27 @@ void CommandExecutor::handleChannelMode(int clientFd, const std::string& channel
                                 channel->removeOperator(targetClient);
                             }
                             modeChanges += mode;
-                           // modeArgs += " " + args[argIndex];
+                            modeArgs += " " + args[2];
                             paramModeCount++;
                         }
                         argIndex++;
                     }
                     break;
                 case 'l': // User limit
-                Logger::info("In mode (l)");
-                    if (adding && argIndex < args.size()) {
-                        Logger::info("Inside if mode (l)");
+                LOG_DEBUG("In mode (l)");
+                    if (adding && argIndex + 1 < args.size()) {
+                        LOG_DEBUG("Inside if mode (l)");
                         int userLimit;
                         std::stringstream ss(args[argIndex + 1]);
                         ss >> userLimit;
 
                         if (ss.fail() || !ss.eof()) {
-                            Logger::error("Error while executing MODE (l)");
+                            LOG_ERROR("Error while executing MODE (l)");
                         } else {
-                            Logger::info("In mode (l)");
+                            LOG_DEBUG("In mode (l)");
                             channel->setUserLimit(userLimit);
                             modeChanges += mode;
-                            modeArgs += " " + args[argIndex];
+                            modeArgs += " " + args[argIndex + 1];
                             paramModeCount++;
                         }
                     }
@@ -572,7 +788,8 @@ void CommandExecutor::handleChannelMode(int clientFd, const std::string& channel
     // 4. Build the mode change string && broadcast
     if (!modeChanges.empty()) {
         std::string modeMessage = ":" + client->getNickname() + " MODE " + channelName + " " + modeChanges + modeArgs + "\r\n";
-        _server.broadcastToChannel(channelName, modeMessage);
+        _server.broadcastToChannel(channelName, modeMessage, NULL, true);
+        _server.propagate(modeMessage, NULL);
     }
 }
 
@@ -581,7 +798,7 @@ void CommandExecutor::executeTopic(int clientFd, const Command& cmd) {
     Client* client = _server.getClientByFd(clientFd);
 
     if (cmd.getParameters().empty() || cmd.getParameters().size() > 2) {
-        Logger::debug("Invalid number of parameters for TOPIC command");
+        LOG_DEBUG("Invalid number of parameters for TOPIC command");
         sendReply(clientFd, "461 TOPIC :Wrong number of parameters", true);
         return;
     }
@@ -589,13 +806,13 @@ void CommandExecutor::executeTopic(int clientFd, const Command& cmd) {
     std::string channelName = cmd.getParameters()[0];
     Channel* channel = _server.getChannel(channelName);
     if (!channel) {
-        Logger::debug("Channel " + channelName + " does not exist");
+        LOG_DEBUG("Channel " + channelName + " does not exist");
         sendReply(clientFd, "403 " + channelName + " :No such channel", true);
         return;
     }
 
     if (!channel->isMember(client)) {
-        Logger::debug("Client " + client->getNickname() + " is not a member of channel " + channelName);
+        LOG_DEBUG("Client " + client->getNickname() + " is not a member of channel " + channelName);
         sendReply(clientFd, "442 " + channelName + " :You're not on that channel", true);
         return;
     }
@@ -613,13 +830,13 @@ void CommandExecutor::executeTopic(int clientFd, const Command& cmd) {
 
     // Querying the topic
     if (cmd.getParameters().size() == 1) {
-        Logger::debug("Querying the topic for channel " + channelName);
+        LOG_DEBUG("Querying the topic for channel " + channelName);
         std::string currentTopic = channel->getTopic();
         if (currentTopic.empty()) {
-            Logger::debug("No topic is set for channel " + channelName);
+            LOG_DEBUG("No topic is set for channel " + channelName);
             sendReply(clientFd, "331 " + client->getNickname() + " " + channelName + " :No topic is set", true);
         } else {
-            Logger::debug("Sending topic for channel " + channelName);
+            LOG_DEBUG("Sending topic for channel " + channelName);
             sendReply(clientFd, "332 " + client->getNickname() + " " + channelName + " :" + currentTopic, false); // No server name
         }
         return;
@@ -627,7 +844,7 @@ void CommandExecutor::executeTopic(int clientFd, const Command& cmd) {
 
     // Setting the topic
     if (!channel->isOperator(client)) {
-        Logger::debug("Client " + client->getNickname() + " is not an operator in channel " + channelName);
+        LOG_DEBUG("Client " + client->getNickname() + " is not an operator in channel " + channelName);
         sendReply(clientFd, "482 " + channelName + " :You're not channel operator", true);
         return;
     }
@@ -636,7 +853,7 @@ void CommandExecutor::executeTopic(int clientFd, const Command& cmd) {
 
     // Check if the new topic starts with a colon (IRC requirement for multi-word topics)
     if (newTopic.empty() || newTopic[0] != ':') {
-        Logger::debug("Invalid topic format for channel " + channelName);
+        LOG_DEBUG("Invalid topic format for channel " + channelName);
         sendReply(clientFd, "461 TOPIC :Topic must start with ':'", true);
         return;
     }
@@ -644,12 +861,17 @@ void CommandExecutor::executeTopic(int clientFd, const Command& cmd) {
     // Remove the leading colon for storage
     newTopic = newTopic.substr(1);
 
-    Logger::debug("Setting new topic for channel " + channelName + ": " + newTopic);
+    LOG_DEBUG("Setting new topic for channel " + channelName + ": " + newTopic);
     channel->setTopic(newTopic);
 
     // Broadcast the new topic to all members of the channel
-    std::string topicMessage = ":" + client->getFullClientIdentifier() + " TOPIC " + channelName + " :" + newTopic + "\r\n";
-    _server.broadcastToChannel(channelName, topicMessage);
+    std::string senderPrefix = client->getFullClientIdentifier();
+    std::string topicMessage = ":" + senderPrefix + " TOPIC " + channelName + " :" + newTopic + "\r\n";
+    _server.broadcastToChannel(channelName, topicMessage, NULL, true);
+    _server.propagate(topicMessage, NULL);
+    if (_server.getHistory()) {
+        _server.getHistory()->record(channelName, HistoryStore::TOPIC, senderPrefix, newTopic);
+    }
 }
 
 
@@ -764,18 +986,23 @@ void CommandExecutor::executeKick(int clientFd, const Command& cmd) {
 
     // All checks passed, proceed with kicking the user
     channel->removeMember(kicked);
+    kicked->removeChannel(channel->getName());
 
     // Construct the kick message
     std::string kickMsg = ":" + kicker->getFullClientIdentifier() + " KICK " + channelName + " " + kickedNick + reason + "\r\n";
 
     // Send the kick message to all members of the channel, including the kicked user
-    _server.broadcastToChannel(channelName, kickMsg);
+    _server.broadcastToChannel(channelName, kickMsg, NULL, true);
+    _server.propagate(kickMsg, NULL);
 
-    // Additionally, send the message to the kicked user
-    _server.sendToClient(kicked->getFd(), kickMsg);
+    // Additionally, send the message to the kicked user (a remote one gets it through propagate)
+    if (!kicked->isRemote()) {
+        _server.sendToClient(kicked->getFd(), kickMsg);
+    }
+    _server.removeChannelIfEmpty(channelName);
 
     // Log the kick action
-    Logger::info("User " + kickedNick + " was kicked from " + channelName + " by " + kicker->getNickname() + ". Reason: " + reason);
+    LOG_INFO("User " + kickedNick + " was kicked from " + channelName + " by " + kicker->getNickname() + ". Reason: " + reason);
 }
 
 
@@ -826,12 +1053,262 @@ void CommandExecutor::executePing(int clientFd, const Command& cmd){
      sendReply(clientFd, "PONG "+ _server.getServerName(), true);
 }
 
-void CommandExecutor::executeCap(int clientFd){
+static const struct {
+    const char* name;
+    Client::Capability bit;
+} kCapabilities[] = {
+    { "sasl", Client::CAP_SASL },
+    { "batch", Client::CAP_BATCH },
+    { "server-time", Client::CAP_SERVER_TIME },
+    { "message-tags", Client::CAP_MESSAGE_TAGS },
+    { "draft/chathistory", Client::CAP_CHATHISTORY }
+};
+static const size_t kCapabilityCount = sizeof(kCapabilities) / sizeof(kCapabilities[0]);
+
+// sasl needs --accounts-file, draft/chathistory --history-lines
+unsigned int CommandExecutor::offeredCapabilities() const {
+    unsigned int offered = Client::CAP_BATCH | Client::CAP_SERVER_TIME | Client::CAP_MESSAGE_TAGS;
+    if (_server.getAuthenticator()) {
+        offered |= Client::CAP_SASL;
+    }
+    if (_server.getHistory()) {
+        offered |= Client::CAP_CHATHISTORY;
+    }
+    return offered;
+}
+
+// IRCv3 capability negotiation (version 302). sasl is offered when
+// --accounts-file is set, with EXTERNAL on the Unix socket; batch,
+// server-time and message-tags shape the CHATHISTORY replay. CAP LS or REQ
+// before registration holds the welcome back until CAP END.
+void CommandExecutor::executeCap(int clientFd, const Command& cmd) {
+    Client* client = _server.getClientByFd(clientFd);
+    std::string nick = client->getNickname().empty() ? "*" : client->getNickname();
+    if (cmd.getParameters().empty()) {
+        sendReply(clientFd, "461 " + nick + " CAP :Wrong number of parameters", true);
+        return;
+    }
+    std::string subcommand = cmd.getParameters()[0];
+    std::transform(subcommand.begin(), subcommand.end(), subcommand.begin(), ::toupper);
+    std::string argument = cmd.getParameters().size() > 1 ? cmd.getParameters()[1] : "";
+    if (!argument.empty() && argument[0] == ':') {
+        argument = argument.substr(1);
+    }
+    unsigned int offered = offeredCapabilities();
 
-     sendReply(clientFd, "CAP * LS", true);
+    if (subcommand == "LS" || subcommand == "LIST") {
+        if (subcommand == "LS" && !isRegistered(client)) {
+            client->setCapNegotiating(true);
+        }
+        unsigned int listed = (subcommand == "LS") ? offered : client->getCapabilities();
+        std::string capabilities;
+        for (size_t i = 0; i < kCapabilityCount; ++i) {
+            if (listed & kCapabilities[i].bit) {
+                capabilities += (capabilities.empty() ? "" : " ") + std::string(kCapabilities[i].name);
+                if (kCapabilities[i].bit == Client::CAP_SASL && subcommand == "LS"
+                    && std::atoi(argument.c_str()) >= 302) {
+                    capabilities += "=" + saslMechanisms(client);
+                }
+            }
+        }
+        sendReply(clientFd, "CAP " + nick + " " + subcommand + " :" + capabilities, true);
+    } else if (subcommand == "REQ") {
+        if (!isRegistered(client)) {
+            client->setCapNegotiating(true);
+        }
+        // All or nothing: one unknown capability refuses the whole request
+        unsigned int capabilities = client->getCapabilities();
+        std::istringstream requested(argument);
+        std::string name;
+        bool known = !argument.empty();
+        while (known && requested >> name) {
+            bool disable = name[0] == '-';
+            std::string wanted = disable ? name.substr(1) : name;
+            known = false;
+            for (size_t i = 0; i < kCapabilityCount; ++i) {
+                if (wanted == kCapabilities[i].name && (offered & kCapabilities[i].bit)) {
+                    capabilities = disable ? capabilities & ~kCapabilities[i].bit : capabilities | kCapabilities[i].bit;
+                    known = true;
+                }
+            }
+        }
+        if (known) {
+            client->setCapabilities(capabilities);
+        }
+        sendReply(clientFd, "CAP " + nick + (known ? " ACK :" : " NAK :") + argument, true);
+    } else if (subcommand == "END") {
+        if (!client->isCapNegotiating()) {
+            return;
+        }
+        client->setCapNegotiating(false);
+        if (isRegistered(client)) {
+            sendWelcome(clientFd, client);
+            _server.introduceUser(client);
+        } else if (!client->isPasswordSet() && !client->getNickname().empty() && client->isUserSet()
+                   && !_server.findSaslSession(clientFd)) {
+            // A pending SASL check completes the registration when it answers
+            sendReply(clientFd, " * :Password required", true);
+        }
+    } else {
+        sendReply(clientFd, "410 " + nick + " " + cmd.getParameters()[0] + " :Invalid CAP command", true);
+    }
 }
 
+// SASL PLAIN (RFC 4616) in AUTHENTICATE messages: the mechanism, then the
+// base64 payload "authzid NUL authcid NUL password" in chunks of 400 bytes.
+// The password check usually finishes on a later tick, in finishSasl().
+// EXTERNAL, on the Unix socket only, answers at once: see finishExternal().
+void CommandExecutor::executeAuthenticate(int clientFd, const Command& cmd) {
+    static const size_t kChunkSize = 400;
+    static const size_t kMaxPayload = 1200;    // Base64 of a 900 byte message: a 64 byte name and a long password
+
+    Client* client = _server.getClientByFd(clientFd);
+    std::string nick = client->getNickname().empty() ? "*" : client->getNickname();
+    if (cmd.getParameters().empty()) {
+        sendReply(clientFd, "461 " + nick + " AUTHENTICATE :Wrong number of parameters", true);
+        return;
+    }
+    std::string argument = cmd.getParameters()[0];
+    if (!argument.empty() && argument[0] == ':') {
+        argument = argument.substr(1);
+    }
+    if (!client->getAccount().empty()) {
+        sendReply(clientFd, "907 " + nick + " :You have already authenticated using SASL", true);
+        return;
+    }
+
+    Server::SaslSession* session = _server.findSaslSession(clientFd);
+    if (argument == "*") {
+        _server.endSaslSession(clientFd);
+        sendReply(clientFd, (session ? "906 " : "904 ") + nick + " :SASL authentication aborted", true);
+        return;
+    }
+    if (!session) {
+        std::string mechanism = argument;
+        std::transform(mechanism.begin(), mechanism.end(), mechanism.begin(), ::toupper);
+        if (mechanism != "PLAIN" && (mechanism != "EXTERNAL" || client->getPeerUid() < 0)) {
+            sendReply(clientFd, "908 " + nick + " " + saslMechanisms(client) + " :are available SASL mechanisms", true);
+            sendReply(clientFd, "904 " + nick + " :SASL authentication failed", true);
+            return;
+        }
+        _server.startSaslSession(clientFd, mechanism);
+        sendReply(clientFd, "AUTHENTICATE +", false);
+        return;
+    }
+    if (session->ticket != 0) {
+        LOG_DEBUG("Ignoring AUTHENTICATE from client " + to_string(clientFd) + " while its password is checked");
+        return;
+    }
+    if (argument.length() > kChunkSize || session->payload.length() + argument.length() > kMaxPayload) {
+        _server.endSaslSession(clientFd);
+        sendReply(clientFd, "905 " + nick + " :SASL message too long", true);
+        return;
+    }
+    if (argument != "+") {
+        session->payload += argument;
+    }
+    if (argument.length() == kChunkSize) {
+        return;     // More chunks follow, or "+" if the payload was a multiple of 400
+    }
 
+    std::string message;
+    bool decoded = decodeBase64(session->payload, message);
+    if (session->mechanism == "EXTERNAL") {
+        // The message is only the authorization identity, usually empty
+        if (decoded) {
+            finishExternal(clientFd, message);
+        } else {
+            finishSasl(clientFd, "", false);
+        }
+        return;
+    }
+    size_t first = message.find('\0');
+    size_t second = first == std::string::npos ? first : message.find('\0', first + 1);
+    if (!decoded || second == std::string::npos) {
+        std::fill(message.begin(), message.end(), '\0');
+        finishSasl(clientFd, "", false);
+        return;
+    }
+    std::string authorization = message.substr(0, first);
+    std::string account = message.substr(first + 1, second - first - 1);
+    std::string password = message.substr(second + 1);
+    std::fill(message.begin(), message.end(), '\0');
+    if (!AccountStore::isValidName(account) || (!authorization.empty() && authorization != account)) {
+        finishSasl(clientFd, "", false);
+    } else {
+        Authenticator::Outcome outcome = _server.checkPassword(clientFd, account, password);
+        if (outcome == Authenticator::ACCEPTED) {
+            _server.getMetrics().logins[Metrics::LOGIN_CACHED].add();
+            finishSasl(clientFd, account, true);
+        } else if (outcome == Authenticator::BUSY) {
+            _server.getMetrics().logins[Metrics::LOGIN_BUSY].add();
+            finishSasl(clientFd, account, false);
+        }
+    }
+    std::fill(password.begin(), password.end(), '\0');
+}
+
+// The login name of a uid, empty if the system does not know it
+static std::string loginName(long uid) {
+    struct passwd entry;
+    struct passwd* found = NULL;
+    char buffer[1024];
+    if (uid < 0 || getpwuid_r(static_cast<uid_t>(uid), &entry, buffer, sizeof(buffer), &found) != 0 || !found) {
+        return "";
+    }
+    return found->pw_name;
+}
+
+std::string CommandExecutor::saslMechanisms(const Client* client) const {
+    return client->getPeerUid() >= 0 ? "PLAIN,EXTERNAL" : "PLAIN";
+}
+
+// EXTERNAL on the Unix socket: the peer's uid vouches for the account named
+// after its login name. A trusted peer, such as a bridge, may name any account.
+void CommandExecutor::finishExternal(int clientFd, const std::string& authorization) {
+    Client* client = _server.getClientByFd(clientFd);
+    std::string account = loginName(client->getPeerUid());
+    if (!authorization.empty() && (authorization == account || _server.isTrustedPeer(client))) {
+        account = authorization;
+    } else if (!authorization.empty()) {
+        account.clear();
+    }
+    bool accepted = !account.empty() && _server.getAuthenticator()->hasAccount(account);
+    _server.getMetrics().logins[accepted ? Metrics::LOGIN_EXTERNAL : Metrics::LOGIN_FAILED].add();
+    finishSasl(clientFd, account, accepted);
+}
+
+void CommandExecutor::finishSasl(int clientFd, const std::string& account, bool accepted) {
+    Client* client = _server.getClientByFd(clientFd);
+    _server.endSaslSession(clientFd);
+    if (!client) {
+        return;
+    }
+    std::string nick = client->getNickname().empty() ? "*" : client->getNickname();
+    if (!accepted) {
+        sendReply(clientFd, "904 " + nick + " :SASL authentication failed", true);
+        return;
+    }
+    client->setAccount(account);
+    client->setPassword(true);      // The account stands in for the server password
+    sendReply(clientFd, "900 " + nick + " " + client->getFullClientIdentifier() + " " + account
+                            + " :You are now logged in as " + account, true);
+    sendReply(clientFd, "903 " + nick + " :SASL authentication successful", true);
+    LOG_INFO("Client " + to_string(clientFd) + " logged in as " + account);
+    // CAP END may have arrived while the password was being checked
+    if (isRegistered(client)) {
+        sendWelcome(clientFd, client);
+        _server.introduceUser(client);
+    }
+}
+
+
+/*
+WHO <channel|mask> [o][%<fields>[,<token>]] (RFC 2812, IRCv3 WHOX)
+Without '%' every user gets a full RPL_WHOREPLY (352); with it an
+RPL_WHOSPCRPL (354) carrying only the fields asked for. A mask search
+returns at most --who-limit users, then ERR_TOOMANYMATCHES (416).
+*/
 void CommandExecutor::executeWho(int clientFd, const Command& cmd) {
     if (cmd.getParameters().size() < 1) {
         sendReply(clientFd, "461 WHO :Wrong number of parameters", true);
@@ -840,85 +1317,496 @@ void CommandExecutor::executeWho(int clientFd, const Command& cmd) {
 
     std::string target = cmd.getParameters()[0];
     Client* requestingClient = _server.getClientByFd(clientFd);
-    
-    if (isChannelSyntaxOk(target)) {
+    std::string options = cmd.getParameters().size() > 1 ? cmd.getParameters()[1] : "";
+    if (!options.empty() && options[0] == ':') {
+        options = options.substr(1);
+    }
+    size_t percent = options.find('%');
+    bool operatorsOnly = options.substr(0, percent).find('o') != std::string::npos;
+    std::string fields;
+    std::string token;
+    if (percent != std::string::npos) {
+        fields = options.substr(percent + 1);
+        size_t comma = fields.find(',');
+        if (comma != std::string::npos) {
+            token = fields.substr(comma + 1, 3);
+            fields = fields.substr(0, comma);
+        }
+        if (token.empty() || token.find_first_not_of("0123456789") != std::string::npos) {
+            token = "0";
+        }
+    }
+    const std::string* selected = percent != std::string::npos ? &fields : NULL;
 
+    _server.cork(clientFd);
+    if (isChannelSyntaxOk(target)) {
         Channel* channel = _server.getChannel(target);
         if (channel) {
+            std::vector<Client*> operators = channel->getOperators();
+            std::sort(operators.begin(), operators.end());
             const std::vector<Client*>& members = channel->getMembers();
             for (std::vector<Client*>::const_iterator it = members.begin(); it != members.end(); ++it) {
-                Client* member = *it;
-                std::string flags = "H"; // Here, assuming all users are "Here" and not away
-                if (channel->isOperator(member)) {
-                    flags += "@";
+                if (!operatorsOnly || (*it)->isOperator()) {
+                    bool channelOperator = std::binary_search(operators.begin(), operators.end(), *it);
+                    _server.sendToClient(clientFd, whoReply(requestingClient, *it, target, channelOperator, selected, token));
                 }
-                sendReply(clientFd, "352 " + requestingClient->getNickname() + " " + 
-                          target + " " + member->getUsername() + " " + 
-                          member->getHostname() + " " + _server.getServerName() + " " + 
-                          member->getNickname() + " " + flags + " :0 " + 
-                          member->getRealname(), true);
             }
         }
     } else {
-        // It's a user
-        Client* targetClient = _server.getClientByNickname(target);
-        if (targetClient) {
-            sendReply(clientFd, "352 " + requestingClient->getNickname() + " * " + 
-                      targetClient->getUsername() + " " + targetClient->getHostname() + " " + 
-                      _server.getServerName() + " " + targetClient->getNickname() + 
-                      " H :0 " + targetClient->getRealname(), true);
+        bool truncated = false;
+        size_t limit = _server.getConfig().whoLimit;
+        std::vector<Client*> users = _server.findUsers(target == "0" ? "*" : target, operatorsOnly, limit, truncated);
+        for (std::vector<Client*>::iterator it = users.begin(); it != users.end(); ++it) {
+            _server.sendToClient(clientFd, whoReply(requestingClient, *it, "*", false, selected, token));
+        }
+        if (truncated) {
+            sendReply(clientFd, "416 " + requestingClient->getNickname() + " WHO :Too many matches, only "
+                                    + to_string(limit) + " listed", true);
         }
     }
 
     // End of WHO list
     sendReply(clientFd, "315 " + requestingClient->getNickname() + " " + target + " :End of /WHO list", true);
+    _server.uncork();
+}
+
+// One 352 line, or with fields a 354 line with them in the WHOX order tcuihsnfdlaor
+std::string CommandExecutor::whoReply(const Client* requester, const Client* user, const std::string& channel,
+                                      bool channelOperator, const std::string* fields, const std::string& token) const {
+    std::string flags = "H";
+    if (user->isOperator()) {
+        flags += "*";
+    }
+    if (user->isBot()) {
+        flags += "B";
+    }
+    if (channelOperator) {
+        flags += "@";
+    }
+    std::string server = user->isRemote() ? user->getServerName() : _server.getServerName();
+    std::string line = ":" + _server.getServerName() + (fields ? " 354 " : " 352 ") + requester->getNickname();
+    if (!fields) {
+        return line + " " + channel + " " + user->getUsername() + " " + user->getHostname() + " " + server + " "
+               + user->getNickname() + " " + flags + " :" + to_string(user->getHops()) + " " + user->getRealname() + "\r\n";
+    }
+    static const char kOrder[] = "tcuihsnfdlaor";
+    for (const char* field = kOrder; *field; ++field) {
+        if (fields->find(*field) == std::string::npos) {
+            continue;
+        }
+        switch (*field) {
+            case 't': line += " " + token; break;
+            case 'c': line += " " + channel; break;
+            case 'u': line += " " + user->getUsername(); break;
+            // Only local TCP users have a known address; 255.255.255.255 is WHOX for none
+            case 'i': line += " " + (user->isRemote() || user->getPeerUid() != -1 ? std::string("255.255.255.255")
+                                                                                  : user->getHostname()); break;
+            case 'h': line += " " + user->getHostname(); break;
+            case 's': line += " " + server; break;
+            case 'n': line += " " + user->getNickname(); break;
+            case 'f': line += " " + flags; break;
+            case 'd': line += " " + to_string(user->getHops()); break;
+            case 'l': line += " 0"; break;
+            case 'a': line += " " + (user->getAccount().empty() ? std::string("0") : user->getAccount()); break;
+            case 'o': line += " n/a"; break;
+            case 'r': line += " :" + user->getRealname(); break;
+        }
+    }
+    return line + "\r\n";
+}
+
+/*
+LIST [<channel>{,<channel>} | <condition>{,<condition>}] (RFC 2812, ELIST)
+Conditions: >n and <n members, T<n and T>n minutes since the topic was set,
+and masks on the name. Named channels are answered at once; the
+rest streams from the channel index (see Server::listChannels).
+*/
+void CommandExecutor::executeList(int clientFd, const Command& cmd) {
+    Client* client = _server.getClientByFd(clientFd);
+    std::vector<std::string> items;
+    if (!cmd.getParameters().empty()) {
+        items = splitList(cmd.getParameters()[0]);
+    }
+    bool named = !items.empty();
+    ChannelIndex::Filter filter;
+    for (std::vector<std::string>::const_iterator it = items.begin(); it != items.end(); ++it) {
+        named = named && !it->empty() && isChannelSyntaxOk(*it) && it->find_first_of("*?") == std::string::npos;
+        filter.add(*it);
+    }
+
+    _server.cork(clientFd);
+    sendReply(clientFd, "321 " + client->getNickname() + " Channel :Users  Name", true);
+    if (named) {
+        for (std::vector<std::string>::const_iterator it = items.begin(); it != items.end(); ++it) {
+            Channel* channel = _server.getChannel(*it);
+            if (channel) {
+                sendReply(clientFd, "322 " + client->getNickname() + " " + channel->getName() + " "
+                                        + to_string(channel->getMemberCount()) + " :" + channel->getTopic(), true);
+            }
+        }
+        sendReply(clientFd, "323 " + client->getNickname() + " :End of /LIST", true);
+    } else {
+        _server.listChannels(clientFd, filter);
+    }
+    _server.uncork();
+}
+
+/*
+MONITOR + <nick>{,<nick>} | - <nick>{,<nick>} | C | L | S (IRCv3 MONITOR)
+The server keeps the list and pushes 730 and 731 when a listed nickname
+registers, changes nick or quits, so clients stop polling with WHO.
+*/
+void CommandExecutor::executeMonitor(int clientFd, const Command& cmd) {
+    Client* client = _server.getClientByFd(clientFd);
+    const std::vector<std::string>& params = cmd.getParameters();
+    std::string action = params.empty() ? "" : params[0];
+    if (action.empty() || ((action == "+" || action == "-") && params.size() < 2)) {
+        sendReply(clientFd, "461 " + client->getNickname() + " MONITOR :Not enough parameters", true);
+        return;
+    }
+    std::vector<std::string> targets;
+    if (params.size() > 1) {
+        targets = splitList(params[1]);
+    }
+
+    _server.cork(clientFd);
+    if (action == "+") {
+        size_t limit = _server.getConfig().monitorLimit;
+        std::vector<std::string> added;
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (targets[i].empty()) {
+                continue;
+            }
+            if (client->getMonitored().size() >= limit && !client->getMonitored().count(casefold(targets[i]))) {
+                std::string rest;
+                for (size_t j = i; j < targets.size(); ++j) {
+                    rest += (j > i ? "," : "") + targets[j];
+                }
+                sendReply(clientFd, "734 " + client->getNickname() + " " + to_string(limit) + " " + rest
+                                        + " :Monitor list is full.", true);
+                break;
+            }
+            _server.monitor(client, targets[i]);
+            added.push_back(targets[i]);
+        }
+        sendMonitorStatus(client, added);
+    } else if (action == "-") {
+        for (std::vector<std::string>::iterator it = targets.begin(); it != targets.end(); ++it) {
+            _server.unmonitor(client, *it);
+        }
+    } else if (action == "C" || action == "c") {
+        _server.clearMonitor(client);
+    } else if (action == "L" || action == "l") {
+        const std::set<std::string>& monitored = client->getMonitored();
+        sendListReply(clientFd, "732 " + client->getNickname() + " :",
+                      std::vector<std::string>(monitored.begin(), monitored.end()));
+        sendReply(clientFd, "733 " + client->getNickname() + " :End of MONITOR list", true);
+    } else if (action == "S" || action == "s") {
+        const std::set<std::string>& monitored = client->getMonitored();
+        sendMonitorStatus(client, std::vector<std::string>(monitored.begin(), monitored.end()));
+    }
+    _server.uncork();
+}
+
+// RPL_MONONLINE (730) for the nicknames in use by registered users, RPL_MONOFFLINE (731) for the rest
+void CommandExecutor::sendMonitorStatus(Client* client, const std::vector<std::string>& nicknames) {
+    std::vector<std::string> online;
+    std::vector<std::string> offline;
+    for (std::vector<std::string>::const_iterator it = nicknames.begin(); it != nicknames.end(); ++it) {
+        Client* target = _server.getClientByNickname(*it);
+        if (target && target->isRegistered()) {
+            online.push_back(target->getFullClientIdentifier());
+        } else {
+            offline.push_back(*it);
+        }
+    }
+    sendListReply(client->getFd(), "730 " + client->getNickname() + " :", online);
+    sendListReply(client->getFd(), "731 " + client->getNickname() + " :", offline);
 }
 
 void CommandExecutor::executeNotice(int clientFd, const Command& cmd) {
-    if (cmd.getParameters().size() < 2) {
-        // Do nothing; NOTICE should not generate error replies
+    deliverMessage(clientFd, cmd, true);
+}
+
+
+/*
+IRCv3 CHATHISTORY: LATEST, BEFORE, AFTER and BETWEEN on channels the client
+is a member of. The events are wrapped in a chathistory BATCH if the client
+enabled batch, and carry their original time and msgid as tags if it enabled
+server-time and message-tags; other clients get plain lines.
+*/
+void CommandExecutor::executeChatHistory(int clientFd, const Command& cmd) {
+    Client* client = _server.getClientByFd(clientFd);
+    HistoryStore* history = _server.getHistory();
+    std::vector<std::string> params = cmd.getParameters();
+
+    if (params.size() < 4) {
+        sendReply(clientFd, "FAIL CHATHISTORY NEED_MORE_PARAMS CHATHISTORY :Missing parameters", true);
         return;
     }
 
-    std::string target = cmd.getParameters()[0];
-    std::string message = cmd.getParameters()[1];
-    Client* sender = _server.getClientByFd(clientFd);
-    
-    if (!sender) {
-        Logger::error("Client not found for fd: " + to_string(clientFd));
+    std::string subcommand = params[0];
+    std::transform(subcommand.begin(), subcommand.end(), subcommand.begin(), ::toupper);
+    std::string target = params[1];
+
+    Channel* channel = _server.getChannel(target);
+    if (!channel || !channel->isMember(client)) {
+        sendReply(clientFd, "FAIL CHATHISTORY INVALID_TARGET " + subcommand + " " + target + " :Messages could not be retrieved", true);
         return;
     }
 
-    // Check if the target is a channel
-    if (isChannelSyntaxOk(target)) {
-        Channel* channel = _server.getChannel(target);
+    std::stringstream limitStream(params.back());
+    size_t limit = 0;
+    limitStream >> limit;
+    if (limitStream.fail() || limit == 0) {
+        sendReply(clientFd, "FAIL CHATHISTORY INVALID_PARAMS " + subcommand + " " + params.back() + " :Invalid limit", true);
+        return;
+    }
+    if (limit > history->getMaxLines()) {
+        limit = history->getMaxLines();
+    }
+
+    HistoryStore::Reference lower;
+    HistoryStore::Reference upper;
+    HistoryStore::Reference first;
+    bool newestFirst = false;
+    bool valid = HistoryStore::Reference::parse(params[2], first);
+
+    if (subcommand == "LATEST" && params.size() == 4) {
+        lower = first;
+        newestFirst = true;
+    } else if (subcommand == "BEFORE" && params.size() == 4) {
+        upper = first;
+        newestFirst = true;
+        valid = valid && first.kind != HistoryStore::Reference::NONE;
+    } else if (subcommand == "AFTER" && params.size() == 4) {
+        lower = first;
+        valid = valid && first.kind != HistoryStore::Reference::NONE;
+    } else if (subcommand == "BETWEEN" && params.size() == 5) {
+        HistoryStore::Reference second;
+        // Both of one kind: a msgid and a timestamp have no order to compare
+        valid = valid && HistoryStore::Reference::parse(params[3], second)
+                && first.kind != HistoryStore::Reference::NONE && second.kind == first.kind;
+        bool reversed = (first.kind == HistoryStore::Reference::MSGID) ? first.msgId > second.msgId : first.timeMs > second.timeMs;
+        lower = reversed ? second : first;
+        upper = reversed ? first : second;
+        newestFirst = reversed;
+    } else {
+        sendReply(clientFd, "FAIL CHATHISTORY INVALID_PARAMS " + subcommand + " :Unknown subcommand or wrong number of parameters", true);
+        return;
+    }
+    if (!valid) {
+        sendReply(clientFd, "FAIL CHATHISTORY INVALID_PARAMS " + subcommand + " " + params[2] + " :Invalid message reference", true);
+        return;
+    }
 
-        if (!channel || !channel->isMember(sender)) {
-            // Do nothing; NOTICE should not generate error replies
-            return;
+    std::vector<HistoryStore::Event> events;
+    history->select(channel->getName(), lower, upper, limit, newestFirst, events);
+
+    bool batched = client->hasCapability(Client::CAP_BATCH);
+    std::string batchId = "history" + to_string(++_batchCounter);
+    if (batched) {
+        sendReply(clientFd, "BATCH +" + batchId + " chathistory " + target, true);
+    }
+    for (std::vector<HistoryStore::Event>::const_iterator it = events.begin(); it != events.end(); ++it) {
+        const char* verb = (it->type == HistoryStore::TOPIC) ? "TOPIC" : (it->type == HistoryStore::NOTICE) ? "NOTICE" : "PRIVMSG";
+        std::string tags;
+        if (batched) {
+            tags += ";batch=" + batchId;
+        }
+        if (client->hasCapability(Client::CAP_SERVER_TIME)) {
+            tags += ";time=" + HistoryStore::formatTime(it->timeMs);
         }
+        if (client->hasCapability(Client::CAP_MESSAGE_TAGS)) {
+            tags += ";msgid=" + to_string(it->msgId);
+        }
+        std::string line = ":" + it->prefix + " " + verb + " " + target + " :" + it->text;
+        sendReply(clientFd, tags.empty() ? line : "@" + tags.substr(1) + " " + line, false);
+    }
+    if (batched) {
+        sendReply(clientFd, "BATCH -" + batchId, true);
+    }
+    LOG_DEBUG("Replayed " + to_string(events.size()) + " history events of " + target + " to client " + to_string(clientFd));
+}
 
-        Logger::info("Client is sending a notice to the channel...");
+void CommandExecutor::executeOper(int clientFd, const Command& cmd) {
+    static const unsigned int kMaxOperFailures = 3;   // Wrong passwords before the connection is closed
+    Client* client = _server.getClientByFd(clientFd);
+    const std::string& nick = client->getNickname();
 
-        // Construct the channel notice in the proper IRC format
-        std::string channelNotice = ":" + sender->getFullClientIdentifier() + " NOTICE " + target + " :" + message + "\r\n";
-        _server.broadcastToChannel(target, channelNotice, sender);
+    if (cmd.getParameters().size() < 2) {
+        sendReply(clientFd, "461 " + nick + " OPER :Not enough parameters", true);
+        return;
+    }
+    const std::string& operPassword = _server.getConfig().operPassword;
+    if (operPassword.empty()) {
+        sendReply(clientFd, "491 " + nick + " :No O-lines for your host", true);
+        return;
+    }
+    std::string password = cmd.getParameters()[1];
+    if (!password.empty() && password[0] == ':') {
+        password = password.substr(1);
+    }
+    // Digests are compared so that neither the bytes nor the length leak through timing
+    if (!Sha256::equals(Sha256::digest(password), Sha256::digest(operPassword))) {
+        LOG_WARNING("Failed OPER attempt from client " + to_string(clientFd));
+        sendReply(clientFd, "464 " + nick + " :Password incorrect", true);
+        client->setOperFailures(client->getOperFailures() + 1);
+        if (client->getOperFailures() >= kMaxOperFailures) {
+            _server.closeClient(clientFd, Metrics::DISCONNECT_OPER_FAILED, "Too many failed OPER attempts");
+        }
+        return;
+    }
+    client->setOperFailures(0);
+    client->setOperator(true);
+    LOG_INFO("Client " + nick + " is now an IRC operator");
+    sendReply(clientFd, "381 " + nick + " :You are now an IRC operator", true);
+}
 
-    } else {
-        // Handle notices to a specific user
-        Client* recipient = _server.getClientByNickname(target);
-        
-        if (!recipient) {
-            // Do nothing; NOTICE should not generate error replies
+/*
+STATS m  RPL_STATSCOMMANDS (212) per verb: count, bytes received
+STATS u  RPL_STATSUPTIME (242)
+STATS x  operators only: the metrics summary as RPL_STATSDEBUG (249) lines
+*/
+void CommandExecutor::executeStats(int clientFd, const Command& cmd) {
+    Client* client = _server.getClientByFd(clientFd);
+    const std::string& nick = client->getNickname();
+    std::string query = cmd.getParameters().empty() ? "" : cmd.getParameters()[0];
+    if (!query.empty() && query[0] == ':') {
+        query = query.substr(1);
+    }
+    std::string letter = query.empty() ? "*" : query.substr(0, 1);
+    Metrics& metrics = _server.getMetrics();
+
+    if (letter == "m") {
+        for (int i = 0; i < Metrics::commandCount(); ++i) {
+            const Metrics::CommandStats& stats = metrics.getCommand(i);
+            if (stats.latency.getCount() > 0) {
+                sendReply(clientFd, "212 " + nick + " " + Metrics::commandName(i) + " " + to_string(stats.latency.getCount())
+                                    + " " + to_string(stats.bytes.get()) + " 0", true);
+            }
+        }
+    } else if (letter == "u") {
+        long uptime = static_cast<long>(std::time(NULL) - metrics.getStartTime());
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "Server Up %ld days %ld:%02ld:%02ld",
+                 uptime / 86400, uptime / 3600 % 24, uptime / 60 % 60, uptime % 60);
+        sendReply(clientFd, "242 " + nick + " :" + buffer, true);
+    } else if (letter == "x") {
+        if (!client->isOperator()) {
+            sendReply(clientFd, "481 " + nick + " :Permission Denied- You're not an IRC operator", true);
             return;
         }
+        _server.sampleMetrics();
+        std::vector<std::string> lines = metrics.renderSummary();
+        for (std::vector<std::string>::const_iterator it = lines.begin(); it != lines.end(); ++it) {
+            sendReply(clientFd, "249 " + nick + " :" + *it, true);
+        }
+    }
+    sendReply(clientFd, "219 " + nick + " " + letter + " :End of STATS report", true);
+}
+
+// Operator extension: writes the span rings to the server's --trace-file
+void CommandExecutor::executeTraceDump(int clientFd) {
+    Client* client = _server.getClientByFd(clientFd);
+    const std::string& nick = client->getNickname();
+
+    if (!client->isOperator()) {
+        sendReply(clientFd, "481 " + nick + " :Permission Denied- You're not an IRC operator", true);
+        return;
+    }
+    if (!Tracer::isEnabled()) {
+        sendReply(clientFd, "NOTICE " + nick + " :Tracing is disabled (start the server with --trace-spans)", true);
+        return;
+    }
+    long spans = _server.dumpTrace();
+    if (spans < 0) {
+        sendReply(clientFd, "NOTICE " + nick + " :Failed to write the trace file", true);
+        return;
+    }
+    sendReply(clientFd, "NOTICE " + nick + " :Wrote " + to_string(spans) + " spans to " + _server.getConfig().traceFile, true);
+}
+
+// Operator extension: restarts the server binary without disconnecting anyone
+void CommandExecutor::executeUpgrade(int clientFd) {
+    Client* client = _server.getClientByFd(clientFd);
+    const std::string& nick = client->getNickname();
+
+    if (!client->isOperator()) {
+        sendReply(clientFd, "481 " + nick + " :Permission Denied- You're not an IRC operator", true);
+        return;
+    }
+    if (!_server.requestUpgrade(clientFd)) {
+        sendReply(clientFd, "NOTICE " + nick + " :Live upgrade is not available in this process", true);
+        return;
+    }
+    sendReply(clientFd, "NOTICE " + nick + " :Upgrading: handing every connection to a new process", true);
+}
+
+// PART <channel>{,<channel>} [:<reason>]; the replies reach the client in one write
+void CommandExecutor::executePart(int clientFd, const Command& cmd) {
+    Client* client = _server.getClientByFd(clientFd);
+
+    if (cmd.getParameters().empty()) {
+        sendReply(clientFd, "461 PART :Not enough parameters", true);
+        return;
+    }
+    std::string reason;
+    if (cmd.getParameters().size() > 1) {
+        reason = cmd.getParameters()[1];
+        if (reason[0] == ':') {
+            reason = reason.substr(1);
+        }
+    }
 
-        Logger::info("Target: " + target + " | Recipient: " + recipient->getNickname());
+    std::vector<std::string> channels = splitList(cmd.getParameters()[0]);
+    _server.cork(clientFd);
+    for (std::vector<std::string>::iterator it = channels.begin(); it != channels.end(); ++it) {
+        partChannel(client, *it, reason);
+    }
+    _server.uncork();
+}
 
-        // Construct the private notice in the proper IRC format
-        std::string privateNotice = ":" + sender->getFullClientIdentifier() + " NOTICE " + target + " :" + message + "\r\n";
-        sendReply(recipient->getFd(), privateNotice, false);
+void CommandExecutor::partChannel(Client* client, const std::string& channelName, const std::string& reason) {
+    int clientFd = client->getFd();
+    Channel* channel = _server.getChannel(channelName);
+    if (!channel) {
+        sendReply(clientFd, "403 " + channelName + " :No such channel", true);
+        return;
+    }
+    if (!channel->isMember(client)) {
+        sendReply(clientFd, "442 " + channelName + " :You're not on that channel", true);
+        return;
+    }
+    std::string partMessage = ":" + client->getFullClientIdentifier() + " PART " + channelName
+                              + (reason.empty() ? "" : " :" + reason) + "\r\n";
+    _server.broadcastToChannel(channelName, partMessage, NULL, true);
+    _server.propagate(partMessage, NULL);
+    channel->removeMember(client);
+    client->removeChannel(channelName);
+    _server.removeChannelIfEmpty(channelName);
+}
+
+// QUIT [:<message>]; the client is gone when this returns
+void CommandExecutor::executeQuit(int clientFd, const Command& cmd) {
+    std::string message = cmd.getParameters().empty() ? "" : cmd.getParameters()[0];
+    if (!message.empty() && message[0] == ':') {
+        message = message.substr(1);
+    }
+    _server.quitClient(clientFd, message.empty() ? "Client Quit" : message);
+}
+
+// SERVER <name> <hopcount> :<info> turns the connection into a server link (RFC 2813)
+void CommandExecutor::executeServer(int clientFd, const Command& cmd) {
+    Client* client = _server.getClientByFd(clientFd);
 
-        Logger::info("Notice sent to recipient: " + recipient->getNickname());
+    if (isRegistered(client)) {
+        sendReply(clientFd, "462 " + client->getNickname() + " :You may not reregister", true);
+        return;
+    }
+    if (!client->isLinkAuthorized()) {
+        _server.dropLink(client, "No link password");
+        return;
     }
+    _server.getLinkExecutor()->acceptServer(client, cmd.getParameters(), true);
 }
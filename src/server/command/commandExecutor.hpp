@@ -25,26 +25,54 @@ class Server;
 
 class CommandExecutor {
 private:
+    static const size_t kMaxTargets = 8;     // Targets per PRIVMSG or NOTICE (TARGMAX)
+
     Server& _server;
+    unsigned long _batchCounter;             // Names the BATCH of each CHATHISTORY reply
 
     void executePass(int clientFd, const Command& cmd);
     void executeNick(int clientFd, const Command& cmd);
     void executeUser(int clientFd, const Command& cmd);
     void executeJoin(int clientFd, const Command& cmd);
+    void joinChannel(Client* client, const std::string& channelName, const std::string& key);
     void executePrivmsg(int clientFd, const Command& cmd);
+    void deliverMessage(int clientFd, const Command& cmd, bool notice);
     void executeMode(int clientFd, const Command& cmd);
+    void executeUserMode(int clientFd, const Command& cmd);
     void executeTopic(int clientFd, const Command& cmd);
     void executeInvite(int clientFd, const Command& cmd);
     void executeKick(int clientFd, const Command& cmd);
     void executePing(int clientFd, const Command& cmd);
-    void executeCap(int clientFd);
+    void executeCap(int clientFd, const Command& cmd);
+    void executeAuthenticate(int clientFd, const Command& cmd);
     void executeWho(int clientFd, const Command& cmd);
+    std::string whoReply(const Client* requester, const Client* user, const std::string& channel, bool channelOperator,
+                         const std::string* fields, const std::string& token) const;
+    void executeList(int clientFd, const Command& cmd);
+    void executeMonitor(int clientFd, const Command& cmd);
+    void sendMonitorStatus(Client* client, const std::vector<std::string>& nicknames);
     void executeNotice(int clientFd, const Command& cmd);
+    void executeChatHistory(int clientFd, const Command& cmd);
+    void executeOper(int clientFd, const Command& cmd);
+    void executeStats(int clientFd, const Command& cmd);
+    void executeTraceDump(int clientFd);
+    void executeUpgrade(int clientFd);
+    void executePart(int clientFd, const Command& cmd);
+    void partChannel(Client* client, const std::string& channelName, const std::string& reason);
+    void executeQuit(int clientFd, const Command& cmd);
+    void executeServer(int clientFd, const Command& cmd);
 
     // Helper methods
     bool isValidNickname(const std::string& nickname) const;
     bool isRegistered(const Client* client) const;
     void sendReply(int clientFd, const std::string& reply, bool flag) const;
+    void sendWelcome(int clientFd, const Client* client) const;
+    // One or more "<head><item>,<item>..." replies, each within the 512 byte line limit
+    void sendListReply(int clientFd, const std::string& head, const std::vector<std::string>& items) const;
+    std::vector<std::string> getISupportTokens() const;
+    std::string saslMechanisms(const Client* client) const;
+    unsigned int offeredCapabilities() const;
+    void finishExternal(int clientFd, const std::string& authorization);
     void handleChannelMode(int clientFd, const std::string& channelName, const std::string& modestring, const std::vector<std::string>& args);
      bool isValidChannelName(const std::string& channelName);
 
@@ -54,6 +82,8 @@ public:
 
     void executeCommand(int clientFd, const Command& cmd);
     bool isChannelSyntaxOk(const std::string& channelName);
+    // Ends the client's SASL exchange with 900 and 903, or with 904
+    void finishSasl(int clientFd, const std::string& account, bool accepted);
     
 };
 
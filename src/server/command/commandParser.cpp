@@ -14,20 +14,32 @@
 
 
 Command CommandParser::parse(const std::string& message) {
-    Logger::debug("Parsing command: " + message);
+    LOG_EVENT(Logger::DEBUG, "Parsing command: {}", << message);
     std::string mutableMessage = message;
+    skipTags(mutableMessage);
     std::string prefix = extractPrefix(mutableMessage);
     std::string command = extractCommand(mutableMessage);
     std::vector<std::string> parameters = extractParameters(mutableMessage);
 
-    Logger::debug("Parsed command - Prefix: '" + prefix + "', Command: '" + command + "', Parameters: " + to_string(parameters.size()));
-    for (size_t i = 0; i < parameters.size(); ++i) {
-        Logger::debug("Parameter " + to_string(i) + ": '" + parameters[i] + "'");
+    if (LOG_ENABLED(Logger::DEBUG)) {
+        LOG_EVENT(Logger::DEBUG, "Parsed command - Prefix: '{}', Command: '{}', Parameters: {}",
+                  << prefix << command << parameters.size());
+        for (size_t i = 0; i < parameters.size(); ++i) {
+            LOG_EVENT(Logger::DEBUG, "Parameter {}: '{}'", << i << parameters[i]);
+        }
     }
 
     return Command(prefix, command, parameters);
 }
 
+// Clients that enabled message-tags may tag their lines; no command reads the tags
+void CommandParser::skipTags(std::string& message) {
+    if (!message.empty() && message[0] == '@') {
+        size_t start = message.find_first_not_of(' ', message.find(' '));
+        message = (start != std::string::npos) ? message.substr(start) : "";
+    }
+}
+
 std::string CommandParser::extractPrefix(std::string& message) {
     std::string prefix;
     if (!message.empty() && message[0] == ':') {
@@ -40,7 +52,7 @@ std::string CommandParser::extractPrefix(std::string& message) {
             message.clear();
         }
     }
-    Logger::debug("Extracted prefix: '" + prefix + "'");
+    LOG_EVENT(Logger::DEBUG, "Extracted prefix: '{}'", << prefix);
     return prefix;
 }
 
@@ -55,7 +67,7 @@ std::string CommandParser::extractCommand(std::string& message) {
         message.clear();
     }
     std::transform(command.begin(), command.end(), command.begin(), ::toupper);
-    Logger::debug("Extracted command: '" + command + "'");
+    LOG_EVENT(Logger::DEBUG, "Extracted command: '{}'", << command);
     return command;
 }
 
@@ -70,16 +82,16 @@ std::vector<std::string> CommandParser::extractParameters(std::string& message)
         if (param[0] == ':') {
             std::string trailing;
             std::getline(iss, trailing);
-            Logger::debug("BEFORE>> Extracted trailing parameter: '" + param + "'");
+            LOG_DEBUG("BEFORE>> Extracted trailing parameter: '" + param + "'");
             //param = param + trailing;
              param = param.substr(1) + trailing;
             parameters.push_back(param);
-            Logger::debug("Extracted trailing parameter: '" + param + "'");
+            LOG_DEBUG("Extracted trailing parameter: '" + param + "'");
             break;
         }
         
         parameters.push_back(param);
-        Logger::debug("Extracted parameter: '" + param + "'");
+        LOG_DEBUG("Extracted parameter: '" + param + "'");
     }
 
     return parameters;
@@ -97,16 +109,16 @@ std::vector<std::string> CommandParser::extractParameters(std::string& message)
         if (param[0] == ':') {
             std::string trailing;
             std::getline(iss, trailing);
-            Logger::debug("BEFORE>> Extracted trailing parameter: '" + param + "'");
+            LOG_EVENT(Logger::DEBUG, "BEFORE>> Extracted trailing parameter: '{}'", << param);
 
               param = param + trailing;
 
             parameters.push_back(param);
-            Logger::debug("Extracted trailing parameter: '" + param + "'");
+            LOG_EVENT(Logger::DEBUG, "Extracted trailing parameter: '{}'", << param);
             break;
         }
         parameters.push_back(param);
-        Logger::debug("Extracted parameter: '" + param + "'");
+        LOG_EVENT(Logger::DEBUG, "Extracted parameter: '{}'", << param);
         flag++;
     }
 
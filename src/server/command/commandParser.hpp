@@ -25,6 +25,7 @@ public:
     static Command parse(const std::string& message);
 
 private:
+    static void skipTags(std::string& message);
     static std::string extractPrefix(std::string& message);
     static std::string extractCommand(std::string& message);
     static std::vector<std::string> extractParameters(std::string& message);
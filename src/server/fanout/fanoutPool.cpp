@@ -0,0 +1,189 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   fanoutPool.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/02 18:41:06 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/02 18:41:06 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "fanoutPool.hpp"
+#include "../../trace/tracer.hpp"
+#include <unistd.h>
+#include <algorithm>
+#include <stdexcept>
+
+FanoutPool::FanoutPool(size_t threadCount)
+    : _threads(),
+      _jobs(),
+      _blocked(4096),
+      _blockedLost(0),
+      _inFlight(0),
+      _nextSequence(1),
+      _running(),
+      _wakeAt(0),
+      _stopping(false)
+{
+    pthread_mutex_init(&_mutex, NULL);
+    pthread_cond_init(&_jobReady, NULL);
+    pthread_cond_init(&_idle, NULL);
+
+    for (size_t i = 0; i < threadCount; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, &FanoutPool::workerMain, this) != 0) {
+            break;
+        }
+        _threads.push_back(thread);
+    }
+    if (_threads.empty() && threadCount > 0) {
+        pthread_cond_destroy(&_idle);
+        pthread_cond_destroy(&_jobReady);
+        pthread_mutex_destroy(&_mutex);
+        throw std::runtime_error("Failed to start fan-out worker threads");
+    }
+}
+
+FanoutPool::~FanoutPool() {
+    pthread_mutex_lock(&_mutex);
+    _stopping = true;
+    pthread_cond_broadcast(&_jobReady);
+    pthread_mutex_unlock(&_mutex);
+
+    for (size_t i = 0; i < _threads.size(); ++i) {
+        pthread_join(_threads[i], NULL);
+    }
+    for (std::deque<Job*>::iterator it = _jobs.begin(); it != _jobs.end(); ++it) {
+        delete *it;
+    }
+    pthread_cond_destroy(&_idle);
+    pthread_cond_destroy(&_jobReady);
+    pthread_mutex_destroy(&_mutex);
+}
+
+void* FanoutPool::workerMain(void* arg) {
+    static_cast<FanoutPool*>(arg)->workerLoop();
+    return NULL;
+}
+
+void FanoutPool::workerLoop() {
+    Tracer::setThreadName("fan-out worker");
+    pthread_mutex_lock(&_mutex);
+    while (true) {
+        while (_jobs.empty() && !_stopping) {
+            pthread_cond_wait(&_jobReady, &_mutex);
+        }
+        if (_jobs.empty() && _stopping) {
+            break;
+        }
+        Job* job = _jobs.front();
+        _jobs.pop_front();
+        unsigned long sequence = job->sequence;
+        pthread_mutex_unlock(&_mutex);
+
+        runJob(job);
+        delete job;
+
+        pthread_mutex_lock(&_mutex);
+        _running.erase(sequence);
+        if (_wakeAt && isRetiredLocked(_wakeAt)) {
+            _wakeAt = 0;
+            _blocked.wake();
+        }
+        if (--_inFlight == 0) {
+            pthread_cond_broadcast(&_idle);
+        }
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+void FanoutPool::runJob(Job* job) {
+    TraceSpan span("fanout job", NULL, static_cast<long>(job->recipients.size()));
+    for (std::vector<Client*>::iterator it = job->recipients.begin(); it != job->recipients.end(); ++it) {
+        // Errors are left in the queue too: the loop sees them on its next flush
+        if ((*it)->getOutbound().flush((*it)->getFd()) != 0 && !_blocked.push((*it)->getFd())) {
+            __atomic_store_n(&_blockedLost, 1, __ATOMIC_RELEASE);
+            _blocked.wake();
+        }
+    }
+}
+
+void FanoutPool::submit(const std::vector<Client*>& recipients) {
+    if (recipients.empty()) {
+        return;
+    }
+    size_t slices = _threads.size();
+    size_t sliceSize = (recipients.size() + slices - 1) / slices;
+
+    pthread_mutex_lock(&_mutex);
+    for (size_t begin = 0; begin < recipients.size(); begin += sliceSize) {
+        size_t end = std::min(begin + sliceSize, recipients.size());
+        Job* job = new Job;
+        job->recipients.assign(recipients.begin() + begin, recipients.begin() + end);
+        job->sequence = _nextSequence++;
+        _running.insert(job->sequence);
+        _jobs.push_back(job);
+        ++_inFlight;
+    }
+    pthread_cond_broadcast(&_jobReady);
+    pthread_mutex_unlock(&_mutex);
+}
+
+// Before UPGRADE hands the clients over, so their queues hold everything sent
+void FanoutPool::waitIdle() {
+    pthread_mutex_lock(&_mutex);
+    while (_inFlight > 0) {
+        pthread_cond_wait(&_idle, &_mutex);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+bool FanoutPool::isRetiredLocked(unsigned long ticket) const {
+    return _running.empty() || *_running.begin() >= ticket;
+}
+
+bool FanoutPool::retire(unsigned long& ticket) {
+    pthread_mutex_lock(&_mutex);
+    ticket = _nextSequence;
+    bool retired = isRetiredLocked(ticket);
+    if (!retired) {
+        _wakeAt = ticket;
+    }
+    pthread_mutex_unlock(&_mutex);
+    return retired;
+}
+
+bool FanoutPool::isRetired(unsigned long ticket) {
+    pthread_mutex_lock(&_mutex);
+    bool retired = isRetiredLocked(ticket);
+    pthread_mutex_unlock(&_mutex);
+    return retired;
+}
+
+bool FanoutPool::isIdle() {
+    pthread_mutex_lock(&_mutex);
+    bool idle = (_inFlight == 0);
+    pthread_mutex_unlock(&_mutex);
+    return idle;
+}
+
+bool FanoutPool::takeBlockedFds(std::vector<int>& out) {
+    _blocked.clearWakeup();
+    bool complete = __atomic_exchange_n(&_blockedLost, 0, __ATOMIC_ACQ_REL) == 0;
+    int batch[256];
+    size_t count;
+    while ((count = _blocked.popBatch(batch, sizeof(batch) / sizeof(batch[0]))) > 0) {
+        out.insert(out.end(), batch, batch + count);
+    }
+    return complete;
+}
+
+int FanoutPool::getWakeFd() const {
+    return _blocked.getWakeFd();
+}
+
+size_t FanoutPool::getThreadCount() const {
+    return _threads.size();
+}
@@ -0,0 +1,92 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   fanoutPool.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/02 18:41:02 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/02 18:41:02 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef FANOUTPOOL_HPP
+#define FANOUTPOOL_HPP
+
+#include "../../client/client.hpp"
+#include "../../utils/mailbox.hpp"
+#include <vector>
+#include <deque>
+#include <set>
+#include <pthread.h>
+
+/*
+Worker threads that flush the outbound queues of a large channel's members.
+The event loop enqueues the broadcast into every recipient's queue itself
+(cheap, and it keeps per-client ordering with later replies), then hands
+the recipient list to submit(), which splits it into one slice per worker.
+The workers perform the send() calls while the loop keeps polling.
+Clients whose socket filled up are reported back through a Mailbox, whose
+wake fd the loop polls; takeBlockedFds() drains it so the loop can wait for
+POLLOUT on them.
+
+Jobs go the other way through _jobs under _mutex, not through a Mailbox:
+every worker takes from that queue, and a Mailbox has a single consumer.
+Workers also sleep on _jobReady while there is no job, where a Mailbox
+only wakes a poll() loop, and taking a job must update _inFlight and
+_running with it for waitIdle() and retire(). The loop takes the lock
+once per submit(), not once per recipient.
+
+Jobs hold raw Client pointers and flush by fd, so a client that leaves may
+only be freed, and its fd closed, once the jobs submitted before it left
+have run. retire() hands out a ticket for that moment; the loop keeps the
+client until isRetired(ticket), and is woken through the wake fd when it
+comes.
+*/
+class FanoutPool {
+private:
+    struct Job {
+        std::vector<Client*> recipients;
+        unsigned long sequence;
+    };
+
+    std::vector<pthread_t> _threads;
+    std::deque<Job*> _jobs;
+    Mailbox<int> _blocked;
+    int _blockedLost;              // Set when _blocked was full; cleared by takeBlockedFds()
+    size_t _inFlight;
+    unsigned long _nextSequence;
+    std::set<unsigned long> _running;   // Sequences of the jobs queued or running
+    unsigned long _wakeAt;              // Wake the loop once every job before it ran, 0 if nobody waits
+    bool _stopping;
+    pthread_mutex_t _mutex;
+    pthread_cond_t _jobReady;
+    pthread_cond_t _idle;
+
+    FanoutPool(const FanoutPool& other);
+    FanoutPool& operator=(const FanoutPool& other);
+
+    static void* workerMain(void* arg);
+    void workerLoop();
+    void runJob(Job* job);
+    bool isRetiredLocked(unsigned long ticket) const;
+
+public:
+    explicit FanoutPool(size_t threadCount);
+    ~FanoutPool();
+
+    void submit(const std::vector<Client*>& recipients);
+    void waitIdle();
+    bool isIdle();
+    // True if no job submitted so far is left; otherwise the loop is woken
+    // once isRetired(ticket) holds
+    bool retire(unsigned long& ticket);
+    bool isRetired(unsigned long ticket);
+    // Returns false if some blocked clients could not be reported: the
+    // caller must then look for output left in every queue itself
+    bool takeBlockedFds(std::vector<int>& out);
+    int getWakeFd() const;
+    size_t getThreadCount() const;
+};
+
+#endif // FANOUTPOOL_HPP
@@ -0,0 +1,355 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   historyStore.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/04 15:02:14 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/04 15:02:14 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "historyStore.hpp"
+#include <sys/time.h>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Rough per-node cost of the std::map entries, used for memory accounting
+static const size_t kPrefixOverhead = 64;
+
+class ChannelHistory {
+public:
+    struct Entry {
+        long long timeMs;
+        unsigned long long msgId;
+        unsigned int prefixId;
+        unsigned int offset;     // Payload position in the arena
+        unsigned short length;
+        unsigned char type;
+    };
+
+    std::string name;
+    Entry* entries;
+    size_t capacity;
+    size_t first;                // Index of the oldest entry
+    size_t count;
+    char* arena;
+    size_t arenaSize;
+    size_t tail;                 // Next free arena byte
+    std::list<ChannelHistory*>::iterator lruPos;
+
+    ChannelHistory(const std::string& channelName, size_t lines, size_t bytes)
+        : name(channelName),
+          entries(new Entry[lines]),
+          capacity(lines),
+          first(0),
+          count(0),
+          arena(new char[bytes]),
+          arenaSize(bytes),
+          tail(0),
+          lruPos()
+    {
+    }
+
+    ~ChannelHistory() {
+        delete[] entries;
+        delete[] arena;
+    }
+
+    static size_t footprint(size_t lines, size_t bytes) {
+        return sizeof(ChannelHistory) + lines * sizeof(Entry) + bytes;
+    }
+
+    const Entry& at(size_t i) const {
+        return entries[(first + i) % capacity];
+    }
+
+    void evictOldest(HistoryStore& store) {
+        store.releasePrefix(entries[first].prefixId);
+        first = (first + 1) % capacity;
+        --count;
+        if (count == 0) {
+            first = 0;
+            tail = 0;
+        }
+    }
+
+    // Finds room for len payload bytes, evicting the oldest entries as needed
+    size_t reserve(size_t len, HistoryStore& store) {
+        while (count > 0) {
+            size_t head = entries[first].offset;
+            if (count < capacity) {
+                if (head < tail) {
+                    if (tail + len <= arenaSize) {
+                        return tail;
+                    }
+                    if (len <= head) {
+                        return 0;
+                    }
+                } else if (head > tail && tail + len <= head) {
+                    return tail;
+                }
+            }
+            evictOldest(store);
+        }
+        return 0;
+    }
+
+    void append(HistoryStore& store, const Entry& entry, const char* payload) {
+        size_t offset = reserve(entry.length, store);
+        Entry& slot = entries[(first + count) % capacity];
+        slot = entry;
+        slot.offset = static_cast<unsigned int>(offset);
+        std::memcpy(arena + offset, payload, entry.length);
+        tail = offset + entry.length;
+        ++count;
+    }
+
+private:
+    ChannelHistory(const ChannelHistory& other);
+    ChannelHistory& operator=(const ChannelHistory& other);
+};
+
+
+HistoryStore::Reference::Reference() : kind(NONE), timeMs(0), msgId(0) {}
+
+bool HistoryStore::Reference::parse(const std::string& token, Reference& out) {
+    out = Reference();
+    if (token == "*") {
+        return true;
+    }
+    if (token.compare(0, 6, "msgid=") == 0) {
+        std::string value = token.substr(6);
+        char* end = NULL;
+        out.msgId = strtoull(value.c_str(), &end, 10);
+        out.kind = MSGID;
+        return !value.empty() && *end == '\0';
+    }
+    if (token.compare(0, 10, "timestamp=") == 0) {
+        struct tm tm;
+        int millis = 0;
+        std::memset(&tm, 0, sizeof(tm));
+        int fields = std::sscanf(token.c_str() + 10, "%4d-%2d-%2dT%2d:%2d:%2d.%3dZ",
+                                 &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                                 &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &millis);
+        if (fields < 6) {
+            return false;
+        }
+        tm.tm_year -= 1900;
+        tm.tm_mon -= 1;
+        out.timeMs = static_cast<long long>(timegm(&tm)) * 1000 + millis;
+        out.kind = TIMESTAMP;
+        return true;
+    }
+    return false;
+}
+
+static bool isAfter(const ChannelHistory::Entry& entry, const HistoryStore::Reference& ref) {
+    switch (ref.kind) {
+        case HistoryStore::Reference::MSGID: return entry.msgId > ref.msgId;
+        case HistoryStore::Reference::TIMESTAMP: return entry.timeMs > ref.timeMs;
+        default: return true;
+    }
+}
+
+static bool isBefore(const ChannelHistory::Entry& entry, const HistoryStore::Reference& ref) {
+    switch (ref.kind) {
+        case HistoryStore::Reference::MSGID: return entry.msgId < ref.msgId;
+        case HistoryStore::Reference::TIMESTAMP: return entry.timeMs < ref.timeMs;
+        default: return true;
+    }
+}
+
+
+HistoryStore::HistoryStore(size_t linesPerChannel, size_t bytesPerChannel, size_t memoryCap)
+    : _linesPerChannel(linesPerChannel),
+      _bytesPerChannel(bytesPerChannel),
+      _memoryCap(memoryCap),
+      _memoryUsed(0),
+      _nextMsgId(1),
+      _channels(),
+      _lru(),
+      _prefixes(),
+      _prefixIndex(),
+      _freePrefixIds()
+{
+}
+
+HistoryStore::~HistoryStore() {
+    for (std::map<std::string, ChannelHistory*>::iterator it = _channels.begin(); it != _channels.end(); ++it) {
+        delete it->second;
+    }
+}
+
+void HistoryStore::record(const std::string& channel, EventType type, const std::string& prefix, const std::string& text) {
+    ChannelHistory* history = getOrCreate(channel);
+    if (!history) {
+        return;
+    }
+    touch(history);
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    size_t length = text.length();
+    if (length > history->arenaSize) {
+        length = history->arenaSize;
+    }
+    if (length > 0xFFFF) {
+        length = 0xFFFF;
+    }
+
+    ChannelHistory::Entry entry;
+    entry.timeMs = static_cast<long long>(now.tv_sec) * 1000 + now.tv_usec / 1000;
+    entry.msgId = _nextMsgId++;
+    entry.prefixId = internPrefix(prefix);
+    entry.offset = 0;
+    entry.length = static_cast<unsigned short>(length);
+    entry.type = static_cast<unsigned char>(type);
+    history->append(*this, entry, text.data());
+}
+
+void HistoryStore::select(const std::string& channel, const Reference& lower, const Reference& upper,
+                          size_t limit, bool newestFirst, std::vector<Event>& out) {
+    std::map<std::string, ChannelHistory*>::iterator found = _channels.find(channel);
+    if (found == _channels.end() || limit == 0) {
+        return;
+    }
+    ChannelHistory* history = found->second;
+    touch(history);
+
+    std::vector<size_t> matches;
+    for (size_t i = 0; i < history->count; ++i) {
+        const ChannelHistory::Entry& entry = history->at(i);
+        if (isAfter(entry, lower) && isBefore(entry, upper)) {
+            matches.push_back(i);
+        }
+    }
+    size_t begin = 0;
+    size_t end = matches.size();
+    if (end - begin > limit) {
+        if (newestFirst) {
+            begin = end - limit;
+        } else {
+            end = begin + limit;
+        }
+    }
+    for (size_t i = begin; i < end; ++i) {
+        const ChannelHistory::Entry& entry = history->at(matches[i]);
+        Event event;
+        event.type = static_cast<EventType>(entry.type);
+        event.prefix = _prefixes[entry.prefixId].value;
+        event.timeMs = entry.timeMs;
+        event.msgId = entry.msgId;
+        event.text.assign(history->arena + entry.offset, entry.length);
+        out.push_back(event);
+    }
+}
+
+ChannelHistory* HistoryStore::getOrCreate(const std::string& channel) {
+    std::map<std::string, ChannelHistory*>::iterator found = _channels.find(channel);
+    if (found != _channels.end()) {
+        return found->second;
+    }
+
+    size_t needed = ChannelHistory::footprint(_linesPerChannel, _bytesPerChannel) + channel.length();
+    while (_memoryUsed + needed > _memoryCap && !_lru.empty()) {
+        evictLeastRecent();
+    }
+    if (_memoryUsed + needed > _memoryCap) {
+        return NULL;
+    }
+
+    ChannelHistory* history = new ChannelHistory(channel, _linesPerChannel, _bytesPerChannel);
+    _lru.push_front(history);
+    history->lruPos = _lru.begin();
+    _channels[channel] = history;
+    _memoryUsed += needed;
+    return history;
+}
+
+void HistoryStore::evictLeastRecent() {
+    discard(_lru.back());
+}
+
+void HistoryStore::drop(const std::string& channel) {
+    std::map<std::string, ChannelHistory*>::iterator it = _channels.find(channel);
+    if (it != _channels.end()) {
+        discard(it->second);
+    }
+}
+
+// Frees the ring and arena and releases the entries' interned prefixes
+void HistoryStore::discard(ChannelHistory* history) {
+    _lru.erase(history->lruPos);
+    while (history->count > 0) {
+        history->evictOldest(*this);
+    }
+    _memoryUsed -= ChannelHistory::footprint(history->capacity, history->arenaSize) + history->name.length();
+    _channels.erase(history->name);
+    delete history;
+}
+
+void HistoryStore::touch(ChannelHistory* history) {
+    if (history->lruPos != _lru.begin()) {
+        _lru.splice(_lru.begin(), _lru, history->lruPos);
+    }
+}
+
+unsigned int HistoryStore::internPrefix(const std::string& prefix) {
+    std::map<std::string, unsigned int>::iterator found = _prefixIndex.find(prefix);
+    if (found != _prefixIndex.end()) {
+        _prefixes[found->second].refs++;
+        return found->second;
+    }
+
+    unsigned int id;
+    if (!_freePrefixIds.empty()) {
+        id = _freePrefixIds.back();
+        _freePrefixIds.pop_back();
+    } else {
+        id = static_cast<unsigned int>(_prefixes.size());
+        _prefixes.push_back(InternedPrefix());
+    }
+    _prefixes[id].value = prefix;
+    _prefixes[id].refs = 1;
+    _prefixIndex[prefix] = id;
+    _memoryUsed += 2 * prefix.length() + kPrefixOverhead;
+    return id;
+}
+
+void HistoryStore::releasePrefix(unsigned int id) {
+    InternedPrefix& prefix = _prefixes[id];
+    if (--prefix.refs > 0) {
+        return;
+    }
+    _memoryUsed -= 2 * prefix.value.length() + kPrefixOverhead;
+    _prefixIndex.erase(prefix.value);
+    std::string().swap(prefix.value);
+    _freePrefixIds.push_back(id);
+}
+
+size_t HistoryStore::getMaxLines() const {
+    return _linesPerChannel;
+}
+
+size_t HistoryStore::getMemoryUsage() const {
+    return _memoryUsed;
+}
+
+size_t HistoryStore::getChannelCount() const {
+    return _channels.size();
+}
+
+std::string HistoryStore::formatTime(long long timeMs) {
+    time_t seconds = static_cast<time_t>(timeMs / 1000);
+    struct tm tm;
+    gmtime_r(&seconds, &tm);
+    char buffer[40];
+    size_t len = std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buffer + len, sizeof(buffer) - len, ".%03dZ", static_cast<int>(timeMs % 1000));
+    return std::string(buffer);
+}
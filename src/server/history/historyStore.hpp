@@ -0,0 +1,108 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   historyStore.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/04 15:02:10 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/04 15:02:10 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef HISTORYSTORE_HPP
+#define HISTORYSTORE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+
+class ChannelHistory;
+
+/*
+Recent PRIVMSG/NOTICE/TOPIC events per channel, replayed through CHATHISTORY.
+Each channel gets a fixed ring of entries plus a fixed byte arena for the
+payloads, both allocated once on the channel's first event: recording a
+message only copies bytes into the arena. Sender prefixes are interned and
+shared by all entries. When the total exceeds the memory cap, the least
+recently used channel histories are dropped whole.
+*/
+class HistoryStore {
+public:
+    enum EventType {
+        PRIVMSG,
+        NOTICE,
+        TOPIC
+    };
+
+    struct Event {
+        EventType type;
+        std::string prefix;
+        long long timeMs;
+        unsigned long long msgId;
+        std::string text;
+    };
+
+    // A CHATHISTORY reference: "*", "timestamp=..." or "msgid=..."
+    struct Reference {
+        enum Kind { NONE, TIMESTAMP, MSGID };
+        Kind kind;
+        long long timeMs;
+        unsigned long long msgId;
+
+        Reference();
+        static bool parse(const std::string& token, Reference& out);
+    };
+
+    HistoryStore(size_t linesPerChannel, size_t bytesPerChannel, size_t memoryCap);
+    ~HistoryStore();
+
+    void record(const std::string& channel, EventType type, const std::string& prefix, const std::string& text);
+
+    // Events strictly between the two references, at most limit of them, in
+    // chronological order. newestFirst picks which end of the range is kept.
+    void select(const std::string& channel, const Reference& lower, const Reference& upper,
+                size_t limit, bool newestFirst, std::vector<Event>& out);
+
+    // Forgets the channel's events: a channel created later under its name
+    // must not see them
+    void drop(const std::string& channel);
+
+    size_t getMaxLines() const;
+    size_t getMemoryUsage() const;
+    size_t getChannelCount() const;
+
+    static std::string formatTime(long long timeMs);
+
+private:
+    struct InternedPrefix {
+        std::string value;
+        unsigned int refs;
+    };
+
+    size_t _linesPerChannel;
+    size_t _bytesPerChannel;
+    size_t _memoryCap;
+    size_t _memoryUsed;
+    unsigned long long _nextMsgId;
+    std::map<std::string, ChannelHistory*> _channels;
+    std::list<ChannelHistory*> _lru;                 // Most recently used first
+    std::vector<InternedPrefix> _prefixes;
+    std::map<std::string, unsigned int> _prefixIndex;
+    std::vector<unsigned int> _freePrefixIds;
+
+    HistoryStore(const HistoryStore& other);
+    HistoryStore& operator=(const HistoryStore& other);
+
+    ChannelHistory* getOrCreate(const std::string& channel);
+    void evictLeastRecent();
+    void discard(ChannelHistory* history);
+    void touch(ChannelHistory* history);
+    unsigned int internPrefix(const std::string& prefix);
+    void releasePrefix(unsigned int id);
+
+    friend class ChannelHistory;
+};
+
+#endif // HISTORYSTORE_HPP
@@ -0,0 +1,344 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   connectionLimiter.cpp                              :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/22 09:17:32 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/22 09:17:32 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "connectionLimiter.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <arpa/inet.h>
+
+static const size_t kInitialNodes = 1024;
+static const size_t kNodesPerAdmit = 4;     // Two inserts, each adding a leaf and a fork at most
+static const int kMaxDepth = 34;            // Root plus one node per prefix length
+
+static unsigned int maskOf(unsigned int length) {
+    return length == 0 ? 0 : ~0u << (32 - length);
+}
+
+// The bit after the first position bits
+static int bitAt(unsigned int value, unsigned int position) {
+    return (value >> (31 - position)) & 1;
+}
+
+static unsigned int commonLength(unsigned int a, unsigned int b, unsigned int limit) {
+    unsigned int difference = a ^ b;
+    unsigned int common = difference ? static_cast<unsigned int>(__builtin_clz(difference)) : 32;
+    return common < limit ? common : limit;
+}
+
+ConnectionLimiter::ConnectionLimiter(size_t perAddress, size_t perNetwork, unsigned int networkPrefix, size_t connectsPerMinute)
+    : _nodes(),
+      _freeList(-1),
+      _freeCount(0),
+      _exemptions(0),
+      _perAddress(perAddress),
+      _perNetwork(perNetwork),
+      _networkPrefix(networkPrefix),
+      _connectsPerMinute(connectsPerMinute)
+{
+    _nodes.reserve(kInitialNodes);
+    Node root;
+    root.prefix = 0;
+    root.connections = 0;
+    root.windowStart = 0;
+    root.attempts = 0;
+    root.child[0] = -1;
+    root.child[1] = -1;
+    root.length = 0;
+    root.exempt = 0;
+    _nodes.push_back(root);
+    _grow();
+}
+
+bool ConnectionLimiter::parseNetwork(const std::string& text, unsigned int& prefix, unsigned int& length) {
+    size_t slash = text.find('/');
+    std::string address = text.substr(0, slash);
+    length = 32;
+    if (slash != std::string::npos) {
+        std::string bits = text.substr(slash + 1);
+        char* end = NULL;
+        long parsed = std::strtol(bits.c_str(), &end, 10);
+        if (bits.empty() || *end != '\0' || parsed < 0 || parsed > 32) {
+            return false;
+        }
+        length = static_cast<unsigned int>(parsed);
+    }
+    struct in_addr parsedAddress;
+    if (inet_pton(AF_INET, address.c_str(), &parsedAddress) != 1) {
+        return false;
+    }
+    prefix = ntohl(parsedAddress.s_addr);
+    return (prefix & ~maskOf(length)) == 0;
+}
+
+void ConnectionLimiter::addExemption(unsigned int prefix, unsigned int length) {
+    _reserve(0);
+    _nodes[_insert(prefix & maskOf(length), length)].exempt = 1;
+    ++_exemptions;
+}
+
+ConnectionLimiter::Verdict ConnectionLimiter::admit(unsigned int address, time_t now) {
+    if (_isExempt(address)) {
+        return ADMITTED;
+    }
+    _reserve(now);
+    int host = _insert(address, 32);
+    Verdict verdict = ADMITTED;
+    if (_connectsPerMinute > 0) {
+        Node& node = _nodes[host];
+        unsigned int seconds = static_cast<unsigned int>(now);
+        if (node.attempts == 0 || seconds - node.windowStart >= kRateWindowSeconds) {
+            node.windowStart = seconds;
+            node.attempts = 0;
+        }
+        if (++node.attempts > _connectsPerMinute) {
+            verdict = TOO_FAST;
+        }
+    }
+    if (verdict == ADMITTED && _perAddress > 0 && _nodes[host].connections >= _perAddress) {
+        verdict = TOO_MANY_FROM_ADDRESS;
+    }
+    unsigned int network = address & maskOf(_networkPrefix);
+    int networkNode = -1;
+    if (verdict == ADMITTED && _perNetwork > 0) {
+        networkNode = _insert(network, _networkPrefix);
+        if (_nodes[networkNode].connections >= _perNetwork) {
+            verdict = TOO_MANY_FROM_NETWORK;
+        }
+    }
+    if (verdict != ADMITTED) {
+        if (networkNode != -1) {
+            _prune(network, _networkPrefix, now);
+        }
+        _prune(address, 32, now);
+        return verdict;
+    }
+    ++_nodes[host].connections;
+    if (networkNode != -1) {
+        ++_nodes[networkNode].connections;
+    }
+    return ADMITTED;
+}
+
+void ConnectionLimiter::count(unsigned int address, time_t now) {
+    if (_isExempt(address)) {
+        return;
+    }
+    _reserve(now);
+    ++_nodes[_insert(address, 32)].connections;
+    if (_perNetwork > 0) {
+        ++_nodes[_insert(address & maskOf(_networkPrefix), _networkPrefix)].connections;
+    }
+}
+
+void ConnectionLimiter::release(unsigned int address, time_t now) {
+    if (_isExempt(address)) {
+        return;
+    }
+    int host = _find(address, 32);
+    if (host != -1 && _nodes[host].connections > 0) {
+        --_nodes[host].connections;
+        _prune(address, 32, now);
+    }
+    if (_perNetwork > 0) {
+        unsigned int network = address & maskOf(_networkPrefix);
+        int networkNode = _find(network, _networkPrefix);
+        if (networkNode != -1 && _nodes[networkNode].connections > 0) {
+            --_nodes[networkNode].connections;
+            _prune(network, _networkPrefix, now);
+        }
+    }
+}
+
+size_t ConnectionLimiter::getNodeCount() const {
+    return _nodes.size() - _freeCount;
+}
+
+size_t ConnectionLimiter::getCapacity() const {
+    return _nodes.size();
+}
+
+bool ConnectionLimiter::_isExempt(unsigned int address) const {
+    if (_exemptions == 0) {
+        return false;
+    }
+    int index = 0;
+    while (index != -1) {
+        const Node& node = _nodes[index];
+        if ((address & maskOf(node.length)) != node.prefix) {
+            return false;
+        }
+        if (node.exempt) {
+            return true;
+        }
+        if (node.length == 32) {
+            return false;
+        }
+        index = node.child[bitAt(address, node.length)];
+    }
+    return false;
+}
+
+int ConnectionLimiter::_find(unsigned int prefix, unsigned int length) const {
+    int index = 0;
+    while (index != -1) {
+        const Node& node = _nodes[index];
+        if (node.length > length || (prefix & maskOf(node.length)) != node.prefix) {
+            return -1;
+        }
+        if (node.length == length) {
+            return index;
+        }
+        index = node.child[bitAt(prefix, node.length)];
+    }
+    return -1;
+}
+
+// Needs two free nodes: a split adds a fork above the new leaf
+int ConnectionLimiter::_insert(unsigned int prefix, unsigned int length) {
+    int index = 0;
+    while (_nodes[index].length != length) {
+        int side = bitAt(prefix, _nodes[index].length);
+        int childIndex = _nodes[index].child[side];
+        if (childIndex == -1) {
+            int leaf = _allocate(prefix, length);
+            _nodes[index].child[side] = leaf;
+            return leaf;
+        }
+        const Node& child = _nodes[childIndex];
+        unsigned int common = commonLength(child.prefix, prefix, std::min<unsigned int>(child.length, length));
+        if (common == child.length) {
+            index = childIndex;
+            continue;
+        }
+        unsigned int childPrefix = child.prefix;
+        if (common == length) {
+            // The new key is a prefix of the child's: it goes in between
+            int middle = _allocate(prefix, length);
+            _nodes[middle].child[bitAt(childPrefix, length)] = childIndex;
+            _nodes[index].child[side] = middle;
+            return middle;
+        }
+        int fork = _allocate(prefix & maskOf(common), common);
+        int leaf = _allocate(prefix, length);
+        _nodes[fork].child[bitAt(childPrefix, common)] = childIndex;
+        _nodes[fork].child[bitAt(prefix, common)] = leaf;
+        _nodes[index].child[side] = fork;
+        return leaf;
+    }
+    return index;
+}
+
+// Removes the node for the key if nothing needs it any more
+void ConnectionLimiter::_prune(unsigned int prefix, unsigned int length, time_t now) {
+    int path[kMaxDepth];
+    int depth = 0;
+    int index = 0;
+    while (index != -1) {
+        const Node& node = _nodes[index];
+        if (node.length > length || (prefix & maskOf(node.length)) != node.prefix) {
+            return;
+        }
+        path[depth++] = index;
+        if (node.length == length) {
+            _removeAt(path, depth, now);
+            return;
+        }
+        index = node.child[bitAt(prefix, node.length)];
+    }
+}
+
+// path[depth - 1] is the node, the entries before it its ancestors
+void ConnectionLimiter::_removeAt(const int* path, int depth, time_t now) {
+    int index = path[depth - 1];
+    Node& node = _nodes[index];
+    if (depth == 1 || !_isUnused(node, now) || (node.child[0] != -1 && node.child[1] != -1)) {
+        return;   // The root, a live key or a fork still needed
+    }
+    node.connections = 0;
+    node.attempts = 0;
+    int replacement = node.child[0] != -1 ? node.child[0] : node.child[1];
+    Node& parent = _nodes[path[depth - 2]];
+    parent.child[parent.child[0] == index ? 0 : 1] = replacement;
+    _free(index);
+    if (replacement == -1) {
+        // The parent lost a branch: if it was only a fork, it is not needed now
+        _removeAt(path, depth - 1, now);
+    }
+}
+
+bool ConnectionLimiter::_isUnused(const Node& node, time_t now) const {
+    return !node.exempt && node.connections == 0
+           && (node.attempts == 0 || static_cast<unsigned int>(now) - node.windowStart >= kRateWindowSeconds);
+}
+
+void ConnectionLimiter::_reserve(time_t now) {
+    if (_freeCount >= kNodesPerAdmit) {
+        return;
+    }
+    _sweep(now);
+    if (_freeCount < kNodesPerAdmit || _freeCount < _nodes.size() / 4) {
+        _grow();
+    }
+}
+
+// Drops addresses kept only for a rate window that has expired
+void ConnectionLimiter::_sweep(time_t now) {
+    std::vector<std::pair<unsigned int, unsigned int> > expired;
+    std::vector<int> pending(1, 0);
+    while (!pending.empty()) {
+        int index = pending.back();
+        pending.pop_back();
+        const Node& node = _nodes[index];
+        if (index != 0 && node.attempts != 0 && _isUnused(node, now)) {
+            expired.push_back(std::make_pair(node.prefix, static_cast<unsigned int>(node.length)));
+        }
+        for (int side = 0; side < 2; ++side) {
+            if (node.child[side] != -1) {
+                pending.push_back(node.child[side]);
+            }
+        }
+    }
+    for (size_t i = 0; i < expired.size(); ++i) {
+        _prune(expired[i].first, expired[i].second, now);
+    }
+}
+
+void ConnectionLimiter::_grow() {
+    size_t first = _nodes.size();
+    size_t added = first < kInitialNodes ? kInitialNodes : first;
+    _nodes.resize(first + added);
+    for (size_t i = first + added; i > first; --i) {
+        _free(static_cast<int>(i - 1));
+    }
+}
+
+int ConnectionLimiter::_allocate(unsigned int prefix, unsigned int length) {
+    int index = _freeList;
+    Node& node = _nodes[index];
+    _freeList = node.child[0];
+    --_freeCount;
+    node.prefix = prefix & maskOf(length);
+    node.connections = 0;
+    node.windowStart = 0;
+    node.attempts = 0;
+    node.child[0] = -1;
+    node.child[1] = -1;
+    node.length = static_cast<unsigned char>(length);
+    node.exempt = 0;
+    return index;
+}
+
+void ConnectionLimiter::_free(int index) {
+    _nodes[index].child[0] = _freeList;
+    _freeList = index;
+    ++_freeCount;
+}
@@ -0,0 +1,102 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   connectionLimiter.hpp                              :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/22 09:17:32 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/22 09:17:32 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CONNECTIONLIMITER_HPP
+#define CONNECTIONLIMITER_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <ctime>
+
+/*
+Connection counts per IPv4 address and per network, checked on the accept
+path before a Client exists. Addresses, networks and exemptions are keys of
+one path-compressed binary trie (PATRICIA): a node holds a prefix of up to
+32 bits and branches on the next bit, so a lookup visits at most one node
+per prefix bit and usually far fewer.
+
+Nodes live in an arena and refer to each other by index, with unused ones
+on a free list. An admit() that needs nodes takes them from the list; only
+when it runs dry are nodes whose connections closed and whose rate window
+expired reclaimed, and the arena doubles if that freed less than a quarter.
+Accepting and rejecting therefore allocate nothing in the steady state.
+
+Event loop only. Addresses are in host byte order.
+*/
+class ConnectionLimiter {
+public:
+    enum Verdict {
+        ADMITTED,
+        TOO_MANY_FROM_ADDRESS,
+        TOO_MANY_FROM_NETWORK,
+        TOO_FAST
+    };
+
+    static const unsigned int kRateWindowSeconds = 60;
+
+    // A limit of 0 disables that check; networks group addresses by their
+    // first networkPrefix bits (0 to 31)
+    ConnectionLimiter(size_t perAddress, size_t perNetwork, unsigned int networkPrefix, size_t connectsPerMinute);
+
+    // "a.b.c.d" or "a.b.c.d/len"; bits past len must be zero
+    static bool parseNetwork(const std::string& text, unsigned int& prefix, unsigned int& length);
+    // Connections from inside the network are neither limited nor counted
+    void addExemption(unsigned int prefix, unsigned int length);
+
+    // Counts the connection if it is admitted; every admitted connection
+    // needs a release() when it closes
+    Verdict admit(unsigned int address, time_t now);
+    // Counts a connection without checking the limits (clients taken over by UPGRADE)
+    void count(unsigned int address, time_t now);
+    void release(unsigned int address, time_t now);
+
+    size_t getNodeCount() const;
+    size_t getCapacity() const;
+
+private:
+    struct Node {
+        unsigned int prefix;        // First length bits of the key, the rest zero
+        unsigned int connections;
+        unsigned int windowStart;   // Addresses: start of the current rate window, in seconds
+        unsigned int attempts;      // Connects seen in that window, admitted or not
+        int child[2];               // By the bit after the prefix; child[0] links the free list
+        unsigned char length;
+        unsigned char exempt;
+    };
+
+    std::vector<Node> _nodes;       // _nodes[0] is the root, the empty prefix
+    int _freeList;
+    size_t _freeCount;
+    size_t _exemptions;
+    size_t _perAddress;
+    size_t _perNetwork;
+    unsigned int _networkPrefix;
+    size_t _connectsPerMinute;
+
+    bool _isExempt(unsigned int address) const;
+    int _find(unsigned int prefix, unsigned int length) const;
+    int _insert(unsigned int prefix, unsigned int length);
+    void _prune(unsigned int prefix, unsigned int length, time_t now);
+    void _removeAt(const int* path, int depth, time_t now);
+    bool _isUnused(const Node& node, time_t now) const;
+    void _reserve(time_t now);
+    void _sweep(time_t now);
+    void _grow();
+    int _allocate(unsigned int prefix, unsigned int length);
+    void _free(int index);
+
+    ConnectionLimiter(const ConnectionLimiter& other);
+    ConnectionLimiter& operator=(const ConnectionLimiter& other);
+};
+
+#endif // CONNECTIONLIMITER_HPP
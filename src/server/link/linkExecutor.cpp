@@ -0,0 +1,616 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   linkExecutor.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/18 09:30:19 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/18 09:30:19 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "linkExecutor.hpp"
+#include "../server.hpp"
+#include <cstdlib>
+
+// Burst lines are cut well below the 512 byte limit, so they still fit when
+// a relay names a longer server in front of them
+static const size_t kMaxBurstLine = 400;
+static const size_t kMaxUnickField = 64;    // User name and host; the real name takes what is left
+
+static std::string stripColon(const std::string& param) {
+    if (!param.empty() && param[0] == ':') {
+        return param.substr(1);
+    }
+    return param;
+}
+
+static bool isChannelName(const std::string& name) {
+    return !name.empty() && std::string("#&+!").find(name[0]) != std::string::npos;
+}
+
+// UNICK fields: no spaces (they separate users) and no commas (they separate fields).
+// Stops before the escaped field would exceed budget bytes.
+static std::string escapeField(const std::string& field, size_t budget = std::string::npos) {
+    std::string escaped;
+    for (size_t i = 0; i < field.length(); ++i) {
+        std::string code = (field[i] == '\\') ? "\\\\" : (field[i] == ' ') ? "\\s"
+                           : (field[i] == ',') ? "\\c" : std::string(1, field[i]);
+        if (escaped.length() + code.length() > budget) {
+            break;
+        }
+        escaped += code;
+    }
+    return escaped;
+}
+
+static std::string unescapeField(const std::string& field) {
+    std::string plain;
+    for (size_t i = 0; i < field.length(); ++i) {
+        if (field[i] != '\\' || i + 1 == field.length()) {
+            plain += field[i];
+            continue;
+        }
+        char code = field[++i];
+        plain += (code == 's') ? ' ' : (code == 'c') ? ',' : code;
+    }
+    return plain;
+}
+
+LinkExecutor::LinkExecutor(Server& server) : _server(server) {}
+
+LinkExecutor::~LinkExecutor() {}
+
+void LinkExecutor::sendIntroduction(Client* link) {
+    const std::string& password = _server.getConfig().linkPassword;
+    std::string flags = _server.getConfig().linkCompression ? "Z" : "";
+    _server.sendToClient(link->getFd(), "PASS " + password + " 0210 IRC|" + flags + "\r\n"
+                                        "SERVER " + _server.getServerName() + " 1 :ft_irc server\r\n");
+}
+
+bool LinkExecutor::acceptPassword(Client* link, const std::vector<std::string>& params) {
+    const std::string& password = _server.getConfig().linkPassword;
+    if (password.empty() || params.empty() || stripColon(params[0]) != password) {
+        return false;
+    }
+    link->setLinkAuthorized(true);
+    if (params.size() > 2) {
+        std::string flags = params[2];
+        size_t bar = flags.find('|');
+        link->setLinkCompressionOffered(bar != std::string::npos && flags.find('Z', bar) != std::string::npos);
+    }
+    return true;
+}
+
+void LinkExecutor::acceptServer(Client* link, const std::vector<std::string>& params, bool inbound) {
+    if (params.empty()) {
+        _server.dropLink(link, "SERVER without a name");
+        return;
+    }
+    std::string name = params[0];
+    if (name.find('.') == std::string::npos || name.find_first_of(":!@,") != std::string::npos) {
+        _server.dropLink(link, "Bogus server name " + name);
+        return;
+    }
+    if (_server.isServerKnown(name)) {
+        _server.dropLink(link, "Server " + name + " already exists");
+        return;
+    }
+    std::string info = params.size() > 2 ? stripColon(params.back()) : name;
+    if (inbound) {
+        sendIntroduction(link);
+    }
+    _server.registerLink(link, name, info);
+    LOG_EVENT(Logger::INFO, "Linked with server {} on fd {}", << name << link->getFd());
+    _server.propagate(":" + _server.getServerName() + " SERVER " + name + " 2 :" + info + "\r\n", link);
+    _sendBurst(link);
+}
+
+void LinkExecutor::execute(Client* link, const Command& cmd, const std::string& line) {
+    std::string command = cmd.getCommand();
+    std::vector<std::string> params = cmd.getParameters();
+
+    if (link->getLinkState() == Client::LINK_CONNECTING) {
+        _executeHandshake(link, command, params);
+        return;
+    }
+
+    std::string relay = line + "\r\n";
+    if (command == "PING") {
+        std::string token = params.empty() ? _server.getServerName() : stripColon(params[0]);
+        _server.sendToClient(link->getFd(), ":" + _server.getServerName() + " PONG " + _server.getServerName() + " :" + token + "\r\n");
+    } else if (command == "PONG") {
+        return;
+    } else if (command == "ERROR") {
+        LOG_EVENT(Logger::WARNING, "Server {} closed the link: {}",
+                  << link->getServerName() << (params.empty() ? "" : stripColon(params[0])));
+        _server.dropLink(link, "");
+    } else if (command == "SERVER") {
+        _executeServer(link, params);
+    } else if (command == "SQUIT") {
+        _executeSquit(link, params, relay);
+    } else if (command == "NICK") {
+        _executeNick(link, cmd.getPrefix(), params, relay);
+    } else if (command == "UNICK") {
+        _executeUnick(link, params);
+    } else if (command == "NJOIN") {
+        _executeNjoin(link, params, relay);
+    } else if (command == "MODE") {
+        _executeMode(link, params, relay);
+    } else if (command == "TOPIC") {
+        _executeTopic(link, cmd.getPrefix(), params, relay);
+    } else if (command == "KICK") {
+        _executeKick(link, params, relay);
+    } else if (command == "INVITE") {
+        _executeInvite(link, params, relay);
+    } else {
+        Client* user = _sourceUser(link, cmd.getPrefix());
+        if (!user) {
+            LOG_EVENT(Logger::WARNING, "Dropped {} from {}: unknown source {}",
+                      << command << link->getServerName() << cmd.getPrefix());
+            return;
+        }
+        if (command == "JOIN") {
+            _executeJoin(link, user, params, relay);
+        } else if (command == "PART") {
+            _executePart(link, user, params, relay);
+        } else if (command == "QUIT") {
+            _server.quitRemoteClient(user, params.empty() ? "" : stripColon(params[0]), link);
+        } else if (command == "PRIVMSG" || command == "NOTICE") {
+            _executeMessage(link, user, command, params, relay);
+        } else {
+            LOG_WARNING("Unsupported server command " + command + " from " + link->getServerName());
+        }
+    }
+}
+
+// Waiting for the PASS and SERVER answering ours
+void LinkExecutor::_executeHandshake(Client* link, const std::string& command, const std::vector<std::string>& params) {
+    if (command == "PASS") {
+        if (!acceptPassword(link, params)) {
+            _server.dropLink(link, "Bad link password");
+        }
+    } else if (command == "SERVER") {
+        if (link->isLinkAuthorized()) {
+            acceptServer(link, params, false);
+        } else {
+            _server.dropLink(link, "No link password");
+        }
+    } else if (command == "ERROR") {
+        LOG_EVENT(Logger::ERROR, "Server on fd {} refused the link: {}",
+                  << link->getFd() << (params.empty() ? "" : stripColon(params[0])));
+        _server.dropLink(link, "");
+    }
+}
+
+/*
+Everything the peer needs to know about our side of the network: the servers
+behind us, every user, then every channel as NJOIN lines followed by its
+modes and topic. Nothing that lives behind the peer itself is sent back.
+*/
+void LinkExecutor::_sendBurst(Client* link) {
+    const std::string& ourName = _server.getServerName();
+    std::string burst;
+    size_t serverCount = 0;
+
+    const std::map<std::string, Server::RemoteServer>& servers = _server.getRemoteServers();
+    for (std::map<std::string, Server::RemoteServer>::const_iterator it = servers.begin(); it != servers.end(); ++it) {
+        if (it->second.link != link) {
+            burst += ":" + ourName + " SERVER " + it->first + " " + to_string(it->second.hops + 1) + " :" + it->second.info + "\r\n";
+            ++serverCount;
+        }
+    }
+
+    // Users are grouped by server and hop count, which every UNICK line states once
+    size_t users = 0;
+    std::map<std::string, std::string> batches;
+    const std::map<int, Client*>& clients = _server.getClients();
+    for (std::map<int, Client*>::const_iterator it = clients.begin(); it != clients.end(); ++it) {
+        Client* user = it->second;
+        if (user->getLinkState() != Client::LINK_NONE || user->getLink() == link || !user->isRegistered()) {
+            continue;
+        }
+        int hops = user->isRemote() ? user->getHops() + 1 : 1;
+        std::string server = user->isRemote() ? user->getServerName() : ourName;
+        std::string head = ":" + ourName + " UNICK " + server + " " + to_string(hops) + " :";
+        // An entry always fits a line of its own: a long real name is cut
+        std::string entry = escapeField(user->getNickname()) + "," + escapeField(user->getUsername(), kMaxUnickField)
+                            + "," + escapeField(user->getHostname(), kMaxUnickField) + ",";
+        size_t used = head.length() + entry.length();
+        entry += escapeField(user->getRealname(), used < kMaxBurstLine ? kMaxBurstLine - used : 0);
+        std::string& batch = batches[head];
+        if (!batch.empty() && head.length() + batch.length() + entry.length() + 3 > kMaxBurstLine) {
+            burst += head + batch + "\r\n";
+            batch.clear();
+        }
+        batch += (batch.empty() ? "" : " ") + entry;
+        ++users;
+    }
+    for (std::map<std::string, std::string>::const_iterator it = batches.begin(); it != batches.end(); ++it) {
+        if (!it->second.empty()) {
+            burst += it->first + it->second + "\r\n";
+        }
+    }
+
+    const std::map<std::string, Channel*>& channels = _server.getChannels();
+    for (std::map<std::string, Channel*>::const_iterator it = channels.begin(); it != channels.end(); ++it) {
+        Channel* channel = it->second;
+        std::string head = ":" + ourName + " NJOIN " + it->first + " :";
+        std::string names;
+        std::vector<Client*> members = channel->getMembers();
+        for (std::vector<Client*>::const_iterator member = members.begin(); member != members.end(); ++member) {
+            if ((*member)->getLink() == link) {
+                continue;
+            }
+            std::string entry = (channel->isOperator(*member) ? "@" : "") + (*member)->getNickname();
+            if (!names.empty() && head.length() + names.length() + entry.length() + 3 > kMaxBurstLine) {
+                burst += head + names + "\r\n";
+                names.clear();
+            }
+            names += (names.empty() ? "" : ",") + entry;
+        }
+        if (names.empty()) {
+            continue;
+        }
+        burst += head + names + "\r\n";
+
+        std::string modes;
+        std::string modeArgs;
+        if (channel->isInviteOnly()) {
+            modes += "i";
+        }
+        if (channel->isTopicRestricted()) {
+            modes += "t";
+        }
+        if (!channel->getKey().empty()) {
+            modes += "k";
+            modeArgs += " " + channel->getKey();
+        }
+        if (channel->getUserLimit() > 0) {
+            modes += "l";
+            modeArgs += " " + to_string(channel->getUserLimit());
+        }
+        if (!modes.empty()) {
+            burst += ":" + ourName + " MODE " + it->first + " +" + modes + modeArgs + "\r\n";
+        }
+        if (!channel->getTopic().empty()) {
+            burst += ":" + ourName + " TOPIC " + it->first + " :" + channel->getTopic() + "\r\n";
+        }
+    }
+
+    LOG_EVENT(Logger::INFO, "Sent burst to {}: {} servers, {} users, {} bytes",
+              << link->getServerName() << serverCount << users << burst.length());
+    if (!burst.empty()) {
+        _server.sendToClient(link->getFd(), burst);
+    }
+}
+
+// The user a relayed command comes from; it must live behind the link it arrived on
+Client* LinkExecutor::_sourceUser(Client* link, const std::string& prefix) {
+    Client* user = _server.getClientByNickname(prefix.substr(0, prefix.find('!')));
+    if (!user || user->getLink() != link) {
+        return NULL;
+    }
+    return user;
+}
+
+// A server further down the peer's side of the tree
+void LinkExecutor::_executeServer(Client* link, const std::vector<std::string>& params) {
+    if (params.size() < 2) {
+        return;
+    }
+    std::string name = params[0];
+    if (_server.isServerKnown(name)) {
+        // A second path to a known server would close a loop
+        _server.dropLink(link, "Server " + name + " already exists");
+        return;
+    }
+    int hops = std::atoi(params[1].c_str());
+    std::string info = params.size() > 2 ? stripColon(params.back()) : name;
+    _server.addRemoteServer(name, link, hops, info);
+    LOG_EVENT(Logger::INFO, "Server {} joined the network behind {}", << name << link->getServerName());
+    _server.propagate(":" + _server.getServerName() + " SERVER " + name + " " + to_string(hops + 1) + " :" + info + "\r\n", link);
+}
+
+void LinkExecutor::_executeSquit(Client* link, const std::vector<std::string>& params, const std::string& relay) {
+    if (params.empty()) {
+        return;
+    }
+    std::string name = params[0];
+    const std::map<std::string, Server::RemoteServer>& servers = _server.getRemoteServers();
+    std::map<std::string, Server::RemoteServer>::const_iterator server = servers.find(name);
+    if (server == servers.end() || server->second.link != link) {
+        return;
+    }
+
+    // Peers quit the users of a split server before the SQUIT; catch any left over
+    std::vector<Client*> users;
+    const std::map<int, Client*>& clients = _server.getClients();
+    for (std::map<int, Client*>::const_iterator it = clients.begin(); it != clients.end(); ++it) {
+        if (it->second->getLink() == link && it->second->getServerName() == name) {
+            users.push_back(it->second);
+        }
+    }
+    std::string reason = link->getServerName() + " " + name;
+    for (std::vector<Client*>::iterator it = users.begin(); it != users.end(); ++it) {
+        _server.quitRemoteClient(*it, reason, link);
+    }
+    _server.removeRemoteServer(name);
+    LOG_EVENT(Logger::INFO, "Server {} left the network", << name);
+    _server.propagate(relay, link);
+}
+
+/*
+NICK <nick> <hopcount> <user> <host> <server> <umode> :<realname> introduces a
+user; :<nick> NICK <new> is a nick change. Two users with the same nick would
+make every later message ambiguous, so a collision drops the link.
+*/
+void LinkExecutor::_executeNick(Client* link, const std::string& prefix, const std::vector<std::string>& params, const std::string& relay) {
+    if (params.size() >= 7) {
+        std::string nick = params[0];
+        if (_server.getClientByNickname(nick)) {
+            _server.dropLink(link, "Nick collision on " + nick);
+            return;
+        }
+        int hops = std::atoi(params[1].c_str());
+        std::string realname = stripColon(params[6]);
+        _server.addRemoteClient(link, nick, params[2], params[3], params[4], hops, realname);
+        _server.propagate("NICK " + nick + " " + to_string(hops + 1) + " " + params[2] + " " + params[3] + " "
+                              + params[4] + " + :" + realname + "\r\n", link);
+        return;
+    }
+
+    Client* user = _sourceUser(link, prefix);
+    if (!user || params.empty()) {
+        return;
+    }
+    std::string newNick = stripColon(params[0]);
+    Client* holder = _server.getClientByNickname(newNick);
+    if (holder && holder != user) {
+        _server.dropLink(link, "Nick collision on " + newNick);
+        return;
+    }
+    std::string nickMessage = ":" + user->getFullClientIdentifier() + " NICK " + newNick + "\r\n";
+    _server.setNickname(user, newNick);
+    _server.broadcast(nickMessage);
+    _server.propagate(relay, link);
+}
+
+// :<server> UNICK <server> <hopcount> :<user> <user> ..., the batched NICK of a burst
+void LinkExecutor::_executeUnick(Client* link, const std::vector<std::string>& params) {
+    if (params.size() < 3) {
+        return;
+    }
+    std::string server = params[0];
+    int hops = std::atoi(params[1].c_str());
+    std::string entries = stripColon(params[2]);
+    std::stringstream stream(entries);
+    std::string entry;
+    while (stream >> entry) {
+        std::vector<std::string> fields;
+        std::stringstream fieldStream(entry);
+        std::string field;
+        while (std::getline(fieldStream, field, ',')) {
+            fields.push_back(unescapeField(field));
+        }
+        if (fields.size() < 3) {
+            continue;
+        }
+        if (_server.getClientByNickname(fields[0])) {
+            _server.dropLink(link, "Nick collision on " + fields[0]);
+            return;
+        }
+        _server.addRemoteClient(link, fields[0], fields[1], fields[2], server, hops,
+                                fields.size() > 3 ? fields[3] : "");
+    }
+    _server.propagate(":" + _server.getServerName() + " UNICK " + server + " " + to_string(hops + 1) + " :" + entries + "\r\n", link);
+}
+
+// :<server> NJOIN <channel> :[@]<nick>,[@]<nick>... puts users behind the link in a channel
+void LinkExecutor::_executeNjoin(Client* link, const std::vector<std::string>& params, const std::string& relay) {
+    if (params.size() < 2 || !isChannelName(params[0])) {
+        return;
+    }
+    std::string channelName = params[0];
+    std::stringstream names(stripColon(params[1]));
+    std::string entry;
+    while (std::getline(names, entry, ',')) {
+        bool op = !entry.empty() && entry[0] == '@';
+        if (op) {
+            entry.erase(0, 1);
+        }
+        Client* user = _server.getClientByNickname(entry);
+        if (!user || user->getLink() != link) {
+            continue;
+        }
+        _joinChannel(user, channelName, op);
+    }
+    _server.propagate(relay, link);
+}
+
+void LinkExecutor::_executeJoin(Client* link, Client* user, const std::vector<std::string>& params, const std::string& relay) {
+    if (params.empty()) {
+        return;
+    }
+    std::stringstream names(stripColon(params[0]));
+    std::string channelName;
+    while (std::getline(names, channelName, ',')) {
+        if (!isChannelName(channelName)) {
+            continue;
+        }
+        // Same rule as a local JOIN: whoever creates a channel operates it
+        Channel* channel = _server.getChannel(channelName);
+        bool op = channelName[0] != '+' && (!channel || channel->getMembers().empty());
+        _joinChannel(user, channelName, op);
+    }
+    _server.propagate(relay, link);
+}
+
+void LinkExecutor::_executePart(Client* link, Client* user, const std::vector<std::string>& params, const std::string& relay) {
+    if (params.empty()) {
+        return;
+    }
+    std::string reason = params.size() > 1 ? " :" + stripColon(params[1]) : "";
+    std::stringstream names(stripColon(params[0]));
+    std::string channelName;
+    while (std::getline(names, channelName, ',')) {
+        Channel* channel = _server.getChannel(channelName);
+        if (!channel || !channel->isMember(user)) {
+            continue;
+        }
+        _server.broadcastToChannel(channelName, ":" + user->getFullClientIdentifier() + " PART " + channelName + reason + "\r\n", NULL, true);
+        channel->removeMember(user);
+        user->removeChannel(channelName);
+        _server.removeChannelIfEmpty(channelName);
+    }
+    _server.propagate(relay, link);
+}
+
+// Channel messages only travel toward members; private ones toward the recipient
+void LinkExecutor::_executeMessage(Client* link, Client* user, const std::string& command, const std::vector<std::string>& params, const std::string& relay) {
+    if (params.size() < 2) {
+        return;
+    }
+    std::string target = params[0];
+    if (isChannelName(target)) {
+        if (!_server.getChannel(target)) {
+            return;
+        }
+        _server.broadcastToChannel(target, relay, user);
+        if (_server.getHistory()) {
+            _server.getHistory()->record(target, command == "NOTICE" ? HistoryStore::NOTICE : HistoryStore::PRIVMSG,
+                                         user->getFullClientIdentifier(), stripColon(params[1]));
+        }
+        return;
+    }
+    Client* recipient = _server.getClientByNickname(target);
+    if (recipient && recipient->getLinkState() == Client::LINK_NONE && recipient->getLink() != link) {
+        _server.sendToClient(recipient->getFd(), relay);
+    }
+}
+
+// Channel modes from a user or, in a burst, from a server; the origin already checked them
+void LinkExecutor::_executeMode(Client* link, const std::vector<std::string>& params, const std::string& relay) {
+    if (params.size() < 2) {
+        return;
+    }
+    Channel* channel = _server.getChannel(params[0]);
+    if (!channel) {
+        return;
+    }
+    std::string modes = params[1];
+    size_t argIndex = 2;
+    bool adding = true;
+    for (size_t i = 0; i < modes.length(); ++i) {
+        switch (modes[i]) {
+            case '+':
+            case '-':
+                adding = (modes[i] == '+');
+                break;
+            case 'i':
+                channel->setInviteOnly(adding);
+                break;
+            case 't':
+                channel->setTopicRestricted(adding);
+                break;
+            case 'k':
+                if (!adding) {
+                    channel->removeKey();
+                } else if (argIndex < params.size()) {
+                    channel->setKey(params[argIndex++]);
+                }
+                break;
+            case 'l':
+                if (!adding) {
+                    channel->removeUserLimit();
+                } else if (argIndex < params.size()) {
+                    channel->setUserLimit(std::atoi(stripColon(params[argIndex++]).c_str()));
+                }
+                break;
+            case 'o':
+                if (argIndex < params.size()) {
+                    Client* target = _server.getClientByNickname(stripColon(params[argIndex++]));
+                    if (target && channel->isMember(target)) {
+                        channel->removeOperator(target);
+                        if (adding) {
+                            channel->addOperator(target);
+                        }
+                    }
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    _server.broadcastToChannel(params[0], relay, NULL, true);
+    _server.propagate(relay, link);
+}
+
+void LinkExecutor::_executeTopic(Client* link, const std::string& prefix, const std::vector<std::string>& params, const std::string& relay) {
+    if (params.size() < 2) {
+        return;
+    }
+    Channel* channel = _server.getChannel(params[0]);
+    if (!channel) {
+        return;
+    }
+    std::string topic = stripColon(params[1]);
+    channel->setTopic(topic);
+    _server.broadcastToChannel(params[0], relay, NULL, true);
+    if (_server.getHistory()) {
+        _server.getHistory()->record(params[0], HistoryStore::TOPIC, prefix, topic);
+    }
+    _server.propagate(relay, link);
+}
+
+void LinkExecutor::_executeKick(Client* link, const std::vector<std::string>& params, const std::string& relay) {
+    if (params.size() < 2) {
+        return;
+    }
+    std::string channelName = params[0];
+    Channel* channel = _server.getChannel(channelName);
+    Client* kicked = _server.getClientByNickname(params[1]);
+    if (!channel || !kicked || !channel->isMember(kicked)) {
+        return;
+    }
+    // Announced before the removal so a local kicked user sees it too
+    _server.broadcastToChannel(channelName, relay, NULL, true);
+    channel->removeMember(kicked);
+    kicked->removeChannel(channelName);
+    _server.removeChannelIfEmpty(channelName);
+    _server.propagate(relay, link);
+}
+
+// Only the server of the invited user acts on an INVITE; the others pass it on
+void LinkExecutor::_executeInvite(Client* link, const std::vector<std::string>& params, const std::string& relay) {
+    if (params.size() < 2) {
+        return;
+    }
+    Client* invitee = _server.getClientByNickname(params[0]);
+    if (!invitee || invitee->getLink() == link) {
+        return;
+    }
+    Channel* channel = _server.getChannel(stripColon(params[1]));
+    if (channel) {
+        channel->inviteClient(invitee);
+    }
+    _server.sendToClient(invitee->getFd(), relay);
+}
+
+// Adds a user behind a link to a channel, creating it if needed, and tells the local members
+void LinkExecutor::_joinChannel(Client* user, const std::string& channelName, bool op) {
+    Channel* channel = _server.getChannel(channelName);
+    if (!channel) {
+        channel = _server.createChannel(channelName);
+    }
+    if (channel->isMember(user)) {
+        return;
+    }
+    channel->addMemberUnchecked(user);
+    if (op) {
+        channel->addOperator(user);
+    }
+    user->addChannel(channelName);
+    _server.broadcastToChannel(channelName, ":" + user->getFullClientIdentifier() + " JOIN :" + channelName + "\r\n", NULL, true);
+}
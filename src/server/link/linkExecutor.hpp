@@ -0,0 +1,83 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   linkExecutor.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/18 09:30:12 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/18 09:30:12 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef LINKEXECUTOR_HPP
+#define LINKEXECUTOR_HPP
+
+#include "../../client/client.hpp"
+#include "../command/command.hpp"
+#include <string>
+#include <vector>
+
+class Server;
+
+/*
+Server-to-server protocol, a subset of RFC 2813. Servers form a spanning
+tree: a server name that is already known arrives over a second path only if
+the new link would close a loop, and that link is refused.
+
+    PASS <password> 0210 IRC|          SERVER <name> <hopcount> :<info>
+    NICK <nick> <hopcount> <user> <host> <server> + :<realname>
+    :<server> UNICK <server> <hopcount> :<nick>,<user>,<host>,<realname> ...
+    :<server> NJOIN <channel> :[@]<nick>,...
+
+After the handshake both sides burst their servers, users and channels. The
+burst introduces users in batches with UNICK (an extension: fields escaped
+with \s for space, \c for comma and \\ for backslash), about ten per line. From
+then on user commands travel with the user's prefix exactly as clients see
+them. Membership changes (JOIN, PART, QUIT, NICK, KICK) and channel state
+(MODE, TOPIC) reach every server; PRIVMSG and NOTICE to a channel only go to
+links with members behind them.
+*/
+class LinkExecutor {
+public:
+    LinkExecutor(Server& server);
+    ~LinkExecutor();
+
+    // Every line received from a connection that is a server link
+    void execute(Client* link, const Command& cmd, const std::string& line);
+
+    // PASS and SERVER announcing this server on a new link
+    void sendIntroduction(Client* link);
+    // PASS <password> <version> <flags> from a server; false if the password is wrong
+    bool acceptPassword(Client* link, const std::vector<std::string>& params);
+    // Completes the handshake once the peer sent a valid SERVER; inbound links
+    // have not seen our PASS/SERVER yet and get them first
+    void acceptServer(Client* link, const std::vector<std::string>& params, bool inbound);
+
+private:
+    Server& _server;
+
+    void _executeHandshake(Client* link, const std::string& command, const std::vector<std::string>& params);
+    void _sendBurst(Client* link);
+    Client* _sourceUser(Client* link, const std::string& prefix);
+
+    void _executeServer(Client* link, const std::vector<std::string>& params);
+    void _executeSquit(Client* link, const std::vector<std::string>& params, const std::string& relay);
+    void _executeNick(Client* link, const std::string& prefix, const std::vector<std::string>& params, const std::string& relay);
+    void _executeUnick(Client* link, const std::vector<std::string>& params);
+    void _executeNjoin(Client* link, const std::vector<std::string>& params, const std::string& relay);
+    void _executeJoin(Client* link, Client* user, const std::vector<std::string>& params, const std::string& relay);
+    void _executePart(Client* link, Client* user, const std::vector<std::string>& params, const std::string& relay);
+    void _executeMessage(Client* link, Client* user, const std::string& command, const std::vector<std::string>& params, const std::string& relay);
+    void _executeMode(Client* link, const std::vector<std::string>& params, const std::string& relay);
+    void _executeTopic(Client* link, const std::string& prefix, const std::vector<std::string>& params, const std::string& relay);
+    void _executeKick(Client* link, const std::vector<std::string>& params, const std::string& relay);
+    void _executeInvite(Client* link, const std::vector<std::string>& params, const std::string& relay);
+
+    void _joinChannel(Client* user, const std::string& channelName, bool op);
+
+    LinkExecutor(const LinkExecutor& other);
+    LinkExecutor& operator=(const LinkExecutor& other);
+};
+
+#endif // LINKEXECUTOR_HPP
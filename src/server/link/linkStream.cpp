@@ -0,0 +1,210 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   linkStream.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/19 10:04:58 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/19 10:04:58 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "linkStream.hpp"
+#include <cstring>
+
+static const size_t kWindow = 65535;          // Largest offset a match can encode
+static const size_t kMaxChunk = 32768;        // Plain bytes per frame; the worst case still fits 16 bits
+static const size_t kMinMatch = 4;
+static const int kHashBits = 14;
+static const size_t kHeader = 4;
+
+static unsigned int read32(const char* p) {
+    unsigned int value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static size_t hash4(const char* p) {
+    return (read32(p) * 2654435761U) >> (32 - kHashBits);
+}
+
+static void writeLength(std::string& out, size_t length) {
+    while (length >= 255) {
+        out += static_cast<char>(255);
+        length -= 255;
+    }
+    out += static_cast<char>(length);
+}
+
+static void writeSequence(std::string& out, const char* literals, size_t literalLength, size_t offset, size_t matchLength) {
+    size_t matchCode = matchLength ? matchLength - kMinMatch : 0;
+    unsigned char token = static_cast<unsigned char>(((literalLength < 15 ? literalLength : 15) << 4)
+                                                     | (matchCode < 15 ? matchCode : 15));
+    out += static_cast<char>(token);
+    if (literalLength >= 15) {
+        writeLength(out, literalLength - 15);
+    }
+    out.append(literals, literalLength);
+    if (matchLength) {
+        out += static_cast<char>(offset & 0xff);
+        out += static_cast<char>(offset >> 8);
+        if (matchCode >= 15) {
+            writeLength(out, matchCode - 15);
+        }
+    }
+}
+
+LinkStream::LinkStream()
+    : _pending(),
+      _deflateWindow(),
+      _deflateStart(0),
+      _table(static_cast<size_t>(1) << kHashBits, 0),
+      _inflateWindow(),
+      _partial()
+{
+}
+
+void LinkStream::queue(const std::string& text) {
+    _pending += text;
+}
+
+bool LinkStream::hasPending() const {
+    return !_pending.empty();
+}
+
+void LinkStream::deflate(std::string& out) {
+    for (size_t offset = 0; offset < _pending.length(); offset += kMaxChunk) {
+        size_t length = _pending.length() - offset < kMaxChunk ? _pending.length() - offset : kMaxChunk;
+        _compressChunk(_pending.data() + offset, length, out);
+    }
+    _pending.clear();
+}
+
+// Keeps at least one window of history while bounding the copy cost
+void LinkStream::_trim(std::string& window, unsigned long* start) {
+    if (window.length() > 4 * kWindow) {
+        size_t drop = window.length() - kWindow;
+        window.erase(0, drop);
+        if (start) {
+            *start += drop;
+        }
+    }
+}
+
+// Greedy matching: one hash probe per position, the match is extended as far as it goes
+void LinkStream::_compressChunk(const char* data, size_t length, std::string& out) {
+    _trim(_deflateWindow, &_deflateStart);
+    size_t base = _deflateWindow.length();
+    _deflateWindow.append(data, length);
+    const char* window = _deflateWindow.data();
+    size_t end = _deflateWindow.length();
+
+    size_t frameStart = out.length();
+    out.append(kHeader, '\0');
+
+    size_t anchor = base;
+    size_t position = base;
+    while (position + kMinMatch <= end) {
+        size_t slot = hash4(window + position);
+        unsigned long candidate = _table[slot];
+        _table[slot] = _deflateStart + position + 1;
+        if (candidate > _deflateStart) {
+            size_t match = candidate - 1 - _deflateStart;
+            if (position - match <= kWindow && read32(window + match) == read32(window + position)) {
+                size_t matchLength = kMinMatch;
+                while (position + matchLength < end && window[match + matchLength] == window[position + matchLength]) {
+                    ++matchLength;
+                }
+                writeSequence(out, window + anchor, position - anchor, position - match, matchLength);
+                position += matchLength;
+                anchor = position;
+                continue;
+            }
+        }
+        ++position;
+    }
+    writeSequence(out, window + anchor, end - anchor, 0, 0);
+
+    size_t payload = out.length() - frameStart - kHeader;
+    out[frameStart] = static_cast<char>(payload & 0xff);
+    out[frameStart + 1] = static_cast<char>(payload >> 8);
+    out[frameStart + 2] = static_cast<char>(length & 0xff);
+    out[frameStart + 3] = static_cast<char>(length >> 8);
+}
+
+bool LinkStream::inflate(const char* data, size_t length, std::string& out) {
+    _partial.append(data, length);
+    size_t offset = 0;
+    while (_partial.length() - offset >= kHeader) {
+        const unsigned char* header = reinterpret_cast<const unsigned char*>(_partial.data() + offset);
+        size_t payload = header[0] | (header[1] << 8);
+        size_t plain = header[2] | (header[3] << 8);
+        if (_partial.length() - offset - kHeader < payload) {
+            break;
+        }
+        if (!_expandFrame(header + kHeader, payload, plain, out)) {
+            return false;
+        }
+        offset += kHeader + payload;
+    }
+    _partial.erase(0, offset);
+    return true;
+}
+
+bool LinkStream::_expandFrame(const unsigned char* payload, size_t length, size_t plainLength, std::string& out) {
+    _trim(_inflateWindow, NULL);
+    size_t base = _inflateWindow.length();
+    size_t position = 0;
+    while (position < length) {
+        unsigned char token = payload[position++];
+        size_t literalLength = token >> 4;
+        if (literalLength == 15) {
+            unsigned char extra;
+            do {
+                if (position >= length) {
+                    return false;
+                }
+                extra = payload[position++];
+                literalLength += extra;
+            } while (extra == 255);
+        }
+        if (length - position < literalLength) {
+            return false;
+        }
+        _inflateWindow.append(reinterpret_cast<const char*>(payload + position), literalLength);
+        position += literalLength;
+        if (position == length) {
+            break;
+        }
+        if (length - position < 2) {
+            return false;
+        }
+        size_t offset = payload[position] | (payload[position + 1] << 8);
+        position += 2;
+        size_t matchLength = (token & 0x0f) + kMinMatch;
+        if ((token & 0x0f) == 15) {
+            unsigned char extra;
+            do {
+                if (position >= length) {
+                    return false;
+                }
+                extra = payload[position++];
+                matchLength += extra;
+            } while (extra == 255);
+        }
+        if (offset == 0 || offset > _inflateWindow.length()) {
+            return false;
+        }
+        // Byte by byte: the match may overlap the bytes it produces
+        size_t from = _inflateWindow.length() - offset;
+        for (size_t i = 0; i < matchLength; ++i) {
+            _inflateWindow += _inflateWindow[from + i];
+        }
+    }
+    if (_inflateWindow.length() - base != plainLength) {
+        return false;
+    }
+    out.append(_inflateWindow, base, plainLength);
+    return true;
+}
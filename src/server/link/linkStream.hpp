@@ -0,0 +1,63 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   linkStream.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/19 10:04:51 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/19 10:04:51 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef LINKSTREAM_HPP
+#define LINKSTREAM_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+/*
+Compression of a server link, used in both directions once both servers sent
+the Z flag in PASS. Everything queued during one event loop iteration is
+compressed together at its end, so a burst or a busy channel costs a few
+frames rather than one per line.
+
+The stream is a sequence of frames:
+
+    uint16 compressed length, uint16 plain length (little endian), payload
+
+Payloads use an LZ77 encoding in the style of LZ4 blocks: a token with
+literal and match length nibbles, extra length bytes of 255 while a nibble
+is 15, the literals, a 16-bit offset and the match length. A match may reach
+back into earlier frames, up to 64 KiB, so repeated prefixes and nicknames
+compress across lines and frames. The last sequence of a frame has no match.
+*/
+class LinkStream {
+public:
+    LinkStream();
+
+    // Plain text to send; compressed by deflate()
+    void queue(const std::string& text);
+    bool hasPending() const;
+    // Appends frames holding everything queued so far to out
+    void deflate(std::string& out);
+
+    // Appends the plain text of every complete frame in data to out; a
+    // partial frame is kept for the next call. False on corrupt input.
+    bool inflate(const char* data, size_t length, std::string& out);
+
+private:
+    std::string _pending;
+    std::string _deflateWindow;          // Recent plain text sent, matches point into it
+    unsigned long _deflateStart;         // Stream position of _deflateWindow[0]
+    std::vector<unsigned long> _table;   // Hash of 4 bytes -> stream position + 1
+    std::string _inflateWindow;          // Recent plain text received
+    std::string _partial;                // Start of a frame whose end has not arrived
+
+    void _compressChunk(const char* data, size_t length, std::string& out);
+    bool _expandFrame(const unsigned char* payload, size_t length, size_t plainLength, std::string& out);
+    static void _trim(std::string& window, unsigned long* start);
+};
+
+#endif // LINKSTREAM_HPP
@@ -0,0 +1,266 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   metrics.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/11 09:12:46 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/11 09:12:46 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "metrics.hpp"
+#include <cstdio>
+#include <cstring>
+#include <cstdarg>
+
+// Sorted for the binary search in commandIndex(); "OTHER" is appended last
+static const char* const kCommandNames[] = {
+    "AUTHENTICATE", "CAP", "CHATHISTORY", "ERROR", "INVITE", "JOIN", "KICK", "LIST", "MODE", "MONITOR", "NICK",
+    "NJOIN", "NOTICE", "OPER", "PART", "PASS", "PING", "PONG", "PRIVMSG", "QUIT", "SERVER",
+    "SQUIT", "STATS", "TOPIC", "TRACEDUMP", "UNICK", "UPGRADE", "USER", "WHO",
+    "OTHER"
+};
+static const int kCommandCount = sizeof(kCommandNames) / sizeof(kCommandNames[0]);
+
+static const char* const kDisconnectNames[] = { "peer_closed", "read_error", "write_error", "quit", "link_error", "sendq_exceeded",
+                                                  "oper_failed" };
+static const char* const kRejectNames[] = { "address_limit", "network_limit", "connect_rate" };
+static const char* const kLoginNames[] = { "verified", "cached", "failed", "busy", "external" };
+
+LatencyHistogram::LatencyHistogram() : _count(0), _sum(0), _max(0) {
+    std::memset(_buckets, 0, sizeof(_buckets));
+}
+
+unsigned long LatencyHistogram::bucketUpperBound(int index) {
+    if (index < kSubBuckets) {
+        return static_cast<unsigned long>(index);
+    }
+    int shift = index / kSubBuckets - 1;
+    unsigned long sub = static_cast<unsigned long>(index % kSubBuckets);
+    unsigned long lower = (static_cast<unsigned long>(kSubBuckets) + sub) << shift;
+    return lower + ((1UL << shift) - 1);
+}
+
+unsigned long LatencyHistogram::quantile(double q) const {
+    unsigned long total = getCount();
+    if (total == 0) {
+        return 0;
+    }
+    unsigned long rank = static_cast<unsigned long>(q * total);
+    if (rank >= total) {
+        rank = total - 1;
+    }
+    unsigned long seen = 0;
+    for (int i = 0; i < kBucketCount; ++i) {
+        seen += __atomic_load_n(&_buckets[i], __ATOMIC_RELAXED);
+        if (seen > rank) {
+            unsigned long bound = bucketUpperBound(i);
+            unsigned long max = getMax();
+            return bound < max ? bound : max;
+        }
+    }
+    return getMax();
+}
+
+Metrics::Metrics() : _commands(new CommandStats[kCommandCount]), _startTime(std::time(NULL)) {}
+
+Metrics::~Metrics() {
+    delete[] _commands;
+}
+
+int Metrics::commandIndex(const std::string& command) {
+    int low = 0;
+    int high = kCommandCount - 2;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        int order = std::strcmp(command.c_str(), kCommandNames[middle]);
+        if (order == 0) {
+            return middle;
+        }
+        if (order < 0) {
+            high = middle - 1;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return kCommandCount - 1;
+}
+
+const char* Metrics::commandName(int index) {
+    return kCommandNames[index];
+}
+
+const char* Metrics::rejectReasonName(RejectReason reason) {
+    return kRejectNames[reason];
+}
+
+int Metrics::commandCount() {
+    return kCommandCount;
+}
+
+static void appendLine(std::string& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void appendLine(std::string& out, const char* format, ...) {
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length > 0) {
+        out.append(line, static_cast<size_t>(length) < sizeof(line) ? length : sizeof(line) - 1);
+    }
+}
+
+static void appendSummary(std::string& out, const char* name, const char* labels, const LatencyHistogram& histogram, double scale) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); ++i) {
+        appendLine(out, "%s{%s%squantile=\"%g\"} %.9g\n", name, labels, *labels ? "," : "",
+                   quantiles[i], histogram.quantile(quantiles[i]) * scale);
+    }
+    const char* open = *labels ? "{" : "";
+    const char* close = *labels ? "}" : "";
+    appendLine(out, "%s_sum%s%s%s %.9g\n", name, open, labels, close, histogram.getSum() * scale);
+    appendLine(out, "%s_count%s%s%s %lu\n", name, open, labels, close, histogram.getCount());
+}
+
+std::string Metrics::renderPrometheus() const {
+    std::string out;
+    out += "# HELP ircserv_commands_total Commands executed, by verb.\n# TYPE ircserv_commands_total counter\n";
+    for (int i = 0; i < kCommandCount; ++i) {
+        appendLine(out, "ircserv_commands_total{command=\"%s\"} %lu\n", kCommandNames[i], _commands[i].latency.getCount());
+    }
+    out += "# HELP ircserv_command_bytes_total Bytes of command lines received, by verb.\n# TYPE ircserv_command_bytes_total counter\n";
+    for (int i = 0; i < kCommandCount; ++i) {
+        appendLine(out, "ircserv_command_bytes_total{command=\"%s\"} %lu\n", kCommandNames[i], _commands[i].bytes.get());
+    }
+    out += "# HELP ircserv_command_duration_seconds Time spent executing a command, by verb.\n# TYPE ircserv_command_duration_seconds summary\n";
+    for (int i = 0; i < kCommandCount; ++i) {
+        if (_commands[i].latency.getCount() == 0) {
+            continue;
+        }
+        char labels[64];
+        snprintf(labels, sizeof(labels), "command=\"%s\"", kCommandNames[i]);
+        appendSummary(out, "ircserv_command_duration_seconds", labels, _commands[i].latency, 1e-9);
+    }
+    out += "# HELP ircserv_fanout_recipients Recipients per channel broadcast.\n# TYPE ircserv_fanout_recipients summary\n";
+    appendSummary(out, "ircserv_fanout_recipients", "", fanoutRecipients, 1.0);
+
+    out += "# HELP ircserv_tick_duration_seconds Time spent handling the events of one poll().\n# TYPE ircserv_tick_duration_seconds summary\n";
+    appendSummary(out, "ircserv_tick_duration_seconds", "", tickDuration, 1e-9);
+    out += "# TYPE ircserv_tick_lag_seconds gauge\n";
+    appendLine(out, "ircserv_tick_lag_seconds %.9g\n", tickLag.get() * 1e-9);
+    out += "# TYPE ircserv_slow_ticks_total counter\n";
+    appendLine(out, "ircserv_slow_ticks_total %lu\n", slowTicks.get());
+
+    out += "# TYPE ircserv_accepts_total counter\n";
+    appendLine(out, "ircserv_accepts_total %lu\n", accepts.get());
+    out += "# HELP ircserv_unix_accepts_total Connections accepted on the Unix socket, included in ircserv_accepts_total.\n"
+           "# TYPE ircserv_unix_accepts_total counter\n";
+    appendLine(out, "ircserv_unix_accepts_total %lu\n", unixAccepts.get());
+    out += "# TYPE ircserv_disconnects_total counter\n";
+    for (int i = 0; i < DISCONNECT_REASON_COUNT; ++i) {
+        appendLine(out, "ircserv_disconnects_total{reason=\"%s\"} %lu\n", kDisconnectNames[i], disconnects[i].get());
+    }
+    out += "# HELP ircserv_rejected_connections_total Connections closed at accept by the connection limits.\n"
+           "# TYPE ircserv_rejected_connections_total counter\n";
+    for (int i = 0; i < REJECT_REASON_COUNT; ++i) {
+        appendLine(out, "ircserv_rejected_connections_total{reason=\"%s\"} %lu\n", kRejectNames[i], rejects[i].get());
+    }
+    out += "# HELP ircserv_sasl_logins_total SASL logins, by outcome.\n# TYPE ircserv_sasl_logins_total counter\n";
+    for (int i = 0; i < LOGIN_RESULT_COUNT; ++i) {
+        appendLine(out, "ircserv_sasl_logins_total{result=\"%s\"} %lu\n", kLoginNames[i], logins[i].get());
+    }
+    out += "# HELP ircserv_sasl_check_duration_seconds Time from queuing a password check to its answer.\n"
+           "# TYPE ircserv_sasl_check_duration_seconds summary\n";
+    appendSummary(out, "ircserv_sasl_check_duration_seconds", "", loginDuration, 1e-9);
+    out += "# TYPE ircserv_received_bytes_total counter\n";
+    appendLine(out, "ircserv_received_bytes_total %lu\n", bytesIn.get());
+    out += "# TYPE ircserv_sent_bytes_total counter\n";
+    appendLine(out, "ircserv_sent_bytes_total %lu\n", bytesOut.get());
+    out += "# TYPE ircserv_invalid_lines_total counter\n";
+    appendLine(out, "ircserv_invalid_lines_total %lu\n", invalidLines.get());
+
+    out += "# HELP ircserv_link_compression_bytes_total Traffic of compressed server links, as plain text and on the wire.\n"
+           "# TYPE ircserv_link_compression_bytes_total counter\n";
+    appendLine(out, "ircserv_link_compression_bytes_total{direction=\"in\",stage=\"plain\"} %lu\n", linkPlainIn.get());
+    appendLine(out, "ircserv_link_compression_bytes_total{direction=\"in\",stage=\"wire\"} %lu\n", linkWireIn.get());
+    appendLine(out, "ircserv_link_compression_bytes_total{direction=\"out\",stage=\"plain\"} %lu\n", linkPlainOut.get());
+    appendLine(out, "ircserv_link_compression_bytes_total{direction=\"out\",stage=\"wire\"} %lu\n", linkWireOut.get());
+
+    out += "# TYPE ircserv_clients gauge\n";
+    appendLine(out, "ircserv_clients %ld\n", clients.get());
+    out += "# TYPE ircserv_channels gauge\n";
+    appendLine(out, "ircserv_channels %ld\n", channels.get());
+    out += "# HELP ircserv_pending_write_clients Clients with output waiting for the socket.\n# TYPE ircserv_pending_write_clients gauge\n";
+    appendLine(out, "ircserv_pending_write_clients %ld\n", pendingWriteClients.get());
+    out += "# TYPE ircserv_queued_output_bytes gauge\n";
+    appendLine(out, "ircserv_queued_output_bytes %ld\n", queuedOutputBytes.get());
+    out += "# TYPE ircserv_max_client_queue_bytes gauge\n";
+    appendLine(out, "ircserv_max_client_queue_bytes %ld\n", maxClientQueueBytes.get());
+    out += "# HELP ircserv_input_buffers Receive blocks held by clients with a partial line.\n# TYPE ircserv_input_buffers gauge\n";
+    appendLine(out, "ircserv_input_buffers %ld\n", inputBuffers.get());
+    out += "# TYPE ircserv_connection_limit_nodes gauge\n";
+    appendLine(out, "ircserv_connection_limit_nodes %ld\n", limiterNodes.get());
+    out += "# TYPE ircserv_start_time_seconds gauge\n";
+    appendLine(out, "ircserv_start_time_seconds %ld\n", static_cast<long>(_startTime));
+    return out;
+}
+
+std::vector<std::string> Metrics::renderSummary() const {
+    std::vector<std::string> lines;
+    std::string line;
+    appendLine(line, "clients=%ld channels=%ld accepts=%lu unix_accepts=%lu in=%luB out=%luB invalid=%lu",
+               clients.get(), channels.get(), accepts.get(), unixAccepts.get(), bytesIn.get(), bytesOut.get(),
+               invalidLines.get());
+    lines.push_back(line);
+    line.clear();
+    appendLine(line, "disconnects peer_closed=%lu read_error=%lu write_error=%lu quit=%lu link_error=%lu sendq_exceeded=%lu"
+                     " oper_failed=%lu",
+               disconnects[DISCONNECT_PEER_CLOSED].get(), disconnects[DISCONNECT_READ_ERROR].get(),
+               disconnects[DISCONNECT_WRITE_ERROR].get(), disconnects[DISCONNECT_QUIT].get(),
+               disconnects[DISCONNECT_LINK_ERROR].get(), disconnects[DISCONNECT_SENDQ_EXCEEDED].get(),
+               disconnects[DISCONNECT_OPER_FAILED].get());
+    lines.push_back(line);
+    line.clear();
+    appendLine(line, "rejects address_limit=%lu network_limit=%lu connect_rate=%lu limit_nodes=%ld",
+               rejects[REJECT_ADDRESS_LIMIT].get(), rejects[REJECT_NETWORK_LIMIT].get(),
+               rejects[REJECT_CONNECT_RATE].get(), limiterNodes.get());
+    lines.push_back(line);
+    line.clear();
+    appendLine(line, "sasl verified=%lu cached=%lu failed=%lu busy=%lu external=%lu check_p50=%luns check_p99=%luns",
+               logins[LOGIN_VERIFIED].get(), logins[LOGIN_CACHED].get(), logins[LOGIN_FAILED].get(),
+               logins[LOGIN_BUSY].get(), logins[LOGIN_EXTERNAL].get(), loginDuration.quantile(0.5),
+               loginDuration.quantile(0.99));
+    lines.push_back(line);
+    line.clear();
+    appendLine(line, "queues pending_clients=%ld queued=%ldB max_client=%ldB input_buffers=%ld",
+               pendingWriteClients.get(), queuedOutputBytes.get(), maxClientQueueBytes.get(), inputBuffers.get());
+    lines.push_back(line);
+    line.clear();
+    appendLine(line, "links in=%luB/%luB out=%luB/%luB (plain/wire, compressed links only)",
+               linkPlainIn.get(), linkWireIn.get(), linkPlainOut.get(), linkWireOut.get());
+    lines.push_back(line);
+    line.clear();
+    appendLine(line, "fanout broadcasts=%lu p50=%lu p99=%lu max=%lu",
+               fanoutRecipients.getCount(), fanoutRecipients.quantile(0.5),
+               fanoutRecipients.quantile(0.99), fanoutRecipients.getMax());
+    lines.push_back(line);
+    line.clear();
+    appendLine(line, "ticks count=%lu p50=%luns p99=%luns max=%luns last=%ldns slow=%lu",
+               tickDuration.getCount(), tickDuration.quantile(0.5), tickDuration.quantile(0.99),
+               tickDuration.getMax(), tickLag.get(), slowTicks.get());
+    lines.push_back(line);
+    for (int i = 0; i < kCommandCount; ++i) {
+        const LatencyHistogram& latency = _commands[i].latency;
+        if (latency.getCount() == 0) {
+            continue;
+        }
+        line.clear();
+        appendLine(line, "%s count=%lu p50=%luns p99=%luns max=%luns", kCommandNames[i], latency.getCount(),
+                   latency.quantile(0.5), latency.quantile(0.99), latency.getMax());
+        lines.push_back(line);
+    }
+    return lines;
+}
@@ -0,0 +1,193 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   metrics.hpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/11 09:12:40 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/11 09:12:40 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <vector>
+#include <ctime>
+
+/*
+In-process metrics. Every sample is a relaxed atomic add on a preallocated
+slot, so recording never locks or allocates and is safe from the fan-out
+workers. Readers (STATS, the Prometheus listener) see a slightly torn but
+never invalid view.
+*/
+
+class MetricCounter {
+public:
+    MetricCounter() : _value(0) {}
+    void add(unsigned long amount = 1) { __atomic_add_fetch(&_value, amount, __ATOMIC_RELAXED); }
+    unsigned long get() const { return __atomic_load_n(&_value, __ATOMIC_RELAXED); }
+
+private:
+    unsigned long _value;
+};
+
+class MetricGauge {
+public:
+    MetricGauge() : _value(0) {}
+    void set(long value) { __atomic_store_n(&_value, value, __ATOMIC_RELAXED); }
+    void add(long amount) { __atomic_add_fetch(&_value, amount, __ATOMIC_RELAXED); }
+    long get() const { return __atomic_load_n(&_value, __ATOMIC_RELAXED); }
+
+private:
+    long _value;
+};
+
+// Log-bucketed histogram: values below 8 are exact, above that every power of
+// two is split into 8 linear sub-buckets, so a bucket is at most 12.5% wide.
+class LatencyHistogram {
+public:
+    static const int kSubBucketBits = 3;
+    static const int kSubBuckets = 1 << kSubBucketBits;
+    static const int kBucketCount = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    LatencyHistogram();
+
+    void record(unsigned long value) {
+        __atomic_add_fetch(&_buckets[bucketIndex(value)], 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&_count, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&_sum, value, __ATOMIC_RELAXED);
+        unsigned long seen = __atomic_load_n(&_max, __ATOMIC_RELAXED);
+        while (value > seen && !__atomic_compare_exchange_n(&_max, &seen, value, true,
+                                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+    }
+
+    unsigned long getCount() const { return __atomic_load_n(&_count, __ATOMIC_RELAXED); }
+    unsigned long getSum() const { return __atomic_load_n(&_sum, __ATOMIC_RELAXED); }
+    unsigned long getMax() const { return __atomic_load_n(&_max, __ATOMIC_RELAXED); }
+    // Upper bound of the bucket holding the q-th sample (0 <= q <= 1)
+    unsigned long quantile(double q) const;
+
+    static int bucketIndex(unsigned long value) {
+        if (value < static_cast<unsigned long>(kSubBuckets)) {
+            return static_cast<int>(value);
+        }
+        int msb = 63 - __builtin_clzl(value);
+        int sub = static_cast<int>((value >> (msb - kSubBucketBits)) & (kSubBuckets - 1));
+        return (msb - kSubBucketBits + 1) * kSubBuckets + sub;
+    }
+    static unsigned long bucketUpperBound(int index);
+
+private:
+    unsigned long _buckets[kBucketCount];
+    unsigned long _count;
+    unsigned long _sum;
+    unsigned long _max;
+
+    LatencyHistogram(const LatencyHistogram&);
+    LatencyHistogram& operator=(const LatencyHistogram&);
+};
+
+class Metrics {
+public:
+    enum DisconnectReason {
+        DISCONNECT_PEER_CLOSED,
+        DISCONNECT_READ_ERROR,
+        DISCONNECT_WRITE_ERROR,
+        DISCONNECT_QUIT,
+        DISCONNECT_LINK_ERROR,
+        DISCONNECT_SENDQ_EXCEEDED,
+        DISCONNECT_OPER_FAILED,
+        DISCONNECT_REASON_COUNT
+    };
+
+    // Connections closed right after accept() by the connection limits
+    enum RejectReason {
+        REJECT_ADDRESS_LIMIT,
+        REJECT_NETWORK_LIMIT,
+        REJECT_CONNECT_RATE,
+        REJECT_REASON_COUNT
+    };
+
+    // Outcomes of SASL logins
+    enum LoginResult {
+        LOGIN_VERIFIED,             // Key derivation matched
+        LOGIN_CACHED,               // Matched the cache of recent logins
+        LOGIN_FAILED,
+        LOGIN_BUSY,                 // Refused unchecked: too many checks queued
+        LOGIN_EXTERNAL,             // EXTERNAL: vouched for by the Unix socket peer's uid
+        LOGIN_RESULT_COUNT
+    };
+
+    struct CommandStats {
+        MetricCounter bytes;
+        LatencyHistogram latency;   // Nanoseconds spent in executeCommand
+    };
+
+    Metrics();
+    ~Metrics();
+
+    // Index into the per-command table; unknown verbs share the last slot
+    static int commandIndex(const std::string& command);
+    static const char* commandName(int index);
+    static int commandCount();
+    static const char* rejectReasonName(RejectReason reason);
+
+    void recordCommand(int index, size_t lineBytes, unsigned long nanoseconds) {
+        _commands[index].bytes.add(lineBytes);
+        _commands[index].latency.record(nanoseconds);
+    }
+    const CommandStats& getCommand(int index) const { return _commands[index]; }
+
+    static unsigned long nowNs() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<unsigned long>(ts.tv_sec) * 1000000000UL + ts.tv_nsec;
+    }
+
+    MetricCounter accepts;
+    MetricCounter unixAccepts;           // Of accepts, those on the Unix socket
+    MetricCounter bytesIn;
+    MetricCounter bytesOut;
+    MetricCounter invalidLines;
+    MetricCounter disconnects[DISCONNECT_REASON_COUNT];
+    MetricCounter rejects[REJECT_REASON_COUNT];
+    MetricCounter logins[LOGIN_RESULT_COUNT];
+    LatencyHistogram loginDuration;      // Nanoseconds from queuing a password check to its answer
+    LatencyHistogram fanoutRecipients;   // Members reached per channel broadcast
+    LatencyHistogram tickDuration;       // Nanoseconds from poll() returning to the next poll()
+    MetricGauge tickLag;                 // Duration of the last loop iteration
+    MetricCounter slowTicks;             // Iterations over --tick-budget-us
+    MetricCounter linkPlainIn;           // Compressed server links: bytes before and after the codec
+    MetricCounter linkWireIn;
+    MetricCounter linkPlainOut;
+    MetricCounter linkWireOut;
+
+    // Sampled by the server right before the metrics are read
+    MetricGauge clients;
+    MetricGauge channels;
+    MetricGauge pendingWriteClients;
+    MetricGauge queuedOutputBytes;
+    MetricGauge maxClientQueueBytes;
+    MetricGauge inputBuffers;            // Receive blocks held by clients with a partial line
+    MetricGauge limiterNodes;            // Trie nodes in use by the connection limits
+
+    time_t getStartTime() const { return _startTime; }
+
+    // Prometheus text exposition format, version 0.0.4
+    std::string renderPrometheus() const;
+    // Human readable lines for STATS x
+    std::vector<std::string> renderSummary() const;
+
+private:
+    CommandStats* _commands;
+    time_t _startTime;
+
+    Metrics(const Metrics&);
+    Metrics& operator=(const Metrics&);
+};
+
+#endif // METRICS_HPP
@@ -11,28 +11,134 @@
 /* ************************************************************************** */
 
 #include "server.hpp"
+#include <sys/stat.h>
 
+// One batch of LIST replies (see _continueListing)
+static const size_t kListBatchBytes = 16384;
+static const size_t kListScanLimit = 4096;
 
-Server::Server(int port, const std::string& password) 
+// NICK lines to other servers, whose parser drops lines over 512 bytes; a relay adds at most a hop count digit
+static const size_t kMaxNickLine = 500;
+static const size_t kMaxNickField = 64;         // User name and host in that line
+
+// The uid of the process at the other end of a Unix socket, -1 for TCP
+static long peerUid(int fd) {
+    struct sockaddr_un local;
+    socklen_t localLength = sizeof(local);
+    struct ucred credentials;
+    socklen_t credentialsLength = sizeof(credentials);
+    if (getsockname(fd, (struct sockaddr*)&local, &localLength) == -1 || local.sun_family != AF_UNIX
+        || getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &credentialsLength) == -1) {
+        return -1;
+    }
+    return static_cast<long>(credentials.uid);
+}
+
+
+Server::Server(int port, const std::string& password, const ServerConfig& config) 
     : _serverSocket(-1),
       _port(port),
       _password(password),
-      _serverName("ft_irc.com"),
+      _serverName(config.serverName),
       _clients(),
+      _nicknames(),
+      _watchers(),
+      _hosts(),
       _pollFds(),
       _cmdExecutor(NULL),
-      _maxChannelsPerClient(3)
+      _channelIndex(),
+      _listings(),
+      _maxChannelsPerClient(3),
+      _config(config),
+      _fanoutPool(NULL),
+      _history(NULL),
+      _pendingWrites(),
+      _sendqExceeded(),
+      _graveyard(),
+      _metricsSocket(-1),
+      _metricsConnections(),
+      _capture(NULL),
+      _linkExecutor(NULL),
+      _links(),
+      _remoteServers(),
+      _nextRemoteId(-2),
+      _nextSnapshot(0),
+      _upgradeCommand(),
+      _upgradeRequester(-1),
+      _connectionLimiter(NULL),
+      _authenticator(NULL),
+      _saslSessions(),
+      _nextAuthTicket(1),
+      _unixSocket(-1),
+      _unixSocketPath(),
+      _corkedFd(-1),
+      _corked()
       {
 
+
+    if (!_config.links.empty() && _config.linkPassword.empty()) {
+        throw std::runtime_error("--link needs --link-password");
+    }
+    _setupConnectionLimits();
+
+    if (_config.upgradeFd != -1) {
+        _resumeUpgrade();
+    } else {
+        _setupListener();
+    }
+
+    // Add server socket to poll set
+    pollfd serverPollFd = {_serverSocket, POLLIN, 0};
+    _pollFds.push_back(serverPollFd);
+    _setupUnixListener();
+
+    _cmdExecutor = new CommandExecutor(*this);
+    _setupFanout();
+    _setupAuthentication();
+    _setupMetricsListener();
+
+    if (_config.historyLines > 0) {
+        _history = new HistoryStore(_config.historyLines, _config.historyBytes, _config.historyMemory);
+        LOG_INFO("Channel history enabled: " + to_string(_config.historyLines) + " events per channel, "
+                     + to_string(_config.historyMemory) + " bytes total");
+    }
+
+    if (!_config.captureFile.empty()) {
+        _capture = new TrafficCapture();
+        if (!_capture->open(_config.captureFile)) {
+            LOG_ERROR("Failed to open capture file " + _config.captureFile + ": " + std::string(strerror(errno)));
+            throw std::runtime_error("Failed to open capture file");
+        }
+        LOG_WARNING("Capturing client traffic to " + _config.captureFile);
+    }
+
+    _loadSnapshot();
+    _linkExecutor = new LinkExecutor(*this);
+    _connectLinks();
+
+    if (_config.upgradeFd != -1) {
+        // Until it reads this, the old process can still take its clients back
+        for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+            if (!it->second->getOutbound().empty()) {
+                _pendingWrites.insert(it->first);
+            }
+        }
+        LiveUpgrade::sendReady(_config.upgradeFd);
+        close(_config.upgradeFd);
+    }
+    LOG_INFO("Server initialized on port " + to_string(_port));
+}
+
+void Server::_setupListener() {
     _serverSocket = socket(AF_INET, SOCK_STREAM, 0);
     if (_serverSocket == -1) {
-        Logger::error("Failed to create socket: " + std::string(strerror(errno)));
+        LOG_ERROR("Failed to create socket: " + std::string(strerror(errno)));
         throw std::runtime_error("Failed to create socket");
     }
 
     int opt = 1;
     if (setsockopt(_serverSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1) {
-        Logger::error("Failed to set socket options: " + std::string(strerror(errno)));
+        LOG_ERROR("Failed to set socket options: " + std::string(strerror(errno)));
         throw std::runtime_error("Failed to set socket options");
     }
 
@@ -43,163 +149,934 @@ Server::Server(int port, const std::string& password)
     address.sin_port = htons(_port);
 
     if (bind(_serverSocket, (struct sockaddr*)&address, sizeof(address)) == -1) {
-        Logger::error("Failed to bind to port :  "+ std::string(strerror(errno)));
+        LOG_ERROR("Failed to bind to port :  "+ std::string(strerror(errno)));
         throw std::runtime_error("Failed to bind to port");
     }
 
     if (listen(_serverSocket, SOMAXCONN) == -1) {
-        Logger::error("Failed to listen on socket: " + std::string(strerror(errno)));
+        LOG_ERROR("Failed to listen on socket: " + std::string(strerror(errno)));
         throw std::runtime_error("Failed to listen on socket");
     }
 
     if (fcntl(_serverSocket, F_SETFL, O_NONBLOCK) == -1) {
-        Logger::error("Failed to set socket to non-blocking mode: " + std::string(strerror(errno)));
+        LOG_ERROR("Failed to set socket to non-blocking mode: " + std::string(strerror(errno)));
         throw std::runtime_error("Failed to set socket to non-blocking mode");
     }
+}
 
-    // Add server socket to poll set
-    pollfd serverPollFd = {_serverSocket, POLLIN, 0};
-    _pollFds.push_back(serverPollFd);
+/*
+Clients on the same host (bots, bridges) can skip the TCP stack. A socket
+file left behind by a server that did not shut down cleanly is replaced;
+one that still accepts connections belongs to a running server.
+*/
+void Server::_setupUnixListener() {
+    if (_config.unixSocket.empty()) {
+        if (_unixSocket != -1) {
+            // Handed over by an UPGRADE started without --unix-socket
+            close(_unixSocket);
+            _unixSocket = -1;
+        }
+        return;
+    }
+    const std::string& path = _config.unixSocket;
+    if (_unixSocket == -1) {
+        struct sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
 
-    _cmdExecutor = new CommandExecutor(*this);
+        struct stat existing;
+        if (lstat(path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) {
+            int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+            bool inUse = probe != -1 && connect(probe, (struct sockaddr*)&address, sizeof(address)) == 0;
+            if (probe != -1) {
+                close(probe);
+            }
+            if (inUse) {
+                LOG_ERROR("Unix socket " + path + " is in use by another server");
+                throw std::runtime_error("Unix socket in use");
+            }
+            unlink(path.c_str());
+        }
+
+        // Open to every local user, as the TCP port is: peers that are not
+        // trusted still need PASS. The directory's permissions can narrow it.
+        _unixSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (_unixSocket == -1 || bind(_unixSocket, (struct sockaddr*)&address, sizeof(address)) == -1
+            || chmod(path.c_str(), 0666) == -1 || listen(_unixSocket, SOMAXCONN) == -1
+            || fcntl(_unixSocket, F_SETFL, O_NONBLOCK) == -1) {
+            LOG_ERROR("Failed to set up Unix socket " + path + ": " + std::string(strerror(errno)));
+            throw std::runtime_error("Failed to set up Unix socket");
+        }
+    }
+    _unixSocketPath = path;
+    pollfd unixPollFd = {_unixSocket, POLLIN, 0};
+    _pollFds.push_back(unixPollFd);
+    LOG_INFO("Accepting local clients on " + path + ", " + to_string(_config.unixTrusted.size())
+                 + " trusted uids");
+}
+
+// New process of an UPGRADE: the listener and the clients come from the old one
+void Server::_resumeUpgrade() {
+    unsigned long start = Metrics::nowNs();
+    std::string state;
+    std::vector<int> fds;
+    std::string error;
+    if (!LiveUpgrade::receiveState(_config.upgradeFd, state, fds, error)
+        || !LiveUpgrade::restore(state, fds, *this, _serverSocket, _metricsSocket, _unixSocket, error)) {
+        LOG_ERROR("Live upgrade failed: " + error);
+        throw std::runtime_error("Live upgrade failed");
+    }
+    for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+        it->second->setPeerUid(peerUid(it->first));
+    }
+    for (std::map<int, Client*>::iterator it = _clients.begin(); _connectionLimiter && it != _clients.end(); ++it) {
+        unsigned int address;
+        unsigned int length;
+        if (ConnectionLimiter::parseNetwork(it->second->getHostname(), address, length) && address != 0) {
+            _connectionLimiter->count(address, std::time(NULL));
+            it->second->setCountedAddress(address);
+        }
+    }
+    LOG_EVENT(Logger::INFO, "Took over {} clients and {} channels ({} bytes of state) in {} us",
+              << _clients.size() << _channels.size() << state.length() << (Metrics::nowNs() - start) / 1000);
+}
+
+// One attempt per --link at startup; a link that fails or drops later is not retried
+void Server::_connectLinks() {
+    for (std::vector<std::string>::const_iterator it = _config.links.begin(); it != _config.links.end(); ++it) {
+        size_t colon = it->rfind(':');
+        std::string host = it->substr(0, colon);
+        if (host == "localhost") {
+            host = "127.0.0.1";
+        }
+        struct sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(std::atoi(it->c_str() + colon + 1));
+        if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+            LOG_ERROR("Cannot link to " + *it + ": not an IPv4 address");
+            continue;
+        }
+
+        int linkSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (linkSocket == -1 || connect(linkSocket, (struct sockaddr*)&address, sizeof(address)) == -1
+            || fcntl(linkSocket, F_SETFL, O_NONBLOCK) == -1) {
+            LOG_ERROR("Failed to link to " + *it + ": " + std::string(strerror(errno)));
+            if (linkSocket != -1) {
+                close(linkSocket);
+            }
+            continue;
+        }
+        Client* link = addClient(linkSocket, host);
+        link->setLinkState(Client::LINK_CONNECTING);
+        _linkExecutor->sendIntroduction(link);
+        LOG_INFO("Connecting to server at " + *it);
+    }
+}
+
+void Server::_setupFanout() {
+    if (_config.fanoutThreads == 0) {
+        return;
+    }
+
+    _fanoutPool = new FanoutPool(_config.fanoutThreads);
+    pollfd wakePollFd = {_fanoutPool->getWakeFd(), POLLIN, 0};
+    _pollFds.push_back(wakePollFd);
+    LOG_INFO("Fan-out enabled: " + to_string(_fanoutPool->getThreadCount()) + " workers for channels with at least "
+                 + to_string(_config.fanoutThreshold) + " members");
+}
+
+void Server::_setupAuthentication() {
+    if (_config.accountsFile.empty()) {
+        return;
+    }
+    _authenticator = new Authenticator(_config.accountsFile, _config.authThreads, _config.authCacheEntries);
+    pollfd wakePollFd = {_authenticator->getWakeFd(), POLLIN, 0};
+    _pollFds.push_back(wakePollFd);
+    LOG_INFO("SASL enabled: " + to_string(_authenticator->getAccountCount()) + " accounts, "
+                 + to_string(_authenticator->getThreadCount()) + " threads checking passwords");
+}
+
+// Plain HTTP on the loopback interface only: the metrics are not meant for clients
+void Server::_setupMetricsListener() {
+    if (_metricsSocket != -1) {
+        // Handed over by UPGRADE, already listening
+        pollfd metricsPollFd = {_metricsSocket, POLLIN, 0};
+        _pollFds.push_back(metricsPollFd);
+        return;
+    }
+    if (_config.metricsPort == 0) {
+        return;
+    }
 
-    Logger::info("Server initialized on port " + to_string(_port));
+    _metricsSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (_metricsSocket == -1) {
+        LOG_ERROR("Failed to create metrics socket: " + std::string(strerror(errno)));
+        throw std::runtime_error("Failed to create metrics socket");
+    }
+    int opt = 1;
+    setsockopt(_metricsSocket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in metricsAddr;
+    std::memset(&metricsAddr, 0, sizeof(metricsAddr));
+    metricsAddr.sin_family = AF_INET;
+    metricsAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    metricsAddr.sin_port = htons(_config.metricsPort);
+    if (bind(_metricsSocket, (struct sockaddr*)&metricsAddr, sizeof(metricsAddr)) == -1
+        || listen(_metricsSocket, 8) == -1
+        || fcntl(_metricsSocket, F_SETFL, O_NONBLOCK) == -1) {
+        LOG_ERROR("Failed to set up metrics listener: " + std::string(strerror(errno)));
+        throw std::runtime_error("Failed to set up metrics listener");
+    }
+
+    pollfd metricsPollFd = {_metricsSocket, POLLIN, 0};
+    _pollFds.push_back(metricsPollFd);
+    LOG_INFO("Metrics available at http://127.0.0.1:" + to_string(_config.metricsPort) + "/metrics");
 }
 
 
 
 //enhanced version: added Logger
 Server::~Server() {
+    // Join the workers first: their jobs hold raw Client pointers
+    delete _fanoutPool;
+    _buryClients(true);
     for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
         delete it->second;
     }
     delete _cmdExecutor;
+    delete _linkExecutor;
+    for (std::map<int, LinkStream*>::iterator it = _linkStreams.begin(); it != _linkStreams.end(); ++it) {
+        delete it->second;
+    }
+    delete _history;
+    delete _capture;
+    delete _connectionLimiter;
+    delete _authenticator;
+    for (std::set<int>::iterator it = _metricsConnections.begin(); it != _metricsConnections.end(); ++it) {
+        close(*it);
+    }
+    if (_metricsSocket != -1) {
+        close(_metricsSocket);
+    }
+    if (_unixSocket != -1) {
+        close(_unixSocket);
+        if (!_unixSocketPath.empty()) {
+            unlink(_unixSocketPath.c_str());
+        }
+    }
     close(_serverSocket);
-    Logger::info("Server shut down");
+    LOG_INFO("Server shut down");
 }
 
 
+static volatile sig_atomic_t shutdownRequested = 0;
+
+static void handleShutdownSignal(int) {
+    shutdownRequested = 1;
+}
+
+// No SA_RESTART: the signal interrupts poll() and run() sees the flag at once
+void Server::installShutdownHandler() {
+    struct sigaction action;
+    action.sa_handler = &handleShutdownSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = 0;
+    sigaction(SIGTERM, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+}
+
 //enhanced version: added Logger
 void Server::run() {
-    Logger::info("Server started running");
-    while (true) {
-        int ret = poll(_pollFds.data(), _pollFds.size(), -1);
-        if (ret == -1) {
-            Logger::error("Poll failed: " + std::string(strerror(errno)));
-            throw std::runtime_error("Poll failed");
-        }
-        for (size_t i = 0; i < _pollFds.size(); ++i) {
-            if (_pollFds[i].revents & POLLIN) {
-                if (_pollFds[i].fd == _serverSocket) {
-                    _acceptNewConnection();
-                } else {
-                    _handleClientMessage(_pollFds[i].fd);
-                }
+    LOG_INFO("Server started running");
+    Tracer::setThreadName("event loop");
+    if (!_config.snapshotFile.empty() && _config.snapshotInterval > 0) {
+        _nextSnapshot = std::time(NULL) + _config.snapshotInterval;
+    }
+    while (!shutdownRequested) {
+        runOnce(_snapshotTimeoutMs());
+        if (_upgradeRequester != -1 && _performUpgrade()) {
+            // The new process owns the sockets and saves the snapshots from now on
+            LOG_INFO("Handed over to the new process");
+            return;
+        }
+        if (_nextSnapshot != 0 && std::time(NULL) >= _nextSnapshot) {
+            saveSnapshot();
+            _nextSnapshot = std::time(NULL) + _config.snapshotInterval;
+        }
+    }
+    LOG_INFO("Shutdown requested");
+    if (!_config.snapshotFile.empty()) {
+        saveSnapshot();
+    }
+}
+
+// The binary and arguments UPGRADE starts; without them it is refused
+void Server::setUpgradeCommand(const std::vector<std::string>& command) {
+    _upgradeCommand = command;
+}
+
+// UPGRADE runs between two ticks, once the command that asked for it returned
+bool Server::requestUpgrade(int clientFd) {
+    if (_upgradeCommand.empty()) {
+        return false;
+    }
+    _upgradeRequester = clientFd;
+    return true;
+}
+
+/*
+Hands every local user to a new process started from _upgradeCommand. Server
+links cannot follow (their compression state stays here), so they are
+closed first and the new process reconnects through --link. Returns false,
+still serving, if the new process failed to take over.
+*/
+bool Server::_performUpgrade() {
+    int requesterFd = _upgradeRequester;
+    _upgradeRequester = -1;
+    if (_fanoutPool) {
+        _fanoutPool->waitIdle();
+        _buryClients(true);
+    }
+    if (_authenticator) {
+        // Their answers go out with the queued output. Exchanges still waiting
+        // for a payload are not carried over: the next AUTHENTICATE gets 904.
+        _authenticator->waitIdle();
+        _handleAuthResults();
+    }
+    std::vector<Client*> links;
+    for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+        if (it->second->getLinkState() != Client::LINK_NONE) {
+            links.push_back(it->second);
+        }
+    }
+    for (std::vector<Client*>::iterator it = links.begin(); it != links.end(); ++it) {
+        dropLink(*it, "Server upgrading");
+    }
+    while (!_metricsConnections.empty()) {
+        _closeMetricsConnection(*_metricsConnections.begin());
+    }
+    if (_capture) {
+        _capture->flush();
+    }
+
+    unsigned long start = Metrics::nowNs();
+    std::vector<int> fds;
+    std::string state = LiveUpgrade::encode(*this, _serverSocket, _metricsSocket, _unixSocket, fds);
+    std::string error;
+    int channel = -1;
+    pid_t pid = LiveUpgrade::spawn(_upgradeCommand, channel, error);
+    bool handedOver = pid != -1 && LiveUpgrade::sendState(channel, state, fds, error)
+                      && LiveUpgrade::waitReady(channel, error);
+    if (channel != -1) {
+        close(channel);
+    }
+    if (handedOver) {
+        _unixSocketPath.clear();    // The new process listens on it now
+        LOG_EVENT(Logger::INFO, "Upgrade: process {} took over {} descriptors ({} bytes of state) in {} us",
+                  << pid << fds.size() << state.length() << (Metrics::nowNs() - start) / 1000);
+        return true;
+    }
+
+    if (pid != -1) {
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    }
+    LOG_ERROR("Upgrade failed: " + error);
+    if (getClientByFd(requesterFd)) {
+        sendToClient(requesterFd, ":" + _serverName + " NOTICE " + getClientByFd(requesterFd)->getNickname()
+                                  + " :Upgrade failed: " + error + "\r\n");
+    }
+    _connectLinks();
+    return false;
+}
+
+// poll() timeout that wakes the loop for the next periodic snapshot
+int Server::_snapshotTimeoutMs() const {
+    if (_nextSnapshot == 0) {
+        return -1;
+    }
+    time_t now = std::time(NULL);
+    return _nextSnapshot > now ? static_cast<int>(_nextSnapshot - now) * 1000 : 0;
+}
+
+bool Server::saveSnapshot() {
+    if (_config.snapshotFile.empty()) {
+        return false;
+    }
+    unsigned long start = Metrics::nowNs();
+    std::string error;
+    if (!ChannelSnapshot::save(_config.snapshotFile, _channels, error)) {
+        LOG_ERROR("Failed to save channel snapshot: " + error);
+        return false;
+    }
+    LOG_EVENT(Logger::INFO, "Saved {} channels to {} in {} us",
+              << _channels.size() << _config.snapshotFile << (Metrics::nowNs() - start) / 1000);
+    return true;
+}
+
+// A missing or unusable snapshot only costs the old channels: the server still starts
+void Server::_loadSnapshot() {
+    if (_config.snapshotFile.empty()) {
+        return;
+    }
+    unsigned long start = Metrics::nowNs();
+    std::string error;
+    long restored = ChannelSnapshot::load(_config.snapshotFile, *this, error);
+    if (restored < 0) {
+        LOG_WARNING("Ignoring channel snapshot " + _config.snapshotFile + ": " + error);
+        return;
+    }
+    LOG_EVENT(Logger::INFO, "Restored {} channels from {} in {} us",
+              << restored << _config.snapshotFile << (Metrics::nowNs() - start) / 1000);
+}
+
+// One poll() and the handling of everything it returned; returns the number
+// of ready descriptors (0 on timeout or signal). ircreplay drives the server
+// through this with a zero timeout.
+int Server::runOnce(int timeoutMs) {
+    if (Tracer::takeDumpRequest()) {
+        dumpTrace();
+    }
+    _refreshPollEvents();
+    int ret;
+    {
+        TraceSpan span("poll", NULL, static_cast<long>(_pollFds.size()));
+        ret = poll(_pollFds.data(), _pollFds.size(), timeoutMs);
+    }
+    if (ret == -1) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        LOG_ERROR("Poll failed: " + std::string(strerror(errno)));
+        throw std::runtime_error("Poll failed");
+    }
+    if (ret == 0) {
+        return 0;
+    }
+    unsigned long tickStart = Metrics::nowNs();
+    TraceSpan tick("tick", NULL, ret);
+    for (size_t i = 0; i < _pollFds.size(); ++i) {
+        int fd = _pollFds[i].fd;
+        short revents = _pollFds[i].revents;
+        if (fd == _serverSocket) {
+            if (revents & POLLIN) {
+                _acceptNewConnection();
+            }
+        } else if (fd == _unixSocket) {
+            if (revents & POLLIN) {
+                _acceptUnixConnection();
+            }
+        } else if (_fanoutPool && fd == _fanoutPool->getWakeFd()) {
+            if (revents & POLLIN) {
+                _handleWakeup();
+            }
+        } else if (_authenticator && fd == _authenticator->getWakeFd()) {
+            if (revents & POLLIN) {
+                _handleAuthResults();
+            }
+        } else if (fd == _metricsSocket) {
+            if (revents & POLLIN) {
+                _acceptMetricsConnection();
+            }
+        } else if (_metricsConnections.count(fd)) {
+            if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                _serveMetrics(fd);
+            }
+        } else {
+            if ((revents & POLLOUT) && !_flushClient(fd) && i < _pollFds.size() && _pollFds[i].fd == fd) {
+                _pollFds[i].events = POLLIN;
+                _continueListing(fd);   // Queues POLLOUT again until the list is sent
+            }
+            if ((revents & (POLLIN | POLLHUP | POLLERR)) && getClientByFd(fd)) {
+                _handleClientMessage(fd);
             }
         }
     }
+    _dropSendqExceeded();
+    _endTick(tickStart);
+    return ret;
+}
+
+// Tick lag: how long the events returned by one poll() kept the loop busy
+// Not at once: whoever sent may still be walking a member list. Quits
+// announced here may push more clients over the limit.
+void Server::_dropSendqExceeded() {
+    while (!_sendqExceeded.empty()) {
+        int fd = *_sendqExceeded.begin();
+        _sendqExceeded.erase(_sendqExceeded.begin());
+        Client* client = getClientByFd(fd);
+        if (client && client->getOutbound().isOverflowed()) {     // Not a new client on a reused fd
+            LOG_EVENT(Logger::WARNING, "Client {} exceeded the send queue limit", << fd);
+            _removeClient(fd, Metrics::DISCONNECT_SENDQ_EXCEEDED, "SendQ exceeded");
+        }
+    }
+}
+
+void Server::_endTick(unsigned long tickStart) {
+    _flushLinkStreams();
+    if (_capture) {
+        _capture->flush();
+    }
+    unsigned long elapsed = Metrics::nowNs() - tickStart;
+    _metrics.tickDuration.record(elapsed);
+    _metrics.tickLag.set(static_cast<long>(elapsed));
+    if (_config.tickBudgetUs > 0 && elapsed / 1000 > _config.tickBudgetUs) {
+        _metrics.slowTicks.add();
+        LOG_EVENT(Logger::WARNING, "Event loop tick took {} us, over the {} us budget",
+                  << elapsed / 1000 << _config.tickBudgetUs);
+    }
+}
+
+// Writes the trace rings to --trace-file; returns the span count or -1
+long Server::dumpTrace() {
+    long spans = Tracer::dump(_config.traceFile);
+    if (spans < 0) {
+        LOG_ERROR("Failed to write trace to " + _config.traceFile);
+    } else {
+        LOG_INFO("Wrote " + to_string(spans) + " trace spans to " + _config.traceFile);
+    }
+    return spans;
+}
+
+// Adds POLLOUT for every client that was left with queued output since the last poll()
+void Server::_refreshPollEvents() {
+    if (_pendingWrites.empty()) {
+        return;
+    }
+    for (std::vector<pollfd>::iterator it = _pollFds.begin(); it != _pollFds.end(); ++it) {
+        if (_pendingWrites.count(it->fd)) {
+            it->events |= POLLOUT;
+        }
+    }
+    _pendingWrites.clear();
+}
+
+// Returns true while the client still has output waiting for the socket
+bool Server::_flushClient(int clientFd) {
+    TraceSpan span("flush", NULL, clientFd);
+    Client* client = getClientByFd(clientFd);
+    if (!client) {
+        return false;
+    }
+    long pending = client->getOutbound().flush(clientFd);
+    if (pending == -1) {
+        LOG_ERROR("Failed to send message to client " + to_string(clientFd) + ": " + std::string(strerror(errno)));
+        _removeClient(clientFd, Metrics::DISCONNECT_WRITE_ERROR);
+        return false;
+    }
+    return pending > 0;
+}
+
+// Answers that arrive for a connection that closed or restarted SASL meanwhile are dropped
+void Server::_handleAuthResults() {
+    std::vector<Authenticator::Result> results;
+    _authenticator->takeResults(results);
+    unsigned long now = Metrics::nowNs();
+    for (std::vector<Authenticator::Result>::iterator it = results.begin(); it != results.end(); ++it) {
+        _metrics.loginDuration.record(now - it->startNs);
+        _metrics.logins[it->accepted ? Metrics::LOGIN_VERIFIED : Metrics::LOGIN_FAILED].add();
+        SaslSession* session = findSaslSession(it->fd);
+        if (session && session->ticket == it->ticket) {
+            _cmdExecutor->finishSasl(it->fd, it->account, it->accepted);
+        }
+    }
+}
+
+bool Server::isTrustedPeer(const Client* client) const {
+    long uid = client->getPeerUid();
+    return uid >= 0 && std::find(_config.unixTrusted.begin(), _config.unixTrusted.end(),
+                                 static_cast<unsigned int>(uid)) != _config.unixTrusted.end();
+}
+
+Authenticator* Server::getAuthenticator() {
+    return _authenticator;
+}
+
+Server::SaslSession* Server::findSaslSession(int clientFd) {
+    std::map<int, SaslSession>::iterator it = _saslSessions.find(clientFd);
+    return it == _saslSessions.end() ? NULL : &it->second;
+}
+
+Server::SaslSession& Server::startSaslSession(int clientFd, const std::string& mechanism) {
+    SaslSession& session = _saslSessions[clientFd];
+    session.mechanism = mechanism;
+    session.payload.clear();
+    session.ticket = 0;
+    return session;
+}
+
+void Server::endSaslSession(int clientFd) {
+    std::map<int, SaslSession>::iterator it = _saslSessions.find(clientFd);
+    if (it != _saslSessions.end()) {
+        std::fill(it->second.payload.begin(), it->second.payload.end(), '\0');
+        _saslSessions.erase(it);
+    }
+}
+
+Authenticator::Outcome Server::checkPassword(int clientFd, const std::string& account, const std::string& password) {
+    SaslSession& session = _saslSessions[clientFd];
+    session.ticket = _nextAuthTicket++;
+    return _authenticator->check(clientFd, session.ticket, account, password);
+}
+
+// Frees the removed clients no fan-out job can reach any more, or all of them
+void Server::_buryClients(bool all) {
+    while (!_graveyard.empty() && (all || _fanoutPool->isRetired(_graveyard.front().first))) {
+        Client* client = _graveyard.front().second;
+        _graveyard.pop_front();
+        close(client->getFd());
+        delete client;
+    }
+}
+
+void Server::_handleWakeup() {
+    std::vector<int> blocked;
+    bool complete = _fanoutPool->takeBlockedFds(blocked);
+    _buryClients(false);    // After takeBlockedFds() cleared the wakeup, so a later retirement wakes us again
+    if (!complete) {
+        LOG_WARNING("Fan-out mailbox overflowed, scanning every queue for blocked clients");
+        for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+            if (!it->second->isRemote() && !it->second->getOutbound().empty()) {
+                _pendingWrites.insert(it->first);
+            }
+        }
+    }
+    for (std::vector<int>::iterator it = blocked.begin(); it != blocked.end(); ++it) {
+        if (getClientByFd(*it)) {
+            _pendingWrites.insert(*it);
+        }
+    }
 }
 
 
 
 //enhanced version: added Logger
 void Server::_acceptNewConnection() {
+    TraceSpan span("accept");
 
     struct sockaddr_in clientAddr;
     socklen_t clientAddrLen = sizeof(clientAddr);
     int clientSocket = accept(_serverSocket, (struct sockaddr*)&clientAddr, &clientAddrLen);
     if (clientSocket == -1) {
-        Logger::error("Failed to accept new connection: " + std::string(strerror(errno)));
+        LOG_ERROR("Failed to accept new connection: " + std::string(strerror(errno)));
+        return;
+    }
+
+    // Before anything is allocated for the connection
+    unsigned int address = ntohl(clientAddr.sin_addr.s_addr);
+    if (_connectionLimiter && !_admitConnection(clientSocket, address)) {
         return;
     }
 
     std::string clientIP = _getIPAddress(clientAddr);
     if (clientIP == "Unknown") {
+        _releaseAddress(address);
         close(clientSocket);
         return;
     }
 
     if (fcntl(clientSocket, F_SETFL, O_NONBLOCK) == -1) {
-        Logger::error("Failed to set client socket to non-blocking mode: " + std::string(strerror(errno)));
+        LOG_ERROR("Failed to set client socket to non-blocking mode: " + std::string(strerror(errno)));
+        _releaseAddress(address);
+        close(clientSocket);
+        return;
+    }
+
+    Client* client = addClient(clientSocket, clientIP);
+    if (_connectionLimiter) {
+        client->setCountedAddress(address);
+    }
+    if (_capture) {
+        _capture->connectionOpened(clientSocket, clientIP);
+    }
+    _metrics.accepts.add();
+    LOG_EVENT(Logger::INFO, "New client connected from {}", << clientIP);
+}
+
+// The connection limits do not apply: every peer has the same address
+void Server::_acceptUnixConnection() {
+    TraceSpan span("accept");
+
+    int clientSocket = accept(_unixSocket, NULL, NULL);
+    if (clientSocket == -1) {
+        LOG_ERROR("Failed to accept new local connection: " + std::string(strerror(errno)));
+        return;
+    }
+    if (fcntl(clientSocket, F_SETFL, O_NONBLOCK) == -1) {
+        LOG_ERROR("Failed to set client socket to non-blocking mode: " + std::string(strerror(errno)));
         close(clientSocket);
         return;
     }
 
+    Client* client = addClient(clientSocket, "localhost");
+    client->setPeerUid(peerUid(clientSocket));
+    if (isTrustedPeer(client)) {
+        client->setPassword(true);
+    }
+    if (_capture) {
+        _capture->connectionOpened(clientSocket, "localhost");
+    }
+    _metrics.accepts.add();
+    _metrics.unixAccepts.add();
+    LOG_EVENT(Logger::INFO, "New local client connected (uid {}{})",
+              << client->getPeerUid() << (client->isPasswordSet() ? ", trusted" : ""));
+}
+
+// Closes the socket with an ERROR line and returns false if the limits refuse it
+bool Server::_admitConnection(int clientSocket, unsigned int address) {
+    ConnectionLimiter::Verdict verdict = _connectionLimiter->admit(address, std::time(NULL));
+    if (verdict == ConnectionLimiter::ADMITTED) {
+        return true;
+    }
+    Metrics::RejectReason reason;
+    const char* error;
+    if (verdict == ConnectionLimiter::TOO_MANY_FROM_ADDRESS) {
+        reason = Metrics::REJECT_ADDRESS_LIMIT;
+        error = "ERROR :Closing link: too many connections from your address\r\n";
+    } else if (verdict == ConnectionLimiter::TOO_MANY_FROM_NETWORK) {
+        reason = Metrics::REJECT_NETWORK_LIMIT;
+        error = "ERROR :Closing link: too many connections from your network\r\n";
+    } else {
+        reason = Metrics::REJECT_CONNECT_RATE;
+        error = "ERROR :Closing link: connecting too fast\r\n";
+    }
+    // Best effort: the socket is still blocking, and a full buffer is not worth waiting for
+    ssize_t ignored = send(clientSocket, error, std::strlen(error), MSG_DONTWAIT | MSG_NOSIGNAL);
+    (void)ignored;
+    close(clientSocket);
+    _metrics.rejects[reason].add();
+    LOG_EVENT(Logger::DEBUG, "Refused connection from {}.{}.{}.{} ({})",
+              << (address >> 24) << ((address >> 16) & 0xff) << ((address >> 8) & 0xff) << (address & 0xff)
+              << Metrics::rejectReasonName(reason));
+    return false;
+}
+
+void Server::_releaseAddress(unsigned int address) {
+    if (_connectionLimiter && address != 0) {
+        _connectionLimiter->release(address, std::time(NULL));
+    }
+}
+
+void Server::_setupConnectionLimits() {
+    if (_config.ipConnections == 0 && _config.ipConnectRate == 0 && _config.netConnections == 0) {
+        return;
+    }
+    _connectionLimiter = new ConnectionLimiter(_config.ipConnections, _config.netConnections,
+                                               static_cast<unsigned int>(_config.netPrefix), _config.ipConnectRate);
+    for (std::vector<std::string>::const_iterator it = _config.connectionExempt.begin();
+         it != _config.connectionExempt.end(); ++it) {
+        unsigned int prefix;
+        unsigned int length;
+        if (ConnectionLimiter::parseNetwork(*it, prefix, length)) {
+            _connectionLimiter->addExemption(prefix, length);
+        }
+    }
+    LOG_EVENT(Logger::INFO, "Connection limits: {} per address, {} per /{} network, {} connects per minute, {} exemptions",
+              << _config.ipConnections << _config.netConnections << _config.netPrefix << _config.ipConnectRate
+              << _config.connectionExempt.size());
+}
+
+// Registers an already connected, non-blocking socket as a new client
+Client* Server::addClient(int clientFd, const std::string& hostname) {
     // Add new client to our data structures
-    Client* newClient = new Client(clientSocket);
-    newClient->setHostname(clientIP);
-    _clients[clientSocket] = newClient;
+    Client* newClient = new Client(clientFd);
+    newClient->setHostname(hostname);
+    newClient->getOutbound().setLimit(_config.maxSendq);
+    _clients[clientFd] = newClient;
+    _hosts.insert(std::make_pair(casefold(hostname), newClient));
+    _metrics.clients.add(1);
 
-    Logger::debug("New client created with fd: " + to_string(clientSocket) + 
-              ", password set: " + (newClient->isPasswordSet() ? "true" : "false"));
+    LOG_EVENT(Logger::DEBUG, "New client created with fd: {}, password set: {}",
+              << clientFd << (newClient->isPasswordSet() ? "true" : "false"));
               
-    pollfd clientPollFd = {clientSocket, POLLIN, 0};
+    pollfd clientPollFd = {clientFd, POLLIN, 0};
     _pollFds.push_back(clientPollFd);
-
-    Logger::info("New client connected from " + clientIP);
+    return newClient;
 }
 
 void Server::_handleClientMessage(int clientFd) {
-    char buffer[1024];
-    ssize_t bytesRead = recv(clientFd, buffer, sizeof(buffer) - 1, 0);
+    // Links read in large chunks: a burst arrives as tens of kilobytes at once
+    char buffer[16384];
+    Client* client = getClientByFd(clientFd);
+    size_t capacity = (client && client->getLinkState() != Client::LINK_NONE) ? sizeof(buffer) : 1024;
+    ssize_t bytesRead;
+    {
+        TraceSpan span("read", NULL, clientFd);
+        bytesRead = recv(clientFd, buffer, capacity - 1, 0);
+    }
     if (bytesRead <= 0) {
         if (bytesRead == 0) {
-            Logger::info("Client disconnected: " + to_string(clientFd));
+            LOG_EVENT(Logger::INFO, "Client disconnected: {}", << clientFd);
+            _removeClient(clientFd, Metrics::DISCONNECT_PEER_CLOSED);
         } else {
-            Logger::error("Error reading from client " + to_string(clientFd) + ": " + std::string(strerror(errno)));
+            LOG_ERROR("Error reading from client " + to_string(clientFd) + ": " + std::string(strerror(errno)));
+            _removeClient(clientFd, Metrics::DISCONNECT_READ_ERROR);
         }
-        _removeClient(clientFd);
         return;
     }
+    _metrics.bytesIn.add(bytesRead);
+    if (_capture) {
+        _capture->received(clientFd, buffer, bytesRead);
+    }
+    handleInput(clientFd, buffer, bytesRead);
+}
 
-    if (bytesRead > 0 && buffer[bytesRead - 1] == '\n'  && buffer[bytesRead - 2] != '\r') {
-        bytesRead--;
+// Runs every complete line in data, keeping the incomplete tail for the next read
+void Server::handleInput(int clientFd, const char* data, size_t length) {
+    std::map<int, LinkStream*>::iterator stream = _linkStreams.find(clientFd);
+    if (stream == _linkStreams.end()) {
+        // A link's handshake may be followed by compressed bytes in the same read
+        if (_clients[clientFd]->getLinkState() == Client::LINK_NONE
+            && length > 1 && data[length - 1] == '\n'  && data[length - 2] != '\r') {
+            length--;
+        }
+        _splitLines(clientFd, data, length);
+        return;
     }
 
+    std::string plain;
+    if (!stream->second->inflate(data, length, plain)) {
+        dropLink(getClientByFd(clientFd), "Corrupt compressed stream");
+        return;
+    }
+    _metrics.linkWireIn.add(length);
+    _metrics.linkPlainIn.add(plain.length());
+    _splitLines(clientFd, plain.data(), plain.length());
+}
 
-    _clients[clientFd]->appendToBuffer(std::string(buffer, bytesRead));
-    std::string& clientBuffer = _clients[clientFd]->getBuffer();
-    Logger::info("CLIENT BUFFER: " + clientBuffer);
+void Server::_splitLines(int clientFd, const char* data, size_t length) {
+    // Lines are split in a scratch string shared by all clients; only an
+    // incomplete tail is copied back into the client's pooled block
+    std::string& clientBuffer = _inputScratch;
+    clientBuffer.clear();
+    _clients[clientFd]->getInput().moveTo(clientBuffer);
+    clientBuffer.append(data, length);
+    LOG_EVENT(Logger::DEBUG, "CLIENT BUFFER: {}", << clientBuffer);
+    bool compressed = _linkStreams.count(clientFd) > 0;
 
+    size_t start = 0;
     size_t pos;
-    while ((pos = clientBuffer.find("\r\n")) != std::string::npos) {
-        std::string cmd = clientBuffer.substr(0, pos);
-        clientBuffer.erase(0, pos + 2); // Remove processed command and \r\n
+    while ((pos = clientBuffer.find("\r\n", start)) != std::string::npos) {
+        std::string cmd = clientBuffer.substr(start, pos - start);
+        start = pos + 2;
 
         // Check if the message (including \r\n) exceeds 512 bytes
         if (cmd.length() + 2 > 512) {
-            Logger::warning("Received message too long from client " + to_string(clientFd));
+            LOG_EVENT(Logger::WARNING, "Received message too long from client {}", << clientFd);
             sendToClient(clientFd, ":" + getServerName() + " " + getClientByFd(clientFd)->getFullClientIdentifier() + " :Input line was too long\r\n");
             continue;
         }
 
         if (!cmd.empty()) {
-            Logger::debug("Received command from client " + to_string(clientFd) + ": " + cmd);
-            Command parsedCmd = CommandParser::parse(cmd);
-            if (parsedCmd.isValid()) {
-                Logger::info("Parsed command: " + parsedCmd.toString());
-                _cmdExecutor->executeCommand(clientFd, parsedCmd);
-            } else {
-                Logger::warning("Invalid command received from client " + to_string(clientFd));
-                sendToClient(clientFd, ":" + getServerName() + " [421] " + getClientByFd(clientFd)->getFullClientIdentifier() + " " + parsedCmd.getCommand() + " :Unknown command\r\n");
+            processLine(clientFd, cmd);
+            if (!getClientByFd(clientFd)) {
+                return;   // QUIT, or a link that was dropped
+            }
+            if (!compressed && _linkStreams.count(clientFd)) {
+                // The link was just established: the peer compresses everything after its SERVER line
+                std::string rest = clientBuffer.substr(start);
+                handleInput(clientFd, rest.data(), rest.length());
+                return;
             }
         }
     }
+    clientBuffer.erase(0, start);
 
     // Check if the remaining buffer exceeds the maximum length
     if (clientBuffer.length() >= 510) { // 510 to allow for potential \r\n
-        Logger::warning("Client " + to_string(clientFd) + " buffer exceeds maximum length of 512 bytes.");
+        LOG_EVENT(Logger::WARNING, "Client {} buffer exceeds maximum length of 512 bytes.", << clientFd);
         sendToClient(clientFd, ":" + getServerName() + " 417 " + getClientByFd(clientFd)->getFullClientIdentifier() + " :Input line was too long\r\n");
         clientBuffer.clear();
     }
+    Client* client = getClientByFd(clientFd);
+    if (client) {
+        client->getInput().assign(clientBuffer);
+    }
+}
+
+// Parses and executes one complete line (without its \r\n) sent by a client
+void Server::processLine(int clientFd, const std::string& line) {
+    LOG_EVENT(Logger::DEBUG, "Received command from client {}: {}", << clientFd << line);
+    Command parsedCmd;
+    {
+        TraceSpan span("parse", NULL, clientFd);
+        parsedCmd = CommandParser::parse(line);
+    }
+    if (parsedCmd.isValid()) {
+        LOG_DEBUG("Parsed command: " + parsedCmd.toString());
+        int commandIndex = Metrics::commandIndex(parsedCmd.getCommand());
+        TraceSpan span("execute", Metrics::commandName(commandIndex), clientFd);
+        unsigned long start = Metrics::nowNs();
+        Client* client = getClientByFd(clientFd);
+        if (client && client->getLinkState() != Client::LINK_NONE) {
+            _linkExecutor->execute(client, parsedCmd, line);
+        } else {
+            _cmdExecutor->executeCommand(clientFd, parsedCmd);
+        }
+        _metrics.recordCommand(commandIndex, line.length() + 2, Metrics::nowNs() - start);
+    } else {
+        _metrics.invalidLines.add();
+        LOG_EVENT(Logger::WARNING, "Invalid command received from client {}", << clientFd);
+        sendToClient(clientFd, ":" + getServerName() + " [421] " + getClientByFd(clientFd)->getFullClientIdentifier() + " " + parsedCmd.getCommand() + " :Unknown command\r\n");
+    }
 }
 
 //enhanced version: added Logger
-void Server::_removeClient(int clientFd) {
-    Logger::info("Removing client: " + to_string(clientFd));
-    delete _clients[clientFd];
+void Server::_removeClient(int clientFd, Metrics::DisconnectReason reason, const std::string& quitMessage) {
+    LOG_EVENT(Logger::INFO, "Removing client: {}", << clientFd);
+    if (clientFd == _corkedFd) {
+        uncork();
+    }
+    _metrics.disconnects[reason].add();
+    _metrics.clients.add(-1);
+    if (_capture) {
+        _capture->connectionClosed(clientFd);
+    }
+    Client* client = _clients[clientFd];
+    if (client) {
+        _releaseAddress(client->getCountedAddress());
+    }
+    endSaslSession(clientFd);
+    std::map<int, LinkStream*>::iterator stream = _linkStreams.find(clientFd);
+    if (stream != _linkStreams.end()) {
+        LinkStream* closing = stream->second;
+        _linkStreams.erase(stream);
+        if (closing->hasPending() && client) {
+            std::string frames;
+            closing->deflate(frames);   // Usually the ERROR explaining the close
+            _writeToClient(client, frames);
+        }
+        delete closing;
+    }
+    if (client && client->getLinkState() == Client::LINK_ESTABLISHED) {
+        _splitLink(client);
+    } else if (client && client->getLinkState() == Client::LINK_NONE) {
+        std::string message = quitMessage;
+        if (message.empty()) {
+            message = (reason == Metrics::DISCONNECT_PEER_CLOSED) ? "Connection closed"
+                    : (reason == Metrics::DISCONNECT_READ_ERROR) ? "Read error" : "Write error";
+        }
+        _announceQuit(client, message, NULL);
+    }
+    if (client) {
+        clearMonitor(client);
+        _forgetNickname(client);
+        _forgetHost(client);
+    }
     _clients.erase(clientFd);
-    close(clientFd);
+    _pendingWrites.erase(clientFd);
+    _listings.erase(clientFd);
+    unsigned long ticket;
+    if (client && _fanoutPool && !_fanoutPool->retire(ticket)) {
+        // Keeps the fd number taken until the workers are done with it; the peer sees the close now
+        shutdown(clientFd, SHUT_RDWR);
+        _graveyard.push_back(std::make_pair(ticket, client));
+    } else {
+        delete client;
+        close(clientFd);
+    }
 
     // Remove from _pollFds
     for (std::vector<pollfd>::iterator it = _pollFds.begin(); it != _pollFds.end(); ++it) {
@@ -210,29 +1087,74 @@ void Server::_removeClient(int clientFd) {
     }
 }
 
+// Every local user; other servers learn through propagate()
 void Server::broadcast(const std::string& message, int senderFd) {
     for (std::map<int, Client*>::const_iterator it = _clients.begin(); it != _clients.end(); ++it) {
-        if (it->first != senderFd) {
+        if (it->first != senderFd && !it->second->isRemote() && it->second->getLinkState() == Client::LINK_NONE) {
             sendToClient(it->first, message);
         }
     }
 }
 
 void Server::sendToClient(int clientFd, const std::string& message) {
+    TraceSpan span("send", NULL, clientFd);
+    Client* client = getClientByFd(clientFd);
+    if (!client) {
+        LOG_ERROR("Cannot send to unknown client " + to_string(clientFd));
+        return;
+    }
+    if (client->isRemote()) {
+        client = client->getLink();
+        clientFd = client->getFd();
+    }
+    std::map<int, LinkStream*>::iterator stream = _linkStreams.find(clientFd);
+    if (stream != _linkStreams.end()) {
+        stream->second->queue(message);   // Compressed and written at the end of the tick
+        _metrics.linkPlainOut.add(message.length());
+        return;
+    }
+    if (clientFd == _corkedFd) {
+        _corked += message;
+        return;
+    }
+    _writeToClient(client, message);
+}
 
-    std::string formattedMessage = message;
+void Server::cork(int clientFd) {
+    _flushCorked();
+    _corkedFd = clientFd;
+}
 
-    if (formattedMessage.substr(formattedMessage.length() - 2) != "\r\n") {
-        formattedMessage += "\r\n";
+void Server::uncork() {
+    _flushCorked();
+    _corkedFd = -1;
+}
+
+// Writes what collected so far; the client stays corked
+void Server::_flushCorked() {
+    if (_corked.empty()) {
+        return;
     }
+    Client* client = getClientByFd(_corkedFd);
+    if (client) {
+        _writeToClient(client, _corked);
+    }
+    _corked.clear();
+}
 
-    ssize_t bytesSent = send(clientFd, message.c_str(), message.length(), 0);
-    if (bytesSent == -1) {
-        Logger::error("Failed to send message to client " + to_string(clientFd) + ": " + std::string(strerror(errno)));
-    } else if (static_cast<size_t>(bytesSent) < message.length()) {
-        Logger::warning("Incomplete message sent to client " + to_string(clientFd));
+void Server::_writeToClient(Client* client, const std::string& message) {
+    int clientFd = client->getFd();
+    _metrics.bytesOut.add(message.length());
+    long pending = client->getOutbound().write(clientFd, message);
+    if (pending == -1) {
+        LOG_ERROR("Failed to send message to client " + to_string(clientFd) + ": " + std::string(strerror(errno)));
+    } else if (pending == OutboundQueue::kOverflow) {
+        _sendqExceeded.insert(clientFd);
+    } else if (pending > 0) {
+        LOG_EVENT(Logger::WARNING, "Incomplete message sent to client {}, {} bytes queued", << clientFd << pending);
+        _pendingWrites.insert(clientFd);
     } else {
-        Logger::debug("Successfully sent " + to_string(bytesSent) + " bytes to client " + to_string(clientFd));
+        LOG_EVENT(Logger::DEBUG, "Successfully sent {} bytes to client {}", << message.length() << clientFd);
     }
 }
 
@@ -248,22 +1170,155 @@ std::string Server::getServerName() const {
     return _serverName;
 }
 
+HistoryStore* Server::getHistory() const {
+    return _history;
+}
+
 bool Server::isNicknameTaken(const std::string& nickname) const {
-    for (std::map<int, Client*>::const_iterator it = _clients.begin(); it != _clients.end(); ++it) {
-        if (it->second->getNickname() == nickname) {
-            return true;
+    return _nicknames.find(casefold(nickname)) != _nicknames.end();
+}
+
+Client* Server::getClientByNickname(const std::string& nickname) {
+    std::map<std::string, Client*>::iterator it = _nicknames.find(casefold(nickname));
+    return it != _nicknames.end() ? it->second : NULL;
+}
+
+void Server::setNickname(Client* client, const std::string& nickname) {
+    bool renamed = client->isRegistered() && casefold(client->getNickname()) != casefold(nickname);
+    if (renamed) {
+        _notifyWatchers(client, false);
+    }
+    _forgetNickname(client);
+    client->setNickname(nickname);
+    if (!nickname.empty()) {
+        _nicknames[casefold(nickname)] = client;
+    }
+    if (renamed) {
+        _notifyWatchers(client, true);
+    }
+}
+
+void Server::_forgetNickname(Client* client) {
+    std::map<std::string, Client*>::iterator it = _nicknames.find(casefold(client->getNickname()));
+    if (it != _nicknames.end() && it->second == client) {
+        _nicknames.erase(it);
+    }
+}
+
+void Server::_forgetHost(Client* client) {
+    typedef std::multimap<std::string, Client*>::iterator HostIterator;
+    std::pair<HostIterator, HostIterator> range = _hosts.equal_range(casefold(client->getHostname()));
+    for (HostIterator it = range.first; it != range.second; ++it) {
+        if (it->second == client) {
+            _hosts.erase(it);
+            return;
         }
     }
-    return false;
 }
 
-Client* Server::getClientByNickname(const std::string& nickname) {
-    for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
-        if (it->second->getNickname() == nickname) {
-            return it->second;
+// Everything up to the first wildcard
+static std::string literalPrefix(const std::string& mask) {
+    return mask.substr(0, mask.find_first_of("*?"));
+}
+
+// Appends the values of index whose key starts with prefix
+template <typename Index>
+static void collectPrefix(const Index& index, const std::string& prefix, std::vector<Client*>& out) {
+    for (typename Index::const_iterator it = index.lower_bound(prefix);
+         it != index.end() && it->first.compare(0, prefix.length(), prefix) == 0; ++it) {
+        out.push_back(it->second);
+    }
+}
+
+std::vector<Client*> Server::findUsers(const std::string& mask, bool operatorsOnly, size_t limit, bool& truncated) {
+    std::string folded = casefold(mask);
+    size_t separator = folded.find_first_of("!@");
+    bool full = separator != std::string::npos;
+    size_t at = folded.find('@');
+    std::string nickPrefix = literalPrefix(full ? folded.substr(0, separator) : folded);
+    std::string hostPrefix = full ? (at == std::string::npos ? "" : literalPrefix(folded.substr(at + 1))) : nickPrefix;
+
+    std::vector<Client*> candidates;
+    if (!nickPrefix.empty()) {
+        collectPrefix(_nicknames, nickPrefix, candidates);
+        if (!full) {
+            collectPrefix(_hosts, hostPrefix, candidates);
+        }
+    } else if (full && !hostPrefix.empty()) {
+        collectPrefix(_hosts, hostPrefix, candidates);
+    } else {
+        candidates.reserve(_clients.size());
+        for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+            candidates.push_back(it->second);
         }
     }
-    return NULL;
+
+    std::vector<Client*> found;
+    std::set<Client*> seen;
+    truncated = false;
+    for (std::vector<Client*>::iterator it = candidates.begin(); it != candidates.end(); ++it) {
+        Client* client = *it;
+        if (!client->isRegistered() || client->getLinkState() != Client::LINK_NONE
+            || (operatorsOnly && !client->isOperator())) {
+            continue;
+        }
+        bool matches = full ? matchMask(mask, client->getFullClientIdentifier())
+                            : matchMask(mask, client->getNickname()) || matchMask(mask, client->getHostname());
+        if (!matches || !seen.insert(client).second) {
+            continue;
+        }
+        if (limit && found.size() == limit) {
+            truncated = true;
+            break;
+        }
+        found.push_back(client);
+    }
+    return found;
+}
+
+// RPL_MONONLINE (730) with the full identifier, or RPL_MONOFFLINE (731) with the nickname
+void Server::_notifyWatchers(Client* client, bool online) {
+    std::map<std::string, std::set<Client*> >::iterator it = _watchers.find(casefold(client->getNickname()));
+    if (it == _watchers.end()) {
+        return;
+    }
+    std::string tail = (online ? " :" + client->getFullClientIdentifier() : " :" + client->getNickname()) + "\r\n";
+    std::string head = ":" + _serverName + (online ? " 730 " : " 731 ");
+    for (std::set<Client*>::iterator watcher = it->second.begin(); watcher != it->second.end(); ++watcher) {
+        if (*watcher != client) {
+            sendToClient((*watcher)->getFd(), head + (*watcher)->getNickname() + tail);
+        }
+    }
+}
+
+bool Server::monitor(Client* watcher, const std::string& nickname) {
+    std::string folded = casefold(nickname);
+    if (!watcher->addMonitored(folded)) {
+        return false;
+    }
+    _watchers[folded].insert(watcher);
+    return true;
+}
+
+void Server::unmonitor(Client* watcher, const std::string& nickname) {
+    std::string folded = casefold(nickname);
+    if (!watcher->removeMonitored(folded)) {
+        return;
+    }
+    std::map<std::string, std::set<Client*> >::iterator it = _watchers.find(folded);
+    if (it != _watchers.end()) {
+        it->second.erase(watcher);
+        if (it->second.empty()) {
+            _watchers.erase(it);
+        }
+    }
+}
+
+void Server::clearMonitor(Client* watcher) {
+    std::set<std::string> monitored = watcher->getMonitored();
+    for (std::set<std::string>::iterator it = monitored.begin(); it != monitored.end(); ++it) {
+        unmonitor(watcher, *it);
+    }
 }
 
 Client* Server::getClientByFd(int fd) {
@@ -277,7 +1332,7 @@ Client* Server::getClientByFd(int fd) {
 std::string Server::_getIPAddress(const struct sockaddr_in& clientAddr) const {
     char ipStr[INET_ADDRSTRLEN];
     if (inet_ntop(AF_INET, &(clientAddr.sin_addr), ipStr, INET_ADDRSTRLEN) == NULL) {
-        Logger::error("Failed to convert IP address to string: " + std::string(strerror(errno)));
+        LOG_ERROR("Failed to convert IP address to string: " + std::string(strerror(errno)));
         return "Unknown";
     }
     return std::string(ipStr);
@@ -317,6 +1372,7 @@ Channel* Server::getOrCreateChannel(const std::string& channelName, int clientFd
         newChannel = new Channel(channelName);
     }
     _channels[newChannel->getName()] = newChannel;
+    newChannel->setIndex(&_channelIndex);
     return newChannel;
 }
 
@@ -329,16 +1385,80 @@ Channel* Server::getChannel(const std::string& channelName) {
     return NULL;
 }
 
-void Server::broadcastToChannel(const std::string& channelName, const std::string& message, Client* excludeClient) {
+/*
+Local members get the message directly. Members on other servers are reached
+by one copy per link that has any of them behind it, except the link the
+excluded client (the sender) came from. localOnly skips the links: used for
+membership and mode changes, which every server gets through propagate().
+*/
+void Server::broadcastToChannel(const std::string& channelName, const std::string& message, Client* excludeClient,
+                                bool localOnly, std::set<Client*>* delivered) {
     Channel* channel = getChannel(channelName);
     if (channel) {
-        std::vector<Client*> members = channel->getMembers();
+        std::vector<Client*> members;
+        if (delivered) {
+            // Remote members stay: their link is reached once per channel regardless
+            const std::vector<Client*>& all = channel->getMembers();
+            members.reserve(all.size());
+            for (std::vector<Client*>::const_iterator it = all.begin(); it != all.end(); ++it) {
+                if ((*it)->isRemote() || delivered->insert(*it).second) {
+                    members.push_back(*it);
+                }
+            }
+        } else {
+            members = channel->getMembers();
+        }
+        TraceSpan span("broadcast", NULL, static_cast<long>(members.size()));
+        std::vector<Client*> links;
+        if (!_links.empty()) {
+            for (std::vector<Client*>::iterator it = members.begin(); it != members.end(); ++it) {
+                Client* link = (*it)->getLink();
+                if (link && !localOnly && (!excludeClient || link != excludeClient->getLink())
+                    && std::find(links.begin(), links.end(), link) == links.end()) {
+                    links.push_back(link);
+                }
+            }
+            for (std::vector<Client*>::iterator it = links.begin(); it != links.end(); ++it) {
+                sendToClient((*it)->getFd(), message);
+            }
+        }
+        if (_fanoutPool && members.size() >= _config.fanoutThreshold) {
+            _fanOut(message, members, excludeClient);
+            return;
+        }
+        size_t recipients = 0;
         for (std::vector<Client*>::iterator it = members.begin(); it != members.end(); ++it) {
-            if (*it != excludeClient) {
+            if (*it != excludeClient && !(*it)->isRemote()) {
                 sendToClient((*it)->getFd(), message);
+                ++recipients;
             }
         }
+        _metrics.fanoutRecipients.record(recipients);
+    }
+}
+
+// Queues one shared copy of the message for every recipient, in order, then lets
+// the workers do the send() calls. Replies sent afterwards queue behind it.
+void Server::_fanOut(const std::string& message, const std::vector<Client*>& members, Client* excludeClient) {
+    _flushCorked();     // The corked client may be a recipient: what it was sent before goes first
+    SharedMessage* shared = SharedMessage::create(message);
+    std::vector<Client*> recipients;
+    recipients.reserve(members.size());
+    for (std::vector<Client*>::const_iterator it = members.begin(); it != members.end(); ++it) {
+        if (*it == excludeClient || (*it)->isRemote()) {
+            continue;
+        }
+        if ((*it)->getOutbound().push(shared) == OutboundQueue::kOverflow) {
+            _sendqExceeded.insert((*it)->getFd());
+        } else {
+            recipients.push_back(*it);
+        }
     }
+    shared->release();
+    _metrics.bytesOut.add(message.length() * recipients.size());
+    _metrics.fanoutRecipients.record(recipients.size());
+    _fanoutPool->submit(recipients);
+    LOG_EVENT(Logger::DEBUG, "Handed broadcast to {} recipients to the fan-out workers", << recipients.size());
 }
 
 bool Server::canJoinMoreChannels(const Client* client) const {
@@ -357,13 +1477,28 @@ Server::Server(const Server& other)
       _clients(other._clients),
       _pollFds(other._pollFds),
       _cmdExecutor(NULL),
-      _maxChannelsPerClient(other._maxChannelsPerClient)
-      
-  
+      _maxChannelsPerClient(other._maxChannelsPerClient),
+      _config(other._config),
+      _fanoutPool(NULL),
+      _history(NULL),
+      _pendingWrites(),
+      _sendqExceeded(),
+      _metricsSocket(-1),
+      _metricsConnections(),
+      _capture(NULL),
+      _linkExecutor(NULL),
+      _links(),
+      _remoteServers(),
+      _nextRemoteId(-2),
+      _nextSnapshot(0),
+      _corkedFd(-1)
 {
     if (other._cmdExecutor) {
         _cmdExecutor = new CommandExecutor(*this);
     }
+    if (other._linkExecutor) {
+        _linkExecutor = new LinkExecutor(*this);
+    }
 }
 
 Server& Server::operator=(const Server& other)
@@ -373,6 +1508,7 @@ Server& Server::operator=(const Server& other)
         _password = other._password;
         _serverName = other._serverName;
         _maxChannelsPerClient = other._maxChannelsPerClient;
+        _config = other._config;
         _serverSocket = other._serverSocket;
         _pollFds = other._pollFds;
         _clients = other._clients;
@@ -397,4 +1533,352 @@ std::string Server::generateUniqueId() const {
     }
     
     return uniqueId;
-}
\ No newline at end of file
+}
+const ServerConfig& Server::getConfig() const {
+    return _config;
+}
+
+Metrics& Server::getMetrics() {
+    return _metrics;
+}
+
+// Refreshes the gauges that are cheaper to compute on demand than to maintain
+void Server::sampleMetrics() {
+    long queued = 0;
+    long largest = 0;
+    long pendingClients = 0;
+    for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+        long bytes = static_cast<long>(it->second->getOutbound().getPendingBytes());
+        if (bytes > 0) {
+            ++pendingClients;
+            queued += bytes;
+            if (bytes > largest) {
+                largest = bytes;
+            }
+        }
+    }
+    _metrics.channels.set(static_cast<long>(_channels.size()));
+    _metrics.pendingWriteClients.set(pendingClients);
+    _metrics.queuedOutputBytes.set(queued);
+    _metrics.maxClientQueueBytes.set(largest);
+    _metrics.inputBuffers.set(static_cast<long>(InputBuffer::getBorrowedBlocks()));
+    _metrics.limiterNodes.set(_connectionLimiter ? static_cast<long>(_connectionLimiter->getNodeCount()) : 0);
+}
+
+void Server::_acceptMetricsConnection() {
+    int fd = accept(_metricsSocket, NULL, NULL);
+    if (fd == -1) {
+        LOG_ERROR("Failed to accept metrics connection: " + std::string(strerror(errno)));
+        return;
+    }
+    if (fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
+        close(fd);
+        return;
+    }
+    _metricsConnections.insert(fd);
+    pollfd metricsPollFd = {fd, POLLIN, 0};
+    _pollFds.push_back(metricsPollFd);
+}
+
+// Any request gets the full exposition; the connection is closed right after
+void Server::_serveMetrics(int fd) {
+    char request[1024];
+    ssize_t bytesRead = recv(fd, request, sizeof(request), 0);
+    if (bytesRead > 0) {
+        sampleMetrics();
+        std::string body = _metrics.renderPrometheus();
+        std::string response = "HTTP/1.0 200 OK\r\n"
+                               "Content-Type: text/plain; version=0.0.4\r\n"
+                               "Content-Length: " + to_string(body.length()) + "\r\n"
+                               "Connection: close\r\n\r\n" + body;
+        size_t sent = 0;
+        while (sent < response.length()) {
+            ssize_t n = send(fd, response.data() + sent, response.length() - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                LOG_WARNING("Metrics response truncated: " + std::string(strerror(errno)));
+                break;
+            }
+            sent += n;
+        }
+    }
+    _closeMetricsConnection(fd);
+}
+
+void Server::_closeMetricsConnection(int fd) {
+    _metricsConnections.erase(fd);
+    close(fd);
+    for (std::vector<pollfd>::iterator it = _pollFds.begin(); it != _pollFds.end(); ++it) {
+        if (it->fd == fd) {
+            _pollFds.erase(it);
+            break;
+        }
+    }
+}
+
+// Only for channels that arrive from another server: no creator, no operator
+Channel* Server::createChannel(const std::string& channelName) {
+    Channel* channel = new Channel(channelName);
+    _channels[channelName] = channel;
+    channel->setIndex(&_channelIndex);
+    return channel;
+}
+
+void Server::listChannels(int clientFd, const ChannelIndex::Filter& filter) {
+    Listing& listing = _listings[clientFd];
+    listing.filter = filter;
+    listing.next = filter.first();
+    _continueListing(clientFd);
+}
+
+/*
+One batch of a LIST: 322 lines until kListBatchBytes are queued or
+kListScanLimit channels were looked at, whichever comes first, so neither
+a long answer nor a filter few channels pass holds up the loop. Nothing is
+sent while earlier output still waits in the client's queue; POLLOUT
+brings us back here once it drained.
+*/
+void Server::_continueListing(int clientFd) {
+    std::map<int, Listing>::iterator listing = _listings.find(clientFd);
+    Client* client = getClientByFd(clientFd);
+    if (listing == _listings.end() || !client) {
+        return;
+    }
+    _pendingWrites.insert(clientFd);
+    if (!client->getOutbound().empty()) {
+        return;
+    }
+    const ChannelIndex::Filter& filter = listing->second.filter;
+    std::string head = ":" + _serverName + " 322 " + client->getNickname() + " ";
+    std::string batch;
+    time_t now = std::time(NULL);
+    ChannelIndex::const_iterator it = _channelIndex.lowerBound(listing->second.next);
+    ChannelIndex::const_iterator stop = _channelIndex.stop(filter);
+    for (size_t scanned = 0; it != stop && scanned < kListScanLimit && batch.length() < kListBatchBytes;
+         ++it, ++scanned) {
+        const Channel& channel = *it->second;
+        if (filter.matches(channel, now)) {
+            batch += head + channel.getName() + " " + to_string(channel.getMemberCount()) + " :" + channel.getTopic()
+                     + "\r\n";
+        }
+    }
+    if (it == stop) {
+        batch += ":" + _serverName + " 323 " + client->getNickname() + " :End of /LIST\r\n";
+        _listings.erase(listing);
+        _pendingWrites.erase(clientFd);
+    } else {
+        listing->second.next = it->first;
+    }
+    if (!batch.empty()) {
+        sendToClient(clientFd, batch);
+    }
+}
+
+const ChannelIndex& Server::getChannelIndex() const {
+    return _channelIndex;
+}
+
+void Server::removeChannelIfEmpty(const std::string& channelName) {
+    std::map<std::string, Channel*>::iterator it = _channels.find(channelName);
+    if (it != _channels.end() && it->second->getMembers().empty()) {
+        if (_history) {
+            _history->drop(it->first);     // Whoever creates the name next gets ops, past any +k or +i
+        }
+        delete it->second;
+        _channels.erase(it);
+    }
+}
+
+// QUIT from a local user: ERROR to them, QUIT to everyone sharing a channel
+void Server::quitClient(int clientFd, const std::string& message) {
+    Client* client = getClientByFd(clientFd);
+    if (!client) {
+        return;
+    }
+    sendToClient(clientFd, "ERROR :Closing link: " + client->getHostname() + " (Quit: " + message + ")\r\n");
+    _removeClient(clientFd, Metrics::DISCONNECT_QUIT, "Quit: " + message);
+}
+
+void Server::closeClient(int clientFd, Metrics::DisconnectReason reason, const std::string& message) {
+    Client* client = getClientByFd(clientFd);
+    if (!client) {
+        return;
+    }
+    sendToClient(clientFd, "ERROR :Closing link: " + client->getHostname() + " (" + message + ")\r\n");
+    _removeClient(clientFd, reason, message);
+}
+
+/*
+Tells the local users sharing a channel with client that it is gone, once
+each, and the other servers unless the QUIT came from them. The client
+leaves all its channels; the ones left empty are deleted.
+*/
+void Server::_announceQuit(Client* client, const std::string& message, Client* originLink) {
+    std::string quitMessage = ":" + client->getFullClientIdentifier() + " QUIT :" + message + "\r\n";
+    std::set<Client*> notified;
+    std::vector<std::string> channels = client->getChannels();
+    for (std::vector<std::string>::iterator it = channels.begin(); it != channels.end(); ++it) {
+        Channel* channel = getChannel(*it);
+        if (!channel) {
+            continue;
+        }
+        std::vector<Client*> members = channel->getMembers();
+        for (std::vector<Client*>::iterator member = members.begin(); member != members.end(); ++member) {
+            if (*member != client && !(*member)->isRemote() && notified.insert(*member).second) {
+                sendToClient((*member)->getFd(), quitMessage);
+            }
+        }
+        channel->removeMember(client);
+        removeChannelIfEmpty(*it);
+    }
+    if (client->isRegistered()) {
+        propagate(quitMessage, originLink);
+        _notifyWatchers(client, false);
+    }
+}
+
+LinkExecutor* Server::getLinkExecutor() {
+    return _linkExecutor;
+}
+
+const std::map<int, Client*>& Server::getClients() const {
+    return _clients;
+}
+
+const std::map<std::string, Channel*>& Server::getChannels() const {
+    return _channels;
+}
+
+const std::map<std::string, Server::RemoteServer>& Server::getRemoteServers() const {
+    return _remoteServers;
+}
+
+bool Server::isServerKnown(const std::string& name) const {
+    return name == _serverName || _remoteServers.count(name) > 0;
+}
+
+// The handshake on link is complete: the peer is one hop away
+void Server::registerLink(Client* link, const std::string& name, const std::string& info) {
+    link->setLinkState(Client::LINK_ESTABLISHED);
+    link->getOutbound().setLimit(0);     // A burst may be large; a stuck link is noticed by its peer
+    link->setServerName(name);
+    _links.push_back(link);
+    addRemoteServer(name, link, 1, info);
+    if (_config.linkCompression && link->isLinkCompressionOffered()) {
+        _linkStreams[link->getFd()] = new LinkStream();
+        LOG_EVENT(Logger::INFO, "Link with {} is compressed", << name);
+    }
+}
+
+// One batch of frames per link and tick, however many lines were queued
+void Server::_flushLinkStreams() {
+    if (_linkStreams.empty()) {
+        return;
+    }
+    std::string frames;
+    for (std::map<int, LinkStream*>::iterator it = _linkStreams.begin(); it != _linkStreams.end(); ++it) {
+        Client* link = getClientByFd(it->first);
+        if (!link || !it->second->hasPending()) {
+            continue;
+        }
+        frames.clear();
+        it->second->deflate(frames);
+        _metrics.linkWireOut.add(frames.length());
+        _writeToClient(link, frames);
+    }
+}
+
+void Server::addRemoteServer(const std::string& name, Client* link, int hops, const std::string& info) {
+    RemoteServer server;
+    server.link = link;
+    server.hops = hops;
+    server.info = info;
+    _remoteServers[name] = server;
+}
+
+void Server::removeRemoteServer(const std::string& name) {
+    _remoteServers.erase(name);
+}
+
+// A user of another server; it has no socket, sendToClient() goes through link
+Client* Server::addRemoteClient(Client* link, const std::string& nickname, const std::string& username, const std::string& hostname,
+                                const std::string& serverName, int hops, const std::string& realname) {
+    Client* client = new Client(_nextRemoteId--);
+    setNickname(client, nickname);
+    client->setUsername(username);
+    client->setHostname(hostname);
+    client->setRealname(realname);
+    client->setPassword(true);
+    client->setUser(true);
+    client->setRemote(link, serverName, hops);
+    _clients[client->getFd()] = client;
+    _hosts.insert(std::make_pair(casefold(hostname), client));
+    _notifyWatchers(client, true);
+    LOG_EVENT(Logger::DEBUG, "Remote user {} on {} ({} hops)", << nickname << serverName << hops);
+    return client;
+}
+
+void Server::quitRemoteClient(Client* client, const std::string& message, Client* originLink) {
+    _announceQuit(client, message, originLink);
+    _forgetNickname(client);
+    _forgetHost(client);
+    _clients.erase(client->getFd());
+    delete client;
+}
+
+// Announces a user that just completed registration to the other servers
+void Server::introduceUser(Client* client) {
+    // A peer drops lines longer than 512 bytes, which would leave the user unknown there
+    std::string line = "NICK " + client->getNickname() + " 1 " + client->getUsername().substr(0, kMaxNickField) + " "
+                       + client->getHostname().substr(0, kMaxNickField) + " " + _serverName + " + :";
+    line += client->getRealname().substr(0, line.length() < kMaxNickLine ? kMaxNickLine - line.length() : 0);
+    propagate(line + "\r\n", NULL);
+    _notifyWatchers(client, true);
+}
+
+// Sends to every link except the one the message arrived on
+void Server::propagate(const std::string& message, Client* originLink) {
+    for (std::vector<Client*>::iterator it = _links.begin(); it != _links.end(); ++it) {
+        if (*it != originLink) {
+            sendToClient((*it)->getFd(), message);
+        }
+    }
+}
+
+// An empty reason closes without sending ERROR (the peer sent one)
+void Server::dropLink(Client* link, const std::string& reason) {
+    if (!reason.empty()) {
+        LOG_EVENT(Logger::WARNING, "Dropping link on fd {}: {}", << link->getFd() << reason);
+        sendToClient(link->getFd(), "ERROR :Closing link: " + reason + "\r\n");
+    }
+    _removeClient(link->getFd(), Metrics::DISCONNECT_LINK_ERROR);
+}
+
+/*
+Netsplit: every user behind the lost link quits with "<us> <peer>" as the
+reason, then the servers behind it are announced gone. The other servers get
+the QUITs before the SQUITs, so they do not need to work out who was where.
+*/
+void Server::_splitLink(Client* link) {
+    std::string reason = _serverName + " " + link->getServerName();
+    std::vector<Client*> users;
+    for (std::map<int, Client*>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+        if (it->second->getLink() == link) {
+            users.push_back(it->second);
+        }
+    }
+    for (std::vector<Client*>::iterator it = users.begin(); it != users.end(); ++it) {
+        quitRemoteClient(*it, reason, link);
+    }
+
+    std::map<std::string, RemoteServer>::iterator it = _remoteServers.begin();
+    while (it != _remoteServers.end()) {
+        if (it->second.link == link) {
+            propagate(":" + _serverName + " SQUIT " + it->first + " :" + reason + "\r\n", link);
+            _remoteServers.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    _links.erase(std::remove(_links.begin(), _links.end(), link), _links.end());
+    LOG_EVENT(Logger::WARNING, "Lost link to {}: {} users split off", << link->getServerName() << users.size());
+}
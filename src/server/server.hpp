@@ -17,65 +17,251 @@
 #include "../logger/logger.hpp"
 #include "./command/command.hpp"
 #include "./channel/channel.hpp"
+#include "./channel/channelIndex.hpp"
 #include "./command/commandParser.hpp"
 #include "./command/commandExecutor.hpp"
 #include "../utils/server_utils.hpp"
+#include "./serverConfig.hpp"
+#include "./fanout/fanoutPool.hpp"
+#include "./history/historyStore.hpp"
+#include "./metrics/metrics.hpp"
+#include "./capture/trafficCapture.hpp"
+#include "./link/linkExecutor.hpp"
+#include "./link/linkStream.hpp"
+#include "./snapshot/channelSnapshot.hpp"
+#include "./upgrade/liveUpgrade.hpp"
+#include "./limits/connectionLimiter.hpp"
+#include "./auth/authenticator.hpp"
+#include "../trace/tracer.hpp"
 #include <string>
 #include <map>
+#include <set>
+#include <deque>
 #include <vector>
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <sys/wait.h>
 
 class CommandExecutor;
 
 class Server {
+public:
+    // Another server of the network, as seen from here
+    struct RemoteServer {
+        Client* link;       // Our connection it is reached through
+        int hops;           // 1 for the server at the other end of the link
+        std::string info;
+    };
+
+    // A SASL exchange in progress on a connection
+    struct SaslSession {
+        std::string mechanism;
+        std::string payload;        // Base64 received so far, in chunks of up to 400 bytes
+        unsigned long ticket;       // Tags the Authenticator's answer; 0 until a check is queued
+    };
+
+    // A LIST still being sent: the conditions and the channel it goes on with
+    struct Listing {
+        ChannelIndex::Filter filter;
+        ChannelIndex::Position next;
+    };
+
 private:
     int _serverSocket;
     int _port;
     std::string _password;
     std::string _serverName;
     std::map<int, Client*> _clients;
+    std::map<std::string, Client*> _nicknames;    // Casefolded nickname to its holder, local or remote
+    std::map<std::string, std::set<Client*> > _watchers;   // Casefolded nickname to the clients that MONITOR it
+    std::multimap<std::string, Client*> _hosts;   // Casefolded hostname to the users on it, local or remote
     std::vector<pollfd> _pollFds;
     CommandExecutor* _cmdExecutor;
     std::map<std::string, Channel*> _channels;
+    ChannelIndex _channelIndex;    // The same channels by member count, for LIST
+    std::map<int, Listing> _listings;
     int _maxChannelsPerClient;
+    ServerConfig _config;
+    FanoutPool* _fanoutPool;
+    HistoryStore* _history;        // NULL unless --history-lines is set
+    std::set<int> _pendingWrites;  // Clients that need POLLOUT on the next poll()
+    std::set<int> _sendqExceeded;  // Clients over --max-sendq, dropped at the end of the tick
+    // Removed clients a fan-out job may still flush, with their FanoutPool::retire() ticket
+    std::deque<std::pair<unsigned long, Client*> > _graveyard;
+    Metrics _metrics;
+    int _metricsSocket;            // Local Prometheus listener, -1 unless --metrics-port is set
+    std::set<int> _metricsConnections;
+    TrafficCapture* _capture;      // NULL unless --capture-file is set
+    std::string _inputScratch;     // Working copy of the input being split into lines
+    LinkExecutor* _linkExecutor;
+    std::vector<Client*> _links;   // Established connections to other servers
+    std::map<std::string, RemoteServer> _remoteServers;
+    int _nextRemoteId;             // Users of other servers are keyed by negative ids in _clients
+    std::map<int, LinkStream*> _linkStreams;  // Links that negotiated compression, by fd
+    time_t _nextSnapshot;          // When run() saves the channels again, 0 if it does not
+    std::vector<std::string> _upgradeCommand;  // Binary and arguments UPGRADE starts (empty = refused)
+    int _upgradeRequester;         // Operator whose UPGRADE runs after this tick, -1 if none
+    ConnectionLimiter* _connectionLimiter;   // NULL unless a connection limit is set
+    Authenticator* _authenticator;  // NULL unless --accounts-file is set
+    std::map<int, SaslSession> _saslSessions;
+    unsigned long _nextAuthTicket;
+    int _unixSocket;               // Listener for --unix-socket, -1 if none
+    std::string _unixSocketPath;   // Removed at shutdown; cleared once UPGRADE handed the listener over
+    int _corkedFd;                 // Client whose replies collect in _corked, -1 if none
+    std::string _corked;
 
     void _acceptNewConnection();
+    void _acceptUnixConnection();
     void _handleClientMessage(int clientFd);
-    void _removeClient(int clientFd);
+    void _removeClient(int clientFd, Metrics::DisconnectReason reason, const std::string& quitMessage = "");
+    bool _flushClient(int clientFd);
+    void _refreshPollEvents();
+    void _handleWakeup();
+    void _buryClients(bool all);
+    void _dropSendqExceeded();
+    void _setupFanout();
+    void _setupMetricsListener();
+    void _endTick(unsigned long tickStart);
+    void _acceptMetricsConnection();
+    void _serveMetrics(int fd);
+    void _closeMetricsConnection(int fd);
+    void _fanOut(const std::string& message, const std::vector<Client*>& members, Client* excludeClient);
     std::string _getIPAddress(const struct sockaddr_in& clientAddr) const;
+    void _connectLinks();
+    void _announceQuit(Client* client, const std::string& message, Client* originLink);
+    void _splitLink(Client* link);
+    void _splitLines(int clientFd, const char* data, size_t length);
+    void _writeToClient(Client* client, const std::string& message);
+    void _flushCorked();
+    void _forgetNickname(Client* client);
+    void _forgetHost(Client* client);
+    void _notifyWatchers(Client* client, bool online);
+    void _continueListing(int clientFd);
+    void _flushLinkStreams();
+    void _loadSnapshot();
+    int _snapshotTimeoutMs() const;
+    void _setupListener();
+    void _setupUnixListener();
+    void _resumeUpgrade();
+    bool _performUpgrade();
+    void _setupConnectionLimits();
+    bool _admitConnection(int clientSocket, unsigned int address);
+    void _releaseAddress(unsigned int address);
+    void _setupAuthentication();
+    void _handleAuthResults();
     
 
 public:
-    Server(int port, const std::string& password);
+    Server(int port, const std::string& password, const ServerConfig& config = ServerConfig());
     ~Server();
     Server(const Server& other);
     Server& operator=(const Server& other);
 
+    // Returns after SIGTERM or SIGINT, once the snapshot is saved, or once
+    // an UPGRADE handed the clients to a new process
     void run();
+    static void installShutdownHandler();
+    bool saveSnapshot();
+    void setUpgradeCommand(const std::vector<std::string>& command);
+    bool requestUpgrade(int clientFd);
+    int runOnce(int timeoutMs);
+    Client* addClient(int clientFd, const std::string& hostname);
+    void handleInput(int clientFd, const char* data, size_t length);
+    void processLine(int clientFd, const std::string& line);
     void broadcast(const std::string& message, int senderFd = -1);
     void sendToClient(int clientFd, const std::string& message);
+    // Between the two, what is sent to the client is written in one piece by uncork()
+    void cork(int clientFd);
+    void uncork();
 
     // Getters
     int getPort() const;
     std::string getPassword() const;
     std::string getServerName() const;
+    HistoryStore* getHistory() const;
+    const ServerConfig& getConfig() const;
+    Metrics& getMetrics();
+    void sampleMetrics();
+    long dumpTrace();
     
     bool isNicknameTaken(const std::string& nickname) const;
     Client* getClientByNickname(const std::string& nickname);
+    // Renames the client in the nickname index; a registered user's watchers see 731 and 730
+    void setNickname(Client* client, const std::string& nickname);
+    // MONITOR lists: watchers get 730 when the nickname comes online and 731 when it goes
+    bool monitor(Client* watcher, const std::string& nickname);
+    void unmonitor(Client* watcher, const std::string& nickname);
+    void clearMonitor(Client* watcher);
+    /*
+    Registered users matching a WHO mask, only IRC operators if asked, at
+    most limit of them (0 = no limit); truncated tells whether more matched. A mask with '!' or '@'
+    matches nick!user@host, any other the nickname or the host. The literal
+    prefix before the first wildcard selects a range of the nickname or host
+    index, so only masks starting with a wildcard look at every user.
+    */
+    std::vector<Client*> findUsers(const std::string& mask, bool operatorsOnly, size_t limit, bool& truncated);
     Client* getClientByFd(int fd);
     Channel* getOrCreateChannel(const std::string& channelName, int clientFd);
     Channel* getChannel(const std::string& channelName);
-    void broadcastToChannel(const std::string& channelName, const std::string& message, Client* excludeClient = NULL);
+    /*
+    LIST: 322 for each channel filter lets through, largest first, then 323.
+    The replies go out a batch at a time, the next once the client's queue
+    drained, so a long list neither piles up in memory nor holds up the
+    loop. A LIST still being sent to the client is dropped.
+    */
+    void listChannels(int clientFd, const ChannelIndex::Filter& filter);
+    const ChannelIndex& getChannelIndex() const;
+    // With delivered, local members already in it are skipped and the others added
+    void broadcastToChannel(const std::string& channelName, const std::string& message, Client* excludeClient = NULL,
+                            bool localOnly = false, std::set<Client*>* delivered = NULL);
     bool canJoinMoreChannels(const Client* client) const;
     int getMaxChannelsPerClient() const;
     std::string generateUniqueId() const;
+    Channel* createChannel(const std::string& channelName);
+    void removeChannelIfEmpty(const std::string& channelName);
+    void quitClient(int clientFd, const std::string& message);
+    // Server-side disconnect: ERROR with the reason, then QUIT to the channels
+    void closeClient(int clientFd, Metrics::DisconnectReason reason, const std::string& message);
+
+    // Server links
+    LinkExecutor* getLinkExecutor();
+    const std::map<int, Client*>& getClients() const;
+    const std::map<std::string, Channel*>& getChannels() const;
+    const std::map<std::string, RemoteServer>& getRemoteServers() const;
+    bool isServerKnown(const std::string& name) const;
+    void registerLink(Client* link, const std::string& name, const std::string& info);
+    void addRemoteServer(const std::string& name, Client* link, int hops, const std::string& info);
+    void removeRemoteServer(const std::string& name);
+    Client* addRemoteClient(Client* link, const std::string& nickname, const std::string& username, const std::string& hostname,
+                            const std::string& serverName, int hops, const std::string& realname);
+    void quitRemoteClient(Client* client, const std::string& message, Client* originLink);
+    // A local user finished registering: tells the other servers and the user's watchers
+    void introduceUser(Client* client);
+    void propagate(const std::string& message, Client* originLink);
+    void dropLink(Client* link, const std::string& reason);
+
+    // SASL
+    Authenticator* getAuthenticator();
+    SaslSession* findSaslSession(int clientFd);
+    SaslSession& startSaslSession(int clientFd, const std::string& mechanism);
+    void endSaslSession(int clientFd);
+    // Queues or answers the check of a PLAIN password; a PENDING answer
+    // reaches CommandExecutor::finishSasl() on a later tick
+    Authenticator::Outcome checkPassword(int clientFd, const std::string& account, const std::string& password);
+    // Unix socket peers running as one of the --unix-trusted uids
+    bool isTrustedPeer(const Client* client) const;
 };
 
 #endif // SERVER_HPP
\ No newline at end of file
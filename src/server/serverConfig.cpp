@@ -0,0 +1,240 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   serverConfig.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/02 18:30:15 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/02 18:30:15 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "serverConfig.hpp"
+#include "./limits/connectionLimiter.hpp"
+#include <cstdlib>
+#include <cerrno>
+#include <sys/un.h>
+
+ServerConfig::ServerConfig()
+    : fanoutThreads(0),
+      fanoutThreshold(1024),
+      historyLines(0),
+      historyBytes(16384),
+      historyMemory(64 * 1024 * 1024),
+      logLevel("debug"),
+      logFile(),
+      logAsyncCapacity(0),
+      logBlockOnOverflow(false),
+      logBinary(),
+      metricsPort(0),
+      operPassword(),
+      traceSpans(0),
+      traceFile("ircserv-trace.json"),
+      tickBudgetUs(100000),
+      captureFile(),
+      serverName("ft_irc.com"),
+      linkPassword(),
+      links(),
+      linkCompression(true),
+      snapshotFile(),
+      snapshotInterval(300),
+      upgradeFd(-1),
+      ipConnections(0),
+      ipConnectRate(0),
+      netConnections(0),
+      netPrefix(24),
+      connectionExempt(),
+      accountsFile(),
+      authThreads(2),
+      authCacheEntries(4096),
+      unixSocket(),
+      unixTrusted(),
+      monitorLimit(100),
+      whoLimit(500),
+      maxSendq(1024 * 1024)
+{
+}
+
+static bool parseSize(const std::string& value, size_t& out) {
+    if (value.empty() || value[0] == '-') {
+        return false;
+    }
+    char* end = NULL;
+    errno = 0;
+    unsigned long parsed = std::strtoul(value.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0') {
+        return false;
+    }
+    out = static_cast<size_t>(parsed);
+    return true;
+}
+
+bool ServerConfig::parseOption(const std::string& arg) {
+    if (arg.compare(0, 2, "--") != 0) {
+        return false;
+    }
+    size_t eq = arg.find('=');
+    if (eq == std::string::npos) {
+        return false;
+    }
+    std::string name = arg.substr(2, eq - 2);
+    std::string value = arg.substr(eq + 1);
+
+    if (name == "fanout-threads") {
+        return parseSize(value, fanoutThreads);
+    } else if (name == "fanout-threshold") {
+        return parseSize(value, fanoutThreshold) && fanoutThreshold > 0;
+    } else if (name == "history-lines") {
+        return parseSize(value, historyLines);
+    } else if (name == "history-bytes") {
+        return parseSize(value, historyBytes) && historyBytes >= 512;
+    } else if (name == "history-memory") {
+        return parseSize(value, historyMemory);
+    } else if (name == "log-level") {
+        logLevel = value;
+        return value == "debug" || value == "info" || value == "warning" || value == "error";
+    } else if (name == "log-file") {
+        logFile = value;
+        return !value.empty();
+    } else if (name == "log-async") {
+        return parseSize(value, logAsyncCapacity);
+    } else if (name == "log-overflow") {
+        logBlockOnOverflow = (value == "block");
+        return value == "block" || value == "drop";
+    } else if (name == "log-binary") {
+        logBinary = value;
+        return !value.empty();
+    } else if (name == "metrics-port") {
+        size_t port;
+        if (!parseSize(value, port) || port > 65535) {
+            return false;
+        }
+        metricsPort = static_cast<int>(port);
+        return true;
+    } else if (name == "oper-password") {
+        operPassword = value;
+        return !value.empty();
+    } else if (name == "trace-spans") {
+        return parseSize(value, traceSpans);
+    } else if (name == "trace-file") {
+        traceFile = value;
+        return !value.empty();
+    } else if (name == "tick-budget-us") {
+        return parseSize(value, tickBudgetUs);
+    } else if (name == "capture-file") {
+        captureFile = value;
+        return !value.empty();
+    } else if (name == "server-name") {
+        serverName = value;
+        return !value.empty() && value.find('.') != std::string::npos && value.find_first_of(" :!@,") == std::string::npos;
+    } else if (name == "link-password") {
+        linkPassword = value;
+        return !value.empty() && value.find(' ') == std::string::npos;
+    } else if (name == "link") {
+        size_t colon = value.rfind(':');
+        size_t port;
+        if (colon == std::string::npos || colon == 0 || !parseSize(value.substr(colon + 1), port)
+            || port == 0 || port > 65535) {
+            return false;
+        }
+        links.push_back(value);
+        return true;
+    } else if (name == "link-compression") {
+        linkCompression = (value == "on");
+        return value == "on" || value == "off";
+    } else if (name == "snapshot-file") {
+        snapshotFile = value;
+        return !value.empty();
+    } else if (name == "snapshot-interval") {
+        return parseSize(value, snapshotInterval);
+    } else if (name == "upgrade-fd") {
+        size_t fd;
+        if (!parseSize(value, fd) || fd < 3 || fd > 65535) {
+            return false;
+        }
+        upgradeFd = static_cast<int>(fd);
+        return true;
+    } else if (name == "ip-connections") {
+        return parseSize(value, ipConnections);
+    } else if (name == "ip-connect-rate") {
+        return parseSize(value, ipConnectRate);
+    } else if (name == "net-connections") {
+        return parseSize(value, netConnections);
+    } else if (name == "net-prefix") {
+        return parseSize(value, netPrefix) && netPrefix < 32;
+    } else if (name == "connection-exempt") {
+        unsigned int prefix;
+        unsigned int length;
+        if (!ConnectionLimiter::parseNetwork(value, prefix, length)) {
+            return false;
+        }
+        connectionExempt.push_back(value);
+        return true;
+    } else if (name == "accounts-file") {
+        accountsFile = value;
+        return !value.empty();
+    } else if (name == "auth-threads") {
+        return parseSize(value, authThreads) && authThreads > 0 && authThreads <= 64;
+    } else if (name == "auth-cache") {
+        return parseSize(value, authCacheEntries);
+    } else if (name == "unix-socket") {
+        struct sockaddr_un address;
+        unixSocket = value;
+        return !value.empty() && value.length() < sizeof(address.sun_path);
+    } else if (name == "unix-trusted") {
+        size_t uid;
+        if (!parseSize(value, uid) || uid >= 0xffffffffUL) {
+            return false;
+        }
+        unixTrusted.push_back(static_cast<unsigned int>(uid));
+        return true;
+    } else if (name == "monitor-limit") {
+        return parseSize(value, monitorLimit);
+    } else if (name == "max-sendq") {
+        return parseSize(value, maxSendq);
+    } else if (name == "who-limit") {
+        return parseSize(value, whoLimit);
+    }
+    return false;
+}
+
+std::string ServerConfig::usage() {
+    return "Options:\n"
+           "  --fanout-threads=<n>     worker threads for large channel broadcasts (default 0, disabled)\n"
+           "  --fanout-threshold=<n>   member count above which broadcasts use the workers (default 1024)\n"
+           "  --history-lines=<n>      events kept per channel for CHATHISTORY (default 0, disabled)\n"
+           "  --history-bytes=<n>      payload bytes kept per channel history (default 16384)\n"
+           "  --history-memory=<n>     memory cap for all channel histories (default 67108864)\n"
+           "  --log-level=<level>      debug, info, warning or error (default debug)\n"
+           "  --log-file=<path>        also append log lines to this file\n"
+           "  --log-async=<n>          log through a background writer with an <n> record ring (default 0, synchronous)\n"
+           "  --log-overflow=<policy>  drop or block when the async ring is full (default drop)\n"
+           "  --log-binary=<path>      append binary records to <path> instead of text (read with ircserv-logdump)\n"
+           "  --metrics-port=<n>       serve Prometheus metrics on 127.0.0.1:<n> (default 0, disabled)\n"
+           "  --oper-password=<pw>     enable OPER with this password (needed for STATS x)\n"
+           "  --trace-spans=<n>        keep the last <n> trace spans per thread (default 0, disabled)\n"
+           "  --trace-file=<path>      file written on SIGUSR1 or TRACEDUMP (default ircserv-trace.json)\n"
+           "  --tick-budget-us=<n>     warn when a loop iteration takes longer (default 100000, 0 = never)\n"
+           "  --capture-file=<path>    record inbound client traffic for ircreplay (includes passwords)\n"
+           "  --server-name=<name>     name of this server, must contain a dot (default ft_irc.com)\n"
+           "  --link-password=<pw>     password exchanged with linked servers (default none, links disabled)\n"
+           "  --link=<host>:<port>     connect to another server at startup (repeatable)\n"
+           "  --link-compression=<on|off> compress links when the other server agrees (default on)\n"
+           "  --snapshot-file=<path>   save channels, topics and modes here, restore them at startup\n"
+           "  --snapshot-interval=<s>  seconds between snapshots (default 300, 0 = only at shutdown)\n"
+           "  --upgrade-fd=<n>         internal: added by UPGRADE when it starts the new process\n"
+           "  --ip-connections=<n>     open connections allowed per IPv4 address (default 0, unlimited)\n"
+           "  --ip-connect-rate=<n>    new connections allowed per address per minute (default 0, unlimited)\n"
+           "  --net-connections=<n>    open connections allowed per network (default 0, unlimited)\n"
+           "  --net-prefix=<bits>      prefix length of a network for --net-connections (default 24)\n"
+           "  --connection-exempt=<a.b.c.d[/bits]> address or network exempt from the limits (repeatable)\n"
+           "  --accounts-file=<path>   enable SASL PLAIN with the accounts in <path> (made with ircserv-passwd)\n"
+           "  --auth-threads=<n>       threads that check SASL passwords (default 2)\n"
+           "  --auth-cache=<n>         accounts whose last good password is cached (default 4096, 0 = none)\n"
+           "  --unix-socket=<path>     also accept clients on a Unix socket at <path> (default none)\n"
+           "  --unix-trusted=<uid>     Unix socket peers with this uid need no PASS (repeatable)\n"
+           "  --monitor-limit=<n>      nicknames a client may MONITOR (default 100, 0 = MONITOR disabled)\n"
+           "  --who-limit=<n>          users one WHO mask search returns (default 500, 0 = unlimited)\n"
+           "  --max-sendq=<bytes>      output queued per client before it is dropped (default 1048576, 0 = unlimited)\n";
+}
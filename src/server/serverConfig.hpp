@@ -0,0 +1,67 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   serverConfig.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/02 18:30:11 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/02 18:30:11 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef SERVERCONFIG_HPP
+#define SERVERCONFIG_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Optional tuning knobs, given as --name=value after <port> <password>.
+// Every feature they enable is off by default.
+struct ServerConfig {
+    size_t fanoutThreads;     // Worker threads for large channel broadcasts (0 = disabled)
+    size_t fanoutThreshold;   // Minimum member count before a broadcast is handed to the workers
+    size_t historyLines;      // Events kept per channel for CHATHISTORY (0 = disabled)
+    size_t historyBytes;      // Payload arena per channel history
+    size_t historyMemory;     // Cap on all channel histories together
+    std::string logLevel;     // debug, info, warning or error
+    std::string logFile;      // Also append log lines to this file
+    size_t logAsyncCapacity;  // Records in the async logger ring (0 = synchronous logging)
+    bool logBlockOnOverflow;  // Block producers instead of dropping when the ring is full
+    std::string logBinary;    // Write records in binary form to this file instead of text
+    int metricsPort;          // Prometheus endpoint on 127.0.0.1 (0 = disabled)
+    std::string operPassword; // Password for OPER (empty = OPER disabled)
+    size_t traceSpans;        // Spans kept per thread for the Chrome trace dump (0 = tracing off)
+    std::string traceFile;    // Where SIGUSR1 and TRACEDUMP write the trace
+    size_t tickBudgetUs;      // Warn when one loop iteration takes longer (0 = never)
+    std::string captureFile;  // Record inbound client traffic here for ircreplay
+    std::string serverName;   // Name in replies and on server links; unique per network
+    std::string linkPassword; // PASS expected from and sent to linked servers (empty = no links)
+    std::vector<std::string> links;   // host:port of servers to connect to at startup
+    bool linkCompression;     // Offer compressed links (PASS flag Z); used when both ends offer it
+    std::string snapshotFile; // Channel state saved here and loaded at startup (empty = disabled)
+    size_t snapshotInterval;  // Seconds between snapshots while running (0 = only at shutdown)
+    int upgradeFd;            // Set by UPGRADE: socket to receive the live state from (-1 = fresh start)
+    size_t ipConnections;     // Open connections per IPv4 address (0 = unlimited)
+    size_t ipConnectRate;     // New connections per address per minute (0 = unlimited)
+    size_t netConnections;    // Open connections per network of netPrefix bits (0 = unlimited)
+    size_t netPrefix;         // Prefix length grouping addresses into a network
+    std::vector<std::string> connectionExempt;   // Addresses or networks the limits do not apply to
+    std::string accountsFile; // Accounts for SASL PLAIN (empty = SASL disabled)
+    size_t authThreads;       // Threads running the password key derivation
+    size_t authCacheEntries;  // Accounts whose last successful login is cached (0 = no cache)
+    std::string unixSocket;   // Also accept clients on this Unix socket path (empty = TCP only)
+    std::vector<unsigned int> unixTrusted;   // Uids that connect through unixSocket without PASS
+    size_t monitorLimit;      // Nicknames per MONITOR list (0 = MONITOR disabled)
+    size_t whoLimit;          // Users one WHO mask search returns (0 = unlimited)
+    size_t maxSendq;          // Bytes queued for a client before it is disconnected (0 = unlimited)
+
+    ServerConfig();
+
+    // Returns false if the option is unknown or its value is malformed
+    bool parseOption(const std::string& arg);
+    static std::string usage();
+};
+
+#endif // SERVERCONFIG_HPP
@@ -0,0 +1,213 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   channelSnapshot.cpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/20 15:22:40 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/20 15:22:40 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "channelSnapshot.hpp"
+#include "../server.hpp"
+#include "../../utils/binaryCodec.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char kMagic[8] = { 'I', 'R', 'C', 'S', 'N', 'A', 'P', '\0' };
+static const size_t kHeaderSize = 8 + 4 + 4 + 8;
+static const unsigned char kFlagInviteOnly = 1;
+static const unsigned char kFlagTopicRestricted = 2;
+
+static unsigned int fnv1a(const unsigned char* data, size_t length) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static void encodeChannel(std::string& out, const Channel& channel) {
+    std::string record;
+    putStr16(record, channel.getName());
+    putStr16(record, channel.getTopic());
+    putStr16(record, channel.getKey());
+    putU8(record, (channel.isInviteOnly() ? kFlagInviteOnly : 0) | (channel.isTopicRestricted() ? kFlagTopicRestricted : 0));
+    putU32(record, static_cast<unsigned int>(channel.getUserLimit()));
+
+    // Operators still to be restored count as operators: they were not back yet
+    std::vector<std::string> operators = channel.getRestoredOperators();
+    std::vector<Client*> current = channel.getOperators();
+    for (std::vector<Client*>::const_iterator it = current.begin(); it != current.end(); ++it) {
+        std::string identity = Channel::restoredIdentity(*it);
+        if (!(*it)->isRemote() && !(*it)->getNickname().empty()
+            && std::find(operators.begin(), operators.end(), identity) == operators.end()) {
+            operators.push_back(identity);
+        }
+    }
+    size_t count = operators.size() < 0xffff ? operators.size() : 0xffff;
+    putU16(record, count);
+    for (size_t i = 0; i < count; ++i) {
+        putStr8(record, operators[i]);
+    }
+    putU64(record, static_cast<unsigned long long>(channel.getTopicTime()));
+    putU32(out, record.length());
+    out += record;
+}
+
+static bool writeAll(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.length()) {
+        ssize_t result = write(fd, data.data() + written, data.length() - written);
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += result;
+    }
+    return true;
+}
+
+bool ChannelSnapshot::save(const std::string& path, const std::map<std::string, Channel*>& channels, std::string& error) {
+    std::string out;
+    out.reserve(kHeaderSize + channels.size() * 64);
+    out.append(kMagic, sizeof(kMagic));
+    putU32(out, kVersion);
+    putU32(out, channels.size());
+    putU64(out, static_cast<unsigned long long>(std::time(NULL)));
+    for (std::map<std::string, Channel*>::const_iterator it = channels.begin(); it != channels.end(); ++it) {
+        encodeChannel(out, *it->second);
+    }
+    putU32(out, fnv1a(reinterpret_cast<const unsigned char*>(out.data()), out.length()));
+
+    std::string temporary = path + ".tmp";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        error = temporary + ": " + std::strerror(errno);
+        return false;
+    }
+    if (!writeAll(fd, out) || fsync(fd) == -1) {
+        error = temporary + ": " + std::strerror(errno);
+        close(fd);
+        unlink(temporary.c_str());
+        return false;
+    }
+    close(fd);
+    if (rename(temporary.c_str(), path.c_str()) == -1) {
+        error = path + ": " + std::strerror(errno);
+        unlink(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Parses the mapped snapshot; channels are only created once the checksum matched
+static long restore(const unsigned char* data, size_t length, Server& server, std::string& error) {
+    if (length < kHeaderSize + 4 || std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+        error = "not a channel snapshot";
+        return -1;
+    }
+    BinaryReader header(data, length - 4);
+    header.pos = sizeof(kMagic);
+    unsigned int version = header.u32();
+    unsigned int count = header.u32();
+    header.u64();
+    if (version != ChannelSnapshot::kVersion) {
+        error = "unsupported snapshot version " + to_string(version);
+        return -1;
+    }
+    BinaryReader trailer(data + length - 4, 4);
+    if (trailer.u32() != fnv1a(data, length - 4)) {
+        error = "checksum mismatch";
+        return -1;
+    }
+
+    long restored = 0;
+    for (unsigned int i = 0; i < count; ++i) {
+        size_t recordLength = header.u32();
+        if (!header.need(recordLength)) {
+            break;
+        }
+        BinaryReader record(data + header.pos, recordLength);
+        header.pos += recordLength;
+
+        std::string name = record.str16();
+        std::string topic = record.str16();
+        std::string key = record.str16();
+        unsigned int flags = record.u8();
+        int limit = static_cast<int>(record.u32());
+        unsigned int operatorCount = record.u16();
+        std::vector<std::string> operators;
+        for (unsigned int j = 0; j < operatorCount && record.ok; ++j) {
+            operators.push_back(record.str8());
+        }
+        time_t topicTime = 0;
+        if (record.ok && record.pos < record.end) {
+            topicTime = static_cast<time_t>(record.u64());
+        }
+        if (!record.ok || name.empty()) {
+            error = "truncated channel record";
+            return -1;
+        }
+        if (server.getChannel(name)) {
+            continue;
+        }
+        Channel* channel = server.createChannel(name);
+        channel->setTopic(topic, topicTime);
+        channel->setKey(key);
+        channel->setInviteOnly(flags & kFlagInviteOnly);
+        channel->setTopicRestricted(flags & kFlagTopicRestricted);
+        channel->setUserLimit(limit);
+        channel->setRestoredOperators(operators);
+        ++restored;
+    }
+    if (!header.ok) {
+        error = "truncated snapshot";
+        return -1;
+    }
+    return restored;
+}
+
+long ChannelSnapshot::load(const std::string& path, Server& server, std::string& error) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno == ENOENT) {
+            return 0;
+        }
+        error = path + ": " + std::strerror(errno);
+        return -1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1) {
+        error = path + ": " + std::strerror(errno);
+        close(fd);
+        return -1;
+    }
+    size_t length = static_cast<size_t>(info.st_size);
+    if (length == 0) {
+        close(fd);
+        error = "empty snapshot";
+        return -1;
+    }
+    void* mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        error = path + ": " + std::strerror(errno);
+        return -1;
+    }
+    madvise(mapping, length, MADV_SEQUENTIAL);
+    long restored = restore(static_cast<const unsigned char*>(mapping), length, server, error);
+    munmap(mapping, length);
+    return restored;
+}
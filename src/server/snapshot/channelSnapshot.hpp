@@ -0,0 +1,59 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   channelSnapshot.hpp                                :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/20 15:22:40 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/20 15:22:40 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CHANNELSNAPSHOT_HPP
+#define CHANNELSNAPSHOT_HPP
+
+#include <string>
+#include <map>
+
+class Channel;
+class Server;
+
+/*
+Channel state that outlives a restart: name, topic, key, user limit, the
+i and t modes and who the operators were: their SASL account, or their
+nick!user@host without one. Members are not kept; restored channels start
+empty and their operators get their status back when they rejoin (see
+Channel::matchRestoredOperator).
+
+File layout, integers little endian:
+
+    "IRCSNAP\0", uint32 version, uint32 channel count, uint64 save time
+    per channel: uint32 record length, then
+        str16 name, str16 topic, str16 key, uint8 flags (1 = +i, 2 = +t),
+        int32 user limit (-1 = none), uint16 operator count, str8 identities
+        ("$a:account" or nick!user@host),
+        uint64 time the topic was set (0 = no topic; absent before LIST)
+    uint32 FNV-1a checksum of everything before it
+
+str16 and str8 are a uint16 or uint8 length followed by the bytes. A reader
+skips bytes it does not know at the end of a record, so later versions may
+append fields there without changing the version.
+
+save() writes a temporary file next to the target and renames it over the
+old one, so a crash mid-write leaves the previous snapshot intact. load()
+maps the file and creates the channels straight from the mapping.
+*/
+class ChannelSnapshot {
+public:
+    static const unsigned int kVersion = 1;
+
+    // False with error set if the file could not be written
+    static bool save(const std::string& path, const std::map<std::string, Channel*>& channels, std::string& error);
+
+    // Creates the channels of the snapshot that do not exist yet. Returns how
+    // many, 0 if there is no file, or -1 with error set if it is unusable.
+    static long load(const std::string& path, Server& server, std::string& error);
+};
+
+#endif // CHANNELSNAPSHOT_HPP
@@ -0,0 +1,496 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   liveUpgrade.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/21 10:31:55 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/21 10:31:55 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "liveUpgrade.hpp"
+#include "../server.hpp"
+#include "../../utils/binaryCodec.hpp"
+#include <cerrno>
+#include <cstring>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+static const char kMagic[8] = { 'I', 'R', 'C', 'U', 'P', 'G', 'D', '\0' };
+static const unsigned int kNoIndex = 0xffffffffu;
+static const char kReady = 'R';
+
+static const unsigned char kFlagPassword = 1;
+static const unsigned char kFlagUser = 2;
+static const unsigned char kFlagOperator = 4;
+static const unsigned char kFlagLinkAuthorized = 8;        // Incoming link between PASS and SERVER
+static const unsigned char kFlagLinkCompression = 16;
+static const unsigned char kFlagCapNegotiating = 32;
+static const unsigned char kFlagBot = 64;
+
+static const unsigned char kFlagInviteOnly = 1;
+static const unsigned char kFlagTopicRestricted = 2;
+
+// Clients that are not carried over (remote users) are left out of the list
+static void putClients(std::string& out, const std::vector<Client*>& clients, const std::map<Client*, unsigned int>& indexes) {
+    std::string list;
+    unsigned int count = 0;
+    for (std::vector<Client*>::const_iterator it = clients.begin(); it != clients.end(); ++it) {
+        std::map<Client*, unsigned int>::const_iterator index = indexes.find(*it);
+        if (index != indexes.end()) {
+            putU32(list, index->second);
+            ++count;
+        }
+    }
+    putU32(out, count);
+    out += list;
+}
+
+static bool takeClients(BinaryReader& record, const std::vector<Client*>& clients, std::vector<Client*>& out) {
+    unsigned int count = record.u32();
+    for (unsigned int i = 0; i < count && record.ok; ++i) {
+        unsigned int index = record.u32();
+        if (index >= clients.size()) {
+            return false;
+        }
+        out.push_back(clients[index]);
+    }
+    return record.ok;
+}
+
+static void encodeChannel(std::string& out, const Channel& channel, const std::map<Client*, unsigned int>& indexes) {
+    std::string record;
+    putStr16(record, channel.getName());
+    putStr16(record, channel.getTopic());
+    putStr16(record, channel.getKey());
+    putU8(record, (channel.isInviteOnly() ? kFlagInviteOnly : 0) | (channel.isTopicRestricted() ? kFlagTopicRestricted : 0));
+    putU32(record, static_cast<unsigned int>(channel.getUserLimit()));
+    putClients(record, channel.getMembers(), indexes);
+    putClients(record, channel.getOperators(), indexes);
+    putClients(record, channel.getInvitedClients(), indexes);
+    const std::vector<std::string>& restored = channel.getRestoredOperators();
+    size_t count = restored.size() < 0xffff ? restored.size() : 0xffff;
+    putU16(record, count);
+    for (size_t i = 0; i < count; ++i) {
+        putStr8(record, restored[i]);
+    }
+    putU64(record, static_cast<unsigned long long>(channel.getTopicTime()));
+    putU32(out, record.length());
+    out += record;
+}
+
+std::string LiveUpgrade::encode(Server& server, int serverSocket, int metricsSocket, int unixSocket,
+                                std::vector<int>& fds) {
+    fds.clear();
+    std::string out;
+    out.append(kMagic, sizeof(kMagic));
+    putU32(out, kVersion);
+    putU32(out, fds.size());
+    fds.push_back(serverSocket);
+    if (metricsSocket != -1) {
+        putU32(out, fds.size());
+        fds.push_back(metricsSocket);
+    } else {
+        putU32(out, kNoIndex);
+    }
+
+    const std::map<int, Client*>& clients = server.getClients();
+    std::map<Client*, unsigned int> indexes;
+    std::string records;
+    for (std::map<int, Client*>::const_iterator it = clients.begin(); it != clients.end(); ++it) {
+        Client* client = it->second;
+        if (client->isRemote() || client->getLinkState() != Client::LINK_NONE) {
+            continue;
+        }
+        std::string record;
+        putU32(record, fds.size());
+        fds.push_back(it->first);
+        putStr8(record, client->getNickname());
+        putStr8(record, client->getUsername());
+        putStr16(record, client->getRealname());
+        putStr16(record, client->getHostname());
+        putU8(record, (client->isPasswordSet() ? kFlagPassword : 0) | (client->isUserSet() ? kFlagUser : 0)
+                      | (client->isOperator() ? kFlagOperator : 0)
+                      | (client->isLinkAuthorized() ? kFlagLinkAuthorized : 0)
+                      | (client->isLinkCompressionOffered() ? kFlagLinkCompression : 0)
+                      | (client->isCapNegotiating() ? kFlagCapNegotiating : 0)
+                      | (client->isBot() ? kFlagBot : 0));
+        std::string input;
+        client->getInput().copyTo(input);
+        putStr16(record, input);
+        std::string output;
+        client->getOutbound().copyPending(output);
+        putStr32(record, output);
+        std::vector<std::string> channels = client->getChannels();
+        putU16(record, channels.size());
+        for (std::vector<std::string>::const_iterator name = channels.begin(); name != channels.end(); ++name) {
+            putStr16(record, *name);
+        }
+        putStr8(record, client->getAccount());
+        putU8(record, client->getCapabilities());
+        const std::set<std::string>& monitored = client->getMonitored();
+        putU16(record, monitored.size());
+        for (std::set<std::string>::const_iterator nick = monitored.begin(); nick != monitored.end(); ++nick) {
+            putStr8(record, *nick);
+        }
+        putU32(records, record.length());
+        records += record;
+        unsigned int index = indexes.size();
+        indexes[client] = index;
+    }
+    putU32(out, indexes.size());
+    out += records;
+
+    const std::map<std::string, Channel*>& channels = server.getChannels();
+    putU32(out, channels.size());
+    for (std::map<std::string, Channel*>::const_iterator it = channels.begin(); it != channels.end(); ++it) {
+        encodeChannel(out, *it->second, indexes);
+    }
+    if (unixSocket != -1) {
+        putU32(out, fds.size());
+        fds.push_back(unixSocket);
+    } else {
+        putU32(out, kNoIndex);
+    }
+    return out;
+}
+
+bool LiveUpgrade::restore(const std::string& state, const std::vector<int>& fds, Server& server,
+                          int& serverSocket, int& metricsSocket, int& unixSocket, std::string& error) {
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(state.data());
+    if (state.length() < sizeof(kMagic) || std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+        error = "not an upgrade state";
+        return false;
+    }
+    BinaryReader reader(data, state.length());
+    reader.pos = sizeof(kMagic);
+    unsigned int version = reader.u32();
+    if (version != kVersion) {
+        error = "unsupported upgrade state version " + to_string(version);
+        return false;
+    }
+    unsigned int listener = reader.u32();
+    unsigned int metrics = reader.u32();
+    if (!reader.ok || listener >= fds.size() || (metrics != kNoIndex && metrics >= fds.size())) {
+        error = "no listening socket";
+        return false;
+    }
+    serverSocket = fds[listener];
+    metricsSocket = (metrics == kNoIndex) ? -1 : fds[metrics];
+
+    std::vector<Client*> clients;
+    unsigned int clientCount = reader.u32();
+    for (unsigned int i = 0; i < clientCount && reader.ok; ++i) {
+        size_t recordLength = reader.u32();
+        if (!reader.need(recordLength)) {
+            break;
+        }
+        BinaryReader record(data + reader.pos, recordLength);
+        reader.pos += recordLength;
+
+        unsigned int fdIndex = record.u32();
+        std::string nickname = record.str8();
+        std::string username = record.str8();
+        std::string realname = record.str16();
+        std::string hostname = record.str16();
+        unsigned int flags = record.u8();
+        std::string input = record.str16();
+        std::string output = record.str32();
+        unsigned int channelCount = record.u16();
+        std::vector<std::string> channels;
+        for (unsigned int j = 0; j < channelCount && record.ok; ++j) {
+            channels.push_back(record.str16());
+        }
+        std::string account;
+        unsigned int capabilities = 0;
+        if (record.ok && record.pos < record.end) {
+            account = record.str8();
+            capabilities = record.u8();
+        }
+        std::vector<std::string> monitored;
+        if (record.ok && record.pos < record.end) {
+            unsigned int monitoredCount = record.u16();
+            for (unsigned int j = 0; j < monitoredCount && record.ok; ++j) {
+                monitored.push_back(record.str8());
+            }
+        }
+        if (!record.ok || fdIndex >= fds.size()) {
+            error = "truncated client record";
+            return false;
+        }
+
+        Client* client = server.addClient(fds[fdIndex], hostname);
+        server.setNickname(client, nickname);
+        client->setUsername(username);
+        client->setRealname(realname);
+        client->setPassword(flags & kFlagPassword);
+        client->setUser(flags & kFlagUser);
+        client->setOperator(flags & kFlagOperator);
+        client->setLinkAuthorized(flags & kFlagLinkAuthorized);
+        client->setLinkCompressionOffered(flags & kFlagLinkCompression);
+        client->setCapNegotiating(flags & kFlagCapNegotiating);
+        client->setBot(flags & kFlagBot);
+        client->setAccount(account);
+        client->setCapabilities(capabilities);
+        client->getInput().assign(input);
+        if (!output.empty()) {
+            // Queued, not written: the old process owns the sockets until we report ready
+            SharedMessage* message = SharedMessage::create(output);
+            client->getOutbound().push(message);
+            message->release();
+        }
+        for (std::vector<std::string>::const_iterator it = channels.begin(); it != channels.end(); ++it) {
+            client->addChannel(*it);
+        }
+        for (std::vector<std::string>::const_iterator it = monitored.begin(); it != monitored.end(); ++it) {
+            server.monitor(client, *it);
+        }
+        clients.push_back(client);
+    }
+
+    unsigned int channelCount = reader.u32();
+    for (unsigned int i = 0; i < channelCount && reader.ok; ++i) {
+        size_t recordLength = reader.u32();
+        if (!reader.need(recordLength)) {
+            break;
+        }
+        BinaryReader record(data + reader.pos, recordLength);
+        reader.pos += recordLength;
+
+        std::string name = record.str16();
+        std::string topic = record.str16();
+        std::string key = record.str16();
+        unsigned int flags = record.u8();
+        int limit = static_cast<int>(record.u32());
+        std::vector<Client*> members;
+        std::vector<Client*> operators;
+        std::vector<Client*> invited;
+        bool valid = takeClients(record, clients, members) && takeClients(record, clients, operators)
+                     && takeClients(record, clients, invited);
+        unsigned int restoredCount = record.u16();
+        std::vector<std::string> restored;
+        for (unsigned int j = 0; j < restoredCount && record.ok; ++j) {
+            restored.push_back(record.str8());
+        }
+        time_t topicTime = 0;
+        if (record.ok && record.pos < record.end) {
+            topicTime = static_cast<time_t>(record.u64());
+        }
+        if (!valid || !record.ok || name.empty() || server.getChannel(name)) {
+            error = "bad channel record";
+            return false;
+        }
+
+        Channel* channel = server.createChannel(name);
+        channel->setTopic(topic, topicTime);
+        channel->setKey(key);
+        channel->setInviteOnly(flags & kFlagInviteOnly);
+        channel->setTopicRestricted(flags & kFlagTopicRestricted);
+        channel->setUserLimit(limit);
+        channel->setRestoredOperators(restored);
+        for (std::vector<Client*>::iterator it = members.begin(); it != members.end(); ++it) {
+            channel->addMemberUnchecked(*it);
+        }
+        for (std::vector<Client*>::iterator it = operators.begin(); it != operators.end(); ++it) {
+            channel->addOperator(*it);
+        }
+        for (std::vector<Client*>::iterator it = invited.begin(); it != invited.end(); ++it) {
+            channel->inviteClient(*it);
+        }
+    }
+    unixSocket = -1;
+    if (reader.ok && reader.pos < reader.end) {
+        unsigned int index = reader.u32();
+        if (index != kNoIndex && index < fds.size()) {
+            unixSocket = fds[index];
+        }
+    }
+    if (!reader.ok) {
+        error = "truncated upgrade state";
+        return false;
+    }
+    return true;
+}
+
+pid_t LiveUpgrade::spawn(const std::vector<std::string>& command, int& channel, std::string& error) {
+    int pair[2];
+    if (command.empty() || socketpair(AF_UNIX, SOCK_STREAM, 0, pair) == -1) {
+        error = command.empty() ? "no binary to start" : "socketpair: " + std::string(std::strerror(errno));
+        return -1;
+    }
+    // Everything the child needs is built before fork(): it only closes and execs
+    std::vector<std::string> arguments(command);
+    arguments.push_back("--upgrade-fd=" + to_string(pair[1]));
+    std::vector<char*> argv;
+    for (std::vector<std::string>::iterator it = arguments.begin(); it != arguments.end(); ++it) {
+        argv.push_back(const_cast<char*>(it->c_str()));
+    }
+    argv.push_back(NULL);
+    struct rlimit limit;
+    int maxFd = 65536;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY) {
+        maxFd = static_cast<int>(limit.rlim_cur);
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // The client sockets arrive over the pair; inherited copies would keep them open forever
+        for (int fd = 3; fd < maxFd; ++fd) {
+            if (fd != pair[1]) {
+                close(fd);
+            }
+        }
+        execv(argv[0], &argv[0]);
+        _exit(127);
+    }
+    close(pair[1]);
+    if (pid == -1) {
+        error = "fork: " + std::string(std::strerror(errno));
+        close(pair[0]);
+        return -1;
+    }
+    fcntl(pair[0], F_SETFD, FD_CLOEXEC);
+    struct timeval timeout = { kReadyTimeoutMs / 1000, 0 };
+    setsockopt(pair[0], SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    channel = pair[0];
+    return pid;
+}
+
+static bool sendAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.length()) {
+        ssize_t result = send(fd, data.data() + sent, data.length() - sent, MSG_NOSIGNAL);
+        if (result == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        sent += result;
+    }
+    return true;
+}
+
+static bool receiveAll(int fd, char* data, size_t length) {
+    size_t received = 0;
+    while (received < length) {
+        ssize_t result = recv(fd, data + received, length - received, 0);
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        received += result;
+    }
+    return true;
+}
+
+// The descriptors ride on one byte per message, so a read never spans two batches
+bool LiveUpgrade::sendState(int channel, const std::string& state, const std::vector<int>& fds, std::string& error) {
+    std::string header;
+    putU32(header, state.length());
+    putU32(header, fds.size());
+    if (!sendAll(channel, header) || !sendAll(channel, state)) {
+        error = "sending the state: " + std::string(std::strerror(errno));
+        return false;
+    }
+    std::vector<char> control(CMSG_SPACE(kFdsPerMessage * sizeof(int)));
+    for (size_t first = 0; first < fds.size(); first += kFdsPerMessage) {
+        size_t count = std::min(fds.size() - first, static_cast<size_t>(kFdsPerMessage));
+        char byte = 0;
+        struct iovec iov = { &byte, 1 };
+        struct msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = &control[0];
+        message.msg_controllen = CMSG_SPACE(count * sizeof(int));
+        struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(count * sizeof(int));
+        std::memcpy(CMSG_DATA(header), &fds[first], count * sizeof(int));
+        ssize_t sent;
+        do {
+            sent = sendmsg(channel, &message, MSG_NOSIGNAL);
+        } while (sent == -1 && errno == EINTR);
+        if (sent != 1) {
+            error = "sending descriptors: " + std::string(std::strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LiveUpgrade::waitReady(int channel, std::string& error) {
+    pollfd ready = { channel, POLLIN, 0 };
+    int result;
+    do {
+        result = poll(&ready, 1, kReadyTimeoutMs);
+    } while (result == -1 && errno == EINTR);
+    char byte = 0;
+    if (result == 0) {
+        error = "the new process did not take over within " + to_string(kReadyTimeoutMs / 1000) + " s";
+        return false;
+    }
+    if (result == -1 || recv(channel, &byte, 1, 0) != 1 || byte != kReady) {
+        error = "the new process exited before taking over";
+        return false;
+    }
+    return true;
+}
+
+bool LiveUpgrade::receiveState(int channel, std::string& state, std::vector<int>& fds, std::string& error) {
+    char header[8];
+    if (!receiveAll(channel, header, sizeof(header))) {
+        error = "no state from the old process";
+        return false;
+    }
+    BinaryReader reader(reinterpret_cast<const unsigned char*>(header), sizeof(header));
+    size_t length = reader.u32();
+    size_t count = reader.u32();
+    state.resize(length);
+    if (length > 0 && !receiveAll(channel, &state[0], length)) {
+        error = "truncated state from the old process";
+        return false;
+    }
+
+    std::vector<char> control(CMSG_SPACE(kFdsPerMessage * sizeof(int)));
+    while (fds.size() < count) {
+        char byte;
+        struct iovec iov = { &byte, 1 };
+        struct msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = &control[0];
+        message.msg_controllen = control.size();
+        ssize_t received;
+        do {
+            received = recvmsg(channel, &message, MSG_CMSG_CLOEXEC);
+        } while (received == -1 && errno == EINTR);
+        if (received != 1 || (message.msg_flags & MSG_CTRUNC)) {
+            error = "lost descriptors from the old process";
+            return false;
+        }
+        for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            size_t batch = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            size_t first = fds.size();
+            fds.resize(first + batch);
+            std::memcpy(&fds[first], CMSG_DATA(cmsg), batch * sizeof(int));
+        }
+    }
+    return true;
+}
+
+bool LiveUpgrade::sendReady(int channel) {
+    char byte = kReady;
+    return send(channel, &byte, 1, MSG_NOSIGNAL) == 1;
+}
@@ -0,0 +1,83 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   liveUpgrade.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/21 10:31:55 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/21 10:31:55 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef LIVEUPGRADE_HPP
+#define LIVEUPGRADE_HPP
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+class Server;
+
+/*
+Hands a running server over to a new process without closing a connection.
+The old process starts the new binary with --upgrade-fd=<n>, one end of a
+socket pair, and sends it the state below followed by the descriptors it
+refers to, at most kFdsPerMessage per SCM_RIGHTS message. The new process
+rebuilds its clients and channels on those descriptors, then writes one
+byte; only then does the old one stop. Until that byte arrives the old
+process has not touched a socket, so it can kill the new one and carry on.
+
+State layout, integers little endian (see utils/binaryCodec.hpp):
+
+    "IRCUPGD\0", uint32 version, uint32 listener index, uint32 metrics
+    listener index (0xffffffff = none), uint32 client count
+    per client: uint32 record length, then
+        uint32 descriptor index, str8 nickname, str8 username, str16 realname,
+        str16 hostname, uint8 flags (see .cpp), str16 partial input line,
+        str32 output not yet sent, uint16 channel count, str16 names,
+        str8 SASL account, uint8 capabilities (both absent before SASL),
+        uint16 count, str8 casefolded MONITOR nicknames (absent before MONITOR)
+    uint32 channel count
+    per channel: uint32 record length, then
+        str16 name, str16 topic, str16 key, uint8 flags (1 = +i, 2 = +t),
+        int32 user limit, then members, operators and invited users, each a
+        uint32 count of client indexes, then uint16 count, str8 nicknames of
+        operators still to be restored from a snapshot, uint64 time the
+        topic was set (absent before LIST)
+    uint32 Unix socket listener index (0xffffffff = none; absent before
+    --unix-socket)
+
+Descriptor indexes count the descriptors in the order they are sent; client
+indexes count the client records. As in the snapshot, a reader skips bytes
+it does not know at the end of a record.
+
+Only local users are carried over: server links are closed first and come
+back through --link, and the other servers' users are split off meanwhile.
+*/
+class LiveUpgrade {
+public:
+    static const unsigned int kVersion = 1;
+    static const int kFdsPerMessage = 250;     // Below the kernel's SCM_MAX_FD
+    static const int kReadyTimeoutMs = 10000;
+
+    // The state of server; fds receives the descriptors to send with it
+    static std::string encode(Server& server, int serverSocket, int metricsSocket, int unixSocket,
+                              std::vector<int>& fds);
+    // Recreates the clients and channels of state on the received descriptors.
+    // False with error set if state is unusable.
+    static bool restore(const std::string& state, const std::vector<int>& fds, Server& server,
+                        int& serverSocket, int& metricsSocket, int& unixSocket, std::string& error);
+
+    // Old process: forks and execs command plus --upgrade-fd. Returns the
+    // child's pid and our end of the socket pair in channel, or -1.
+    static pid_t spawn(const std::vector<std::string>& command, int& channel, std::string& error);
+    static bool sendState(int channel, const std::string& state, const std::vector<int>& fds, std::string& error);
+    static bool waitReady(int channel, std::string& error);
+
+    // New process
+    static bool receiveState(int channel, std::string& state, std::vector<int>& fds, std::string& error);
+    static bool sendReady(int channel);
+};
+
+#endif // LIVEUPGRADE_HPP
@@ -0,0 +1,192 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   tracer.cpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/13 10:21:44 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/13 10:21:44 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "tracer.hpp"
+#include <cstdio>
+#include <ctime>
+#include <csignal>
+#include <fstream>
+#include <pthread.h>
+#include <unistd.h>
+
+struct TraceEvent {
+    const char* name;
+    const char* detail;
+    long arg;
+    unsigned long start;
+    unsigned long duration;
+};
+
+// Written by its owning thread only; head counts every span ever recorded
+struct TraceRing {
+    TraceEvent* events;
+    unsigned long head;
+    int tid;
+    const char* threadName;
+    TraceRing* next;
+};
+
+bool Tracer::_enabled = false;
+
+static size_t ringCapacity = 0;
+static unsigned long baseNs = 0;
+static TraceRing* rings = NULL;
+static int nextTid = 1;
+static pthread_mutex_t ringsMutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread TraceRing* localRing = NULL;
+static volatile sig_atomic_t dumpRequested = 0;
+
+static TraceRing* currentRing() {
+    if (localRing) {
+        return localRing;
+    }
+    TraceRing* ring = new TraceRing;
+    ring->events = new TraceEvent[ringCapacity];
+    ring->head = 0;
+    ring->threadName = NULL;
+    pthread_mutex_lock(&ringsMutex);
+    ring->tid = nextTid++;
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&ringsMutex);
+    localRing = ring;
+    return ring;
+}
+
+unsigned long Tracer::nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long>(ts.tv_sec) * 1000000000UL + ts.tv_nsec;
+}
+
+void Tracer::enable(size_t spansPerThread) {
+    if (_enabled || spansPerThread == 0) {
+        return;
+    }
+    ringCapacity = spansPerThread;
+    baseNs = nowNs();
+    _enabled = true;
+}
+
+void Tracer::setThreadName(const char* name) {
+    if (_enabled) {
+        currentRing()->threadName = name;
+    }
+}
+
+void Tracer::record(const char* name, const char* detail, long arg, unsigned long startNs, unsigned long endNs) {
+    TraceRing* ring = currentRing();
+    unsigned long position = ring->head;
+    TraceEvent& event = ring->events[position % ringCapacity];
+    event.name = name;
+    event.detail = detail;
+    event.arg = arg;
+    event.start = startNs;
+    event.duration = endNs - startNs;
+    __atomic_store_n(&ring->head, position + 1, __ATOMIC_RELEASE);
+}
+
+static void appendEscaped(std::string& out, const char* text) {
+    for (; *text; ++text) {
+        if (*text == '"' || *text == '\\') {
+            out += '\\';
+        }
+        if (static_cast<unsigned char>(*text) >= 0x20) {
+            out += *text;
+        }
+    }
+}
+
+static void appendEvent(std::string& out, int pid, int tid, const TraceEvent& event) {
+    char buffer[160];
+    out += "{\"name\":\"";
+    appendEscaped(out, event.name);
+    std::snprintf(buffer, sizeof(buffer), "\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                  pid, tid, (event.start - baseNs) / 1000.0, event.duration / 1000.0);
+    out += buffer;
+    if (event.detail || event.arg != -1) {
+        out += ",\"args\":{";
+        if (event.detail) {
+            out += "\"detail\":\"";
+            appendEscaped(out, event.detail);
+            out += "\"";
+        }
+        if (event.arg != -1) {
+            std::snprintf(buffer, sizeof(buffer), "%s\"arg\":%ld", event.detail ? "," : "", event.arg);
+            out += buffer;
+        }
+        out += "}";
+    }
+    out += "},\n";
+}
+
+long Tracer::dump(const std::string& path) {
+    if (!_enabled) {
+        return 0;
+    }
+    int pid = static_cast<int>(getpid());
+    long spans = 0;
+    std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+    pthread_mutex_lock(&ringsMutex);
+    for (TraceRing* ring = rings; ring; ring = ring->next) {
+        if (ring->threadName) {
+            char buffer[96];
+            std::snprintf(buffer, sizeof(buffer), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"",
+                          pid, ring->tid);
+            out += buffer;
+            appendEscaped(out, ring->threadName);
+            out += "\"}},\n";
+        }
+        unsigned long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        unsigned long count = head < ringCapacity ? head : ringCapacity;
+        for (unsigned long position = head - count; position < head; ++position) {
+            appendEvent(out, pid, ring->tid, ring->events[position % ringCapacity]);
+            ++spans;
+        }
+    }
+    pthread_mutex_unlock(&ringsMutex);
+
+    // Drop the trailing ",\n" so the array stays valid JSON
+    if (out[out.length() - 2] == ',') {
+        out.erase(out.length() - 2, 1);
+    }
+    out += "]}\n";
+
+    std::ofstream file(path.c_str(), std::ios::out | std::ios::trunc);
+    if (!file) {
+        return -1;
+    }
+    file << out;
+    file.close();
+    return file ? spans : -1;
+}
+
+static void handleDumpSignal(int) {
+    dumpRequested = 1;
+}
+
+void Tracer::installSignalHandler() {
+    struct sigaction action;
+    action.sa_handler = &handleDumpSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;   // poll() still returns EINTR
+    sigaction(SIGUSR1, &action, NULL);
+}
+
+bool Tracer::takeDumpRequest() {
+    if (!dumpRequested) {
+        return false;
+    }
+    dumpRequested = 0;
+    return true;
+}
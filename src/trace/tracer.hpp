@@ -0,0 +1,80 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   tracer.hpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/13 10:21:37 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/13 10:21:37 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include <string>
+#include <cstddef>
+
+/*
+Span tracing for latency investigations. Each thread records completed spans
+into its own fixed ring, overwriting the oldest ones, so recording takes two
+clock reads and a few stores and never locks. dump() writes every ring as
+Chrome trace_event JSON (load it in chrome://tracing or Perfetto).
+
+Span names and details must be string literals or otherwise outlive the
+process: only the pointers are stored.
+*/
+class Tracer {
+public:
+    // spansPerThread == 0 leaves tracing off; every TraceSpan is then a single branch
+    static void enable(size_t spansPerThread);
+    static bool isEnabled() { return _enabled; }
+
+    // Label shown for the calling thread in the trace viewer
+    static void setThreadName(const char* name);
+
+    static void record(const char* name, const char* detail, long arg,
+                       unsigned long startNs, unsigned long endNs);
+
+    // Returns the number of spans written, or -1 if the file cannot be written.
+    // Rings of other threads are read while they may still be recording, so
+    // their most recent span can come out torn.
+    static long dump(const std::string& path);
+
+    // SIGUSR1 only raises a flag; the event loop calls dump() on its next iteration
+    static void installSignalHandler();
+    static bool takeDumpRequest();
+
+    static unsigned long nowNs();
+
+private:
+    static bool _enabled;
+};
+
+// Records the enclosing scope as one span
+class TraceSpan {
+public:
+    TraceSpan(const char* name, const char* detail = NULL, long arg = -1)
+        : _name(name), _detail(detail), _arg(arg), _start(Tracer::isEnabled() ? Tracer::nowNs() : 0) {}
+
+    ~TraceSpan() {
+        if (_start != 0) {
+            Tracer::record(_name, _detail, _arg, _start, Tracer::nowNs());
+        }
+    }
+
+    void setDetail(const char* detail) { _detail = detail; }
+    void setArg(long arg) { _arg = arg; }
+
+private:
+    const char* _name;
+    const char* _detail;
+    long _arg;
+    unsigned long _start;
+
+    TraceSpan(const TraceSpan&);
+    TraceSpan& operator=(const TraceSpan&);
+};
+
+#endif // TRACER_HPP
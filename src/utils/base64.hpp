@@ -0,0 +1,88 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   base64.hpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/23 14:02:19 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/23 14:02:19 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef BASE64_HPP
+#define BASE64_HPP
+
+#include <string>
+#include <cstddef>
+
+/*
+Standard base64 (RFC 4648) with padding, as AUTHENTICATE carries SASL
+payloads. Decoding is strict: no whitespace, and padding only at the end.
+*/
+
+inline std::string encodeBase64(const std::string& in) {
+    static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    out.reserve((in.length() + 2) / 3 * 4);
+    for (size_t i = 0; i < in.length(); i += 3) {
+        unsigned int group = static_cast<unsigned char>(in[i]) << 16;
+        if (i + 1 < in.length()) {
+            group |= static_cast<unsigned char>(in[i + 1]) << 8;
+        }
+        if (i + 2 < in.length()) {
+            group |= static_cast<unsigned char>(in[i + 2]);
+        }
+        out += kAlphabet[(group >> 18) & 63];
+        out += kAlphabet[(group >> 12) & 63];
+        out += i + 1 < in.length() ? kAlphabet[(group >> 6) & 63] : '=';
+        out += i + 2 < in.length() ? kAlphabet[group & 63] : '=';
+    }
+    return out;
+}
+
+inline int base64Value(char c) {
+    if (c >= 'A' && c <= 'Z') {
+        return c - 'A';
+    }
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 26;
+    }
+    if (c >= '0' && c <= '9') {
+        return c - '0' + 52;
+    }
+    return c == '+' ? 62 : c == '/' ? 63 : -1;
+}
+
+// False if in is not valid base64
+inline bool decodeBase64(const std::string& in, std::string& out) {
+    out.clear();
+    if (in.length() % 4 != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < in.length(); i += 4) {
+        bool last = (i + 4 == in.length());
+        int values[4];
+        int padding = 0;
+        for (int j = 0; j < 4; ++j) {
+            char c = in[i + j];
+            if (c == '=' && last && j >= 2 && (j == 3 || in[i + 3] == '=')) {
+                values[j] = 0;
+                ++padding;
+            } else if ((values[j] = base64Value(c)) < 0 || padding > 0) {
+                return false;
+            }
+        }
+        unsigned int group = (values[0] << 18) | (values[1] << 12) | (values[2] << 6) | values[3];
+        out += static_cast<char>(group >> 16);
+        if (padding < 2) {
+            out += static_cast<char>((group >> 8) & 0xff);
+        }
+        if (padding < 1) {
+            out += static_cast<char>(group & 0xff);
+        }
+    }
+    return true;
+}
+
+#endif // BASE64_HPP
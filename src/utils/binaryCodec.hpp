@@ -0,0 +1,93 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   binaryCodec.hpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/21 10:04:17 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/21 10:04:17 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef BINARYCODEC_HPP
+#define BINARYCODEC_HPP
+
+#include <string>
+#include <cstddef>
+
+/*
+Little-endian integers and length-prefixed strings, as written by the
+channel snapshot and the live upgrade hand-off. str32, str16 and str8 are a
+uint32, uint16 or uint8 length followed by the bytes; longer values are cut.
+*/
+
+inline void putU8(std::string& out, unsigned int value) {
+    out += static_cast<char>(value & 0xff);
+}
+
+inline void putU16(std::string& out, unsigned int value) {
+    putU8(out, value);
+    putU8(out, value >> 8);
+}
+
+inline void putU32(std::string& out, unsigned int value) {
+    putU16(out, value & 0xffff);
+    putU16(out, value >> 16);
+}
+
+inline void putU64(std::string& out, unsigned long long value) {
+    putU32(out, static_cast<unsigned int>(value & 0xffffffffu));
+    putU32(out, static_cast<unsigned int>(value >> 32));
+}
+
+inline void putStr32(std::string& out, const std::string& value) {
+    putU32(out, value.length());
+    out += value;
+}
+
+inline void putStr16(std::string& out, const std::string& value) {
+    size_t length = value.length() < 0xffff ? value.length() : 0xffff;
+    putU16(out, length);
+    out.append(value, 0, length);
+}
+
+inline void putStr8(std::string& out, const std::string& value) {
+    size_t length = value.length() < 0xff ? value.length() : 0xff;
+    putU8(out, length);
+    out.append(value, 0, length);
+}
+
+// Bounds-checked cursor over a buffer; a read past the end clears ok
+struct BinaryReader {
+    const unsigned char* data;
+    size_t end;
+    size_t pos;
+    bool ok;
+
+    BinaryReader(const unsigned char* bytes, size_t length) : data(bytes), end(length), pos(0), ok(true) {}
+
+    bool need(size_t count) {
+        if (!ok || end - pos < count) {
+            ok = false;
+        }
+        return ok;
+    }
+    unsigned int u8() { return need(1) ? data[pos++] : 0; }
+    unsigned int u16() { unsigned int low = u8(); return low | (u8() << 8); }
+    unsigned int u32() { unsigned int low = u16(); return low | (u16() << 16); }
+    unsigned long long u64() { unsigned long long low = u32(); return low | (static_cast<unsigned long long>(u32()) << 32); }
+    std::string bytes(size_t count) {
+        if (!need(count)) {
+            return std::string();
+        }
+        std::string value(reinterpret_cast<const char*>(data + pos), count);
+        pos += count;
+        return value;
+    }
+    std::string str32() { return bytes(u32()); }
+    std::string str16() { return bytes(u16()); }
+    std::string str8() { return bytes(u8()); }
+};
+
+#endif // BINARYCODEC_HPP
@@ -0,0 +1,152 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   mailbox.hpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/20 09:41:12 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/20 09:41:12 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef MAILBOX_HPP
+#define MAILBOX_HPP
+
+#include <cstddef>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+/*
+Bounded multi-producer, single-consumer queue that hands values to a thread
+running a poll() loop. Producers claim a slot with one compare-and-swap and
+never lock; the consumer takes whole batches. Each slot carries a sequence
+number telling whether it is free for the producer of a given round or
+filled for the consumer, as in the logger's ring.
+
+The consumer polls getWakeFd(), an eventfd. Only the first push after the
+consumer called clearWakeup() writes to it, so a burst of pushes costs one
+system call. The consumer must drain with popBatch() after clearWakeup(),
+never before, or a value pushed in between could wait for the next wakeup.
+
+The two positions sit on separate cache lines: producers only touch the
+enqueue side and the consumer the dequeue side.
+*/
+template <typename T>
+class Mailbox {
+public:
+    // capacity is rounded up to a power of two
+    explicit Mailbox(size_t capacity)
+        : _slots(NULL), _mask(0), _enqueuePos(0), _dequeuePos(0), _signaled(0), _wakeFd(-1) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_wakeFd == -1) {
+            throw std::runtime_error("Failed to create mailbox eventfd: " + std::string(std::strerror(errno)));
+        }
+        _slots = new Slot[size];
+        _mask = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            _slots[i].sequence = i;
+        }
+    }
+
+    ~Mailbox() {
+        delete[] _slots;
+        close(_wakeFd);
+    }
+
+    // Any thread. False if the mailbox is full; the value is not queued.
+    bool push(const T& value) {
+        size_t pos = __atomic_load_n(&_enqueuePos, __ATOMIC_RELAXED);
+        Slot* slot;
+        while (true) {
+            slot = &_slots[pos & _mask];
+            size_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+            long diff = static_cast<long>(sequence) - static_cast<long>(pos);
+            if (diff == 0) {
+                if (__atomic_compare_exchange_n(&_enqueuePos, &pos, pos + 1, true,
+                                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = __atomic_load_n(&_enqueuePos, __ATOMIC_RELAXED);
+            }
+        }
+        slot->value = value;
+        __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+        // Orders the publication before reading _signaled; pairs with the fence in clearWakeup()
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        wake();
+        return true;
+    }
+
+    // Any thread: makes the wake fd readable unless it already is
+    void wake() {
+        // Plain load first: while the consumer is busy, pushes do not write the shared flag
+        if (__atomic_load_n(&_signaled, __ATOMIC_RELAXED) == 0
+            && __atomic_exchange_n(&_signaled, 1, __ATOMIC_ACQ_REL) == 0) {
+            unsigned long long one = 1;
+            ssize_t ignored = write(_wakeFd, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+
+    // Consumer only. Moves up to max values into out; returns how many.
+    size_t popBatch(T* out, size_t max) {
+        size_t count = 0;
+        while (count < max) {
+            Slot& slot = _slots[_dequeuePos & _mask];
+            if (__atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE) != _dequeuePos + 1) {
+                break;
+            }
+            out[count++] = slot.value;
+            __atomic_store_n(&slot.sequence, _dequeuePos + _mask + 1, __ATOMIC_RELEASE);
+            ++_dequeuePos;
+        }
+        return count;
+    }
+
+    // Consumer only, once the wake fd polled readable
+    void clearWakeup() {
+        unsigned long long count;
+        ssize_t ignored = read(_wakeFd, &count, sizeof(count));
+        (void)ignored;
+        __atomic_store_n(&_signaled, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+
+    int getWakeFd() const { return _wakeFd; }
+    size_t getCapacity() const { return _mask + 1; }
+
+private:
+    enum { kCacheLine = 64 };
+
+    struct Slot {
+        size_t sequence;
+        T value;
+    };
+
+    Slot* _slots;
+    size_t _mask;
+    char _padBefore[kCacheLine];
+    size_t _enqueuePos;
+    char _padEnqueue[kCacheLine - sizeof(size_t)];
+    size_t _dequeuePos;
+    char _padDequeue[kCacheLine - sizeof(size_t)];
+    int _signaled;
+    int _wakeFd;
+
+    Mailbox(const Mailbox& other);
+    Mailbox& operator=(const Mailbox& other);
+};
+
+#endif // MAILBOX_HPP
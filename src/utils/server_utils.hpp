@@ -23,4 +23,43 @@ std::string to_string(T value) {
     return ss.str();
 }
 
+inline char foldChar(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// Nicknames compare without regard to ASCII case (CASEMAPPING=ascii)
+inline std::string casefold(const std::string& nickname) {
+    std::string folded(nickname);
+    for (std::string::iterator it = folded.begin(); it != folded.end(); ++it) {
+        *it = foldChar(*it);
+    }
+    return folded;
+}
+
+// Wildcard match of a WHO mask: '*' is any run of characters, '?' any one, ASCII case ignored
+inline bool matchMask(const std::string& mask, const std::string& text) {
+    size_t m = 0;
+    size_t t = 0;
+    size_t star = std::string::npos;
+    size_t resume = 0;
+    while (t < text.length()) {
+        if (m < mask.length() && mask[m] == '*') {
+            star = m++;
+            resume = t;
+        } else if (m < mask.length() && (mask[m] == '?' || foldChar(mask[m]) == foldChar(text[t]))) {
+            ++m;
+            ++t;
+        } else if (star != std::string::npos) {
+            m = star + 1;
+            t = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (m < mask.length() && mask[m] == '*') {
+        ++m;
+    }
+    return m == mask.length();
+}
+
 #endif 
@@ -0,0 +1,539 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ircbench.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/14 11:03:52 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/14 11:03:52 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+ircbench: load generator for ircserv. Opens --clients connections to a local
+server, registers them and drives one workload at a fixed, open-loop rate:
+
+    chatter   PRIVMSG to the channel each client joined (--channels of them)
+    dm        PRIVMSG from a random client to another random client
+    joinpart  JOIN then PART of a fresh channel, one operation per tick slot
+    nick      NICK changes back and forth between two names
+
+Message payloads carry the send time, so every delivery gives an end-to-end
+latency sample. JOIN, PART and NICK are followed by a PING and timed until
+its PONG, which the server sends once the command has been handled.
+Everything is single-threaded and driven by one poll(); with the same --seed
+the same clients send the same commands.
+
+    ircbench --port=6667 --password=pw [--clients=500] [--workload=chatter] ...
+*/
+
+#include "server/metrics/metrics.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const size_t kMaxQueuedOutput = 64 * 1024;   // Per client; sends beyond it are skipped
+
+struct Options {
+    std::string host;
+    int port;
+    std::string password;
+    size_t clients;
+    size_t channels;
+    std::string workload;
+    double rate;          // Operations per second, all clients together
+    double duration;      // Measured seconds
+    double warmup;        // Seconds of load before measuring
+    size_t payload;       // Extra PRIVMSG bytes
+    unsigned long seed;
+
+    Options()
+        : host("127.0.0.1"), port(6667), password(), clients(500), channels(10), workload("chatter"),
+          rate(1000), duration(10), warmup(1), payload(32), seed(1) {}
+};
+
+struct SimClient {
+    int fd;
+    bool connected;
+    bool registered;
+    bool joined;
+    std::string nick;
+    std::string names[2];
+    int nameIndex;
+    std::string channel;
+    std::string in;
+    std::string out;
+    unsigned long pendingSince;   // Start of the JOIN/PART/NICK awaiting its PONG, 0 if none
+    std::string pendingVerb;
+    bool pendingFailed;           // An error numeric arrived before the PONG
+    unsigned long churn;
+};
+
+struct Totals {
+    unsigned long sent;
+    unsigned long skipped;
+    unsigned long delivered;
+    unsigned long errors;
+    unsigned long disconnects;
+};
+
+// xorshift64*: fast and identical on every run for a given seed
+class Random {
+public:
+    explicit Random(unsigned long seed) : _state(seed ? seed : 0x9E3779B97F4A7C15UL) {}
+    unsigned long next() {
+        _state ^= _state >> 12;
+        _state ^= _state << 25;
+        _state ^= _state >> 27;
+        return _state * 2685821657736338717UL;
+    }
+    size_t below(size_t bound) { return static_cast<size_t>(next() % bound); }
+
+private:
+    unsigned long _state;
+};
+
+static bool parseNumber(const std::string& value, double& out) {
+    char* end = NULL;
+    out = std::strtod(value.c_str(), &end);
+    return !value.empty() && *end == '\0' && out >= 0;
+}
+
+static bool parseOption(Options& options, const std::string& arg) {
+    size_t eq = arg.find('=');
+    if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+        return false;
+    }
+    std::string name = arg.substr(2, eq - 2);
+    std::string value = arg.substr(eq + 1);
+    double number = 0;
+    bool numeric = parseNumber(value, number);
+
+    if (name == "host") {
+        options.host = value;
+    } else if (name == "password") {
+        options.password = value;
+    } else if (name == "workload") {
+        options.workload = value;
+        return value == "chatter" || value == "dm" || value == "joinpart" || value == "nick";
+    } else if (!numeric) {
+        return false;
+    } else if (name == "port") {
+        options.port = static_cast<int>(number);
+    } else if (name == "clients") {
+        options.clients = static_cast<size_t>(number);
+    } else if (name == "channels") {
+        options.channels = static_cast<size_t>(number);
+    } else if (name == "rate") {
+        options.rate = number;
+    } else if (name == "duration") {
+        options.duration = number;
+    } else if (name == "warmup") {
+        options.warmup = number;
+    } else if (name == "payload") {
+        options.payload = static_cast<size_t>(number);
+    } else if (name == "seed") {
+        options.seed = static_cast<unsigned long>(number);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static void usage(const char* program) {
+    std::fprintf(stderr,
+                 "Usage: %s --password=<pw> [options]\n"
+                 "  --host=<ip>          server address (default 127.0.0.1)\n"
+                 "  --port=<n>           server port (default 6667)\n"
+                 "  --clients=<n>        simulated clients (default 500)\n"
+                 "  --channels=<n>       channels for the chatter workload (default 10)\n"
+                 "  --workload=<name>    chatter, dm, joinpart or nick (default chatter)\n"
+                 "  --rate=<n>           operations per second across all clients (default 1000)\n"
+                 "  --duration=<s>       measured seconds (default 10)\n"
+                 "  --warmup=<s>         seconds of load before measuring (default 1)\n"
+                 "  --payload=<n>        extra bytes per PRIVMSG (default 32)\n"
+                 "  --seed=<n>           random seed (default 1)\n",
+                 program);
+}
+
+static void raiseFileLimit(size_t needed) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < needed + 16) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static int openConnection(const Options& options) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(options.port);
+    if (inet_pton(AF_INET, options.host.c_str(), &addr.sin_addr) != 1
+        || (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 && errno != EINPROGRESS)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void queue(SimClient& client, const std::string& line, Totals& totals) {
+    if (client.out.size() > kMaxQueuedOutput) {
+        ++totals.skipped;
+        return;
+    }
+    client.out += line;
+    client.out += "\r\n";
+}
+
+static void flush(SimClient& client) {
+    while (!client.out.empty()) {
+        ssize_t sent = send(client.fd, client.out.data(), client.out.size(), MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return;
+        }
+        client.out.erase(0, sent);
+    }
+}
+
+class Bench {
+public:
+    Bench(const Options& options)
+        : _options(options), _random(options.seed), _measuring(false), _measureStart(0), _measuredSeconds(0) {
+        std::memset(&_totals, 0, sizeof(_totals));
+    }
+
+    bool connectAll();
+    bool prepareWorkload();
+    void run();
+    void report() const;
+
+private:
+    const Options& _options;
+    Random _random;
+    std::vector<SimClient> _clients;
+    std::vector<pollfd> _pollFds;
+    Totals _totals;
+    LatencyHistogram _delivery;     // PRIVMSG send to receipt, nanoseconds
+    LatencyHistogram _roundTrip;    // JOIN/PART/NICK to the PONG behind it, nanoseconds
+    std::string _serverName;        // Prefix of RPL_WELCOME, needed for PING
+    bool _measuring;
+    unsigned long _measureStart;
+    double _measuredSeconds;
+
+    void _pump(int timeoutMs);
+    void _handleLine(SimClient& client, const std::string& line);
+    void _issue(size_t index);
+    size_t _countWhere(bool SimClient::*flag) const;
+    bool _waitFor(bool SimClient::*flag, double seconds);
+};
+
+bool Bench::connectAll() {
+    raiseFileLimit(_options.clients);
+    _clients.resize(_options.clients);
+    _pollFds.resize(_options.clients);
+    for (size_t i = 0; i < _clients.size(); ++i) {
+        SimClient& client = _clients[i];
+        char name[16];
+        std::snprintf(name, sizeof(name), "b%lua", static_cast<unsigned long>(i));
+        client.names[0] = name;
+        std::snprintf(name, sizeof(name), "b%lub", static_cast<unsigned long>(i));
+        client.names[1] = name;
+        client.nameIndex = 0;
+        client.nick = client.names[0];
+        client.connected = false;
+        client.registered = false;
+        client.joined = false;
+        client.pendingSince = 0;
+        client.pendingFailed = false;
+        client.churn = 0;
+        client.fd = openConnection(_options);
+        if (client.fd == -1) {
+            std::fprintf(stderr, "ircbench: connection %lu failed: %s\n", static_cast<unsigned long>(i), std::strerror(errno));
+            return false;
+        }
+        client.out = "PASS " + _options.password + "\r\nNICK " + client.nick + "\r\nUSER " + client.nick
+                     + " 0 * :ircbench client\r\n";
+        _pollFds[i].fd = client.fd;
+        _pollFds[i].events = POLLIN | POLLOUT;
+        _pollFds[i].revents = 0;
+        // Keep the accept backlog short so big runs do not overflow it
+        if (i % 64 == 63) {
+            _pump(0);
+        }
+    }
+    if (!_waitFor(&SimClient::registered, 30)) {
+        std::fprintf(stderr, "ircbench: only %lu of %lu clients registered\n",
+                     static_cast<unsigned long>(_countWhere(&SimClient::registered)), static_cast<unsigned long>(_clients.size()));
+        return false;
+    }
+    return true;
+}
+
+bool Bench::prepareWorkload() {
+    if (_options.workload != "chatter") {
+        return true;
+    }
+    size_t channels = _options.channels ? _options.channels : 1;
+    for (size_t i = 0; i < _clients.size(); ++i) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "#bench%lu", static_cast<unsigned long>(i % channels));
+        _clients[i].channel = name;
+        queue(_clients[i], "JOIN " + _clients[i].channel, _totals);
+    }
+    if (!_waitFor(&SimClient::joined, 30)) {
+        std::fprintf(stderr, "ircbench: only %lu of %lu clients joined their channel\n",
+                     static_cast<unsigned long>(_countWhere(&SimClient::joined)), static_cast<unsigned long>(_clients.size()));
+        return false;
+    }
+    return true;
+}
+
+size_t Bench::_countWhere(bool SimClient::*flag) const {
+    size_t count = 0;
+    for (size_t i = 0; i < _clients.size(); ++i) {
+        count += _clients[i].*flag ? 1 : 0;
+    }
+    return count;
+}
+
+bool Bench::_waitFor(bool SimClient::*flag, double seconds) {
+    unsigned long deadline = Metrics::nowNs() + static_cast<unsigned long>(seconds * 1e9);
+    while (Metrics::nowNs() < deadline) {
+        _pump(10);
+        if (_countWhere(flag) == _clients.size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Bench::_pump(int timeoutMs) {
+    for (size_t i = 0; i < _pollFds.size(); ++i) {
+        _pollFds[i].events = POLLIN | (_clients[i].out.empty() ? 0 : POLLOUT);
+    }
+    if (poll(&_pollFds[0], _pollFds.size(), timeoutMs) <= 0) {
+        return;
+    }
+    char buffer[16384];
+    for (size_t i = 0; i < _pollFds.size(); ++i) {
+        SimClient& client = _clients[i];
+        if (client.fd == -1) {
+            continue;
+        }
+        if (_pollFds[i].revents & POLLOUT) {
+            client.connected = true;
+            flush(client);
+        }
+        if (!(_pollFds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+            continue;
+        }
+        ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            if (received == 0 || (errno != EAGAIN && errno != EINTR)) {
+                ++_totals.disconnects;
+                close(client.fd);
+                client.fd = -1;
+                _pollFds[i].fd = -1;
+            }
+            continue;
+        }
+        client.in.append(buffer, received);
+        size_t start = 0;
+        size_t end;
+        while ((end = client.in.find("\r\n", start)) != std::string::npos) {
+            _handleLine(client, client.in.substr(start, end - start));
+            start = end + 2;
+        }
+        client.in.erase(0, start);
+    }
+}
+
+void Bench::_handleLine(SimClient& client, const std::string& line) {
+    size_t marker = line.find(" :ircbench ");
+    if (marker != std::string::npos) {
+        unsigned long sentAt = std::strtoul(line.c_str() + marker + 11, NULL, 10);
+        if (_measuring && sentAt >= _measureStart) {
+            ++_totals.delivered;
+            _delivery.record(Metrics::nowNs() - sentAt);
+        }
+        return;
+    }
+
+    // ":server NNN nick ..." numerics
+    size_t space = line.find(' ');
+    std::string verb = space == std::string::npos ? "" : line.substr(space + 1, line.find(' ', space + 1) - space - 1);
+    if (verb == "001") {
+        client.registered = true;
+        if (_serverName.empty() && space != std::string::npos) {
+            _serverName = line.substr(1, space - 1);
+        }
+        return;
+    }
+    if (verb == "JOIN" && line.compare(0, client.nick.size() + 2, ":" + client.nick + "!") == 0) {
+        client.joined = true;
+    }
+    if (client.pendingSince == 0) {
+        return;
+    }
+    if (verb.size() == 3 && verb[0] >= '4' && verb[0] <= '5') {
+        client.pendingFailed = true;
+    } else if (verb == "PONG") {
+        if (_measuring && client.pendingSince >= _measureStart) {
+            _roundTrip.record(Metrics::nowNs() - client.pendingSince);
+            if (client.pendingFailed) {
+                ++_totals.errors;
+            }
+        }
+        if (client.pendingVerb == "NICK" && !client.pendingFailed) {
+            client.nameIndex ^= 1;
+            client.nick = client.names[client.nameIndex];
+        }
+        client.pendingSince = 0;
+        client.pendingFailed = false;
+    }
+}
+
+// One unit of the workload, sent by client `index`
+void Bench::_issue(size_t index) {
+    SimClient& client = _clients[index];
+    if (client.fd == -1) {
+        return;
+    }
+    const std::string& workload = _options.workload;
+    if (workload == "chatter" || workload == "dm") {
+        std::string target = client.channel;
+        if (workload == "dm") {
+            target = _clients[_random.below(_clients.size())].nick;
+        }
+        char stamp[32];
+        std::snprintf(stamp, sizeof(stamp), "%lu ", Metrics::nowNs());
+        queue(client, "PRIVMSG " + target + " :ircbench " + stamp + std::string(_options.payload, 'x'), _totals);
+        ++_totals.sent;
+        return;
+    }
+
+    // joinpart and nick wait for the previous operation of this client
+    if (client.pendingSince != 0) {
+        ++_totals.skipped;
+        return;
+    }
+    client.pendingSince = Metrics::nowNs();
+    if (workload == "nick") {
+        client.pendingVerb = "NICK";
+        queue(client, "NICK " + client.names[client.nameIndex ^ 1], _totals);
+    } else if (client.churn % 2 == 0) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "#churn%lu", static_cast<unsigned long>(index));
+        client.channel = name;
+        client.pendingVerb = "JOIN";
+        queue(client, "JOIN " + client.channel, _totals);
+    } else {
+        client.pendingVerb = "PART";
+        queue(client, "PART " + client.channel, _totals);
+    }
+    queue(client, "PING " + _serverName, _totals);
+    ++client.churn;
+    ++_totals.sent;
+}
+
+void Bench::run() {
+    unsigned long start = Metrics::nowNs();
+    unsigned long loadEnd = start + static_cast<unsigned long>((_options.warmup + _options.duration) * 1e9);
+    unsigned long issued = 0;
+
+    while (true) {
+        unsigned long now = Metrics::nowNs();
+        if (!_measuring && now >= start + static_cast<unsigned long>(_options.warmup * 1e9)) {
+            _measuring = true;
+            _measureStart = now;
+            std::memset(&_totals, 0, sizeof(_totals));
+        }
+        if (now >= loadEnd) {
+            break;
+        }
+        // Open loop: catch up with the schedule whatever the server's pace
+        unsigned long due = static_cast<unsigned long>((now - start) / 1e9 * _options.rate);
+        for (; issued < due; ++issued) {
+            _issue(_random.below(_clients.size()));
+        }
+        for (size_t i = 0; i < _clients.size(); ++i) {
+            if (!_clients[i].out.empty() && _clients[i].fd != -1) {
+                flush(_clients[i]);
+            }
+        }
+        _pump(1);
+    }
+    _measuredSeconds = (loadEnd - _measureStart) / 1e9;
+
+    // Collect what is still in flight, without sending more
+    unsigned long drainEnd = Metrics::nowNs() + 1000000000UL;
+    while (Metrics::nowNs() < drainEnd) {
+        _pump(10);
+    }
+}
+
+void Bench::report() const {
+    std::printf("ircbench workload=%s clients=%lu channels=%lu rate=%.0f/s duration=%.1fs payload=%lu seed=%lu\n",
+                _options.workload.c_str(), static_cast<unsigned long>(_clients.size()),
+                static_cast<unsigned long>(_options.channels), _options.rate, _measuredSeconds,
+                static_cast<unsigned long>(_options.payload), _options.seed);
+    std::printf("sent       %10lu  (%.1f/s)  skipped %lu\n", _totals.sent, _totals.sent / _measuredSeconds, _totals.skipped);
+    const LatencyHistogram* histograms[] = { &_delivery, &_roundTrip };
+    const char* labels[] = { "delivered", "round-trip" };
+    for (int i = 0; i < 2; ++i) {
+        const LatencyHistogram& histogram = *histograms[i];
+        if (histogram.getCount() == 0) {
+            continue;
+        }
+        std::printf("%-10s %10lu  (%.1f/s)\n", labels[i], histogram.getCount(), histogram.getCount() / _measuredSeconds);
+        std::printf("latency us p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+                    histogram.quantile(0.5) / 1000.0, histogram.quantile(0.9) / 1000.0,
+                    histogram.quantile(0.99) / 1000.0, histogram.quantile(0.999) / 1000.0,
+                    histogram.getMax() / 1000.0);
+    }
+    std::printf("errors     %10lu  disconnects %lu\n", _totals.errors, _totals.disconnects);
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        if (!parseOption(options, argv[i])) {
+            std::fprintf(stderr, "ircbench: invalid option %s\n", argv[i]);
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (options.password.empty() || options.clients == 0 || options.rate <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Bench bench(options);
+    if (!bench.connectAll() || !bench.prepareWorkload()) {
+        return 1;
+    }
+    bench.run();
+    bench.report();
+    return 0;
+}
@@ -0,0 +1,290 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ircreplay.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/16 11:20:41 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/16 11:20:41 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+ircreplay: feeds a --capture-file recording into an in-process server. Each
+captured connection becomes a socketpair registered with Server::addClient,
+and the server is driven with runOnce(0) after every record until it has
+nothing left to do, so at --speed=max the same capture always produces the
+same interleaving. --speed=<factor> keeps the recorded gaps instead
+(1 = real time, 2 = twice as fast).
+
+    ircreplay <capture> <password> [--speed=max] [--transcript=<path>] [server options]
+
+--transcript writes every line the server sent as "<connection> <line>", so
+two builds can be compared with diff. Lines of one connection keep their
+order; with --fanout-threads the order across connections may vary.
+*/
+
+#include "server/server.hpp"
+#include "server/capture/trafficCapture.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <csignal>
+#include <ctime>
+
+struct Peer {
+    uint32_t connection;
+    std::string partial;   // Server output after the last \r\n
+};
+
+class Replay {
+public:
+    Replay(Server& server, double speed, FILE* transcript)
+        : _server(server), _speed(speed), _transcript(transcript),
+          _records(0), _connections(0), _bytesFed(0), _bytesReceived(0), _linesReceived(0), _lastOffsetNs(0) {}
+
+    bool run(FILE* capture);
+    void report(double elapsedSeconds, double capturedSeconds) const;
+    double getCapturedSeconds() const { return _lastOffsetNs / 1e9; }
+
+private:
+    Server& _server;
+    double _speed;                            // 0 = as fast as possible
+    FILE* _transcript;
+    std::map<uint32_t, int> _peerFds;         // Connection number -> test end of the socketpair
+    std::map<int, Peer> _peers;
+    unsigned long _records;
+    unsigned long _connections;
+    unsigned long _bytesFed;
+    unsigned long _bytesReceived;
+    unsigned long _linesReceived;
+    unsigned long _lastOffsetNs;
+
+    void _settle();
+    void _drain();
+    void _closePeer(int fd);
+    void _waitUntil(unsigned long deadlineNs);
+    void _open(uint32_t connection, const std::string& address);
+    void _feed(uint32_t connection, const char* data, size_t length);
+};
+
+// Runs the server until one poll() finds nothing to do
+void Replay::_settle() {
+    while (_server.runOnce(0) > 0) {
+    }
+}
+
+void Replay::_drain() {
+    char buffer[65536];
+    std::vector<int> closed;
+    for (std::map<int, Peer>::iterator it = _peers.begin(); it != _peers.end(); ++it) {
+        ssize_t received;
+        while ((received = read(it->first, buffer, sizeof(buffer))) > 0) {
+            _bytesReceived += received;
+            Peer& peer = it->second;
+            peer.partial.append(buffer, received);
+            size_t start = 0;
+            size_t end;
+            while ((end = peer.partial.find("\r\n", start)) != std::string::npos) {
+                ++_linesReceived;
+                if (_transcript) {
+                    std::fprintf(_transcript, "%u %.*s\n", peer.connection, static_cast<int>(end - start),
+                                 peer.partial.data() + start);
+                }
+                start = end + 2;
+            }
+            peer.partial.erase(0, start);
+        }
+        if (received == 0) {
+            closed.push_back(it->first);
+        }
+    }
+    for (size_t i = 0; i < closed.size(); ++i) {
+        _closePeer(closed[i]);
+    }
+}
+
+void Replay::_closePeer(int fd) {
+    std::map<int, Peer>::iterator it = _peers.find(fd);
+    if (it == _peers.end()) {
+        return;
+    }
+    _peerFds.erase(it->second.connection);
+    _peers.erase(it);
+    close(fd);
+}
+
+// Keeps serving the replayed clients until the recorded time of the next record
+void Replay::_waitUntil(unsigned long deadlineNs) {
+    unsigned long now;
+    while ((now = Metrics::nowNs()) < deadlineNs) {
+        unsigned long remainingMs = (deadlineNs - now) / 1000000;
+        _server.runOnce(remainingMs > 100 ? 100 : static_cast<int>(remainingMs));
+        _drain();
+    }
+}
+
+void Replay::_open(uint32_t connection, const std::string& address) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
+        std::perror("ircreplay: socketpair");
+        return;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    _server.addClient(fds[0], address);
+    _peerFds[connection] = fds[1];
+    _peers[fds[1]].connection = connection;
+    ++_connections;
+}
+
+void Replay::_feed(uint32_t connection, const char* data, size_t length) {
+    std::map<uint32_t, int>::iterator it = _peerFds.find(connection);
+    if (it == _peerFds.end()) {
+        return;   // Closed by the server earlier than in the capture
+    }
+    _bytesFed += length;
+    while (length > 0) {
+        ssize_t written = write(it->second, data, length);
+        if (written > 0) {
+            data += written;
+            length -= written;
+        } else if (errno == EAGAIN) {
+            _settle();
+            _drain();
+        } else {
+            return;
+        }
+    }
+}
+
+bool Replay::run(FILE* capture) {
+    CaptureFormat::FileHeader fileHeader;
+    if (std::fread(&fileHeader, sizeof(fileHeader), 1, capture) != 1
+        || std::memcmp(fileHeader.magic, CaptureFormat::kMagic, sizeof(fileHeader.magic)) != 0) {
+        std::fprintf(stderr, "ircreplay: not a capture file\n");
+        return false;
+    }
+
+    unsigned long startNs = Metrics::nowNs();
+    _lastOffsetNs = 0;
+    CaptureFormat::Header header;
+    std::vector<char> payload(CaptureFormat::kMaxPayload);
+    while (std::fread(&header, sizeof(header), 1, capture) == 1) {
+        if (header.length > 0 && std::fread(&payload[0], header.length, 1, capture) != 1) {
+            std::fprintf(stderr, "ircreplay: capture truncated after %lu records\n", _records);
+            break;
+        }
+        if (_speed > 0) {
+            _waitUntil(startNs + static_cast<unsigned long>(header.offsetNs / _speed));
+        }
+        if (header.type == CaptureFormat::RECORD_OPEN) {
+            _open(header.connection, std::string(&payload[0], header.length));
+        } else if (header.type == CaptureFormat::RECORD_DATA) {
+            _feed(header.connection, &payload[0], header.length);
+        } else if (header.type == CaptureFormat::RECORD_CLOSE) {
+            _drain();
+            std::map<uint32_t, int>::iterator it = _peerFds.find(header.connection);
+            if (it != _peerFds.end()) {
+                _closePeer(it->second);
+            }
+        }
+        _settle();
+        if (++_records % 64 == 0) {
+            _drain();
+        }
+        _lastOffsetNs = header.offsetNs;
+    }
+
+    // Let the server see the connections that were still open at the end
+    _drain();
+    while (!_peers.empty()) {
+        _closePeer(_peers.begin()->first);
+    }
+    _settle();
+    return true;
+}
+
+void Replay::report(double elapsedSeconds, double capturedSeconds) const {
+    std::printf("ircreplay records=%lu connections=%lu captured=%.3fs replayed=%.3fs\n",
+                _records, _connections, capturedSeconds, elapsedSeconds);
+    std::printf("fed %luB  received %luB in %lu lines\n", _bytesFed, _bytesReceived, _linesReceived);
+    std::vector<std::string> summary = _server.getMetrics().renderSummary();
+    for (size_t i = 0; i < summary.size(); ++i) {
+        std::printf("%s\n", summary[i].c_str());
+    }
+}
+
+static void usage(const char* program) {
+    std::fprintf(stderr, "Usage: %s <capture> <password> [--speed=max|<factor>] [--transcript=<path>] [server options]\n%s",
+                 program, ServerConfig::usage().c_str());
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+    ServerConfig config;
+    config.logLevel = "error";
+    config.tickBudgetUs = 0;
+    double speed = 0;
+    std::string transcriptPath;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 8, "--speed=") == 0) {
+            std::string value = arg.substr(8);
+            speed = value == "max" ? 0 : std::atof(value.c_str());
+            if (value != "max" && speed <= 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg.compare(0, 13, "--transcript=") == 0) {
+            transcriptPath = arg.substr(13);
+        } else if (!config.parseOption(arg) || !config.captureFile.empty()) {
+            std::fprintf(stderr, "ircreplay: invalid option %s\n", argv[i]);
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.logLevel == "debug") {
+        Logger::setLogLevel(Logger::DEBUG);
+    } else if (config.logLevel == "info") {
+        Logger::setLogLevel(Logger::INFO);
+    } else if (config.logLevel == "warning") {
+        Logger::setLogLevel(Logger::WARNING);
+    } else {
+        Logger::setLogLevel(Logger::ERROR);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    FILE* capture = std::fopen(argv[1], "rb");
+    if (!capture) {
+        std::perror(argv[1]);
+        return 1;
+    }
+    FILE* transcript = NULL;
+    if (!transcriptPath.empty() && !(transcript = std::fopen(transcriptPath.c_str(), "w"))) {
+        std::perror(transcriptPath.c_str());
+        std::fclose(capture);
+        return 1;
+    }
+
+    int status = 0;
+    try {
+        Server server(0, argv[2], config);
+        Replay replay(server, speed, transcript);
+        unsigned long start = Metrics::nowNs();
+        status = replay.run(capture) ? 0 : 1;
+        server.sampleMetrics();
+        replay.report((Metrics::nowNs() - start) / 1e9, replay.getCapturedSeconds());
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "ircreplay: %s\n", e.what());
+        status = 1;
+    }
+    std::fclose(capture);
+    if (transcript) {
+        std::fclose(transcript);
+    }
+    return status;
+}
@@ -0,0 +1,253 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   logdump.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/09 17:40:03 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/09 17:40:03 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+ircserv-logdump: renders a file written with --log-binary back to the text
+format of the regular logger, or to one JSON object per line.
+
+    ircserv-logdump [--json] <file>
+*/
+
+#include "logger/binaryLog.hpp"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace BinaryLogFormat;
+
+struct Format {
+    int level;
+    std::string text;
+};
+
+struct Argument {
+    bool isInteger;
+    long long value;
+    std::string text;
+};
+
+struct SessionClock {
+    uint64_t monotonicNs;
+    uint64_t realtimeNs;
+    bool valid;
+};
+
+static const char* levelName(int level) {
+    static const char* names[] = { "DEBUG", "INFO", "WARNING", "ERROR" };
+    return (level >= 0 && level < 4) ? names[level] : "UNKNOWN";
+}
+
+static std::string formatTime(const SessionClock& clock, uint64_t monotonicNs) {
+    uint64_t realtimeNs = monotonicNs;
+    if (clock.valid) {
+        realtimeNs = clock.realtimeNs + (monotonicNs - clock.monotonicNs);
+    }
+    std::time_t seconds = static_cast<std::time_t>(realtimeNs / 1000000000ULL);
+    std::tm localTime;
+    localtime_r(&seconds, &localTime);
+    char buffer[64];
+    size_t length = std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &localTime);
+    std::snprintf(buffer + length, sizeof(buffer) - length, ".%06lu",
+                  static_cast<unsigned long>(realtimeNs % 1000000000ULL / 1000));
+    return buffer;
+}
+
+static std::string render(const std::string& format, const std::vector<Argument>& args) {
+    std::string out;
+    size_t next = 0;
+    for (size_t i = 0; i < format.length(); ++i) {
+        if (format[i] == '{' && i + 1 < format.length() && format[i + 1] == '}') {
+            if (next < args.size()) {
+                out += args[next].text;
+            }
+            ++next;
+            ++i;
+        } else {
+            out += format[i];
+        }
+    }
+    return out;
+}
+
+static std::string jsonEscape(const std::string& text) {
+    std::string out;
+    for (size_t i = 0; i < text.length(); ++i) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+static bool readArguments(const char* cursor, const char* end, int count, std::vector<Argument>& out) {
+    for (int i = 0; i < count; ++i) {
+        if (cursor >= end) {
+            return false;
+        }
+        Argument arg;
+        uint8_t type = static_cast<uint8_t>(*cursor++);
+        if (type == ARG_INTEGER) {
+            int64_t value;
+            if (end - cursor < static_cast<long>(sizeof(value))) {
+                return false;
+            }
+            std::memcpy(&value, cursor, sizeof(value));
+            cursor += sizeof(value);
+            char number[32];
+            std::snprintf(number, sizeof(number), "%lld", static_cast<long long>(value));
+            arg.isInteger = true;
+            arg.value = value;
+            arg.text = number;
+        } else if (type == ARG_STRING) {
+            uint32_t length;
+            if (end - cursor < static_cast<long>(sizeof(length))) {
+                return false;
+            }
+            std::memcpy(&length, cursor, sizeof(length));
+            cursor += sizeof(length);
+            if (end - cursor < static_cast<long>(length)) {
+                return false;
+            }
+            arg.isInteger = false;
+            arg.value = 0;
+            arg.text.assign(cursor, length);
+            cursor += length;
+        } else {
+            return false;
+        }
+        out.push_back(arg);
+    }
+    return true;
+}
+
+static void printEvent(bool json, const SessionClock& clock, uint64_t timestamp, unsigned int formatId,
+                       const Format* format, const std::vector<Argument>& args) {
+    std::string message = format ? render(format->text, args) : "<unknown format>";
+    int level = format ? format->level : -1;
+    if (!json) {
+        std::cout << formatTime(clock, timestamp) << " [" << levelName(level) << "] " << message << '\n';
+        return;
+    }
+    std::cout << "{\"time\":\"" << formatTime(clock, timestamp) << "\",\"level\":\"" << levelName(level)
+              << "\",\"format\":" << formatId << ",\"message\":\"" << jsonEscape(message) << "\",\"args\":[";
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (i > 0) {
+            std::cout << ',';
+        }
+        if (args[i].isInteger) {
+            std::cout << args[i].text;
+        } else {
+            std::cout << '"' << jsonEscape(args[i].text) << '"';
+        }
+    }
+    std::cout << "]}\n";
+}
+
+int main(int argc, char* argv[]) {
+    bool json = false;
+    const char* path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            path = NULL;
+            break;
+        }
+    }
+    if (!path) {
+        std::cerr << "Usage: " << argv[0] << " [--json] <file>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return 1;
+    }
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    std::map<unsigned int, Format> formats;
+    SessionClock clock = { 0, 0, false };
+    size_t offset = 0;
+    unsigned long corrupt = 0;
+    while (offset < data.size()) {
+        // Zero bytes are padding between records
+        if (data[offset] == 0) {
+            ++offset;
+            continue;
+        }
+        Header header;
+        if (data.size() - offset < sizeof(header)) {
+            ++corrupt;
+            break;
+        }
+        std::memcpy(&header, &data[offset], sizeof(header));
+        if (header.length < sizeof(header) || header.length > data.size() - offset) {
+            ++corrupt;
+            break;
+        }
+        const char* payload = &data[offset] + sizeof(header);
+        const char* end = &data[offset] + header.length;
+
+        if (header.type == RECORD_SESSION && end - payload >= static_cast<long>(sizeof(Session))) {
+            Session session;
+            std::memcpy(&session, payload, sizeof(session));
+            if (std::memcmp(session.magic, kMagic, sizeof(kMagic)) != 0) {
+                ++corrupt;
+                break;
+            }
+            formats.clear();
+            clock.monotonicNs = session.monotonicNs;
+            clock.realtimeNs = session.realtimeNs;
+            clock.valid = true;
+        } else if (header.type == RECORD_FORMAT) {
+            Format format;
+            format.level = header.extra;
+            format.text.assign(payload, end);
+            formats[header.formatId] = format;
+        } else if (header.type == RECORD_EVENT && end - payload >= static_cast<long>(sizeof(uint64_t))) {
+            uint64_t timestamp;
+            std::memcpy(&timestamp, payload, sizeof(timestamp));
+            std::vector<Argument> args;
+            if (!readArguments(payload + sizeof(timestamp), end, header.extra, args)) {
+                ++corrupt;
+            } else {
+                std::map<unsigned int, Format>::const_iterator it = formats.find(header.formatId);
+                printEvent(json, clock, timestamp, header.formatId, it == formats.end() ? NULL : &it->second, args);
+            }
+        } else {
+            ++corrupt;
+        }
+        offset += header.length;
+    }
+    std::cout.flush();
+    if (corrupt > 0) {
+        std::cerr << path << ": " << corrupt << " unreadable record(s)" << std::endl;
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   passwd.cpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rdolzi <rdolzi@student.42.fr>              +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2024/10/23 15:20:44 by rdolzi            #+#    #+#             */
+/*   Updated: 2024/10/23 15:20:44 by rdolzi           ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+ircserv-passwd: prints a line for --accounts-file. The password is read
+from the first line of standard input, without echo on a terminal.
+
+    ircserv-passwd <account> [iterations] >> accounts.txt
+*/
+
+#include "server/auth/accountStore.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <termios.h>
+#include <unistd.h>
+
+static bool readPassword(std::string& password) {
+    struct termios original;
+    bool terminal = isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &original) == 0;
+    if (terminal) {
+        struct termios silent = original;
+        silent.c_lflag &= ~static_cast<tcflag_t>(ECHO);
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &silent);
+        std::fprintf(stderr, "Password: ");
+    }
+    bool ok = static_cast<bool>(std::getline(std::cin, password));
+    if (terminal) {
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &original);
+        std::fprintf(stderr, "\n");
+    }
+    if (!password.empty() && password[password.length() - 1] == '\r') {
+        password.erase(password.length() - 1);
+    }
+    return ok && !password.empty();
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 3 || !AccountStore::isValidName(argv[1])) {
+        std::fprintf(stderr, "usage: %s <account> [iterations] (default %u)\n", argv[0],
+                     AccountStore::kDefaultIterations);
+        return 2;
+    }
+    unsigned int iterations = AccountStore::kDefaultIterations;
+    if (argc == 3) {
+        char* end = NULL;
+        long parsed = std::strtol(argv[2], &end, 10);
+        if (*end != '\0' || parsed < 1 || parsed > 100000000) {
+            std::fprintf(stderr, "%s: iterations must be between 1 and 100000000\n", argv[0]);
+            return 2;
+        }
+        iterations = static_cast<unsigned int>(parsed);
+    }
+    std::string password;
+    if (!readPassword(password)) {
+        std::fprintf(stderr, "%s: no password given\n", argv[0]);
+        return 1;
+    }
+    try {
+        std::cout << AccountStore::makeEntry(argv[1], password, iterations) << std::endl;
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s: %s\n", argv[0], e.what());
+        return 1;
+    }
+    return 0;
+}